@@ -0,0 +1,30 @@
+# Generates C++ structs with hcl::Decoder and hcl::Encoder
+# specializations from an HCL schema file. See tools/hclgen.cpp for the
+# schema format.
+#
+#   include(path/to/microhcl/cmake/MicrohclGenerate.cmake)
+#   microhcl_generate(${CMAKE_CURRENT_SOURCE_DIR}/config.schema.hcl
+#                     ${CMAKE_CURRENT_BINARY_DIR}/config_schema.hpp)
+#   add_executable(app main.cpp)
+#   add_dependencies(app config_schema_gen)
+#
+# The header is made by the target <name>_gen, named after OUTPUT.
+# Targets that include it depend on that target instead of listing the
+# header as a source: with several such targets, each would run its own
+# copy of the rule, and parallel builds would write the header at once.
+
+get_filename_component(MICROHCL_ROOT_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+
+function(microhcl_generate SCHEMA OUTPUT)
+  if(NOT TARGET hclgen)
+    add_executable(hclgen ${MICROHCL_ROOT_DIR}/tools/hclgen.cpp)
+    target_include_directories(hclgen PRIVATE ${MICROHCL_ROOT_DIR}/include)
+  endif()
+
+  add_custom_command(OUTPUT ${OUTPUT}
+                     COMMAND hclgen ${SCHEMA} ${OUTPUT}
+                     DEPENDS hclgen ${SCHEMA}
+                     COMMENT "Generating ${OUTPUT}")
+  get_filename_component(NAME ${OUTPUT} NAME_WE)
+  add_custom_target(${NAME}_gen DEPENDS ${OUTPUT})
+endfunction()
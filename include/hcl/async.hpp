@@ -0,0 +1,252 @@
+#ifndef MICROHCL_ASYNC_H_
+#define MICROHCL_ASYNC_H_
+
+#include "hcl.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace hcl {
+
+// Runs tasks posted by parseAsync().
+class Executor {
+public:
+    virtual ~Executor() {}
+    virtual void post(std::function<void()> task) = 0;
+};
+
+// A fixed number of worker threads fed from a bounded queue.
+// post() blocks while the queue is full, which throttles callers
+// when more parses are queued than the workers can keep up with.
+class ThreadPoolExecutor : public Executor {
+public:
+    // 0 threads means one per hardware thread.
+    explicit ThreadPoolExecutor(size_t threads = 0, size_t maxQueued = 256);
+    // Runs the tasks that are already queued, then joins the workers.
+    ~ThreadPoolExecutor();
+
+    ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+    ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+    void post(std::function<void()> task) override;
+
+private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<std::function<void()>> queue_;
+    size_t maxQueued_;
+    bool stopping_;
+    std::vector<std::thread> workers_;
+};
+
+// Process-wide pool used when no executor is given.
+Executor& defaultExecutor();
+
+// Copies share the same state, so the caller keeps one copy and
+// passes another to parseAsync(). Cancellation is checked between
+// top level items; a cancelled parse yields ErrorCode::CANCELLED.
+class CancellationToken {
+public:
+    CancellationToken() : cancelled_(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { cancelled_->store(true); }
+    bool cancelled() const { return cancelled_->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+typedef std::function<void(ParseResult)> ParseCallback;
+
+// Parses |buffer| on |executor| and calls |callback| on the executor thread.
+void parseAsync(std::string buffer, ParseCallback callback,
+                Executor& executor = defaultExecutor(),
+                const ParseOptions& options = ParseOptions(),
+                CancellationToken token = CancellationToken());
+// Parses the file |filename| on |executor| and calls |callback| on the executor thread.
+void parseFileAsync(std::string filename, ParseCallback callback,
+                    Executor& executor = defaultExecutor(),
+                    const ParseOptions& options = ParseOptions(),
+                    CancellationToken token = CancellationToken());
+
+// Same as above, but the result is delivered through a future.
+std::future<ParseResult> parseAsync(std::string buffer,
+                                    Executor& executor = defaultExecutor(),
+                                    const ParseOptions& options = ParseOptions(),
+                                    CancellationToken token = CancellationToken());
+std::future<ParseResult> parseFileAsync(std::string filename,
+                                        Executor& executor = defaultExecutor(),
+                                        const ParseOptions& options = ParseOptions(),
+                                        CancellationToken token = CancellationToken());
+
+// ----------------------------------------------------------------------
+// Implementations
+
+inline ThreadPoolExecutor::ThreadPoolExecutor(size_t threads, size_t maxQueued) :
+    maxQueued_(maxQueued == 0 ? 1 : maxQueued),
+    stopping_(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < threads; ++i)
+        workers_.emplace_back([this]() { run(); });
+}
+
+inline ThreadPoolExecutor::~ThreadPoolExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+inline void ThreadPoolExecutor::post(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this]() { return stopping_ || queue_.size() < maxQueued_; });
+        queue_.push_back(std::move(task));
+    }
+    notEmpty_.notify_one();
+}
+
+inline void ThreadPoolExecutor::run()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notEmpty_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        notFull_.notify_one();
+        task();
+    }
+}
+
+inline Executor& defaultExecutor()
+{
+    static ThreadPoolExecutor executor;
+    return executor;
+}
+
+namespace internal {
+
+inline ParseResult parseCancellable(std::istream& is, const ParseOptions& options,
+                                    const CancellationToken& token)
+{
+    ParseHandle handle(is, options);
+    while (!handle.step(1)) {
+        if (token.cancelled())
+            return ParseResult(hcl::Value(), "parse was cancelled", ErrorCode::CANCELLED);
+    }
+    return handle.result();
+}
+
+inline ParseResult parseBufferCancellable(const std::string& buffer, const ParseOptions& options,
+                                          const CancellationToken& token)
+{
+    if (token.cancelled())
+        return ParseResult(hcl::Value(), "parse was cancelled", ErrorCode::CANCELLED);
+
+    std::istringstream is(buffer);
+#ifdef MICROHCL_NO_EXCEPTIONS
+    return parseCancellable(is, options, token);
+#else
+    try {
+        return parseCancellable(is, options, token);
+    } catch (const std::exception& e) {
+        return ParseResult(hcl::Value(), e.what(), ErrorCode::SYNTAX_ERROR);
+    }
+#endif
+}
+
+inline ParseResult parseFileCancellable(const std::string& filename, const ParseOptions& options,
+                                        const CancellationToken& token)
+{
+    if (token.cancelled())
+        return ParseResult(hcl::Value(), "parse was cancelled", ErrorCode::CANCELLED);
+
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        return ParseResult(hcl::Value(),
+                           std::string("could not open file: ") + filename,
+                           ErrorCode::IO_ERROR);
+    }
+#ifdef MICROHCL_NO_EXCEPTIONS
+    return parseCancellable(ifs, options, token);
+#else
+    try {
+        return parseCancellable(ifs, options, token);
+    } catch (const std::exception& e) {
+        return ParseResult(hcl::Value(), e.what(), ErrorCode::SYNTAX_ERROR);
+    }
+#endif
+}
+
+// Adapts a callback-based call to a future. std::function needs a
+// copyable callable, so the promise is shared.
+inline std::pair<std::future<ParseResult>, ParseCallback> makeFutureCallback()
+{
+    auto promise = std::make_shared<std::promise<ParseResult>>();
+    std::future<ParseResult> future = promise->get_future();
+    ParseCallback callback = [promise](ParseResult result) {
+        promise->set_value(std::move(result));
+    };
+    return std::make_pair(std::move(future), std::move(callback));
+}
+
+} // namespace internal
+
+inline void parseAsync(std::string buffer, ParseCallback callback, Executor& executor,
+                       const ParseOptions& options, CancellationToken token)
+{
+    executor.post([buffer = std::move(buffer), callback, options, token]() {
+        callback(internal::parseBufferCancellable(buffer, options, token));
+    });
+}
+
+inline void parseFileAsync(std::string filename, ParseCallback callback, Executor& executor,
+                           const ParseOptions& options, CancellationToken token)
+{
+    executor.post([filename = std::move(filename), callback, options, token]() {
+        callback(internal::parseFileCancellable(filename, options, token));
+    });
+}
+
+inline std::future<ParseResult> parseAsync(std::string buffer, Executor& executor,
+                                           const ParseOptions& options, CancellationToken token)
+{
+    auto futureCallback = internal::makeFutureCallback();
+    parseAsync(std::move(buffer), std::move(futureCallback.second), executor, options, token);
+    return std::move(futureCallback.first);
+}
+
+inline std::future<ParseResult> parseFileAsync(std::string filename, Executor& executor,
+                                               const ParseOptions& options, CancellationToken token)
+{
+    auto futureCallback = internal::makeFutureCallback();
+    parseFileAsync(std::move(filename), std::move(futureCallback.second), executor, options, token);
+    return std::move(futureCallback.first);
+}
+
+} // namespace hcl
+
+#endif // MICROHCL_ASYNC_H_
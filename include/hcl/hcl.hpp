@@ -2,57 +2,98 @@
 #define MICROHCL_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <chrono>
+#include <clocale>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <istream>
 #include <iterator>
+#include <limits>
+#include <locale>
+#include <map>
+#include <memory>
+#include <new>
 #include <sstream>
+#include <streambuf>
 #include <string>
-#ifdef MICROHCL_USE_MAP
-#include <map>
-#else
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
-#endif
+#include <utility>
 #include <vector>
 
+#if __cplusplus >= 201703L
+#include <optional>
+#include <string_view>
+#endif
+
 namespace hcl {
 
-class Value;
-typedef std::vector<Value> List;
+template<typename ObjectPolicy> class BasicValue;
+class Key;
+template<typename T, typename K = std::string> class FlatMap;
+template<typename T> class OpenHashMap;
 
-#ifdef MICROHCL_USE_MAP
-typedef std::map<std::string, Value> Object;
-#else
-typedef std::unordered_map<std::string, Value> Object;
-#endif
+// Object policies for BasicValue. map<V> is the container the objects
+// of a BasicValue<Policy> are kept in.
 
-namespace internal {
-template<typename T> struct call_traits_value {
-    typedef T return_type;
+// Unordered. The default.
+struct HashObjects {
+    template<typename V> using map = std::unordered_map<std::string, V>;
 };
-template<typename T> struct call_traits_ref {
-    typedef const T& return_type;
+
+// Sorted by key, so that write() gives the same text for the same keys.
+struct SortedObjects {
+    template<typename V> using map = std::map<std::string, V>;
 };
-} // namespace internal
 
-template<typename T> struct call_traits;
-template<> struct call_traits<bool> : public internal::call_traits_value<bool> {};
-template<> struct call_traits<int> : public internal::call_traits_value<int> {};
-template<> struct call_traits<int64_t> : public internal::call_traits_value<int64_t> {};
-template<> struct call_traits<double> : public internal::call_traits_value<double> {};
-template<> struct call_traits<std::string> : public internal::call_traits_ref<std::string> {};
-template<> struct call_traits<List> : public internal::call_traits_ref<List> {};
-template<> struct call_traits<Object> : public internal::call_traits_ref<Object> {};
+// In insertion order, which for a parsed document is source order.
+// Unlike the std containers, adding or erasing a key can move the other
+// values of the object. See FlatMap.
+struct FlatObjects {
+    template<typename V> using map = FlatMap<V>;
+};
 
-// A value is returned for std::vector<T>. Not reference.
-// This is because a fresh vector is made.
-template<typename T> struct call_traits<std::vector<T>> : public internal::call_traits_value<std::vector<T>> {};
+// For objects with many keys. As with FlatObjects, adding a key can
+// move the other values of the object. See OpenHashMap.
+struct OpenHashObjects {
+    template<typename V> using map = OpenHashMap<V>;
+};
 
-class Value {
-public:
+// As FlatObjects, with keys interned: the parser keeps each distinct key
+// once per document, and objects hold a Key to it. See Key and KeyPool.
+struct InternedObjects {
+    template<typename V> using map = FlatMap<V, Key>;
+};
+
+// The policy of hcl::Value, picked for the whole program by a compile
+// definition.
+#if defined(MICROHCL_USE_MAP)
+typedef SortedObjects DefaultObjects;
+#elif defined(MICROHCL_USE_FLAT_MAP)
+typedef FlatObjects DefaultObjects;
+#elif defined(MICROHCL_USE_OPEN_HASH_MAP)
+typedef OpenHashObjects DefaultObjects;
+#else
+typedef HashObjects DefaultObjects;
+#endif
+
+namespace internal {
+template<typename Tracer, typename V> class BasicParser;
+template<typename V, typename T> struct ValueConverter;
+struct RawNumber;
+
+// The types of a BasicValue, the same for every object policy.
+struct ValueTypes {
     enum Type {
         NULL_TYPE,
         BOOL_TYPE,
@@ -71,2187 +112,8346 @@ public:
         Hil,
     };
 
-    Value() : type_(NULL_TYPE), null_(nullptr) {}
-    Value(bool v) : type_(BOOL_TYPE), bool_(v) {}
-    Value(int v) : type_(INT_TYPE), int_(v) {}
-    Value(int64_t v) : type_(INT_TYPE), int_(v) {}
-    Value(double v) : type_(DOUBLE_TYPE), double_(v) {}
-    Value(const std::string& v) : type_(STRING_TYPE), string_(new std::string(v)) {}
-    Value(const char* v) : type_(STRING_TYPE), string_(new std::string(v)) {}
-    Value(const List& v) : type_(LIST_TYPE), list_(new List(v)) {}
-    Value(const Object& v) : type_(OBJECT_TYPE), object_(new Object(v)) {}
-    Value(std::string&& v) : type_(STRING_TYPE), string_(new std::string(std::move(v))) {}
-    Value(List&& v) : type_(LIST_TYPE), list_(new List(std::move(v))) {}
-    Value(Object&& v) : type_(OBJECT_TYPE), object_(new Object(std::move(v))) {}
-
-    Value(const Value& v);
-    Value(Value&& v) noexcept;
-    Value& operator=(const Value& v);
-    Value& operator=(Value&& v) noexcept;
+protected:
+    static const char* typeToString(Type);
+};
 
-    // Guards from unexpected Value construction.
-    // Someone might use a value like this:
-    //   hcl::Value v = x->find("foo");
-    // But this is wrong. Without this constructor,
-    // value will be unexpectedly initialized with bool.
-    Value(const void* v) = delete;
-    ~Value();
+#ifdef MICROHCL_COMPACT_VALUE
+// A string's length followed by its text, in one heap block.
+class StringBlock {
+public:
+    static StringBlock* make(const char* s, size_t size)
+    {
+        StringBlock* block = new (::operator new(sizeof(StringBlock) + size)) StringBlock(size);
+        std::memcpy(block->data(), s, size);
+        return block;
+    }
+    static StringBlock* copy(const StringBlock& block) { return make(block.data(), block.size()); }
+    static void destroy(StringBlock* block) { ::operator delete(block); }
 
-    // Retruns Value size.
-    // 0 for invalid value.
-    // The number of inner elements for list or object.
-    // 1 for other types.
-    size_t size() const;
-    bool empty() const;
-    Type type() const { return type_; }
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    size_t size() const { return size_; }
 
-    bool valid() const { return type_ != NULL_TYPE; }
-    template<typename T> bool is() const;
-    template<typename T> typename call_traits<T>::return_type as() const;
+private:
+    explicit StringBlock(size_t size) : size_(size) {}
 
-    friend bool operator==(const Value& lhs, const Value& rhs);
-    friend bool operator!=(const Value& lhs, const Value& rhs) { return !(lhs == rhs); }
+    size_t size_;
+};
+#endif
 
-    // ----------------------------------------------------------------------
-    // For integer/floating value
+// A string kept as written by ParseOptions::lazyStrings. The unescaped
+// text is made by the first read and published with a compare-and-swap,
+// so a const Value can be read from several threads, and |text| stays
+// as it was for write().
+class EscapedString {
+public:
+    explicit EscapedString(std::string text) : text(std::move(text)), unescaped_(nullptr) {}
+    EscapedString(const EscapedString& s) : text(s.text), unescaped_(nullptr) {}
+    EscapedString& operator=(const EscapedString&) = delete;
+    ~EscapedString() { delete unescaped_.load(std::memory_order_relaxed); }
 
-    // Returns true if the value is int or double.
-    bool isNumber() const;
-    double asNumber() const;
+    const std::string& unescaped() const;
 
-    // ----------------------------------------------------------------------
-    // For String value
+    const std::string text;
 
-    StringType getStringType() const;
-    void setStringType(StringType);
-    bool isString() const;
-    bool isIdent() const;
-    bool isHil() const;
+private:
+    mutable std::atomic<std::string*> unescaped_;
+};
 
-    // ----------------------------------------------------------------------
-    // For Object value
+template<typename T> struct call_traits_value {
+    typedef T return_type;
+};
+template<typename T> struct call_traits_ref {
+    typedef const T& return_type;
+};
+} // namespace internal
 
-    template<typename T> typename call_traits<T>::return_type get(const std::string&) const;
-    Value* set(const std::string& key, const Value& v);
-    // Finds a Value with |key|. |key| can contain '.'
-    // Note: if you would like to find a child value only, you need to use findChild.
-    const Value* find(const std::string& key) const;
-    Value* find(const std::string& key);
-    bool has(const std::string& key) const { return find(key) != nullptr; }
-    bool erase(const std::string& key);
+// A reference is returned for lists and objects.
+template<typename T> struct call_traits : public internal::call_traits_ref<T> {};
+template<> struct call_traits<bool> : public internal::call_traits_value<bool> {};
+template<> struct call_traits<int> : public internal::call_traits_value<int> {};
+template<> struct call_traits<int64_t> : public internal::call_traits_value<int64_t> {};
+template<> struct call_traits<double> : public internal::call_traits_value<double> {};
+// A value is returned for std::string. Short strings may be kept in the
+// Value itself, with no std::string to refer to, and reading must not
+// change the Value. stringData() and asStringView() read without a copy.
+template<> struct call_traits<std::string> : public internal::call_traits_value<std::string> {};
 
-    Value& operator[](size_t index);
-    Value& operator[](const std::string& key);
+// A value is returned for std::vector<T>. Not reference.
+// This is because a fresh vector is made. Lists are kept as they are.
+template<typename T> struct call_traits<std::vector<T>> : public internal::call_traits_value<std::vector<T>> {};
+template<typename P> struct call_traits<std::vector<BasicValue<P>>> : public internal::call_traits_ref<std::vector<BasicValue<P>>> {};
 
-    // Returns true if two objects share any keys (non-nesting).
-    bool sharesKeyWith(const hcl::Value& v) const;
+namespace internal {
+struct KeyEntry {
+    KeyEntry(const char* s, size_t size, size_t h) : refs(1), hash(h), text(s, size) {}
 
-    // Merge object. Returns true if succeeded. Otherwise, |this| might be corrupted.
-    // When the same key exists, it will be overwritten.
-    bool merge(const Value&);
+    std::atomic<size_t> refs;
+    size_t hash;
+    std::string text;
+};
+} // namespace internal
 
-    // Assigns a value based on a nested list of keys.
-    bool mergeObjects(const std::vector<std::string>&, Value&);
+// An interned object key: a counted reference to text shared by every
+// object that uses the same key. Keys made in one KeyPool are equal when
+// they are the same pointer. Others are compared by hash, then text.
+// The hash is computed once, and is std::hash<std::string> of the text,
+// so a Key and a std::string find the same entries. Keys are immutable
+// and may be copied and read from several threads at once.
+class Key {
+public:
+    Key() : entry_(nullptr) {}
+    // Interned in KeyPool::current(), if there is one.
+    explicit Key(const std::string& text);
+    explicit Key(const char* text) : Key(std::string(text)) {}
+    Key(const Key& key) : entry_(key.entry_) { retain(); }
+    Key(Key&& key) noexcept : entry_(key.entry_) { key.entry_ = nullptr; }
+    Key& operator=(Key key) noexcept
+    {
+        std::swap(entry_, key.entry_);
+        return *this;
+    }
+    ~Key() { release(); }
 
-    // Finds a value with |key|. It searches only children.
-    Value* findChild(const std::string& key);
-    const Value* findChild(const std::string& key) const;
-    // Sets a value, and returns the pointer to the created value.
-    // When the value having the same key exists, it will be overwritten.
-    Value* setChild(size_t index, const Value& v);
-    Value* setChild(size_t index, Value&& v);
-    Value* setChild(const std::string& key, const Value& v);
-    Value* setChild(const std::string& key, Value&& v);
-    bool eraseChild(const std::string& key);
+    const std::string& str() const { return entry_->text; }
+    operator const std::string&() const { return entry_->text; }
+    size_t hash() const { return entry_->hash; }
+    bool null() const { return entry_ == nullptr; }
 
-    // ----------------------------------------------------------------------
-    // For List value
+    friend bool operator==(const Key& lhs, const Key& rhs)
+    {
+        return lhs.entry_ == rhs.entry_ || (lhs.hash() == rhs.hash() && lhs.str() == rhs.str());
+    }
+    friend bool operator!=(const Key& lhs, const Key& rhs) { return !(lhs == rhs); }
+    friend bool operator==(const Key& lhs, const std::string& rhs) { return lhs.str() == rhs; }
+    friend bool operator==(const std::string& lhs, const Key& rhs) { return lhs == rhs.str(); }
+    friend bool operator!=(const Key& lhs, const std::string& rhs) { return lhs.str() != rhs; }
+    friend bool operator!=(const std::string& lhs, const Key& rhs) { return lhs != rhs.str(); }
+    friend bool operator<(const Key& lhs, const Key& rhs) { return lhs.str() < rhs.str(); }
+    friend std::string operator+(const std::string& lhs, const Key& rhs) { return lhs + rhs.str(); }
+    friend std::ostream& operator<<(std::ostream& os, const Key& key) { return os << key.str(); }
 
-    template<typename T> typename call_traits<T>::return_type get(size_t index) const;
-    const Value* find(size_t index) const;
-    Value* find(size_t index);
-    Value* push(const Value& v);
-    Value* push(Value&& v);
+private:
+    friend class KeyPool;
 
-    // ----------------------------------------------------------------------
-    // Others
+    // Not interned.
+    static Key make(const char* s, size_t size, size_t h)
+    {
+        Key key;
+        key.entry_ = new internal::KeyEntry(s, size, h);
+        return key;
+    }
 
-    // Writer.
-    static std::string spaces(int num);
-    static std::string escapeKey(const std::string& key);
+    void retain() const
+    {
+        if (entry_)
+            entry_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    void write(std::ostream*, const std::string& keyPrefix = std::string(), int indent = -1) const;
+    void release()
+    {
+        if (entry_ && entry_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete entry_;
+        entry_ = nullptr;
+    }
 
-    friend std::ostream& operator<<(std::ostream&, const Value&);
+    internal::KeyEntry* entry_;
+};
 
-private:
-    static const char* typeToString(Type);
+// The symbol table Keys are interned in. The parser keeps one per
+// document when it builds an InternedValue. Keys hold their text
+// themselves, so they outlive the pool.
+//
+// A Scope makes a pool current on its thread, for Keys made outside a
+// parse, e.g. when converting a Value to an InternedValue:
+//
+//   hcl::KeyPool pool;
+//   hcl::KeyPool::Scope scope(pool);
+//   hcl::InternedValue interned(value);
+class KeyPool {
+public:
+    KeyPool() : size_(0) {}
+    KeyPool(const KeyPool&) = delete;
+    KeyPool& operator=(const KeyPool&) = delete;
+
+    // The Key with |text|, made if it is new.
+    Key intern(const std::string& text);
+    // Number of distinct keys.
+    size_t size() const { return size_; }
+    // Forgets the keys. Keys handed out stay valid.
+    void clear()
+    {
+        slots_.clear();
+        size_ = 0;
+    }
 
-    template<typename T> void assureType() const;
-    Value* ensureValue(const std::string& key);
+    // The pool of the innermost Scope on this thread, or nullptr.
+    static KeyPool* current() { return currentSlot(); }
 
-    template<typename T> struct ValueConverter;
+    class Scope {
+    public:
+        explicit Scope(KeyPool& pool) : previous_(currentSlot()) { currentSlot() = &pool; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope() { currentSlot() = previous_; }
 
-    Type type_;
-    union {
-        void* null_; // Can never be legitimately set, indicates parse error
-        bool bool_;
-        int64_t int_;
-        double double_;
-        std::string* string_;
-        List* list_;
-        Object* object_;
+    private:
+        KeyPool* previous_;
     };
 
-    template<typename T> friend struct ValueConverter;
-};
-
-// parse() returns ParseResult.
-struct ParseResult {
-    ParseResult(hcl::Value v, std::string er) :
-        value(std::move(v)),
-        errorReason(std::move(er)) {}
-
-    bool valid() const { return value.valid(); }
+private:
+    static KeyPool*& currentSlot()
+    {
+        static thread_local KeyPool* pool = nullptr;
+        return pool;
+    }
 
-    hcl::Value value;
-    std::string errorReason;
+    // Open addressing, at most half full. Null Keys are empty slots.
+    std::vector<Key> slots_;
+    size_t size_;
 };
 
-// Parses from std::istream.
-ParseResult parse(std::istream&);
-// Parses a file.
-ParseResult parseFile(const std::string& filename);
+inline Key::Key(const std::string& text) : entry_(nullptr)
+{
+    if (KeyPool* pool = KeyPool::current())
+        *this = pool->intern(text);
+    else
+        *this = make(text.data(), text.size(), std::hash<std::string>()(text));
+}
 
-namespace internal {
+inline Key KeyPool::intern(const std::string& text)
+{
+    const size_t h = std::hash<std::string>()(text);
+    if (2 * (size_ + 1) > slots_.size()) {
+        std::vector<Key> old(std::max<size_t>(16, 2 * slots_.size()));
+        old.swap(slots_);
+        const size_t mask = slots_.size() - 1;
+        for (Key& key : old) {
+            if (key.null())
+                continue;
+            size_t slot = key.hash() & mask;
+            while (!slots_[slot].null())
+                slot = (slot + 1) & mask;
+            slots_[slot] = std::move(key);
+        }
+    }
 
-enum class TokenType {
-    // Special tokens
-    ILLEGAL,
-    END_OF_FILE,
-    COMMENT,
+    const size_t mask = slots_.size() - 1;
+    size_t slot = h & mask;
+    for (; !slots_[slot].null(); slot = (slot + 1) & mask) {
+        if (slots_[slot].hash() == h && slots_[slot].str() == text)
+            return slots_[slot];
+    }
+    slots_[slot] = Key::make(text.data(), text.size(), h);
+    ++size_;
+    return slots_[slot];
+}
 
-    IDENT, // literals
+// A map from strings to T kept as one vector of pairs, in insertion
+// order. Most objects have a handful of keys, which are found faster by
+// a linear search than by hashing, and take one allocation instead of
+// one per key. From kIndexThreshold keys on, an open addressing index
+// of positions in the vector is kept beside it.
+//
+// Object is a FlatMap<Value> with MICROHCL_USE_FLAT_MAP. It has the
+// parts of the std::map interface that Object is used through. Erasing
+// is O(n), and do not change keys through iterators.
+//
+// As with std::vector, and unlike std::map and std::unordered_map,
+// inserting may reallocate the entries, which invalidates every
+// iterator, pointer and reference into the map. reserve() makes room
+// beforehand: inserts within it keep them valid. Erasing invalidates
+// those to the entries after the erased one.
+//
+// |K| is std::string or Key. With Key, as in InternedObjects, lookups by
+// a Key use its cached hash and compare pointers first.
+template<typename T, typename K>
+class FlatMap {
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<K, T> value_type;
+    typedef typename std::vector<value_type>::iterator iterator;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+    typedef size_t size_type;
 
-    NUMBER,  // 12345
-    FLOAT,   // 123.45
-    BOOL,    // true,false
-    STRING,  // "abc"
-    HIL,     // "${foo(bar)}"
-    HEREDOC, // <<FOO\nbar\nFOO
+    static const size_t kIndexThreshold = 8;
 
-    LBRACK, // [
-    LBRACE, // {
-    COMMA,  // ,
-    PERIOD, // .
+    FlatMap() {}
+    FlatMap(std::initializer_list<value_type> init)
+    {
+        reserve(init.size());
+        for (const value_type& kv : init)
+            emplace(kv.first, kv.second);
+    }
 
-    RBRACK, // ]
-    RBRACE, // }
+    iterator begin() { return entries_.begin(); }
+    iterator end() { return entries_.end(); }
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    const_iterator cbegin() const { return entries_.begin(); }
+    const_iterator cend() const { return entries_.end(); }
 
-    ASSIGN, // =
-    ADD,    // +
-    SUB,    // -
-};
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
 
-class Token {
-public:
-    explicit Token(TokenType type) : type_(type) {}
-    Token(TokenType type, const std::string& v) : type_(type), str_value_(v) {}
-    Token(TokenType type, bool v) : type_(type), int_value_(v) {}
-    Token(TokenType type, std::int64_t v) : type_(type), int_value_(v) {}
-    Token(TokenType type, double v) : type_(type), double_value_(v) {}
+    void clear()
+    {
+        entries_.clear();
+        index_.clear();
+    }
 
-    TokenType type() const { return type_; }
-    const std::string& strValue() const { return str_value_; }
-    bool boolValue() const { return int_value_ != 0; }
-    std::int64_t intValue() const { return int_value_; }
-    double doubleValue() const { return double_value_; }
+    void reserve(size_t n)
+    {
+        entries_.reserve(n);
+        if (n >= kIndexThreshold && index_.size() < 2 * n)
+            rebuildIndex(n);
+    }
 
-private:
-    TokenType type_;
-    std::string str_value_;
-    std::int64_t int_value_;
-    double double_value_;
-};
+    iterator find(const std::string& key)
+    {
+        const size_t i = position(key);
+        return i == kNotFound ? end() : begin() + i;
+    }
 
-class Lexer {
-public:
-    explicit Lexer(std::istream& is) : is_(is),
-                                       lineNo_(1),
-                                       columnNo_(0) {}
+    const_iterator find(const std::string& key) const
+    {
+        const size_t i = position(key);
+        return i == kNotFound ? end() : begin() + i;
+    }
 
-    Token nextToken();
+    iterator find(const Key& key)
+    {
+        const size_t i = position(key);
+        return i == kNotFound ? end() : begin() + i;
+    }
 
-    int lineNo() const { return lineNo_; }
-    int columnNo() const { return columnNo_; }
+    const_iterator find(const Key& key) const
+    {
+        const size_t i = position(key);
+        return i == kNotFound ? end() : begin() + i;
+    }
 
-    // Skips if UTF8BOM is found.
-    // Returns true if success. Returns false if intermediate state is left.
-    bool skipUTF8BOM();
+    size_t count(const std::string& key) const { return position(key) == kNotFound ? 0 : 1; }
+    size_t count(const Key& key) const { return position(key) == kNotFound ? 0 : 1; }
 
-    bool consume(char c);
+    T& operator[](const std::string& key) { return emplace(key).first->second; }
 
-private:
-    bool current(char* c);
-    void next();
+    template<typename Q, typename... Args>
+    std::pair<iterator, bool> emplace(Q&& key, Args&&... args)
+    {
+        const size_t i = position(key);
+        if (i != kNotFound)
+            return std::make_pair(begin() + i, false);
+
+        entries_.emplace_back(std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<Q>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        if (!index_.empty() && 2 * entries_.size() > index_.size())
+            rebuildIndex(entries_.size());
+        else if (!index_.empty())
+            addToIndex(entries_.size() - 1);
+        else if (entries_.size() >= kIndexThreshold)
+            rebuildIndex(entries_.size());
+        return std::make_pair(end() - 1, true);
+    }
 
-    Token nextValueToken();
-    Token nextNumber(bool leadingDot, bool leadingSub);
+    std::pair<iterator, bool> insert(const value_type& kv) { return emplace(kv.first, kv.second); }
 
-    void skipUntilNewLine();
+    // Gives the entry at |pos| a new key, in the same place. |key| must
+    // not be in the map already.
+    void rename(const_iterator pos, const std::string& key)
+    {
+        entries_[pos - cbegin()].first = K(key);
+        if (!index_.empty())
+            rebuildIndex(entries_.size());
+    }
 
-    Token nextStringDoubleQuote();
-    Token nextStringSingleQuote();
-    Token nextHereDoc();
+    size_t erase(const std::string& key)
+    {
+        const size_t i = position(key);
+        if (i == kNotFound)
+            return 0;
+        erase(begin() + i);
+        return 1;
+    }
 
-    std::istream& is_;
-    int lineNo_;
-    int columnNo_;
-};
+    iterator erase(const_iterator pos)
+    {
+        const size_t i = pos - cbegin();
+        entries_.erase(entries_.begin() + i);
+        if (entries_.size() < kIndexThreshold)
+            index_.clear();
+        else
+            rebuildIndex(entries_.size());
+        return begin() + i;
+    }
 
-class Parser {
-public:
-    explicit Parser(std::istream& is) : lexer_(is), token_(TokenType::ILLEGAL)
+    // Equal when both have the same keys with equal values, in any order.
+    friend bool operator==(const FlatMap& lhs, const FlatMap& rhs)
     {
-        if (!lexer_.skipUTF8BOM()) {
-            token_ = Token(TokenType::ILLEGAL, std::string("Invalid UTF8 BOM"));
-        } else {
-            nextToken();
+        if (lhs.size() != rhs.size())
+            return false;
+        for (const value_type& kv : lhs) {
+            const_iterator it = rhs.find(kv.first);
+            if (it == rhs.end() || !(it->second == kv.second))
+                return false;
         }
+        return true;
     }
-
-    // Parses. If failed, value should be invalid value.
-    // You can get the error by calling errorReason().
-    Value parse();
-    const std::string& errorReason();
+    friend bool operator!=(const FlatMap& lhs, const FlatMap& rhs) { return !(lhs == rhs); }
 
 private:
-    const Token& token() const { return token_; }
-    void nextToken() { token_ = lexer_.nextToken(); }
-    bool consume(char c) { return lexer_.consume(c); }
-    int columnNo() { return lexer_.columnNo(); }
+    static const size_t kNotFound = static_cast<size_t>(-1);
 
-    void skipForKey();
-    void skipForValue();
+    static size_t hashOf(const std::string& key) { return std::hash<std::string>()(key); }
+    static size_t hashOf(const Key& key) { return key.hash(); }
 
-    bool consumeForKey(TokenType);
-    bool consumeForValue(TokenType);
-    bool consumeEOLorEOFForKey();
+    template<typename Q>
+    size_t position(const Q& key) const
+    {
+        if (index_.empty()) {
+            for (size_t i = 0; i < entries_.size(); ++i) {
+                if (entries_[i].first == key)
+                    return i;
+            }
+            return kNotFound;
+        }
 
-    Value parseObjectList(bool);
-    bool parseKeys(std::vector<std::string>&);
-    bool parseObjectItem(Value&);
-    bool parseObject(Value&);
-    bool parseObjectType(Value&);
-    bool parseListType(Value&);
-    bool parseLiteralType(Value&);
+        const size_t mask = index_.size() - 1;
+        for (size_t slot = hashOf(key) & mask; index_[slot]; slot = (slot + 1) & mask) {
+            if (entries_[index_[slot] - 1].first == key)
+                return index_[slot] - 1;
+        }
+        return kNotFound;
+    }
 
-    void addError(const std::string& reason);
+    void addToIndex(size_t i)
+    {
+        const size_t mask = index_.size() - 1;
+        size_t slot = hashOf(entries_[i].first) & mask;
+        while (index_[slot])
+            slot = (slot + 1) & mask;
+        index_[slot] = static_cast<std::uint32_t>(i + 1);
+    }
 
-    bool unindentHeredoc(const std::string& heredoc, std::string& out);
+    // Sizes the index for |n| entries, at most half full.
+    void rebuildIndex(size_t n)
+    {
+        size_t slots = 16;
+        while (slots < 2 * n)
+            slots *= 2;
+        index_.assign(slots, 0);
+        for (size_t i = 0; i < entries_.size(); ++i)
+            addToIndex(i);
+    }
 
-    Lexer lexer_;
-    Token token_;
-    std::string errorReason_;
+    std::vector<value_type> entries_;
+    // Positions in |entries_| plus one, 0 for an empty slot. Empty while
+    // there are fewer than kIndexThreshold entries.
+    std::vector<std::uint32_t> index_;
 };
 
-} // namespace internal
+template<typename T, typename K> const size_t FlatMap<T, K>::kIndexThreshold;
+template<typename T, typename K> const size_t FlatMap<T, K>::kNotFound;
+
+// A hash map from strings to T with open addressing, after Swiss tables.
+// A control byte per slot holds kEmpty, kDeleted or seven bits of the
+// key's hash, so most probes are turned down without touching the slot.
+// Each slot also keeps the key's full hash, which is compared before the
+// key and reused when the table grows. find() and count() take a hash
+// computed beforehand with hash(), for keys that are looked up often.
+//
+// Object is an OpenHashMap<Value> with MICROHCL_USE_OPEN_HASH_MAP. As
+// with std::unordered_map, the iteration order is unspecified. Unlike
+// it, the entries live in the slots themselves, so an insert that grows
+// the table moves them all and invalidates every iterator, pointer and
+// reference into the map. Inserts within the room made by reserve()
+// keep them valid, as long as nothing has been erased since: erased
+// slots are only reclaimed by growing. Erasing invalidates nothing but
+// the erased entry.
+template<typename T>
+class OpenHashMap {
+    struct Slot {
+        template<typename K, typename... Args>
+        Slot(size_t h, K&& key, Args&&... args) :
+            hash(h),
+            kv(std::piecewise_construct,
+               std::forward_as_tuple(std::forward<K>(key)),
+               std::forward_as_tuple(std::forward<Args>(args)...))
+        {
+        }
 
-// ----------------------------------------------------------------------
-// Implementations
+        size_t hash;
+        std::pair<std::string, T> kv;
+    };
 
-inline ParseResult parse(std::istream& is)
-{
-    if (!is) {
-        return ParseResult(hcl::Value(), "stream is in bad state. file does not exist?");
-    }
+    template<typename V, typename S>
+    class Iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::remove_const<V>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
 
-    internal::Parser parser(is);
-    hcl::Value v = parser.parse();
+        Iterator() : ctrl_(nullptr), slot_(nullptr) {}
+        // iterator to const_iterator.
+        template<typename V2, typename S2>
+        Iterator(const Iterator<V2, S2>& it) : ctrl_(it.ctrl_), slot_(it.slot_) {}
 
-    if (v.valid())
-        return ParseResult(std::move(v), std::string());
+        reference operator*() const { return slot_->kv; }
+        pointer operator->() const { return &slot_->kv; }
 
-    return ParseResult(std::move(v), std::move(parser.errorReason()));
-}
+        Iterator& operator++()
+        {
+            ++ctrl_;
+            ++slot_;
+            skipFree();
+            return *this;
+        }
 
-inline ParseResult parseFile(const std::string& filename)
-{
-    std::ifstream ifs(filename);
-    if (!ifs) {
-        return ParseResult(hcl::Value(),
-                           std::string("could not open file: ") + filename);
-    }
+        Iterator operator++(int)
+        {
+            Iterator it = *this;
+            ++*this;
+            return it;
+        }
 
-    return parse(ifs);
-}
+        friend bool operator==(const Iterator& lhs, const Iterator& rhs) { return lhs.slot_ == rhs.slot_; }
+        friend bool operator!=(const Iterator& lhs, const Iterator& rhs) { return lhs.slot_ != rhs.slot_; }
 
-inline std::string format(std::stringstream& ss)
-{
-    return ss.str();
-}
+    private:
+        friend class OpenHashMap;
+        template<typename, typename> friend class Iterator;
 
-template<typename T, typename... Args>
-std::string format(std::stringstream& ss, T&& t, Args&&... args)
-{
-    ss << std::forward<T>(t);
-    return format(ss, std::forward<Args>(args)...);
-}
+        Iterator(const std::int8_t* ctrl, S* slot) : ctrl_(ctrl), slot_(slot) { skipFree(); }
 
-template<typename... Args>
-#if defined(_MSC_VER)
-__declspec(noreturn)
-#else
-[[noreturn]]
-#endif
-void failwith(Args&&... args)
-{
-    std::stringstream ss;
-    throw std::runtime_error(format(ss, std::forward<Args>(args)...));
-}
+        // Stops at a full slot or at the sentinel after the last slot.
+        void skipFree()
+        {
+            while (*ctrl_ < kSentinel) {
+                ++ctrl_;
+                ++slot_;
+            }
+        }
 
-namespace internal {
+        const std::int8_t* ctrl_;
+        S* slot_;
+    };
 
-inline std::string removeDelimiter(const std::string& s)
-{
-    std::string r;
-    for (char c : s) {
-        if (c == '_')
-            continue;
-        r += c;
+public:
+    typedef std::string key_type;
+    typedef T mapped_type;
+    typedef std::pair<std::string, T> value_type;
+    typedef Iterator<value_type, Slot> iterator;
+    typedef Iterator<const value_type, const Slot> const_iterator;
+    typedef size_t size_type;
+
+    OpenHashMap() : ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0), growthLeft_(0) {}
+
+    OpenHashMap(std::initializer_list<value_type> init) : OpenHashMap()
+    {
+        reserve(init.size());
+        for (const value_type& kv : init)
+            emplace(kv.first, kv.second);
     }
-    return r;
-}
 
-inline std::string unescape(const std::string& codepoint)
-{
-    std::uint32_t x;
-    std::uint8_t buf[8];
-    std::stringstream ss(codepoint);
+    OpenHashMap(const OpenHashMap& other) : OpenHashMap()
+    {
+        if (other.empty())
+            return;
+        allocate(capacityFor(other.size_));
+        for (size_t i = 0; i < other.capacity_; ++i) {
+            if (other.ctrl_[i] >= 0)
+                construct(freeSlot(other.slots_[i].hash), other.slots_[i].hash, other.slots_[i].kv.first, other.slots_[i].kv.second);
+        }
+    }
 
-    ss >> std::hex >> x;
+    OpenHashMap(OpenHashMap&& other) noexcept : OpenHashMap() { swap(other); }
 
-    if (x <= 0x7FUL) {
-        // 0xxxxxxx
-        buf[0] = 0x00 | ((x >> 0) & 0x7F);
-        buf[1] = '\0';
-    } else if (x <= 0x7FFUL) {
-        // 110yyyyx 10xxxxxx
-        buf[0] = 0xC0 | ((x >> 6) & 0xDF);
-        buf[1] = 0x80 | ((x >> 0) & 0xBF);
-        buf[2] = '\0';
-    } else if (x <= 0xFFFFUL) {
-        // 1110yyyy 10yxxxxx 10xxxxxx
-        buf[0] = 0xE0 | ((x >> 12) & 0xEF);
-        buf[1] = 0x80 | ((x >> 6) & 0xBF);
-        buf[2] = 0x80 | ((x >> 0) & 0xBF);
-        buf[3] = '\0';
-    } else if (x <= 0x10FFFFUL) {
-        // 11110yyy 10yyxxxx 10xxxxxx 10xxxxxx
-        buf[0] = 0xF0 | ((x >> 18) & 0xF7);
-        buf[1] = 0x80 | ((x >> 12) & 0xBF);
-        buf[2] = 0x80 | ((x >> 6) & 0xBF);
-        buf[3] = 0x80 | ((x >> 0) & 0xBF);
-        buf[4] = '\0';
-    } else {
-        buf[0] = '\0';
+    OpenHashMap& operator=(const OpenHashMap& other)
+    {
+        if (this != &other) {
+            OpenHashMap copy(other);
+            swap(copy);
+        }
+        return *this;
     }
 
-    return reinterpret_cast<char*>(buf);
-}
+    OpenHashMap& operator=(OpenHashMap&& other) noexcept
+    {
+        OpenHashMap moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
 
-// Returns true if |s| is integer.
-// [+-]?\d+(_\d+)*
-inline bool isInteger(const std::string& s)
-{
-    if (s.empty())
-        return false;
+    ~OpenHashMap() { release(); }
 
-    std::string::size_type p = 0;
-    if (s[p] == '+' || s[p] == '-')
-        ++p;
+    void swap(OpenHashMap& other) noexcept
+    {
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growthLeft_, other.growthLeft_);
+    }
 
-    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-        ++p;
-        if (p < s.size() && s[p] == '_') {
-            ++p;
-            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                return false;
+    iterator begin() { return iterator(controlBytes(), slots_); }
+    iterator end() { return iterator(controlBytes() + capacity_, slots_ + capacity_); }
+    const_iterator begin() const { return const_iterator(controlBytes(), slots_); }
+    const_iterator end() const { return const_iterator(controlBytes() + capacity_, slots_ + capacity_); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Keeps the table.
+    void clear()
+    {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0)
+                slots_[i].~Slot();
+            ctrl_[i] = kEmpty;
         }
+        size_ = 0;
+        growthLeft_ = maxLoad(capacity_);
     }
 
-    return p == s.size();
-}
+    void reserve(size_t n)
+    {
+        if (n > size_ + growthLeft_)
+            rehash(capacityFor(n));
+    }
 
-// Returns true if |s| is double.
-// [+-]? (\d+(_\d+)*)? (\.\d+(_\d+)*)? ([eE] [+-]? \d+(_\d+)*)?
-//       1-----------  2-------------  3----------------------
-// 2 or (1 and 3) should exist.
-inline bool isDouble(const std::string& s)
-{
-    if (s.empty())
-        return false;
+    static size_t hash(const std::string& key) { return std::hash<std::string>()(key); }
 
-    std::string::size_type p = 0;
-    if (s[p] == '+' || s[p] == '-')
-        ++p;
+    iterator find(const std::string& key) { return find(key, hash(key)); }
+    const_iterator find(const std::string& key) const { return find(key, hash(key)); }
 
-    bool ok = false;
-    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-        ++p;
-        ok = true;
+    // |h| must be hash(key).
+    iterator find(const std::string& key, size_t h)
+    {
+        const size_t i = position(key, h);
+        return i == kNotFound ? end() : iterator(ctrl_ + i, slots_ + i);
+    }
 
-        if (p < s.size() && s[p] == '_') {
-            ++p;
-            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                return false;
-        }
+    const_iterator find(const std::string& key, size_t h) const
+    {
+        const size_t i = position(key, h);
+        return i == kNotFound ? end() : const_iterator(ctrl_ + i, slots_ + i);
     }
 
-    if (p < s.size() && s[p] == '.')
-        ++p;
+    size_t count(const std::string& key) const { return count(key, hash(key)); }
+    size_t count(const std::string& key, size_t h) const { return position(key, h) == kNotFound ? 0 : 1; }
 
-    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-        ++p;
-        ok = true;
+    T& operator[](const std::string& key) { return emplace(key).first->second; }
 
-        if (p < s.size() && s[p] == '_') {
-            ++p;
-            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                return false;
-        }
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplace(K&& key, Args&&... args)
+    {
+        const std::string& k = key;
+        const size_t h = hash(k);
+        size_t i = position(k, h);
+        if (i != kNotFound)
+            return std::make_pair(iterator(ctrl_ + i, slots_ + i), false);
+
+        if (growthLeft_ == 0)
+            rehash(capacityFor(size_ + 1));
+        i = freeSlot(h);
+        construct(i, h, std::forward<K>(key), std::forward<Args>(args)...);
+        return std::make_pair(iterator(ctrl_ + i, slots_ + i), true);
     }
 
-    if (!ok)
-        return false;
-
-    ok = false;
-    if (p < s.size() && (s[p] == 'e' || s[p] == 'E')) {
-        ++p;
-        if (p < s.size() && (s[p] == '+' || s[p] == '-'))
-            ++p;
-        while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-            ++p;
-            ok = true;
+    std::pair<iterator, bool> insert(const value_type& kv) { return emplace(kv.first, kv.second); }
 
-            if (p < s.size() && s[p] == '_') {
-                ++p;
-                if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                    return false;
-            }
-        }
-        if (!ok)
-            return false;
+    size_t erase(const std::string& key)
+    {
+        const size_t i = position(key, hash(key));
+        if (i == kNotFound)
+            return 0;
+        eraseAt(i);
+        return 1;
     }
 
-    return p == s.size();
-}
+    iterator erase(const_iterator pos)
+    {
+        const size_t i = pos.slot_ - slots_;
+        eraseAt(i);
+        return iterator(ctrl_ + i + 1, slots_ + i + 1);
+    }
 
-// static
-inline std::string escapeString(const std::string& s)
-{
-    std::stringstream ss;
-    for (size_t i = 0; i < s.size(); ++i) {
-        switch (s[i]) {
-        case '\n': ss << "\\n"; break;
-        case '\r': ss << "\\r"; break;
-        case '\t': ss << "\\t"; break;
-        case '\"': ss << "\\\""; break;
-        case '\'': ss << "\\\'"; break;
-        case '\\': ss << "\\\\"; break;
-        default: ss << s[i]; break;
+    // Equal when both have the same keys with equal values.
+    friend bool operator==(const OpenHashMap& lhs, const OpenHashMap& rhs)
+    {
+        if (lhs.size() != rhs.size())
+            return false;
+        for (size_t i = 0; i < lhs.capacity_; ++i) {
+            if (lhs.ctrl_[i] < 0)
+                continue;
+            const Slot& slot = lhs.slots_[i];
+            const_iterator it = rhs.find(slot.kv.first, slot.hash);
+            if (it == rhs.end() || !(it->second == slot.kv.second))
+                return false;
         }
+        return true;
     }
+    friend bool operator!=(const OpenHashMap& lhs, const OpenHashMap& rhs) { return !(lhs == rhs); }
 
-    return ss.str();
-}
+private:
+    static const std::int8_t kEmpty = -128;
+    static const std::int8_t kDeleted = -2;
+    // After the last slot, to stop iteration. Full slots are >= 0.
+    static const std::int8_t kSentinel = -1;
+    static const size_t kMinCapacity = 8;
+    static const size_t kNotFound = static_cast<size_t>(-1);
 
-} // namespace internal
+    static std::int8_t tag(size_t h) { return static_cast<std::int8_t>(h & 0x7F); }
+    static size_t maxLoad(size_t capacity) { return capacity - capacity / 4; }
 
-// ----------------------------------------------------------------------
-// Lexer
+    static size_t capacityFor(size_t n)
+    {
+        size_t capacity = kMinCapacity;
+        while (maxLoad(capacity) < n)
+            capacity *= 2;
+        return capacity;
+    }
 
-namespace internal {
+    const std::int8_t* controlBytes() const
+    {
+        static const std::int8_t sentinel = kSentinel;
+        return ctrl_ ? ctrl_ : &sentinel;
+    }
 
-inline bool Lexer::skipUTF8BOM()
-{
-    // Check [EF, BB, BF]
+    size_t position(const std::string& key, size_t h) const
+    {
+        if (capacity_ == 0)
+            return kNotFound;
+
+        const std::int8_t t = tag(h);
+        const size_t mask = capacity_ - 1;
+        for (size_t i = (h >> 7) & mask;; i = (i + 1) & mask) {
+            if (ctrl_[i] == t && slots_[i].hash == h && slots_[i].kv.first == key)
+                return i;
+            if (ctrl_[i] == kEmpty)
+                return kNotFound;
+        }
+    }
 
-    int x1 = is_.peek();
-    if (x1 != 0xEF) {
-        // When the first byte is not 0xEF, it's not UTF8 BOM.
-        // Just return true.
-        return true;
+    // The first empty or deleted slot on |h|'s probe sequence. There is
+    // always one, as at most 3/4 of the slots are full or deleted.
+    size_t freeSlot(size_t h) const
+    {
+        const size_t mask = capacity_ - 1;
+        size_t i = (h >> 7) & mask;
+        while (ctrl_[i] >= 0)
+            i = (i + 1) & mask;
+        return i;
     }
 
-    is_.get();
-    int x2 = is_.get();
-    if (x2 != 0xBB) {
-        return false;
+    template<typename... Args>
+    void construct(size_t i, size_t h, Args&&... args)
+    {
+        new (slots_ + i) Slot(h, std::forward<Args>(args)...);
+        if (ctrl_[i] == kEmpty)
+            --growthLeft_;
+        ctrl_[i] = tag(h);
+        ++size_;
     }
 
-    int x3 = is_.get();
-    if (x3 != 0xBF) {
-        return false;
+    void eraseAt(size_t i)
+    {
+        slots_[i].~Slot();
+        --size_;
+        // No probe sequence goes on past an empty slot, so this slot can
+        // be empty, too, when the next one is.
+        if (ctrl_[(i + 1) & (capacity_ - 1)] == kEmpty) {
+            ctrl_[i] = kEmpty;
+            ++growthLeft_;
+        } else {
+            ctrl_[i] = kDeleted;
+        }
     }
 
-    return true;
-}
+    void allocate(size_t capacity)
+    {
+        ctrl_ = new std::int8_t[capacity + 1];
+        std::fill(ctrl_, ctrl_ + capacity, kEmpty);
+        ctrl_[capacity] = kSentinel;
+        slots_ = static_cast<Slot*>(::operator new(capacity * sizeof(Slot)));
+        capacity_ = capacity;
+        growthLeft_ = maxLoad(capacity);
+    }
 
-inline bool Lexer::current(char* c)
-{
-    int x = is_.peek();
-    if (x == EOF)
-        return false;
-    *c = static_cast<char>(x);
-    return true;
-}
+    // Moves the entries into a table of |capacity| slots, dropping the
+    // deleted ones. The hashes are not computed again.
+    void rehash(size_t capacity)
+    {
+        OpenHashMap table;
+        table.allocate(capacity);
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                Slot& slot = slots_[i];
+                table.construct(table.freeSlot(slot.hash), slot.hash, std::move(slot.kv.first), std::move(slot.kv.second));
+            }
+        }
+        swap(table);
+    }
 
-inline void Lexer::next()
-{
-    int x = is_.get();
-    if (x == '\n') {
-        columnNo_ = 0;
-        ++lineNo_;
-    } else {
-        ++columnNo_;
+    void release()
+    {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0)
+                slots_[i].~Slot();
+        }
+        delete[] ctrl_;
+        ::operator delete(slots_);
     }
-}
 
-inline bool Lexer::consume(char c)
-{
-    char x;
-    if (!current(&x))
-        return false;
-    if (x != c)
-        return false;
-    next();
-    return true;
+    // capacity_ + 1 control bytes, the last being kSentinel.
+    std::int8_t* ctrl_;
+    Slot* slots_;
+    size_t capacity_;
+    size_t size_;
+    // Empty slots that can be filled before growing.
+    size_t growthLeft_;
+};
+
+template<typename T> const std::int8_t OpenHashMap<T>::kEmpty;
+template<typename T> const std::int8_t OpenHashMap<T>::kDeleted;
+template<typename T> const std::int8_t OpenHashMap<T>::kSentinel;
+template<typename T> const size_t OpenHashMap<T>::kMinCapacity;
+template<typename T> const size_t OpenHashMap<T>::kNotFound;
+
+// A parsed value. |ObjectPolicy| picks the container objects are kept
+// in: its member template map<V> is a map from std::string to V with
+// the parts of the std::map interface Value uses (find, emplace,
+// erase, operator[], iteration and ==). Values with different policies
+// can live side by side in one program, and are converted into each
+// other with an explicit constructor. hcl::Value is the BasicValue of
+// DefaultObjects.
+template<typename ObjectPolicy>
+class BasicValue : public internal::ValueTypes {
+public:
+    typedef std::vector<BasicValue> List;
+    typedef typename ObjectPolicy::template map<BasicValue> Object;
+
+    BasicValue() : type_(NULL_TYPE), raw_(0), escaped_(false), inline_(0), null_(nullptr) {}
+    BasicValue(bool v) : type_(BOOL_TYPE), raw_(0), escaped_(false), inline_(0), bool_(v) {}
+    BasicValue(int v) : type_(INT_TYPE), raw_(0), escaped_(false), inline_(0), int_(v) {}
+    BasicValue(int64_t v) : type_(INT_TYPE), raw_(0), escaped_(false), inline_(0), int_(v) {}
+    BasicValue(double v) : type_(DOUBLE_TYPE), raw_(0), escaped_(false), inline_(0), double_(v) {}
+#ifdef MICROHCL_COMPACT_VALUE
+    BasicValue(const std::string& v) : type_(STRING_TYPE), raw_(0), escaped_(false), inline_(kStringBlock), block_(internal::StringBlock::make(v.data(), v.size())) {}
+    BasicValue(const char* v) : type_(STRING_TYPE), raw_(0), escaped_(false), inline_(kStringBlock), block_(internal::StringBlock::make(v, std::strlen(v))) {}
+    BasicValue(std::string&& v) : type_(STRING_TYPE), raw_(0), escaped_(false), inline_(kStringBlock), block_(internal::StringBlock::make(v.data(), v.size())) {}
+#else
+    BasicValue(const std::string& v) : type_(STRING_TYPE), raw_(0), escaped_(false), inline_(0), string_(new std::string(v)) {}
+    BasicValue(const char* v) : type_(STRING_TYPE), raw_(0), escaped_(false), inline_(0), string_(new std::string(v)) {}
+    BasicValue(std::string&& v) : type_(STRING_TYPE), raw_(0), escaped_(false), inline_(0), string_(new std::string(std::move(v))) {}
+#endif
+    BasicValue(const List& v) : type_(LIST_TYPE), raw_(0), escaped_(false), inline_(0), list_(new List(v)) {}
+    BasicValue(const Object& v) : type_(OBJECT_TYPE), raw_(0), escaped_(false), inline_(0), object_(new Object(v)) {}
+    BasicValue(List&& v) : type_(LIST_TYPE), raw_(0), escaped_(false), inline_(0), list_(new List(std::move(v))) {}
+    BasicValue(Object&& v) : type_(OBJECT_TYPE), raw_(0), escaped_(false), inline_(0), object_(new Object(std::move(v))) {}
+
+    BasicValue(const BasicValue& v);
+    BasicValue(BasicValue&& v) noexcept;
+    // Copies a value with another object policy.
+    template<typename P> explicit BasicValue(const BasicValue<P>& v);
+    BasicValue& operator=(const BasicValue& v);
+    BasicValue& operator=(BasicValue&& v) noexcept;
+
+    // Guards from unexpected Value construction.
+    // Someone might use a value like this:
+    //   hcl::Value v = x->find("foo");
+    // But this is wrong. Without this constructor,
+    // value will be unexpectedly initialized with bool.
+    BasicValue(const void* v) = delete;
+    ~BasicValue();
+
+    // Retruns Value size.
+    // 0 for invalid value.
+    // The number of inner elements for list or object.
+    // 1 for other types.
+    size_t size() const;
+    bool empty() const;
+    Type type() const { return type_; }
+
+    // Makes room for |n| children of a list or object. Does nothing for
+    // other types, or for objects kept in a std::map.
+    void reserve(size_t n);
+
+    bool valid() const { return type_ != NULL_TYPE; }
+    template<typename T> bool is() const;
+    template<typename T> typename call_traits<T>::return_type as() const;
+    // Same as as<T>(), but returns false instead of failing when the
+    // value is not a T.
+    template<typename T> bool tryAs(T& out) const;
+
+    friend bool operator==(const BasicValue& lhs, const BasicValue& rhs) { return lhs.equals(rhs); }
+    friend bool operator!=(const BasicValue& lhs, const BasicValue& rhs) { return !(lhs == rhs); }
+
+    // ----------------------------------------------------------------------
+    // For integer/floating value
+
+    // Returns true if the value is int or double.
+    bool isNumber() const;
+    double asNumber() const;
+
+    // Makes an int or double from its text, e.g. "1_000" or "1.50". The
+    // text is converted by each as<T>() and written back by write()
+    // unchanged. Fails if |text| is not a number.
+    static BasicValue rawNumber(const std::string& text);
+    // True for numbers holding their text, as made by rawNumber() or
+    // parsed with ParseOptions::lazyNumbers.
+    bool isRawNumber() const { return raw_ != 0; }
+
+    // ----------------------------------------------------------------------
+    // For String value
+
+    StringType getStringType() const;
+    void setStringType(StringType);
+    bool isString() const;
+    bool isIdent() const;
+    bool isHil() const;
+
+    // The text of a string, identifier or HIL value, without the copy
+    // as<std::string>() makes. For an inline string, the pointer is into
+    // the Value itself, and is invalidated when the Value is moved.
+    const char* stringData() const;
+    size_t stringSize() const;
+#if __cplusplus >= 201703L
+    std::string_view asStringView() const { return std::string_view(stringData(), stringSize()); }
+#endif
+    // True for strings short enough to be kept in the Value itself, as
+    // parsed with ParseOptions::inlineStrings.
+    bool isInlineString() const { return inline_ != 0 && inline_ != kStringBlock; }
+
+    // ----------------------------------------------------------------------
+    // For Object value
+    //
+    // The pointers and references to children returned below stay valid
+    // until the child is erased, as in std::map, unless objects are kept
+    // in a FlatMap or an OpenHashMap. There, adding a key to an object can
+    // move the others, as push() does for a list: find the child again
+    // after set(), setChild() or operator[] with a new key, or reserve()
+    // room first.
+
+    template<typename T> typename call_traits<T>::return_type get(const std::string&) const;
+    // Same as get<T>(key), but returns false instead of failing when
+    // there is no such value or it is not a T.
+    template<typename T> bool tryGet(const std::string& key, T& out) const;
+    BasicValue* set(const std::string& key, const BasicValue& v);
+    // Finds a Value with |key|. |key| can contain '.'
+    // Note: if you would like to find a child value only, you need to use findChild.
+    const BasicValue* find(const std::string& key) const;
+    BasicValue* find(const std::string& key);
+    bool has(const std::string& key) const { return find(key) != nullptr; }
+    bool erase(const std::string& key);
+
+    BasicValue& operator[](size_t index);
+    BasicValue& operator[](const std::string& key);
+
+    // Returns true if two objects share any keys (non-nesting).
+    bool sharesKeyWith(const BasicValue& v) const;
+
+    // Merge object. Returns true if succeeded. Otherwise, |this| might be corrupted.
+    // When the same key exists, it will be overwritten.
+    bool merge(const BasicValue&);
+
+    // Assigns a value based on a nested list of keys.
+    bool mergeObjects(const std::vector<std::string>&, BasicValue&);
+
+    // Finds a value with |key|. It searches only children.
+    BasicValue* findChild(const std::string& key);
+    const BasicValue* findChild(const std::string& key) const;
+    // Same as findChild(key). With InternedValue, a Key from the pool
+    // the value was parsed with is matched by pointer.
+    BasicValue* findChild(const Key& key);
+    const BasicValue* findChild(const Key& key) const;
+    // Sets a value, and returns the pointer to the created value.
+    // When the value having the same key exists, it will be overwritten.
+    BasicValue* setChild(size_t index, const BasicValue& v);
+    BasicValue* setChild(size_t index, BasicValue&& v);
+    BasicValue* setChild(const std::string& key, const BasicValue& v);
+    BasicValue* setChild(const std::string& key, BasicValue&& v);
+    bool eraseChild(const std::string& key);
+    // Gives the child |from| the key |to|. In a FlatMap it keeps its
+    // place. Returns false if there is no |from| or |to| exists already.
+    bool renameChild(const std::string& from, const std::string& to);
+
+    // ----------------------------------------------------------------------
+    // For List value
+
+    template<typename T> typename call_traits<T>::return_type get(size_t index) const;
+    const BasicValue* find(size_t index) const;
+    BasicValue* find(size_t index);
+    BasicValue* push(const BasicValue& v);
+    BasicValue* push(BasicValue&& v);
+
+    // ----------------------------------------------------------------------
+    // Others
+
+    // Writer.
+    static std::string spaces(int num);
+    static std::string escapeKey(const std::string& key);
+
+    void write(std::ostream*, const std::string& keyPrefix = std::string(), int indent = -1) const;
+
+    friend std::ostream& operator<<(std::ostream& os, const BasicValue& v)
+    {
+        v.write(&os);
+        return os;
+    }
+    template<typename P, typename Tracer> friend void write(const BasicValue<P>&, std::ostream&, Tracer&);
+
+private:
+    template<typename T> bool assureType() const;
+    bool equals(const BasicValue& v) const;
+    BasicValue* ensureValue(const std::string& key);
+
+    template<typename Tracer>
+    void writeObject(std::ostream*, const std::string& keyPrefix, int indent, Tracer& tracer) const;
+
+    static BasicValue makeRawNumber(Type type, const std::string& text);
+    template<typename P> void copyRawNumber(const BasicValue<P>& v);
+    static BasicValue makeInlineString(Type type, const std::string& text);
+    static BasicValue makeEscapedString(Type type, const std::string& text);
+    template<typename P> void copyString(const BasicValue<P>& v);
+    const char* stringText() const;
+    size_t stringTextSize() const;
+    const char* rawText() const;
+    size_t rawSize() const;
+    int64_t intValue() const;
+    double doubleValue() const;
+    std::string stringValue() const;
+
+    // Raw numbers keep text of up to 8 bytes in |text_|, and longer text
+    // in |number_|. Either is converted on every read.
+    static const std::uint8_t kHeapNumber = 0xFF;
+    // Strings kept in a StringBlock, under MICROHCL_COMPACT_VALUE.
+    static const std::uint8_t kStringBlock = 0xFF;
+
+    Type type_;
+    // Raw numbers only: the length of the text in |text_|, or
+    // kHeapNumber. 0 otherwise.
+    std::uint8_t raw_;
+    // STRING_TYPE and HIL_TYPE only: the string is in |escapedString_|,
+    // as written in the source.
+    bool escaped_;
+    // Strings only: 1 + the length of the text in |text_|, kStringBlock
+    // when it is in |block_|, 0 when it is in |string_|.
+    std::uint8_t inline_;
+    union {
+        void* null_; // Can never be legitimately set, indicates parse error
+        bool bool_;
+        int64_t int_;
+        double double_;
+        std::string* string_;
+        internal::EscapedString* escapedString_;
+#ifdef MICROHCL_COMPACT_VALUE
+        internal::StringBlock* block_;
+#endif
+        List* list_;
+        Object* object_;
+        char text_[8];
+        internal::RawNumber* number_;
+    };
+
+    template<typename> friend class BasicValue;
+    template<typename, typename> friend struct internal::ValueConverter;
+    friend class ValueRef;
+    template<typename, typename> friend class internal::BasicParser;
+};
+
+typedef BasicValue<DefaultObjects> Value;
+typedef Value::List List;
+typedef Value::Object Object;
+
+typedef BasicValue<HashObjects> HashValue;
+typedef BasicValue<SortedObjects> SortedValue;
+typedef BasicValue<FlatObjects> FlatValue;
+typedef BasicValue<OpenHashObjects> OpenHashValue;
+typedef BasicValue<InternedObjects> InternedValue;
+
+// Why a parse failed. The MAX_* codes mean one of the ParseOptions
+// limits was hit.
+enum class ErrorCode {
+    NONE,
+    SYNTAX_ERROR,
+    IO_ERROR,
+    CANCELLED,
+    SCHEMA_VIOLATION,
+    MAX_DEPTH_EXCEEDED,
+    MAX_BYTES_EXCEEDED,
+    MAX_NODES_EXCEEDED,
+    MAX_STRING_LENGTH_EXCEEDED,
+};
+
+namespace internal {
+struct SchemaNode;
+} // namespace internal
+
+// Describes the expected structure of a document. Build it once and
+// pass it through ParseOptions; the parser then rejects unknown keys,
+// type mismatches and disallowed block labels as soon as it reads the
+// offending key or the first token of the offending value, and checks
+// required keys when an object is closed.
+//
+//   hcl::Schema listener = hcl::Schema::object()
+//       .required("port", hcl::Schema::integer())
+//       .field("host", hcl::Schema::string());
+//   hcl::Schema schema = hcl::Schema::object()
+//       .field("listener", hcl::Schema::block(listener, {"http", "https"}));
+//
+// Copies share the same description.
+class Schema {
+public:
+    enum Kind {
+        ANY,
+        BOOL,
+        INT,
+        DOUBLE,
+        NUMBER,
+        STRING,
+        LIST,
+        OBJECT,
+        // Object whose keys are labels, e.g. |name| in 'service "name" { ... }'.
+        // Every label maps to the same body schema.
+        BLOCK,
+    };
+
+    static Schema any() { return Schema(ANY); }
+    static Schema boolean() { return Schema(BOOL); }
+    static Schema integer() { return Schema(INT); }
+    static Schema floating() { return Schema(DOUBLE); }
+    // int or double.
+    static Schema number() { return Schema(NUMBER); }
+    // Strings, identifiers, HIL and heredocs.
+    static Schema string() { return Schema(STRING); }
+    static Schema list(const Schema& element);
+    static Schema object() { return Schema(OBJECT); }
+    // |labels| lists the allowed labels. Empty means any label.
+    static Schema block(const Schema& body, std::vector<std::string> labels = std::vector<std::string>());
+
+    // For objects.
+    Schema& field(const std::string& key, const Schema& schema);
+    Schema& required(const std::string& key, const Schema& schema);
+    // Keys without a field are accepted and not checked.
+    Schema& allowUnknownKeys();
+
+    Kind kind() const;
+    const internal::SchemaNode* node() const { return node_.get(); }
+
+    static const char* kindToString(Kind);
+
+private:
+    explicit Schema(Kind kind);
+
+    std::shared_ptr<internal::SchemaNode> node_;
+};
+
+namespace internal {
+struct SchemaNode {
+    explicit SchemaNode(Schema::Kind k) : kind(k), allowUnknownKeys(false) {}
+
+    Schema::Kind kind;
+    // LIST element or BLOCK body.
+    std::shared_ptr<const SchemaNode> element;
+    std::unordered_map<std::string, std::shared_ptr<const SchemaNode>> fields;
+    std::vector<std::string> required;
+    std::vector<std::string> labels;
+    bool allowUnknownKeys;
+};
+} // namespace internal
+
+// Sizes of the objects and lists of a parsed document, by path. Passing
+// the profile of one parse to the next parse of the same source lets
+// the parser presize objects and lists instead of growing them one
+// child at a time. A profile is only a hint: paths that are missing or
+// sized differently are still parsed correctly.
+//
+//   hcl::ParseResult first = hcl::parse(is);
+//   hcl::ShapeProfile profile = first.shape();
+//   ...
+//   options.shape = &profile;
+//   hcl::ParseResult second = hcl::parse(is, options);
+class ShapeProfile {
+public:
+    // Paths are hashed as they are built, starting from root(). Two paths
+    // sharing a hash only cost a wrong hint.
+    typedef std::uint64_t Path;
+
+    static Path root() { return 14695981039346656037ull; }
+    static Path child(Path parent, const std::string& key);
+    static Path element(Path parent);
+
+    template<typename V> static ShapeProfile of(const V& value);
+
+    // Size seen at |path|, 0 if none.
+    size_t size(Path path) const;
+    // Number of paths recorded.
+    size_t paths() const { return sizes_.size(); }
+    bool empty() const { return sizes_.empty(); }
+
+private:
+    template<typename V> void record(const V& value, Path path);
+
+    // Only sizes above 1 are kept.
+    std::unordered_map<Path, std::uint32_t> sizes_;
+};
+
+#ifdef MICROHCL_STATS
+namespace internal {
+enum class TokenType;
+} // namespace internal
+
+// Where a parse spent its time, filled by parse() when passed through
+// ParseOptions::stats. Only compiled in with MICROHCL_STATS, so that
+// other builds pay nothing for it.
+struct ParseStats {
+    static const size_t kTokenTypes = 19;
+    static const size_t kValueTypes = Value::OBJECT_TYPE + 1;
+
+    ParseStats() { clear(); }
+    void clear() { *this = ParseStats(0); }
+
+    size_t tokenCount(internal::TokenType type) const { return tokens[static_cast<size_t>(type)]; }
+    size_t valueCount(Value::Type type) const { return values[type]; }
+
+    size_t bytesRead;
+    // By internal::TokenType, including the END_OF_FILE.
+    size_t tokens[kTokenTypes];
+    // Values in the result, by Value::Type.
+    size_t values[kValueTypes];
+    // Heap blocks held by those values: one per string, list, object and
+    // long raw number. Buffers inside lists and objects are not counted.
+    size_t allocations;
+    size_t maxDepth;
+    // Heredoc text before unindenting.
+    size_t heredocBytes;
+
+    // Time in the lexer, in merging items into their objects, and in the
+    // rest of the parser.
+    std::uint64_t lexerNanos;
+    std::uint64_t mergeNanos;
+    std::uint64_t parserNanos;
+
+private:
+    explicit ParseStats(int) :
+        bytesRead(0),
+        tokens(),
+        values(),
+        allocations(0),
+        maxDepth(0),
+        heredocBytes(0),
+        lexerNanos(0),
+        mergeNanos(0),
+        parserNanos(0) {}
+};
+#endif
+
+// Resource limits for parsing untrusted input.
+// 0 means unlimited, which is the default for every limit.
+struct ParseOptions {
+    ParseOptions() :
+        maxDepth(0),
+        maxBytes(0),
+        maxNodes(0),
+        maxStringLength(0),
+        schema(nullptr),
+        shape(nullptr),
+        lazyNumbers(false),
+        lazyStrings(false),
+        inlineStrings(false),
+        keyPool(nullptr)
+#ifdef MICROHCL_STATS
+        , stats(nullptr)
+#endif
+    {}
+
+    typedef std::vector<std::string> Path;
+
+    // Maximum nesting of objects and lists. Each block label is a
+    // level, since `a "b" { }` nests as `a { b { } }` does.
+    size_t maxDepth;
+    // Maximum number of bytes read from the input.
+    size_t maxBytes;
+    // Maximum number of Values created, counting the object made for
+    // each block label.
+    size_t maxNodes;
+    // Maximum length of a single string, identifier or heredoc.
+    size_t maxStringLength;
+
+    // When set, the document is checked against it while parsing and
+    // the parse stops at the first violation. Must outlive the parse.
+    const Schema* schema;
+
+    // Sizes from an earlier parse of the same source, used to presize
+    // objects and lists. Must outlive the parse.
+    const ShapeProfile* shape;
+
+    // Keeps numbers as their text, converted on each read. Numbers that
+    // are never read are never converted, and write() puts them out as
+    // they were written. Reading does not change the value, so it may be
+    // read from several threads at once. See Value::rawNumber().
+    bool lazyNumbers;
+
+    // Keeps double quoted strings with escape sequences as written, and
+    // unescapes them on first read, keeping both texts. write() puts
+    // them out as they were written. maxStringLength then applies to the
+    // escaped text. The unescaped text is published atomically, so such
+    // a value may be read from several threads at once.
+    bool lazyStrings;
+
+    // Keeps strings, identifiers and HIL of up to 8 bytes in the Value
+    // itself instead of on the heap. stringData() and asStringView()
+    // read them in place, and as<std::string>() copies them out. Escaped
+    // strings kept by lazyStrings are never inline.
+    bool inlineStrings;
+
+    // With InternedValue, the pool the keys are interned in instead of
+    // one kept by the parser. Keys made from it beforehand then find
+    // children by pointer. Must outlive the parse.
+    KeyPool* keyPool;
+
+    // Lists whose elements are passed to onListElement one at a time as
+    // they are parsed, instead of being kept, for documents holding a
+    // list too large to build. A path is the keys leading to the list:
+    // {"allow"} for `allow = [...]`, and {"firewall", "main", "cidrs"}
+    // for `firewall "main" { cidrs = [...] }`. The list is left empty in
+    // the result. Lists inside lists are never streamed. maxNodes still
+    // counts the streamed elements. Without onListElement, streamedLists
+    // is ignored and the lists are built.
+    std::vector<Path> streamedLists;
+    std::function<void(const Path& path, Value&& element)> onListElement;
+
+#ifdef MICROHCL_STATS
+    // Cleared and filled by each parse. Must outlive the parse.
+    ParseStats* stats;
+#endif
+};
+
+// parse() returns ParseResult, and parse<V>() BasicParseResult<V>.
+template<typename V>
+struct BasicParseResult {
+    BasicParseResult(V v, std::string er, ErrorCode code = ErrorCode::NONE) :
+        value(std::move(v)),
+        errorReason(std::move(er)),
+        errorCode(code) {}
+
+    bool valid() const { return value.valid(); }
+
+    // Profile to pass to the next parse of the same source.
+    ShapeProfile shape() const { return ShapeProfile::of(value); }
+
+    V value;
+    std::string errorReason;
+    ErrorCode errorCode;
+};
+
+typedef BasicParseResult<Value> ParseResult;
+
+// Parses from std::istream.
+ParseResult parse(std::istream&, const ParseOptions& options = ParseOptions());
+// Parses a file.
+ParseResult parseFile(const std::string& filename, const ParseOptions& options = ParseOptions());
+
+// Same as parse() and parseFile(), into a BasicValue with another object
+// policy:
+//
+//   hcl::BasicParseResult<hcl::SortedValue> result = hcl::parse<hcl::SortedValue>(is);
+template<typename V>
+BasicParseResult<V> parse(std::istream&, const ParseOptions& options = ParseOptions());
+template<typename V>
+BasicParseResult<V> parseFile(const std::string& filename, const ParseOptions& options = ParseOptions());
+
+// Tracers get begin() and end() around each phase of parse() and write(),
+// and around each top level item, with the item's keys:
+//
+//   struct MyTracer {
+//       void begin(const char* phase, const std::string* keys, size_t keyCount);
+//       void end(const char* phase);
+//   };
+//
+// parse() has the phases "parse", "item" and "merge", write() has "write"
+// and "item". keyCount is 0 for whole phases. The calls are resolved at
+// compile time, so NullTracer, which everything else parses with, costs
+// nothing.
+struct NullTracer {
+    static NullTracer& instance()
+    {
+        static NullTracer tracer;
+        return tracer;
+    }
+
+    void begin(const char*, const std::string*, size_t) {}
+    void end(const char*) {}
+};
+
+// Records begin() and end() as Chrome trace_event JSON, which
+// chrome://tracing and Perfetto load. Items are named by their keys.
+// Not thread safe.
+class ChromeTracer {
+public:
+    ChromeTracer() : start_(std::chrono::steady_clock::now()) {}
+
+    void begin(const char* phase, const std::string* keys, size_t keyCount);
+    void end(const char* phase);
+
+    size_t size() const { return events_.size(); }
+    void clear() { events_.clear(); }
+
+    // Writes {"traceEvents": [...]}.
+    void writeJSON(std::ostream& os) const;
+
+private:
+    struct Event {
+        bool begin;
+        const char* phase;
+        std::string name;
+        std::uint64_t nanos;
+    };
+
+    std::uint64_t elapsedNanos() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::chrono::steady_clock::time_point start_;
+    std::vector<Event> events_;
+};
+
+// Parses from std::istream, reporting to |tracer|.
+template<typename Tracer>
+ParseResult parse(std::istream&, const ParseOptions& options, Tracer& tracer);
+// Writes |v| as operator<< does, reporting to |tracer|.
+template<typename P, typename Tracer>
+void write(const BasicValue<P>& v, std::ostream& os, Tracer& tracer);
+
+// Parses the JSON syntax of HCL, as in .hcl.json files, into the same
+// Values parse() builds from the native syntax. Objects holding only
+// objects, and lists holding only objects, are read as blocks and merged
+// the same way. null reads as an empty string. The limits in |options|
+// apply; schema, shape and streamedLists are ignored.
+ParseResult parseJSON(const char* data, size_t size, const ParseOptions& options = ParseOptions());
+ParseResult parseJSON(const std::string& buffer, const ParseOptions& options = ParseOptions());
+ParseResult parseJSONFile(const std::string& filename, const ParseOptions& options = ParseOptions());
+
+// validate() returns ValidationResult.
+struct ValidationResult {
+    ValidationResult() : errorReason(nullptr), lineNo(0), columnNo(0) {}
+
+    bool valid() const { return errorReason == nullptr; }
+
+    // Static string describing the first error, nullptr if valid.
+    const char* errorReason;
+    // Start of the token where the first error was found.
+    int lineNo;
+    int columnNo;
+};
+
+// Checks syntax only. Accepts exactly what parse() accepts, but builds
+// no Values and does not allocate. Documents nested deeper than
+// internal::Validator::kMaxDepth are rejected.
+ValidationResult validate(const char* data, size_t size);
+ValidationResult validate(const std::string& buffer);
+
+// decode() returns DecodeResult.
+struct DecodeResult {
+    bool valid() const { return errorReason.empty(); }
+
+    std::string errorReason;
+};
+
+// Lists the fields of a struct for decode(). Specialize it for each
+// struct, or use the MICROHCL_BEGIN_BINDING() macros below.
+//
+//   namespace hcl {
+//   template<> struct Binding<Listener> {
+//       template<typename Fields> static void fields(Fields& f) {
+//           f.required("port", &Listener::port);
+//           f("host", &Listener::host);
+//       }
+//   };
+//   }
+//
+// Only the first 64 fields of a binding can be required.
+template<typename T> struct Binding;
+
+// Decodes a single value into T. Specialized for bool, integer and
+// floating point types, std::string, std::vector, std::unique_ptr,
+// std::optional and maps with std::string keys. Any other type is
+// decoded as a struct through Binding<T>.
+template<typename T, typename Enable = void> struct Decoder;
+
+// Decodes a document straight into |out|, without building Values.
+// T must have a Binding or be a map with std::string keys.
+//
+// Block labels select struct fields or map entries, as they would
+// select nested objects in the parsed Value. Blocks that share their
+// first labels fill the same map, where parse() would expand them into
+// a list. Repeated blocks and list values are appended to std::vector
+// fields. Unknown keys are skipped, and fields missing from the
+// document keep their current value.
+template<typename T> DecodeResult decode(const char* data, size_t size, T& out);
+template<typename T> DecodeResult decode(const std::string& buffer, T& out);
+template<typename T> DecodeResult decodeFile(const std::string& filename, T& out);
+
+// The reverse of Decoder: turns T into a Value. Specialized for the same
+// types. An empty std::unique_ptr or std::optional becomes an invalid
+// Value, and its field is left out of the enclosing object.
+template<typename T, typename Enable = void> struct Encoder;
+
+// Builds a Value from |in|, so that decode(value text, out) gives |in| back.
+template<typename T> Value encode(const T& in);
+
+// Shorthand for a Binding specialization. Use it at global scope.
+//
+//   MICROHCL_BEGIN_BINDING(Listener)
+//       MICROHCL_REQUIRED_FIELD(port)
+//       MICROHCL_FIELD(host)
+//       MICROHCL_FIELD_AS("tls-cert", tlsCert)
+//   MICROHCL_END_BINDING()
+#define MICROHCL_BEGIN_BINDING(Type) \
+    namespace hcl { \
+    template<> struct Binding<Type> { \
+        typedef Type BoundType; \
+        template<typename Fields> static void fields(Fields& f) {
+#define MICROHCL_FIELD(member) f(#member, &BoundType::member);
+#define MICROHCL_FIELD_AS(key, member) f(key, &BoundType::member);
+#define MICROHCL_REQUIRED_FIELD(member) f.required(#member, &BoundType::member);
+#define MICROHCL_REQUIRED_FIELD_AS(key, member) f.required(key, &BoundType::member);
+#define MICROHCL_END_BINDING() } }; }
+
+namespace internal {
+
+enum class TokenType {
+    // Special tokens
+    ILLEGAL,
+    END_OF_FILE,
+    COMMENT,
+
+    IDENT, // literals
+
+    NUMBER,  // 12345
+    FLOAT,   // 123.45
+    BOOL,    // true,false
+    STRING,  // "abc"
+    HIL,     // "${foo(bar)}"
+    HEREDOC, // <<FOO\nbar\nFOO
+
+    LBRACK, // [
+    LBRACE, // {
+    COMMA,  // ,
+    PERIOD, // .
+
+    RBRACK, // ]
+    RBRACE, // }
+
+    ASSIGN, // =
+    ADD,    // +
+    SUB,    // -
+};
+
+#ifdef MICROHCL_STATS
+static_assert(static_cast<size_t>(TokenType::SUB) + 1 == ParseStats::kTokenTypes,
+              "ParseStats::kTokenTypes is out of date");
+
+// Nanoseconds from |start| to now.
+inline std::uint64_t nanosSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+class Token {
+public:
+    explicit Token(TokenType type) : type_(type), escaped_(false) {}
+    Token(TokenType type, const std::string& v, bool escaped = false) : type_(type), str_value_(v), escaped_(escaped) {}
+    Token(TokenType type, bool v) : type_(type), int_value_(v), escaped_(false) {}
+    Token(TokenType type, std::int64_t v) : type_(type), int_value_(v), escaped_(false) {}
+    Token(TokenType type, double v) : type_(type), double_value_(v), escaped_(false) {}
+
+    TokenType type() const { return type_; }
+    const std::string& strValue() const { return str_value_; }
+    // STRING and HIL: strValue() is still escaped, as written.
+    bool escaped() const { return escaped_; }
+    bool boolValue() const { return int_value_ != 0; }
+    std::int64_t intValue() const { return int_value_; }
+    double doubleValue() const { return double_value_; }
+
+private:
+    TokenType type_;
+    std::string str_value_;
+    std::int64_t int_value_;
+    double double_value_;
+    bool escaped_;
+};
+
+class Lexer {
+public:
+    explicit Lexer(std::istream& is, const ParseOptions& options = ParseOptions()) :
+        is_(is),
+        lineNo_(1),
+        columnNo_(0),
+        bytesRead_(0),
+        tokenOffset_(0),
+        maxBytes_(options.maxBytes),
+        maxStringLength_(options.maxStringLength),
+        tokenCount_(0),
+        errorCode_(ErrorCode::NONE),
+        lazyNumbers_(options.lazyNumbers),
+        lazyStrings_(options.lazyStrings) {}
+
+    Token nextToken();
+
+    // Starts over on the same stream, keeping the scratch buffer.
+    void reset();
+
+    int lineNo() const { return lineNo_; }
+    int columnNo() const { return columnNo_; }
+    size_t tokenCount() const { return tokenCount_; }
+    // Bytes read so far, and where the last token started. The UTF8 BOM
+    // is not counted.
+    size_t offset() const { return bytesRead_; }
+    size_t tokenOffset() const { return tokenOffset_; }
+
+    // Set when a ParseOptions limit was hit. Once set, every
+    // following token is ILLEGAL.
+    ErrorCode errorCode() const { return errorCode_; }
+
+    // Skips if UTF8BOM is found.
+    // Returns true if success. Returns false if intermediate state is left.
+    bool skipUTF8BOM();
+
+    bool consume(char c);
+
+private:
+    bool current(char* c);
+    void next();
+
+    Token scanToken();
+    Token limitToken() const;
+    bool checkStringLength(size_t size);
+
+    Token nextValueToken();
+    Token nextNumber(bool leadingDot, bool leadingSub);
+
+    void skipUntilNewLine();
+
+    Token nextStringDoubleQuote();
+    Token nextStringSingleQuote();
+    Token nextHereDoc();
+
+    std::istream& is_;
+    int lineNo_;
+    int columnNo_;
+    size_t bytesRead_;
+    size_t tokenOffset_;
+    size_t maxBytes_;
+    size_t maxStringLength_;
+    size_t tokenCount_;
+    ErrorCode errorCode_;
+    // NUMBER and FLOAT tokens carry their text instead of their value.
+    bool lazyNumbers_;
+    // Double quoted strings with escapes are returned as written.
+    bool lazyStrings_;
+    // Text of the token being scanned.
+    std::string buffer_;
+};
+
+// A token that refers into the scanned buffer instead of owning its text.
+// For STRING and HIL the span excludes the quotes, and escape sequences
+// are left as written; |escaped| is true if there are any. For HEREDOC
+// the span is the whole heredoc including the anchors.
+struct SpanToken {
+    TokenType type;
+    const char* data;
+    size_t size;
+    bool escaped;
+    // Reason for ILLEGAL tokens.
+    const char* error;
+    int lineNo;
+    int columnNo;
+};
+
+// Tokenizes a buffer in place. Produces the same token types as Lexer,
+// but never copies or decodes the token text.
+class Scanner {
+public:
+    Scanner(const char* data, size_t size) :
+        begin_(data),
+        p_(data),
+        end_(data + size),
+        lineNo_(1),
+        columnNo_(0),
+        tokenLineNo_(1),
+        tokenColumnNo_(0) {}
+
+    SpanToken nextToken();
+
+    // Same as Lexer::skipUTF8BOM().
+    bool skipUTF8BOM();
+
+    size_t offset() const { return static_cast<size_t>(p_ - begin_); }
+    int lineNo() const { return lineNo_; }
+    int columnNo() const { return columnNo_; }
+
+private:
+    bool atEnd() const { return p_ == end_; }
+    void next();
+    void skipUntilNewLine();
+
+    SpanToken token(TokenType type, const char* data, size_t size, bool escaped = false) const;
+    SpanToken illegal(const char* reason) const;
+
+    SpanToken scanStringDoubleQuote();
+    SpanToken scanStringSingleQuote();
+    SpanToken scanHereDoc();
+    SpanToken scanValue();
+    SpanToken scanNumber(const char* start);
+
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    int lineNo_;
+    int columnNo_;
+    int tokenLineNo_;
+    int tokenColumnNo_;
+};
+
+// Makes a parser's KeyPool current while it builds objects whose keys
+// are interned, and does nothing for other objects.
+template<typename Map>
+struct KeyScope {
+    explicit KeyScope(KeyPool&) {}
+};
+
+template<typename V>
+struct KeyScope<FlatMap<V, Key>> : KeyPool::Scope {
+    explicit KeyScope(KeyPool& pool) : KeyPool::Scope(pool) {}
+};
+
+// The HCL parser. |Tracer| is told about each phase and top level item;
+// see NullTracer. |V| is the type of the values built.
+template<typename Tracer = NullTracer, typename V = Value>
+class BasicParser {
+public:
+    // The values built, a BasicValue with any object policy.
+    typedef V Value;
+    typedef typename V::List List;
+    typedef typename V::Object Object;
+
+    explicit BasicParser(std::istream& is, const ParseOptions& options = ParseOptions(),
+                         Tracer& tracer = Tracer::instance()) :
+        lexer_(is, options),
+        token_(TokenType::ILLEGAL),
+        options_(options),
+        depth_(0),
+        nodeCount_(0),
+        objectSchema_(options.schema ? options.schema->node() : nullptr),
+        valueSchema_(nullptr),
+        schemaKey_(nullptr),
+        errorCode_(ErrorCode::NONE),
+        path_(ShapeProfile::root()),
+        itemBegin_(0),
+        itemEnd_(0),
+        listDepth_(0)
+#ifdef MICROHCL_STATS
+        , stats_(options.stats)
+#endif
+        , tracer_(tracer)
+    {
+        start();
+    }
+
+    // Starts over on the same stream, which should have been pointed at
+    // new input. Buffers are kept, so parsing many small documents with
+    // one Parser allocates less.
+    void reset();
+
+    // Parses. If failed, value should be invalid value.
+    // You can get the error by calling errorReason().
+    Value parse();
+    const std::string& errorReason();
+    ErrorCode errorCode() const;
+
+    // Step-wise interface for ParseHandle. Parses the next item of the
+    // top level object list into |root|, which is made an object first
+    // if it is invalid. Returns false at the end of input or on error.
+    // Calling this until it returns false is the same as parse().
+    bool parseNextItem(Value& root);
+    size_t tokenCount() const { return lexer_.tokenCount(); }
+
+    // Byte range and keys of the last top level item parsed, for Document.
+    size_t itemBegin() const { return itemBegin_; }
+    size_t itemEnd() const { return itemEnd_; }
+    const std::vector<std::string>& itemKeys() const { return keyBuffers_.front(); }
+
+private:
+    void start();
+
+    const Token& token() const { return token_; }
+    void nextToken();
+    bool consume(char c) { return lexer_.consume(c); }
+    int columnNo() { return lexer_.columnNo(); }
+
+    void skipForKey();
+    void skipForValue();
+
+    bool consumeForKey(TokenType);
+    bool consumeForValue(TokenType);
+    bool consumeEOLorEOFForKey();
+
+    Value parseObjectList(bool);
+    bool parseObjectListItem(Value&);
+    bool parseKeys(std::vector<std::string>&);
+    bool parseObjectItem(Value&);
+    bool parseObject(Value&);
+    bool parseObjectType(Value&);
+    bool parseListType(Value&);
+    bool parseListElements(Value&);
+    bool parseLiteralType(Value&);
+
+    bool enterNesting();
+    void leaveNesting() { --depth_; }
+    bool addNode();
+
+    bool isStreamedList() const;
+    void pushElement(List& list, Value&& element, bool streamed);
+
+    void reserveFromShape(Value& v) const;
+    void reserveMerged(Value& node, const std::vector<std::string>& keys);
+
+    bool checkSchemaKeys(const std::vector<std::string>& keys);
+    bool checkSchemaValue(bool element = false);
+    bool checkSchemaMerge(const Value& node, const std::vector<std::string>& keys, const Value& v);
+    bool checkSchemaRequired(const Value& node);
+
+    void addError(const std::string& reason);
+    void addError(ErrorCode code, const std::string& reason);
+
+    bool unindentHeredoc(const std::string& heredoc, std::string& out);
+
+#ifdef MICROHCL_STATS
+    void mergeObjects(Value& node, const std::vector<std::string>& keys, Value& v);
+    void countValues(const Value& v);
+#else
+    void mergeObjects(Value& node, const std::vector<std::string>& keys, Value& v) { node.mergeObjects(keys, v); }
+#endif
+
+    Lexer lexer_;
+    Token token_;
+    ParseOptions options_;
+    size_t depth_;
+    size_t nodeCount_;
+    // Schema of the object being parsed and of the value about to be
+    // parsed. nullptr means unchecked.
+    const SchemaNode* objectSchema_;
+    const SchemaNode* valueSchema_;
+    // Key of the value about to be parsed, for schema errors.
+    const std::string* schemaKey_;
+    // Keys of the document, when V interns them.
+    KeyPool keys_;
+    ErrorCode errorCode_;
+    std::string errorReason_;
+    // Keys of the item being parsed at each nesting level.
+    std::deque<std::vector<std::string>> keyBuffers_;
+    // ShapeProfile path of the value being parsed. Only kept up to date
+    // when options_.shape is set.
+    ShapeProfile::Path path_;
+    size_t itemBegin_;
+    size_t itemEnd_;
+    // Keys from the root to the value being parsed, and the number of
+    // lists it is in. Only kept up to date when options_.streamedLists
+    // is set.
+    std::vector<std::string> streamPath_;
+    size_t listDepth_;
+#ifdef MICROHCL_STATS
+    ParseStats* stats_;
+#endif
+    Tracer& tracer_;
+};
+
+typedef BasicParser<> Parser;
+
+} // namespace internal
+
+// Parses a document a few top level items at a time, so that a large
+// parse can be interleaved with other work on the same thread.
+// |is| must outlive the handle.
+//
+//   hcl::ParseHandle handle(is);
+//   while (!handle.step(std::chrono::microseconds(500)))
+//       pollEvents();
+//   hcl::ParseResult result = handle.result();
+//
+// The budget is checked between top level items, so a single item
+// larger than the budget is still parsed in one step.
+class ParseHandle {
+public:
+    explicit ParseHandle(std::istream& is, const ParseOptions& options = ParseOptions());
+
+    // Parses until at least |maxTokens| more tokens have been read.
+    // Returns true when parsing is finished.
+    bool step(size_t maxTokens);
+    // Parses until |maxTime| has elapsed. Returns true when parsing is finished.
+    bool step(std::chrono::microseconds maxTime);
+
+    bool done() const { return done_; }
+
+    // Moves the result out of the handle. Only meaningful once done() is true.
+    ParseResult result();
+
+private:
+    template<typename Predicate> bool stepWhile(Predicate budgetLeft);
+
+    // Checked before parser_ is constructed, which starts reading.
+    ErrorCode streamError_;
+    bool done_;
+    internal::Parser parser_;
+    hcl::Value value_;
+};
+
+namespace internal {
+// Reads a buffer in place.
+class MemoryStreambuf : public std::streambuf {
+public:
+    void reset(const char* data, size_t size)
+    {
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + size);
+    }
+};
+} // namespace internal
+
+// Parses many documents one after another with the same Parser, Lexer
+// and stream, keeping their buffers in between. Meant for services that
+// parse lots of small documents.
+//
+//   hcl::ParserContext context;
+//   for (const std::string& document : documents) {
+//       context.reset(document);
+//       hcl::ParseResult result = context.parse();
+//   }
+//
+// Not thread safe; use one context per thread.
+class ParserContext {
+public:
+    explicit ParserContext(const ParseOptions& options = ParseOptions());
+
+    ParserContext(const ParserContext&) = delete;
+    ParserContext& operator=(const ParserContext&) = delete;
+
+    // Points the context at |data|, which is not copied and must stay
+    // alive until parse() returns.
+    void reset(const char* data, size_t size);
+    void reset(const std::string& input) { reset(input.data(), input.size()); }
+
+    ParseResult parse();
+
+private:
+    internal::MemoryStreambuf buffer_;
+    std::istream is_;
+    internal::Parser parser_;
+};
+
+// A parsed document kept together with its text, for editors that
+// reparse after every change. An edit inside a single top level item
+// reparses only that item and splices it into value(). Other edits,
+// such as ones between items or across several of them, and edits that
+// make an item merge differently with its neighbours, parse the whole
+// text again. So do edits to an item holding a heredoc, whose end
+// depends on the text after it, and to an item whose first token
+// touches the one before it.
+//
+//   hcl::Document document(text);
+//   document.edit(offset, length, "replacement");
+//   const hcl::Value& value = document.value();
+//
+// With a schema or maxNodes in |options|, every edit parses the whole
+// text, as both depend on the whole document.
+class Document {
+public:
+    explicit Document(std::string text, const ParseOptions& options = ParseOptions());
+
+    // Replaces |length| bytes at |offset| with |replacement|, then
+    // updates value(). Returns valid().
+    bool edit(size_t offset, size_t length, const std::string& replacement);
+
+    const std::string& text() const { return text_; }
+    const Value& value() const { return value_; }
+    bool valid() const { return value_.valid(); }
+    const std::string& errorReason() const { return errorReason_; }
+    ErrorCode errorCode() const { return errorCode_; }
+
+    // True if the last edit reparsed a single item.
+    bool lastEditIncremental() const { return incremental_; }
+
+private:
+    struct Item {
+        size_t begin;
+        size_t end;
+        std::vector<std::string> keys;
+    };
+
+    void parseAll();
+    bool reparseItem(size_t index, size_t end);
+    bool hasHeredoc(size_t begin, size_t end) const;
+    Value* findBlock(size_t index);
+
+    std::string text_;
+    ParseOptions options_;
+    Value value_;
+    std::string errorReason_;
+    ErrorCode errorCode_;
+    // Top level items in text order. Empty when value_ is invalid.
+    std::vector<Item> items_;
+    // Number of items by first key.
+    std::unordered_map<std::string, size_t> groups_;
+    bool incremental_;
+};
+
+namespace internal {
+class TapeBuilder;
+
+// The distinct keys of a Tape, each kept once in its string buffer.
+class KeyTable {
+public:
+    struct Key {
+        size_t offset;
+        std::uint32_t size;
+        std::uint32_t hash;
+    };
+
+    // Id of |key|, appending it to |strings| if it is new.
+    std::uint32_t intern(const char* key, size_t size, std::string& strings);
+    // Key with |key| as its text, or nullptr.
+    const Key* find(const char* key, size_t size, const std::string& strings) const;
+    const Key& key(std::uint32_t id) const { return keys_[id]; }
+    size_t size() const { return keys_.size(); }
+
+private:
+    enum : std::uint32_t { kNone = 0xFFFFFFFF };
+
+    static std::uint32_t hash(const char* key, size_t size);
+    size_t slot(const char* key, size_t size, std::uint32_t h, const std::string& strings) const;
+    void grow();
+
+    std::vector<Key> keys_;
+    // Open addressing index of |keys_|, at most half full.
+    std::vector<std::uint32_t> slots_;
+};
+
+// One node of a Tape. A list or object is followed by its children, and
+// each child of an object by a KEY node holding its key.
+struct TapeNode {
+    static const std::uint8_t KEY = 0xFF;
+
+    // Value::Type, or KEY.
+    std::uint8_t type;
+    // Length of a string or key, number of children of a list or object.
+    std::uint32_t size;
+    union {
+        bool bool_;
+        std::int64_t int_;
+        double double_;
+        // Strings and keys, into the string buffer of the Tape.
+        size_t offset;
+        // Lists and objects: number of nodes they take up, themselves included.
+        size_t span;
+    };
+};
+} // namespace internal
+
+// A key interned in a Tape. A Tape keeps one copy of each distinct key,
+// so a Symbol from Tape::symbol() finds children by comparing positions
+// instead of text. Only meaningful with the Tape it came from.
+class Symbol {
+public:
+    Symbol() : offset_(0), size_(kInvalid) {}
+
+    // False if the key is nowhere in the Tape.
+    bool valid() const { return size_ != kInvalid; }
+
+private:
+    friend class Tape;
+    friend class ValueRef;
+
+    static const std::uint32_t kInvalid = 0xFFFFFFFF;
+
+    Symbol(size_t offset, std::uint32_t size) : offset_(offset), size_(size) {}
+
+    size_t offset_;
+    std::uint32_t size_;
+};
+
+// A read-only view of a value in a Tape. Cheap to copy; valid as long as
+// the Tape is, even if the Tape is moved.
+class ValueRef {
+public:
+    ValueRef() : node_(nullptr), strings_(nullptr) {}
+
+    class iterator;
+
+    bool valid() const { return node_ != nullptr; }
+    Value::Type type() const { return valid() ? static_cast<Value::Type>(node_->type) : Value::NULL_TYPE; }
+    // Same as Value::size().
+    size_t size() const;
+
+    // bool, int, int64_t, double and std::string, with the same type
+    // checks as Value.
+    template<typename T> bool is() const;
+    template<typename T> T as() const;
+
+    // Child of an object with |key|. Invalid if there is none, or this
+    // is not an object. Unlike Value::find(), |key| is not a path.
+    ValueRef find(const std::string& key) const;
+    // Same, for a key looked up once with Tape::symbol().
+    ValueRef find(const Symbol& key) const;
+    // Element of a list. Invalid if out of range.
+    ValueRef operator[](size_t index) const;
+
+    // Children of a list or object. Empty for other types.
+    iterator begin() const;
+    iterator end() const;
+
+    // Copies the value out of the tape.
+    Value toValue() const;
+
+private:
+    friend class Tape;
+
+    ValueRef(const internal::TapeNode* node, const char* strings) : node_(node), strings_(strings) {}
+
+    std::string str() const { return std::string(strings_ + node_->offset, node_->size); }
+    template<typename T> void typeError() const;
+
+    const internal::TapeNode* node_;
+    const char* strings_;
+};
+
+class ValueRef::iterator {
+public:
+    ValueRef operator*() const { return ValueRef(object_ ? node_ + 1 : node_, strings_); }
+    // Key of the current child of an object.
+    std::string key() const { return std::string(strings_ + node_->offset, node_->size); }
+
+    iterator& operator++();
+    bool operator==(const iterator& rhs) const { return node_ == rhs.node_; }
+    bool operator!=(const iterator& rhs) const { return node_ != rhs.node_; }
+
+private:
+    friend class ValueRef;
+
+    iterator(const internal::TapeNode* node, const char* strings, bool object) :
+        node_(node), strings_(strings), object_(object) {}
+
+    const internal::TapeNode* node_;
+    const char* strings_;
+    bool object_;
+};
+
+// A parsed document as one flat array of nodes plus one buffer of all
+// its strings, for read-only use. Holds the same values parse() would
+// build, merged the same way, without a heap allocation per value. Each
+// distinct key is stored once, however many objects it appears in.
+class Tape {
+public:
+    ValueRef root() const { return nodes_.empty() ? ValueRef() : ValueRef(nodes_.data(), strings_.data()); }
+    size_t nodeCount() const { return nodes_.size(); }
+    // Number of distinct keys.
+    size_t keyCount() const { return keys_.size(); }
+
+    // |key| as a Symbol for ValueRef::find(), to look it up in many
+    // objects without comparing its text each time.
+    Symbol symbol(const std::string& key) const;
+
+private:
+    friend class internal::TapeBuilder;
+
+    std::vector<internal::TapeNode> nodes_;
+    std::string strings_;
+    internal::KeyTable keys_;
+};
+
+// parseTape() returns TapeResult.
+struct TapeResult {
+    bool valid() const { return errorReason.empty(); }
+
+    hcl::Tape tape;
+    std::string errorReason;
+};
+
+// Parses into a Tape. Accepts what parse() accepts, except documents
+// nested deeper than internal::StructDecoder::kMaxDepth or with more than
+// internal::StructDecoder::kMaxKeys keys on an item.
+TapeResult parseTape(const char* data, size_t size);
+TapeResult parseTape(const std::string& buffer);
+
+// ----------------------------------------------------------------------
+// Implementations
+
+inline ParseResult parse(std::istream& is, const ParseOptions& options)
+{
+    return parse<Value>(is, options);
+}
+
+template<typename V>
+inline BasicParseResult<V> parse(std::istream& is, const ParseOptions& options)
+{
+    if (!is) {
+        return BasicParseResult<V>(V(), "stream is in bad state. file does not exist?",
+                                   ErrorCode::IO_ERROR);
+    }
+
+    internal::BasicParser<NullTracer, V> parser(is, options);
+    V v = parser.parse();
+
+    if (v.valid())
+        return BasicParseResult<V>(std::move(v), std::string());
+
+    return BasicParseResult<V>(std::move(v), std::move(parser.errorReason()), parser.errorCode());
+}
+
+template<typename Tracer>
+inline ParseResult parse(std::istream& is, const ParseOptions& options, Tracer& tracer)
+{
+    if (!is) {
+        return ParseResult(hcl::Value(), "stream is in bad state. file does not exist?",
+                           ErrorCode::IO_ERROR);
+    }
+
+    internal::BasicParser<Tracer> parser(is, options, tracer);
+    hcl::Value v = parser.parse();
+
+    if (v.valid())
+        return ParseResult(std::move(v), std::string());
+
+    return ParseResult(std::move(v), std::move(parser.errorReason()), parser.errorCode());
+}
+
+inline void ChromeTracer::begin(const char* phase, const std::string* keys, size_t keyCount)
+{
+    Event event = { true, phase, std::string(), 0 };
+    for (size_t i = 0; i < keyCount; ++i) {
+        if (i)
+            event.name += ' ';
+        event.name += keys[i];
+    }
+    if (event.name.empty())
+        event.name = phase;
+    event.nanos = elapsedNanos();
+    events_.push_back(std::move(event));
+}
+
+inline void ChromeTracer::end(const char* phase)
+{
+    Event event = { false, phase, std::string(), elapsedNanos() };
+    events_.push_back(std::move(event));
+}
+
+inline void ChromeTracer::writeJSON(std::ostream& os) const
+{
+    os << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const Event& event = events_[i];
+        if (i)
+            os << ',';
+        os << "\n{\"ph\":\"" << (event.begin ? 'B' : 'E') << "\",\"cat\":\"" << event.phase << '"';
+        if (event.begin) {
+            os << ",\"name\":\"";
+            for (char c : event.name) {
+                const unsigned char u = static_cast<unsigned char>(c);
+                if (c == '"' || c == '\\') {
+                    os << '\\' << c;
+                } else if (u < 0x20) {
+                    const char* const hex = "0123456789abcdef";
+                    os << "\\u00" << hex[u >> 4] << hex[u & 0xF];
+                } else {
+                    os << c;
+                }
+            }
+            os << '"';
+        }
+        // Microseconds, with the nanoseconds kept as a fraction.
+        std::string fraction = std::to_string(event.nanos % 1000);
+        fraction.insert(0, 3 - fraction.size(), '0');
+        os << ",\"ts\":" << event.nanos / 1000 << '.' << fraction << ",\"pid\":1,\"tid\":1}";
+    }
+    os << "\n]}\n";
+}
+
+inline ParseResult parseFile(const std::string& filename, const ParseOptions& options)
+{
+    return parseFile<Value>(filename, options);
+}
+
+template<typename V>
+inline BasicParseResult<V> parseFile(const std::string& filename, const ParseOptions& options)
+{
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        return BasicParseResult<V>(V(),
+                                   std::string("could not open file: ") + filename,
+                                   ErrorCode::IO_ERROR);
+    }
+
+    return parse<V>(ifs, options);
+}
+
+inline Schema::Schema(Kind kind) :
+    node_(std::make_shared<internal::SchemaNode>(kind))
+{
+}
+
+inline Schema Schema::list(const Schema& element)
+{
+    Schema schema(LIST);
+    schema.node_->element = element.node_;
+    return schema;
+}
+
+inline Schema Schema::block(const Schema& body, std::vector<std::string> labels)
+{
+    Schema schema(BLOCK);
+    schema.node_->element = body.node_;
+    schema.node_->labels = std::move(labels);
+    return schema;
+}
+
+inline Schema& Schema::field(const std::string& key, const Schema& schema)
+{
+    assert(kind() == OBJECT);
+    node_->fields[key] = schema.node_;
+    return *this;
+}
+
+inline Schema& Schema::required(const std::string& key, const Schema& schema)
+{
+    field(key, schema);
+    node_->required.push_back(key);
+    return *this;
+}
+
+inline Schema& Schema::allowUnknownKeys()
+{
+    node_->allowUnknownKeys = true;
+    return *this;
+}
+
+inline Schema::Kind Schema::kind() const
+{
+    return node_->kind;
+}
+
+// static
+inline const char* Schema::kindToString(Kind kind)
+{
+    switch (kind) {
+    case ANY: return "any";
+    case BOOL: return "bool";
+    case INT: return "int";
+    case DOUBLE: return "double";
+    case NUMBER: return "number";
+    case STRING: return "string";
+    case LIST: return "list";
+    case OBJECT: return "object";
+    case BLOCK: return "block";
+    }
+    return "unknown";
+}
+
+// FNV-1a, with a separator byte before each component so that "a" "bc"
+// and "ab" "c" differ.
+inline ShapeProfile::Path ShapeProfile::child(Path parent, const std::string& key)
+{
+    Path h = (parent ^ 0x1f) * 1099511628211ull;
+    for (unsigned char c : key)
+        h = (h ^ c) * 1099511628211ull;
+    return h;
+}
+
+inline ShapeProfile::Path ShapeProfile::element(Path parent)
+{
+    return (parent ^ 0x1e) * 1099511628211ull;
+}
+
+template<typename V>
+inline ShapeProfile ShapeProfile::of(const V& value)
+{
+    ShapeProfile profile;
+    profile.record(value, root());
+    return profile;
+}
+
+inline size_t ShapeProfile::size(Path path) const
+{
+    auto it = sizes_.find(path);
+    return it == sizes_.end() ? 0 : it->second;
+}
+
+template<typename V>
+inline void ShapeProfile::record(const V& value, Path path)
+{
+    typedef typename V::List List;
+    typedef typename V::Object Object;
+
+    if (!value.template is<List>() && !value.template is<Object>())
+        return;
+
+    if (value.size() > 1) {
+        // Lists of objects share one path for their elements; keep the largest.
+        std::uint32_t& size = sizes_[path];
+        size = std::max(size, static_cast<std::uint32_t>(value.size()));
+    }
+
+    if (value.template is<List>()) {
+        const Path elementPath = element(path);
+        for (const auto& e : value.template as<List>())
+            record(e, elementPath);
+    } else {
+        for (const auto& kv : value.template as<Object>())
+            record(kv.second, child(path, kv.first));
+    }
+}
+
+inline ParseHandle::ParseHandle(std::istream& is, const ParseOptions& options) :
+    streamError_(is ? ErrorCode::NONE : ErrorCode::IO_ERROR),
+    done_(!is),
+    parser_(is, options)
+{
+}
+
+template<typename Predicate>
+inline bool ParseHandle::stepWhile(Predicate budgetLeft)
+{
+    while (!done_ && budgetLeft()) {
+        if (!parser_.parseNextItem(value_)) {
+            if (!parser_.errorReason().empty())
+                value_ = Value();
+            done_ = true;
+        }
+    }
+    return done_;
+}
+
+inline bool ParseHandle::step(size_t maxTokens)
+{
+    const size_t limit = parser_.tokenCount() + maxTokens;
+    return stepWhile([&]() { return parser_.tokenCount() < limit; });
+}
+
+inline bool ParseHandle::step(std::chrono::microseconds maxTime)
+{
+    const auto deadline = std::chrono::steady_clock::now() + maxTime;
+    return stepWhile([&]() { return std::chrono::steady_clock::now() < deadline; });
+}
+
+inline ParseResult ParseHandle::result()
+{
+    if (streamError_ != ErrorCode::NONE)
+        return ParseResult(hcl::Value(), "stream is in bad state. file does not exist?", streamError_);
+    if (value_.valid())
+        return ParseResult(std::move(value_), std::string());
+    return ParseResult(std::move(value_), parser_.errorReason(), parser_.errorCode());
+}
+
+inline ParserContext::ParserContext(const ParseOptions& options) :
+    is_(&buffer_),
+    parser_(is_, options)
+{
+}
+
+inline void ParserContext::reset(const char* data, size_t size)
+{
+    buffer_.reset(data, size);
+    is_.clear();
+    parser_.reset();
+}
+
+inline ParseResult ParserContext::parse()
+{
+    hcl::Value v = parser_.parse();
+
+    if (v.valid())
+        return ParseResult(std::move(v), std::string());
+
+    return ParseResult(std::move(v), parser_.errorReason(), parser_.errorCode());
+}
+
+inline std::string format(std::stringstream& ss)
+{
+    return ss.str();
+}
+
+template<typename T, typename... Args>
+std::string format(std::stringstream& ss, T&& t, Args&&... args)
+{
+    ss << std::forward<T>(t);
+    return format(ss, std::forward<Args>(args)...);
+}
+
+#ifdef MICROHCL_NO_EXCEPTIONS
+// Without exceptions, failwith() records the error and returns. The
+// failing operation then returns nullptr, false, an invalid Value or a
+// default constructed T, and the error can be read with lastError().
+
+namespace internal {
+inline std::string& lastErrorSlot()
+{
+    static thread_local std::string error;
+    return error;
+}
+} // namespace internal
+
+// The error of the last failed operation on this thread, until
+// clearError(). Empty if none failed.
+inline const std::string& lastError()
+{
+    return internal::lastErrorSlot();
+}
+
+inline void clearError()
+{
+    internal::lastErrorSlot().clear();
+}
+
+template<typename... Args>
+void failwith(Args&&... args)
+{
+    std::stringstream ss;
+    internal::lastErrorSlot() = format(ss, std::forward<Args>(args)...);
+}
+#else
+template<typename... Args>
+#if defined(_MSC_VER)
+__declspec(noreturn)
+#else
+[[noreturn]]
+#endif
+void failwith(Args&&... args)
+{
+    std::stringstream ss;
+    throw std::runtime_error(format(ss, std::forward<Args>(args)...));
+}
+#endif
+
+namespace internal {
+
+inline std::string removeDelimiter(const std::string& s)
+{
+    std::string r;
+    for (char c : s) {
+        if (c == '_')
+            continue;
+        r += c;
+    }
+    return r;
+}
+
+// Appends |x| encoded as UTF-8. Code points past U+10FFFF are dropped.
+inline void appendCodepoint(std::uint32_t x, std::string& out)
+{
+    if (x <= 0x7FUL) {
+        // 0xxxxxxx
+        out += static_cast<char>(x);
+    } else if (x <= 0x7FFUL) {
+        // 110yyyyx 10xxxxxx
+        out += static_cast<char>(0xC0 | ((x >> 6) & 0x1F));
+        out += static_cast<char>(0x80 | ((x >> 0) & 0x3F));
+    } else if (x <= 0xFFFFUL) {
+        // 1110yyyy 10yxxxxx 10xxxxxx
+        out += static_cast<char>(0xE0 | ((x >> 12) & 0x0F));
+        out += static_cast<char>(0x80 | ((x >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | ((x >> 0) & 0x3F));
+    } else if (x <= 0x10FFFFUL) {
+        // 11110yyy 10yyxxxx 10xxxxxx 10xxxxxx
+        out += static_cast<char>(0xF0 | ((x >> 18) & 0x07));
+        out += static_cast<char>(0x80 | ((x >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((x >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | ((x >> 0) & 0x3F));
+    }
+}
+
+// Reads |size| hex digits, which must have been checked already.
+inline std::uint32_t parseHex(const char* s, size_t size)
+{
+    std::uint32_t x = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const char c = s[i];
+        const std::uint32_t digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        x = (x << 4) | digit;
+    }
+    return x;
+}
+
+inline std::string unescape(const std::string& codepoint)
+{
+    std::string out;
+    const std::uint32_t x = parseHex(codepoint.data(), codepoint.size());
+    // NUL decodes to nothing, as it always has.
+    if (x != 0)
+        appendCodepoint(x, out);
+    return out;
+}
+
+// Decodes the text of a double quoted STRING or HIL token, without the
+// quotes, the same way Lexer::nextStringDoubleQuote() does. |s| must have
+// been accepted by the Scanner.
+inline void unescapeString(const char* s, size_t size, std::string& out)
+{
+    out.clear();
+    out.reserve(size);
+
+    int braces = 0;
+    bool dollar = false;
+    size_t p = 0;
+    while (p < size) {
+        char c = s[p++];
+        if (braces == 0 && dollar && c == '{') {
+            braces++;
+        } else if (braces > 0 && c == '{') {
+            braces++;
+        }
+        if (braces > 0 && c == '}') {
+            braces--;
+        }
+        dollar = false;
+        if (braces == 0 && c == '$') {
+            dollar = true;
+        }
+        if (c == '\\' && p < size) {
+            c = s[p++];
+            switch (c) {
+            case 't': c = '\t'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 'x':
+            case 'u':
+            case 'U': {
+                size_t digits = c == 'x' ? 2 : (c == 'u' ? 4 : 8);
+                digits = std::min(digits, size - p);
+                const std::uint32_t x = parseHex(s + p, digits);
+                if (x != 0)
+                    appendCodepoint(x, out);
+                p += digits;
+                continue;
+            }
+            case '\n':
+                while (p < size && (s[p] == ' ' || s[p] == '\t' || s[p] == '\r' || s[p] == '\n'))
+                    ++p;
+                continue;
+            default:
+                break;
+            }
+        }
+
+        out += c;
+    }
+}
+
+inline const std::string& EscapedString::unescaped() const
+{
+    std::string* string = unescaped_.load(std::memory_order_acquire);
+    if (string)
+        return *string;
+
+    std::string* made = new std::string();
+    unescapeString(text.data(), text.size(), *made);
+    if (unescaped_.compare_exchange_strong(string, made, std::memory_order_acq_rel))
+        return *made;
+    delete made;
+    return *string;
+}
+
+// Returns true if |s| is integer.
+// [+-]?\d+(_\d+)*
+inline bool isInteger(const char* s, size_t size)
+{
+    if (size == 0)
+        return false;
+
+    size_t p = 0;
+    if (s[p] == '+' || s[p] == '-')
+        ++p;
+
+    while (p < size && '0' <= s[p] && s[p] <= '9') {
+        ++p;
+        if (p < size && s[p] == '_') {
+            ++p;
+            if (!(p < size && '0' <= s[p] && s[p] <= '9'))
+                return false;
+        }
+    }
+
+    return p == size;
+}
+
+inline bool isInteger(const std::string& s)
+{
+    return isInteger(s.data(), s.size());
+}
+
+// Returns true if |s| is double.
+// [+-]? (\d+(_\d+)*)? (\.\d+(_\d+)*)? ([eE] [+-]? \d+(_\d+)*)?
+//       1-----------  2-------------  3----------------------
+// 2 or (1 and 3) should exist.
+inline bool isDouble(const char* s, size_t size)
+{
+    if (size == 0)
+        return false;
+
+    size_t p = 0;
+    if (s[p] == '+' || s[p] == '-')
+        ++p;
+
+    bool ok = false;
+    while (p < size && '0' <= s[p] && s[p] <= '9') {
+        ++p;
+        ok = true;
+
+        if (p < size && s[p] == '_') {
+            ++p;
+            if (!(p < size && '0' <= s[p] && s[p] <= '9'))
+                return false;
+        }
+    }
+
+    if (p < size && s[p] == '.')
+        ++p;
+
+    while (p < size && '0' <= s[p] && s[p] <= '9') {
+        ++p;
+        ok = true;
+
+        if (p < size && s[p] == '_') {
+            ++p;
+            if (!(p < size && '0' <= s[p] && s[p] <= '9'))
+                return false;
+        }
+    }
+
+    if (!ok)
+        return false;
+
+    ok = false;
+    if (p < size && (s[p] == 'e' || s[p] == 'E')) {
+        ++p;
+        if (p < size && (s[p] == '+' || s[p] == '-'))
+            ++p;
+        while (p < size && '0' <= s[p] && s[p] <= '9') {
+            ++p;
+            ok = true;
+
+            if (p < size && s[p] == '_') {
+                ++p;
+                if (!(p < size && '0' <= s[p] && s[p] <= '9'))
+                    return false;
+            }
+        }
+        if (!ok)
+            return false;
+    }
+
+    return p == size;
+}
+
+inline bool isDouble(const std::string& s)
+{
+    return isDouble(s.data(), s.size());
+}
+
+// Converts a span accepted by isInteger(). Returns false if it does not
+// fit in int64_t.
+inline bool parseInteger(const char* s, size_t size, std::int64_t* out)
+{
+    size_t p = 0;
+    bool negative = false;
+    if (s[p] == '+' || s[p] == '-') {
+        negative = s[p] == '-';
+        ++p;
+    }
+
+    const std::uint64_t limit = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) + (negative ? 1 : 0);
+    std::uint64_t x = 0;
+    for (; p < size; ++p) {
+        if (s[p] == '_')
+            continue;
+        const std::uint64_t digit = static_cast<std::uint64_t>(s[p] - '0');
+        if (x > (limit - digit) / 10)
+            return false;
+        x = x * 10 + digit;
+    }
+
+    if (negative && x != 0)
+        *out = -static_cast<std::int64_t>(x - 1) - 1;
+    else
+        *out = static_cast<std::int64_t>(x);
+    return true;
+}
+
+// Converts a span accepted by isInteger() or isDouble().
+inline double parseDouble(const char* s, size_t size)
+{
+    char buf[64];
+    std::string large;
+    char* p = buf;
+    if (size >= sizeof(buf)) {
+        large.resize(size + 1);
+        p = &large[0];
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (s[i] != '_')
+            p[n++] = s[i];
+    }
+    p[n] = '\0';
+
+    // strtod() reads the decimal point of the C locale, which the host
+    // program may have made ',' with setlocale(). Such a locale goes
+    // through a stream in the classic locale instead.
+    const char* point = std::localeconv()->decimal_point;
+    if (point[0] == '.' && point[1] == '\0')
+        return std::strtod(p, nullptr);
+
+    struct ClassicStream {
+        ClassicStream() { is.imbue(std::locale::classic()); }
+        std::istringstream is;
+    };
+    static thread_local ClassicStream stream;
+    stream.is.clear();
+    stream.is.str(p);
+    double x = 0;
+    stream.is >> x;
+    return x;
+}
+
+// Converts a string accepted by isInteger(). Out of range values
+// saturate, as reading them from a stream does.
+inline std::int64_t toInteger(const std::string& s)
+{
+    std::int64_t x;
+    if (!parseInteger(s.data(), s.size(), &x)) {
+        std::stringstream ss(removeDelimiter(s));
+        ss >> x;
+    }
+    return x;
+}
+
+// The text of a raw number too long to keep in the Value. It is
+// converted on each read, not cached, so that reading it stays const.
+struct RawNumber {
+    explicit RawNumber(const std::string& text) : text(text) {}
+
+    std::string text;
+};
+
+// static
+inline std::string escapeString(const char* s, size_t size)
+{
+    std::stringstream ss;
+    for (size_t i = 0; i < size; ++i) {
+        switch (s[i]) {
+        case '\n': ss << "\\n"; break;
+        case '\r': ss << "\\r"; break;
+        case '\t': ss << "\\t"; break;
+        case '\"': ss << "\\\""; break;
+        case '\'': ss << "\\\'"; break;
+        case '\\': ss << "\\\\"; break;
+        default: ss << s[i]; break;
+        }
+    }
+
+    return ss.str();
+}
+
+inline std::string escapeString(const std::string& s)
+{
+    return escapeString(s.data(), s.size());
+}
+
+} // namespace internal
+
+// ----------------------------------------------------------------------
+// Lexer
+
+namespace internal {
+
+inline bool Lexer::skipUTF8BOM()
+{
+    // Check [EF, BB, BF]
+
+    int x1 = is_.peek();
+    if (x1 != 0xEF) {
+        // When the first byte is not 0xEF, it's not UTF8 BOM.
+        // Just return true.
+        return true;
+    }
+
+    is_.get();
+    int x2 = is_.get();
+    if (x2 != 0xBB) {
+        return false;
+    }
+
+    int x3 = is_.get();
+    if (x3 != 0xBF) {
+        return false;
+    }
+
+    return true;
+}
+
+inline bool Lexer::current(char* c)
+{
+    int x = is_.peek();
+    if (x == EOF)
+        return false;
+    if (maxBytes_ != 0 && bytesRead_ >= maxBytes_) {
+        // Pretend the input ended here. nextToken() turns this into ILLEGAL.
+        if (errorCode_ == ErrorCode::NONE)
+            errorCode_ = ErrorCode::MAX_BYTES_EXCEEDED;
+        return false;
+    }
+    *c = static_cast<char>(x);
+    return true;
+}
+
+inline void Lexer::next()
+{
+    int x = is_.get();
+    ++bytesRead_;
+    if (x == '\n') {
+        columnNo_ = 0;
+        ++lineNo_;
+    } else {
+        ++columnNo_;
+    }
+}
+
+inline void Lexer::reset()
+{
+    lineNo_ = 1;
+    columnNo_ = 0;
+    bytesRead_ = 0;
+    tokenOffset_ = 0;
+    tokenCount_ = 0;
+    errorCode_ = ErrorCode::NONE;
+}
+
+inline bool Lexer::consume(char c)
+{
+    char x;
+    if (!current(&x))
+        return false;
+    if (x != c)
+        return false;
+    next();
+    return true;
+}
+
+inline bool Lexer::checkStringLength(size_t size)
+{
+    if (maxStringLength_ == 0 || size <= maxStringLength_)
+        return true;
+    if (errorCode_ == ErrorCode::NONE)
+        errorCode_ = ErrorCode::MAX_STRING_LENGTH_EXCEEDED;
+    return false;
+}
+
+inline Token Lexer::nextToken()
+{
+    ++tokenCount_;
+    if (errorCode_ != ErrorCode::NONE)
+        return limitToken();
+
+    Token t = scanToken();
+    if (errorCode_ != ErrorCode::NONE)
+        return limitToken();
+    return t;
+}
+
+inline Token Lexer::limitToken() const
+{
+    switch (errorCode_) {
+    case ErrorCode::MAX_BYTES_EXCEEDED:
+        return Token(TokenType::ILLEGAL, std::string("input exceeds maximum size"));
+    case ErrorCode::MAX_STRING_LENGTH_EXCEEDED:
+        return Token(TokenType::ILLEGAL, std::string("string exceeds maximum length"));
+    default:
+        return Token(TokenType::ILLEGAL, std::string("limit exceeded"));
+    }
+}
+
+inline void Lexer::skipUntilNewLine()
+{
+    char c;
+    while (current(&c)) {
+        if (c == '\n')
+            return;
+        next();
+    }
+}
+
+inline Token Lexer::nextStringDoubleQuote()
+{
+    if (!consume('"'))
+        return Token(TokenType::ILLEGAL, std::string("string didn't start with '\"'"));
+
+    std::string& s = buffer_;
+    s.clear();
+    char c;
+    int braces = 0;
+    bool dollar = false;
+    bool hil = false;
+    bool escaped = false;
+
+    while (current(&c)) {
+        if (!checkStringLength(s.size()))
+            return limitToken();
+        next();
+        if (braces == 0 && dollar && c == '{') {
+            braces++;
+            hil = true;
+        } else if (braces > 0 && c == '{') {
+            braces++;
+        }
+        if (braces > 0 && c == '}') {
+            braces--;
+        }
+        dollar = false;
+        if (braces == 0 && c == '$') {
+            dollar = true;
+        }
+        if (c == '\\') {
+            if (!current(&c))
+                return Token(TokenType::ILLEGAL, std::string("string has unknown escape sequence"));
+            next();
+            escaped = true;
+            const char e = c;
+            switch (c) {
+            case 't': c = '\t'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 'x':
+            case 'u':
+            case 'U': {
+                int size = 0;
+                if (c == 'x') {
+                    size = 2;
+                } else if (c == 'u') {
+                    size = 4;
+                } else if (c == 'U') {
+                    size = 8;
+                }
+                std::string codepoint;
+                for (int i = 0; i < size; ++i) {
+                  if (current(&c) && (('0' <= c && c <= '9') || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f'))) {
+                    codepoint += c;
+                    next();
+                  } else {
+                    return Token(TokenType::ILLEGAL, std::string("string has unknown escape sequence"));
+                  }
+                }
+                if (lazyStrings_) {
+                    s += '\\';
+                    s += e;
+                    s += codepoint;
+                } else {
+                    s += unescape(codepoint);
+                }
+                continue;
+            }
+            case '"': c = '"'; break;
+            case '\'': c = '\''; break;
+            case '\\': c = '\\'; break;
+            case '\n':
+                if (braces == 0) {
+                    return Token(TokenType::ILLEGAL, std::string("literal not terminated"));
+                } else {
+                    if (lazyStrings_)
+                        s += "\\\n";
+                    while (current(&c) && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+                        if (lazyStrings_)
+                            s += c;
+                        next();
+                    }
+                }
+                continue;
+            default:
+                return Token(TokenType::ILLEGAL, std::string("string has unknown escape sequence"));
+            }
+            if (lazyStrings_) {
+                s += '\\';
+                c = e;
+            }
+        } else if (c == '\n' && braces == 0) {
+            return Token(TokenType::ILLEGAL, std::string("found newline while parsing non-HIL string literal"));
+        } else if (c == '"' && braces == 0) {
+            escaped = escaped && lazyStrings_;
+            if (hil)
+                return Token(TokenType::HIL, s, escaped);
+            else
+                return Token(TokenType::STRING, s, escaped);
+        }
+
+        s += c;
+    }
+
+    return Token(TokenType::ILLEGAL, std::string("string didn't end"));
+}
+
+inline Token Lexer::nextStringSingleQuote()
+{
+    if (!consume('\''))
+        return Token(TokenType::ILLEGAL, std::string("string didn't start with '\''?"));
+
+    std::string& s = buffer_;
+    s.clear();
+    char c;
+
+    if (current(&c) && c == '\'') {
+        // OK. It's empty string.
+        next();
+        return Token(TokenType::STRING, std::string());
+    }
+
+    while (current(&c)) {
+        if (!checkStringLength(s.size()))
+            return limitToken();
+        next();
+        if (c == '\'') {
+            return Token(TokenType::STRING, s);
+        } else if (c == '\n') {
+            return Token(TokenType::ILLEGAL, std::string("found newline while parsing string literal"));
+        }
+
+        s += c;
+    }
+
+    return Token(TokenType::ILLEGAL, std::string("string didn't end with '\''?"));
+}
+
+inline bool hasSuffix(const std::string & s, const std::string & suffix) {
+    if(suffix.size() > s.size()) {
+        return false;
+    }
+    return std::mismatch(suffix.rbegin(),suffix.rend(),s.rbegin()).first == suffix.rend();
+}
+
+inline Token Lexer::nextHereDoc()
+{
+    if (!consume('<'))
+        return Token(TokenType::ILLEGAL, std::string("heredoc didn't start with '<<'?"));
+    if (!consume('<'))
+        return Token(TokenType::ILLEGAL, std::string("heredoc didn't start with '<<'?"));
+
+    std::string s("<<");
+    std::string anchor;
+    char c;
+
+    current(&c);
+
+    // Indented heredoc syntax
+    if(c == '-') {
+        s += c;
+        next();
+    }
+
+    while (current(&c) && (isalpha(static_cast<unsigned char>(c)) || isdigit(static_cast<unsigned char>(c)))) {
+        anchor += c;
+        next();
+    }
+
+    if (anchor.size() == 0) {
+        return Token(TokenType::ILLEGAL, std::string("heredoc anchor was empty"));
+    }
+
+    s += anchor;
+
+    if(!current(&c)) {
+        return Token(TokenType::ILLEGAL, std::string("end of file reached"));
+    }
+
+    if(current(&c) && c == '\r') {
+        skipUntilNewLine();
+    }
+
+    if(!current(&c) || (current(&c) && c != '\n')) {
+        return Token(TokenType::ILLEGAL, std::string("invalid characters in heredoc anchor"));
+    }
+
+    s += '\n';
+
+    if(s.size() == 0) {
+        return Token(TokenType::ILLEGAL, std::string("zero-length heredoc anchor"));
+    }
+
+    std::string buffer;
+    std::string line;
+    std::string indentLine;
+
+    while(current(&c)) {
+        if (!checkStringLength(buffer.size() + indentLine.size() + line.size()))
+            return limitToken();
+        next();
+        if (current(&c) && c == '\n') {
+            if (buffer.size() != 0) {
+                buffer += '\n';
+            }
+            buffer += indentLine;
+            buffer += line;
+            indentLine.clear();
+            line.clear();
+        }
+        else if (current(&c) && line.size() == 0 && (c == ' ' || c == '\t')) {
+            indentLine += c;
+        } else if(current(&c)) {
+            line += c;
+        }
+        if (line.compare(anchor) == 0) {
+            buffer += '\n';
+            buffer += indentLine;
+            buffer += line;
+            buffer += '\n';
+            break;
+        }
+    }
+
+    s += buffer;
+
+    if(current(&c)) {
+        next();
+    }
+    return Token(TokenType::HEREDOC, s);
+}
+
+inline bool isValidIdentChar(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || isdigit(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.' || c == ':' || c == '/';
+}
+
+inline Token Lexer::nextValueToken()
+{
+    std::string& s = buffer_;
+    s.clear();
+    char c;
+
+    if (current(&c) && (isalpha(static_cast<unsigned char>(c)) || c == '_')) {
+        s += c;
+        next();
+
+        while (current(&c) && isValidIdentChar(c)) {
+            if (!checkStringLength(s.size() + 1))
+                return limitToken();
+            s += c;
+            next();
+        }
+
+        if (s == "true") {
+            return Token(TokenType::BOOL, true);
+        }
+        if (s == "false") {
+            return Token(TokenType::BOOL, false);
+        }
+        return Token(TokenType::IDENT, s);
+    }
+
+    return nextNumber(false, false);
+}
+
+inline Token Lexer::nextNumber(bool leadingDot, bool leadingSub)
+{
+    std::string& s = buffer_;
+    s.clear();
+    char c;
+
+    if (leadingDot) {
+        s += '.';
+    }
+
+    if (leadingSub) {
+        s += '-';
+    }
+
+    while (current(&c) && (('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+                           c == 'T' || c == 'Z' || c == '_' || c == ':' || c == '-' || c == '+')) {
+        if (!checkStringLength(s.size() + 1))
+            return limitToken();
+        next();
+        s += c;
+    }
+
+    if (isInteger(s)) {
+        if (lazyNumbers_)
+            return Token(TokenType::NUMBER, s);
+        return Token(TokenType::NUMBER, toInteger(s));
+    }
+
+    if (isDouble(s)) {
+        if (lazyNumbers_)
+            return Token(TokenType::FLOAT, s);
+        return Token(TokenType::FLOAT, parseDouble(s.data(), s.size()));
+    }
+
+    return Token(TokenType::ILLEGAL, std::string("Invalid token"));
+}
+
+
+inline bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline Token Lexer::scanToken()
+{
+    char c;
+    while (current(&c)) {
+        if (isWhitespace(c)) {
+            next();
+            continue;
+        }
+
+        if (c == '#') {
+            skipUntilNewLine();
+            continue;
+        }
+
+        tokenOffset_ = bytesRead_;
+        switch (c) {
+        case '=':
+            next();
+            return Token(TokenType::ASSIGN, "=");
+        case '+':
+            next();
+            return Token(TokenType::ADD, "+");
+        case '-':
+            next();
+            if (current(&c) && isdigit(static_cast<unsigned char>(c))) {
+                return nextNumber(false, true);
+            }
+            else {
+                return Token(TokenType::SUB, "-");
+            }
+        case '{':
+            next();
+            return Token(TokenType::LBRACE, "{");
+        case '}':
+            next();
+            return Token(TokenType::RBRACE, "}");
+        case '[':
+            next();
+            return Token(TokenType::LBRACK, "[");
+        case ']':
+            next();
+            return Token(TokenType::RBRACK, "]");
+        case ',':
+            next();
+            return Token(TokenType::COMMA, ",");
+        case '.':
+            next();
+            if(current(&c) && isdigit(static_cast<unsigned char>(c))) {
+                return nextNumber(true, false);
+            }
+            else {
+                return Token(TokenType::PERIOD, ".");
+            }
+        case '\"':
+            return nextStringDoubleQuote();
+        case '\'':
+            return nextStringSingleQuote();
+        case '<':
+            return nextHereDoc();
+        case '/':
+            next();
+            if(current(&c) && c == '/') {
+                skipUntilNewLine();
+                continue;
+            }
+            return Token(TokenType::ILLEGAL, "unterminated comment");
+        default:
+            return nextValueToken();
+        }
+    }
+
+    tokenOffset_ = bytesRead_;
+    return Token(TokenType::END_OF_FILE);
+}
+
+// ----------------------------------------------------------------------
+// Scanner
+//
+// Mirrors the Lexer above character by character, so both accept and
+// reject the same inputs.
+
+inline bool Scanner::skipUTF8BOM()
+{
+    if (atEnd() || static_cast<unsigned char>(*p_) != 0xEF)
+        return true;
+
+    ++p_;
+    if (atEnd() || static_cast<unsigned char>(*p_++) != 0xBB)
+        return false;
+    if (atEnd() || static_cast<unsigned char>(*p_++) != 0xBF)
+        return false;
+
+    return true;
+}
+
+inline void Scanner::next()
+{
+    if (*p_ == '\n') {
+        columnNo_ = 0;
+        ++lineNo_;
+    } else {
+        ++columnNo_;
+    }
+    ++p_;
+}
+
+inline void Scanner::skipUntilNewLine()
+{
+    while (!atEnd() && *p_ != '\n')
+        next();
+}
+
+inline SpanToken Scanner::token(TokenType type, const char* data, size_t size, bool escaped) const
+{
+    SpanToken t;
+    t.type = type;
+    t.data = data;
+    t.size = size;
+    t.escaped = escaped;
+    t.error = nullptr;
+    t.lineNo = tokenLineNo_;
+    t.columnNo = tokenColumnNo_;
+    return t;
+}
+
+inline SpanToken Scanner::illegal(const char* reason) const
+{
+    SpanToken t = token(TokenType::ILLEGAL, p_, 0);
+    t.error = reason;
+    return t;
+}
+
+inline bool isHexDigit(char c)
+{
+    return ('0' <= c && c <= '9') || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f');
+}
+
+inline SpanToken Scanner::scanStringDoubleQuote()
+{
+    next();
+
+    const char* start = p_;
+    int braces = 0;
+    bool dollar = false;
+    bool hil = false;
+    bool escaped = false;
+
+    while (!atEnd()) {
+        char c = *p_;
+        next();
+        if (braces == 0 && dollar && c == '{') {
+            braces++;
+            hil = true;
+        } else if (braces > 0 && c == '{') {
+            braces++;
+        }
+        if (braces > 0 && c == '}') {
+            braces--;
+        }
+        dollar = false;
+        if (braces == 0 && c == '$') {
+            dollar = true;
+        }
+        if (c == '\\') {
+            escaped = true;
+            if (atEnd())
+                return illegal("string has unknown escape sequence");
+            c = *p_;
+            next();
+            switch (c) {
+            case 't':
+            case 'n':
+            case 'r':
+            case '"':
+            case '\'':
+            case '\\':
+                break;
+            case 'x':
+            case 'u':
+            case 'U': {
+                int size = c == 'x' ? 2 : (c == 'u' ? 4 : 8);
+                for (int i = 0; i < size; ++i) {
+                    if (atEnd() || !isHexDigit(*p_))
+                        return illegal("string has unknown escape sequence");
+                    next();
+                }
+                break;
+            }
+            case '\n':
+                if (braces == 0)
+                    return illegal("literal not terminated");
+                while (!atEnd() && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n'))
+                    next();
+                break;
+            default:
+                return illegal("string has unknown escape sequence");
+            }
+        } else if (c == '\n' && braces == 0) {
+            return illegal("found newline while parsing non-HIL string literal");
+        } else if (c == '"' && braces == 0) {
+            size_t size = static_cast<size_t>(p_ - 1 - start);
+            return token(hil ? TokenType::HIL : TokenType::STRING, start, size, escaped);
+        }
+    }
+
+    return illegal("string didn't end");
+}
+
+inline SpanToken Scanner::scanStringSingleQuote()
+{
+    next();
+
+    const char* start = p_;
+    if (!atEnd() && *p_ == '\'') {
+        next();
+        return token(TokenType::STRING, start, 0);
+    }
+
+    while (!atEnd()) {
+        char c = *p_;
+        next();
+        if (c == '\'')
+            return token(TokenType::STRING, start, static_cast<size_t>(p_ - 1 - start));
+        if (c == '\n')
+            return illegal("found newline while parsing string literal");
+    }
+
+    return illegal("string didn't end with '\''?");
+}
+
+inline SpanToken Scanner::scanHereDoc()
+{
+    const char* start = p_;
+    next();
+    if (atEnd() || *p_ != '<')
+        return illegal("heredoc didn't start with '<<'?");
+    next();
+
+    if (!atEnd() && *p_ == '-')
+        next();
+
+    const char* anchor = p_;
+    while (!atEnd() && (isalpha(static_cast<unsigned char>(*p_)) || isdigit(static_cast<unsigned char>(*p_))))
+        next();
+    const size_t anchorSize = static_cast<size_t>(p_ - anchor);
+
+    if (anchorSize == 0)
+        return illegal("heredoc anchor was empty");
+    if (atEnd())
+        return illegal("end of file reached");
+    if (*p_ == '\r')
+        skipUntilNewLine();
+    if (atEnd() || *p_ != '\n')
+        return illegal("invalid characters in heredoc anchor");
+
+    // |line| is the current line without its indentation, as in
+    // Lexer::nextHereDoc(). nullptr means it is still empty.
+    const char* line = nullptr;
+    while (!atEnd()) {
+        next();
+        if (atEnd())
+            break;
+        if (*p_ == '\n') {
+            line = nullptr;
+        } else if (line == nullptr && (*p_ == ' ' || *p_ == '\t')) {
+            // Indentation
+        } else if (line == nullptr) {
+            line = p_;
+        }
+        if (line != nullptr && static_cast<size_t>(p_ + 1 - line) == anchorSize &&
+            std::equal(anchor, anchor + anchorSize, line)) {
+            break;
+        }
+    }
+
+    if (!atEnd())
+        next();
+    return token(TokenType::HEREDOC, start, static_cast<size_t>(p_ - start));
+}
+
+inline SpanToken Scanner::scanValue()
+{
+    const char* start = p_;
+
+    if (isalpha(static_cast<unsigned char>(*p_)) || *p_ == '_') {
+        next();
+        while (!atEnd() && isValidIdentChar(*p_))
+            next();
+
+        const size_t size = static_cast<size_t>(p_ - start);
+        if (size == 4 && std::equal(start, p_, "true"))
+            return token(TokenType::BOOL, start, size);
+        if (size == 5 && std::equal(start, p_, "false"))
+            return token(TokenType::BOOL, start, size);
+        return token(TokenType::IDENT, start, size);
+    }
+
+    return scanNumber(start);
+}
+
+inline SpanToken Scanner::scanNumber(const char* start)
+{
+    while (!atEnd()) {
+        char c = *p_;
+        if (!(('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+              c == 'T' || c == 'Z' || c == '_' || c == ':' || c == '-' || c == '+'))
+            break;
+        next();
+    }
+
+    const size_t size = static_cast<size_t>(p_ - start);
+    if (isInteger(start, size))
+        return token(TokenType::NUMBER, start, size);
+    if (isDouble(start, size))
+        return token(TokenType::FLOAT, start, size);
+
+    return illegal("Invalid token");
+}
+
+inline SpanToken Scanner::nextToken()
+{
+    while (!atEnd()) {
+        const char c = *p_;
+        if (isWhitespace(c)) {
+            next();
+            continue;
+        }
+
+        if (c == '#') {
+            skipUntilNewLine();
+            continue;
+        }
+
+        tokenLineNo_ = lineNo_;
+        tokenColumnNo_ = columnNo_;
+        const char* start = p_;
+
+        switch (c) {
+        case '=':
+            next();
+            return token(TokenType::ASSIGN, start, 1);
+        case '+':
+            next();
+            return token(TokenType::ADD, start, 1);
+        case '-':
+            next();
+            if (!atEnd() && isdigit(static_cast<unsigned char>(*p_)))
+                return scanNumber(start);
+            return token(TokenType::SUB, start, 1);
+        case '{':
+            next();
+            return token(TokenType::LBRACE, start, 1);
+        case '}':
+            next();
+            return token(TokenType::RBRACE, start, 1);
+        case '[':
+            next();
+            return token(TokenType::LBRACK, start, 1);
+        case ']':
+            next();
+            return token(TokenType::RBRACK, start, 1);
+        case ',':
+            next();
+            return token(TokenType::COMMA, start, 1);
+        case '.':
+            next();
+            if (!atEnd() && isdigit(static_cast<unsigned char>(*p_)))
+                return scanNumber(start);
+            return token(TokenType::PERIOD, start, 1);
+        case '"':
+            return scanStringDoubleQuote();
+        case '\'':
+            return scanStringSingleQuote();
+        case '<':
+            return scanHereDoc();
+        case '/':
+            next();
+            if (!atEnd() && *p_ == '/') {
+                skipUntilNewLine();
+                continue;
+            }
+            return illegal("unterminated comment");
+        default:
+            return scanValue();
+        }
+    }
+
+    tokenLineNo_ = lineNo_;
+    tokenColumnNo_ = columnNo_;
+    return token(TokenType::END_OF_FILE, p_, 0);
+}
+
+// static
+inline const char* ValueTypes::typeToString(Type type)
+{
+    switch (type) {
+    case NULL_TYPE:   return "null";
+    case BOOL_TYPE:   return "bool";
+    case INT_TYPE:    return "int";
+    case DOUBLE_TYPE: return "double";
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+        return "string";
+    case LIST_TYPE:  return "list";
+    case OBJECT_TYPE:  return "object";
+    default:          return "unknown";
+    }
+}
+
+// Containers that cannot make room ahead are left as they are.
+template<typename Map>
+inline void reserveObject(Map&, size_t)
+{
+}
+
+template<typename V>
+inline void reserveObject(std::unordered_map<std::string, V>& object, size_t n)
+{
+    object.reserve(n);
+}
+
+template<typename V, typename K>
+inline void reserveObject(FlatMap<V, K>& object, size_t n)
+{
+    object.reserve(n);
+}
+
+template<typename V>
+inline void reserveObject(OpenHashMap<V>& object, size_t n)
+{
+    object.reserve(n);
+}
+} // namespace internal
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>::BasicValue(const BasicValue& v) :
+    type_(v.type_),
+    raw_(v.raw_),
+    escaped_(v.escaped_),
+    inline_(v.inline_)
+{
+    if (raw_) {
+        copyRawNumber(v);
+        return;
+    }
+
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+        copyString(v);
+        break;
+    case LIST_TYPE: list_ = new List(*v.list_); break;
+    case OBJECT_TYPE: object_ = new Object(*v.object_); break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>::BasicValue(BasicValue&& v) noexcept :
+    type_(v.type_),
+    raw_(v.raw_),
+    escaped_(v.escaped_),
+    inline_(v.inline_)
+{
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE:
+    case DOUBLE_TYPE:
+        if (raw_ == kHeapNumber)
+            number_ = v.number_;
+        else if (raw_)
+            std::memcpy(text_, v.text_, sizeof(text_));
+        else if (type_ == INT_TYPE)
+            int_ = v.int_;
+        else
+            double_ = v.double_;
+        break;
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+        if (inline_)
+            std::memcpy(text_, v.text_, sizeof(text_));
+        else if (escaped_)
+            escapedString_ = v.escapedString_;
+        else
+            string_ = v.string_;
+        break;
+    case LIST_TYPE: list_ = v.list_; break;
+    case OBJECT_TYPE: object_ = v.object_; break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+
+    v.type_ = NULL_TYPE;
+    v.raw_ = 0;
+    v.escaped_ = false;
+    v.inline_ = 0;
+    v.null_ = nullptr;
+}
+
+template<typename ObjectPolicy>
+template<typename P>
+inline BasicValue<ObjectPolicy>::BasicValue(const BasicValue<P>& v) :
+    type_(v.type_),
+    raw_(v.raw_),
+    escaped_(v.escaped_),
+    inline_(v.inline_)
+{
+    if (raw_) {
+        copyRawNumber(v);
+        return;
+    }
+
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+        copyString(v);
+        break;
+    case LIST_TYPE:
+        list_ = new List();
+        list_->reserve(v.list_->size());
+        for (const auto& element : *v.list_)
+            list_->emplace_back(element);
+        break;
+    case OBJECT_TYPE:
+        object_ = new Object();
+        internal::reserveObject(*object_, v.object_->size());
+        for (const auto& kv : *v.object_)
+            object_->emplace(kv.first, BasicValue(kv.second));
+        break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>& BasicValue<ObjectPolicy>::operator=(const BasicValue& v)
+{
+    if (this == &v)
+        return *this;
+
+    this->~BasicValue();
+
+    type_ = v.type_;
+    raw_ = v.raw_;
+    escaped_ = v.escaped_;
+    inline_ = v.inline_;
+    if (raw_) {
+        copyRawNumber(v);
+        return *this;
+    }
+
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+        copyString(v);
+        break;
+    case LIST_TYPE: list_ = new List(*v.list_); break;
+    case OBJECT_TYPE: object_ = new Object(*v.object_); break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+
+    return *this;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>& BasicValue<ObjectPolicy>::operator=(BasicValue&& v) noexcept
+{
+    if (this == &v)
+        return *this;
+
+    this->~BasicValue();
+
+    type_ = v.type_;
+    raw_ = v.raw_;
+    escaped_ = v.escaped_;
+    inline_ = v.inline_;
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE:
+    case DOUBLE_TYPE:
+        if (raw_ == kHeapNumber)
+            number_ = v.number_;
+        else if (raw_)
+            std::memcpy(text_, v.text_, sizeof(text_));
+        else if (type_ == INT_TYPE)
+            int_ = v.int_;
+        else
+            double_ = v.double_;
+        break;
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+        if (inline_)
+            std::memcpy(text_, v.text_, sizeof(text_));
+        else if (escaped_)
+            escapedString_ = v.escapedString_;
+        else
+            string_ = v.string_;
+        break;
+    case LIST_TYPE: list_ = v.list_; break;
+    case OBJECT_TYPE: object_ = v.object_; break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+
+    v.type_ = NULL_TYPE;
+    v.raw_ = 0;
+    v.escaped_ = false;
+    v.inline_ = 0;
+    v.null_ = nullptr;
+    return *this;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>::~BasicValue()
+{
+    if (raw_ == kHeapNumber) {
+        delete number_;
+        return;
+    }
+
+    switch (type_) {
+    case STRING_TYPE:
+    case IDENT_TYPE:
+    case HIL_TYPE:
+#ifdef MICROHCL_COMPACT_VALUE
+        if (inline_ == kStringBlock)
+            internal::StringBlock::destroy(block_);
+#endif
+        if (escaped_)
+            delete escapedString_;
+        else if (!inline_)
+            delete string_;
+        break;
+    case LIST_TYPE:
+        delete list_;
+        break;
+    case OBJECT_TYPE:
+        delete object_;
+        break;
+    default:
+        break;
+    }
+}
+
+template<typename ObjectPolicy>
+inline size_t BasicValue<ObjectPolicy>::size() const
+{
+    switch (type_) {
+    case NULL_TYPE:
+        return 0;
+    case LIST_TYPE:
+        return list_->size();
+    case OBJECT_TYPE:
+        return object_->size();
+    default:
+        return 1;
+    }
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::empty() const
+{
+    return size() == 0;
+}
+
+template<typename ObjectPolicy>
+inline void BasicValue<ObjectPolicy>::reserve(size_t n)
+{
+    switch (type_) {
+    case LIST_TYPE:
+        list_->reserve(n);
+        break;
+    case OBJECT_TYPE:
+        internal::reserveObject(*object_, n);
+        break;
+    default:
+        break;
+    }
+}
+
+namespace internal {
+// What failed operator[]s return a reference to when failwith() does not
+// throw. Writes to it are lost.
+template<typename V>
+inline V& detachedValue()
+{
+    static thread_local V value;
+    value = V();
+    return value;
+}
+
+// What failed as<T>() and get<T>() return when failwith() does not
+// throw.
+template<typename T>
+inline const T& emptyValue()
+{
+    static const T empty = T();
+    return empty;
+}
+
+template<typename V> struct ValueConverter<V, bool>
+{
+    static const char* name() { return "bool"; }
+    bool is(const V& v) { return v.type() == V::BOOL_TYPE; }
+    bool to(const V& v) { return v.template assureType<bool>() ? v.bool_ : false; }
+};
+template<typename V> struct ValueConverter<V, int64_t>
+{
+    static const char* name() { return "int64_t"; }
+    bool is(const V& v) { return v.type() == V::INT_TYPE; }
+    int64_t to(const V& v) { return v.template assureType<int64_t>() ? v.intValue() : 0; }
+};
+template<typename V> struct ValueConverter<V, int>
+{
+    static const char* name() { return "int"; }
+    bool is(const V& v) { return v.type() == V::INT_TYPE; }
+    int to(const V& v) { return v.template assureType<int>() ? static_cast<int>(v.intValue()) : 0; }
+};
+template<typename V> struct ValueConverter<V, double>
+{
+    static const char* name() { return "double"; }
+    bool is(const V& v) { return v.type() == V::DOUBLE_TYPE; }
+    double to(const V& v) { return v.template assureType<double>() ? v.doubleValue() : 0.0; }
+};
+template<typename V> struct ValueConverter<V, std::string>
+{
+    static const char* name() { return "string"; }
+    bool is(const V& v) { return v.isString(); }
+    std::string to(const V& v) { return v.template assureType<std::string>() ? v.stringValue() : std::string(); }
+};
+template<typename P> struct ValueConverter<BasicValue<P>, std::vector<BasicValue<P>>>
+{
+    typedef BasicValue<P> V;
+    static const char* name() { return "list"; }
+    bool is(const V& v) { return v.type() == V::LIST_TYPE; }
+    const typename V::List& to(const V& v) { return v.template assureType<typename V::List>() ? *v.list_ : emptyValue<typename V::List>(); }
+};
+template<typename P> struct ValueConverter<BasicValue<P>, typename BasicValue<P>::Object>
+{
+    typedef BasicValue<P> V;
+    static const char* name() { return "object"; }
+    bool is(const V& v) { return v.type() == V::OBJECT_TYPE; }
+    const typename V::Object& to(const V& v) { return v.template assureType<typename V::Object>() ? *v.object_ : emptyValue<typename V::Object>(); }
+};
+
+template<typename V, typename T>
+struct ValueConverter<V, std::vector<T>>
+{
+    static const char* name() { return "list"; }
+
+    bool is(const V& v)
+    {
+        if (v.type() != V::LIST_TYPE)
+            return false;
+        const typename V::List& list = v.template as<typename V::List>();
+        if (list.empty())
+            return true;
+        return list.front().template is<T>();
+    }
+
+    std::vector<T> to(const V& v)
+    {
+        const typename V::List& list = v.template as<typename V::List>();
+        if (list.empty() || !list.front().template assureType<T>())
+            return std::vector<T>();
+
+        std::vector<T> result;
+        for (const auto& element : list) {
+            result.push_back(element.template as<T>());
+        }
+
+        return result;
+    }
+};
+} // namespace internal
+
+template<typename ObjectPolicy>
+template<typename T>
+inline bool BasicValue<ObjectPolicy>::assureType() const
+{
+    if (!is<T>()) {
+        failwith("type error: this value is ", typeToString(type_), " but ", internal::ValueConverter<BasicValue, T>::name(), " was requested");
+        return false;
+    }
+    return true;
+}
+
+template<typename ObjectPolicy>
+template<typename T>
+inline bool BasicValue<ObjectPolicy>::is() const
+{
+    return internal::ValueConverter<BasicValue, T>().is(*this);
+}
+
+template<typename ObjectPolicy>
+template<typename T>
+inline typename call_traits<T>::return_type BasicValue<ObjectPolicy>::as() const
+{
+    return internal::ValueConverter<BasicValue, T>().to(*this);
+}
+
+template<typename ObjectPolicy>
+template<typename T>
+inline bool BasicValue<ObjectPolicy>::tryAs(T& out) const
+{
+    if (!is<T>())
+        return false;
+    out = as<T>();
+    return true;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::isNumber() const
+{
+    return is<int>() || is<double>();
+}
+
+// static
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy> BasicValue<ObjectPolicy>::rawNumber(const std::string& text)
+{
+    if (internal::isInteger(text))
+        return makeRawNumber(INT_TYPE, text);
+    if (internal::isDouble(text))
+        return makeRawNumber(DOUBLE_TYPE, text);
+
+    failwith("not a number: ", text);
+    return BasicValue();
+}
+
+// static
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy> BasicValue<ObjectPolicy>::makeRawNumber(Type type, const std::string& text)
+{
+    BasicValue v;
+    v.type_ = type;
+    if (text.size() <= sizeof(v.text_)) {
+        v.raw_ = static_cast<std::uint8_t>(text.size());
+        std::memcpy(v.text_, text.data(), text.size());
+    } else {
+        v.raw_ = kHeapNumber;
+        v.number_ = new internal::RawNumber(text);
+    }
+    return v;
+}
+
+template<typename ObjectPolicy>
+template<typename P>
+inline void BasicValue<ObjectPolicy>::copyRawNumber(const BasicValue<P>& v)
+{
+    if (raw_ == kHeapNumber)
+        number_ = new internal::RawNumber(*v.number_);
+    else
+        std::memcpy(text_, v.text_, sizeof(text_));
+}
+
+template<typename ObjectPolicy>
+inline const char* BasicValue<ObjectPolicy>::rawText() const
+{
+    return raw_ == kHeapNumber ? number_->text.data() : text_;
+}
+
+template<typename ObjectPolicy>
+inline size_t BasicValue<ObjectPolicy>::rawSize() const
+{
+    return raw_ == kHeapNumber ? number_->text.size() : raw_;
+}
+
+template<typename ObjectPolicy>
+inline int64_t BasicValue<ObjectPolicy>::intValue() const
+{
+    if (!raw_)
+        return int_;
+    std::int64_t x;
+    if (!internal::parseInteger(rawText(), rawSize(), &x))
+        x = internal::toInteger(std::string(rawText(), rawSize()));
+    return x;
+}
+
+template<typename ObjectPolicy>
+inline double BasicValue<ObjectPolicy>::doubleValue() const
+{
+    if (!raw_)
+        return double_;
+    return internal::parseDouble(rawText(), rawSize());
+}
+
+// static
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy> BasicValue<ObjectPolicy>::makeInlineString(Type type, const std::string& text)
+{
+    BasicValue v;
+    v.type_ = type;
+    if (text.size() <= sizeof(v.text_)) {
+        v.inline_ = static_cast<std::uint8_t>(text.size() + 1);
+        std::memcpy(v.text_, text.data(), text.size());
+    } else {
+        v = BasicValue(text);
+        v.type_ = type;
+    }
+    return v;
+}
+
+// static
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy> BasicValue<ObjectPolicy>::makeEscapedString(Type type, const std::string& text)
+{
+    BasicValue v;
+    v.type_ = type;
+    v.escaped_ = true;
+    v.escapedString_ = new internal::EscapedString(text);
+    return v;
+}
+
+template<typename ObjectPolicy>
+template<typename P>
+inline void BasicValue<ObjectPolicy>::copyString(const BasicValue<P>& v)
+{
+#ifdef MICROHCL_COMPACT_VALUE
+    if (inline_ == kStringBlock) {
+        block_ = internal::StringBlock::copy(*v.block_);
+        return;
+    }
+#endif
+    if (inline_)
+        std::memcpy(text_, v.text_, sizeof(text_));
+    else if (escaped_)
+        escapedString_ = new internal::EscapedString(*v.escapedString_);
+    else
+        string_ = new std::string(*v.string_);
+}
+
+template<typename ObjectPolicy>
+inline const char* BasicValue<ObjectPolicy>::stringText() const
+{
+#ifdef MICROHCL_COMPACT_VALUE
+    if (inline_ == kStringBlock)
+        return block_->data();
+#endif
+    if (escaped_)
+        return escapedString_->unescaped().data();
+    return inline_ ? text_ : string_->data();
+}
+
+template<typename ObjectPolicy>
+inline size_t BasicValue<ObjectPolicy>::stringTextSize() const
+{
+#ifdef MICROHCL_COMPACT_VALUE
+    if (inline_ == kStringBlock)
+        return block_->size();
+#endif
+    if (escaped_)
+        return escapedString_->unescaped().size();
+    return inline_ ? inline_ - 1 : string_->size();
+}
+
+template<typename ObjectPolicy>
+inline std::string BasicValue<ObjectPolicy>::stringValue() const
+{
+    return std::string(stringText(), stringTextSize());
+}
+
+template<typename ObjectPolicy>
+inline const char* BasicValue<ObjectPolicy>::stringData() const
+{
+    if (!assureType<std::string>())
+        return "";
+    return stringText();
+}
+
+template<typename ObjectPolicy>
+inline size_t BasicValue<ObjectPolicy>::stringSize() const
+{
+    if (!assureType<std::string>())
+        return 0;
+    return stringTextSize();
+}
+
+template<typename ObjectPolicy>
+inline double BasicValue<ObjectPolicy>::asNumber() const
+{
+    if (is<int>())
+        return as<int>();
+    if (is<double>())
+        return as<double>();
+
+    failwith("type error: this value is ", typeToString(type_), " but number is requested");
+    return 0.0;
+}
+
+template<typename ObjectPolicy>
+inline typename BasicValue<ObjectPolicy>::StringType BasicValue<ObjectPolicy>::getStringType() const
+{
+    if (!is<std::string>()) {
+        failwith("type must be string to use setStringType(type).");
+        return StringType::Normal;
+    }
+
+    switch (type_) {
+    case STRING_TYPE:
+        return StringType::Normal;
+    case IDENT_TYPE:
+        return StringType::Ident;
+    case HIL_TYPE:
+        return StringType::Hil;
+    default:
+        assert(0);
+        return StringType::Normal;
+    }
+}
+
+template<typename ObjectPolicy>
+inline void BasicValue<ObjectPolicy>::setStringType(StringType type)
+{
+    if (!is<std::string>()) {
+        failwith("type must be string to use setStringType(type).");
+        return;
+    }
+
+    switch (type) {
+    case StringType::Normal:
+        type_ = STRING_TYPE;
+        break;
+    case StringType::Ident:
+        type_ = IDENT_TYPE;
+        break;
+    case StringType::Hil:
+        type_ = HIL_TYPE;
+        break;
+    default:
+        assert(0);
+    }
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::isString() const
+{
+    return type_ == STRING_TYPE || type_ == IDENT_TYPE || type_ == HIL_TYPE;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::isIdent() const
+{
+    return getStringType() == StringType::Ident;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::isHil() const
+{
+    return getStringType() == StringType::Hil;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::equals(const BasicValue& rhs) const
+{
+    const BasicValue& lhs = *this;
+    if (lhs.type() != rhs.type()) {
+        if (!lhs.isString() && !rhs.isString()) {
+            return false;
+        }
+    }
+
+    switch (lhs.type()) {
+    case BasicValue::Type::NULL_TYPE:
+        return true;
+    case BasicValue::Type::BOOL_TYPE:
+        return lhs.bool_ == rhs.bool_;
+    case BasicValue::Type::INT_TYPE:
+        return lhs.intValue() == rhs.intValue();
+    case BasicValue::Type::DOUBLE_TYPE:
+        return lhs.doubleValue() == rhs.doubleValue();
+    case BasicValue::Type::STRING_TYPE:
+    case BasicValue::Type::IDENT_TYPE:
+    case BasicValue::Type::HIL_TYPE:
+        return lhs.stringSize() == rhs.stringSize() &&
+               std::memcmp(lhs.stringData(), rhs.stringData(), lhs.stringSize()) == 0;
+    case BasicValue::Type::LIST_TYPE:
+        return *lhs.list_ == *rhs.list_;
+    case BasicValue::Type::OBJECT_TYPE:
+        return *lhs.object_ == *rhs.object_;
+    default:
+        failwith("unknown type");
+        return false;
+    }
+}
+
+template<typename ObjectPolicy>
+inline std::string BasicValue<ObjectPolicy>::spaces(int num)
+{
+    if (num <= 0)
+        return std::string();
+
+    return std::string(num, ' ');
+}
+
+template<typename ObjectPolicy>
+inline std::string BasicValue<ObjectPolicy>::escapeKey(const std::string& key)
+{
+    auto position = std::find_if(key.begin(), key.end(), [](char c) -> bool {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')
+            return false;
+        return true;
+    });
+
+    if (position != key.end()) {
+        std::string escaped = "\"";
+        for (const char& c : key) {
+            if (c == '\\' || c  == '"')
+                escaped += '\\';
+            escaped += c;
+        }
+        escaped += "\"";
+
+        return escaped;
+    }
+
+    return key;
+}
+
+template<typename ObjectPolicy>
+inline void BasicValue<ObjectPolicy>::write(std::ostream* os, const std::string& keyPrefix, int indent) const
+{
+    if (raw_) {
+        os->write(rawText(), rawSize());
+        return;
+    }
+
+    switch (type_) {
+    case NULL_TYPE:
+        failwith("null type value is not a valid value");
+        break;
+    case BOOL_TYPE:
+        (*os) << (bool_ ? "true" : "false");
+        break;
+    case INT_TYPE:
+        (*os) << int_;
+        break;
+    case DOUBLE_TYPE: {
+        (*os) << std::fixed << std::showpoint << double_;
+        break;
+    }
+    case STRING_TYPE:
+    case HIL_TYPE:
+        (*os) << '"';
+        if (escaped_)
+            os->write(escapedString_->text.data(), escapedString_->text.size());
+        else
+            (*os) << internal::escapeString(stringData(), stringSize());
+        (*os) << '"';
+        break;
+    case IDENT_TYPE:
+        (*os) << internal::escapeString(stringData(), stringSize());
+        break;
+    case LIST_TYPE:
+        (*os) << '[';
+        for (size_t i = 0; i < list_->size(); ++i) {
+            if (i)
+                (*os) << ", ";
+            (*list_)[i].write(os, keyPrefix, -1);
+        }
+        (*os) << ']';
+        break;
+    case OBJECT_TYPE:
+        writeObject(os, keyPrefix, indent, NullTracer::instance());
+        break;
+    default:
+        failwith("writing unknown type");
+        break;
+    }
+}
+
+template<typename ObjectPolicy>
+template<typename Tracer>
+inline void BasicValue<ObjectPolicy>::writeObject(std::ostream* os, const std::string& keyPrefix, int indent, Tracer& tracer) const
+{
+    for (const auto& kv : *object_) {
+        if (kv.second.template is<Object>())
+            continue;
+        if (kv.second.template is<List>() && kv.second.size() > 0 && kv.second.find(0)->template is<Object>())
+            continue;
+        tracer.begin("item", &static_cast<const std::string&>(kv.first), 1);
+        (*os) << spaces(indent) << escapeKey(kv.first) << " = ";
+        kv.second.write(os, keyPrefix, indent + 4);
+        (*os) << '\n';
+        tracer.end("item");
+    }
+    for (const auto& kv : *object_) {
+        if (!kv.second.template is<Object>() &&
+            !(kv.second.template is<List>() && kv.second.size() > 0 && kv.second.find(0)->template is<Object>()))
+            continue;
+        tracer.begin("item", &static_cast<const std::string&>(kv.first), 1);
+        if (kv.second.template is<Object>()) {
+            std::string key;
+
+            key += escapeKey(kv.first);
+            (*os) << spaces(indent) << key << " {\n";
+            kv.second.write(os, key, indent + 4);
+            (*os) << spaces(indent) << "}\n";
+        }
+        if (kv.second.template is<List>() && kv.second.size() > 0 && kv.second.find(0)->template is<Object>()) {
+            std::string key;
+
+            key += escapeKey(kv.first);
+            (*os) << spaces(indent) << key << " = [";
+            for (const auto& v : kv.second.template as<List>()) {
+                if(v.template is<Object>())
+                    (*os) << "\n" << spaces(indent + 4) << "{";
+                else
+                    (*os) << spaces(indent);
+                v.write(os, key, indent + 4);
+                if(v.template is<Object>())
+                    (*os) << "},\n";
+            }
+            (*os) << spaces(indent) << "]\n";
+        }
+        tracer.end("item");
+    }
+}
+
+template<typename P, typename Tracer>
+inline void write(const BasicValue<P>& v, std::ostream& os, Tracer& tracer)
+{
+    tracer.begin("write", nullptr, 0);
+    if (v.template is<typename BasicValue<P>::Object>())
+        v.writeObject(&os, std::string(), -1, tracer);
+    else
+        v.write(&os);
+    tracer.end("write");
+}
+
+template<typename ObjectPolicy>
+template<typename T>
+inline typename call_traits<T>::return_type BasicValue<ObjectPolicy>::get(const std::string& key) const
+{
+    if (!is<Object>()) {
+        failwith("type must be object to do get(key).");
+        return internal::emptyValue<T>();
+    }
+
+    const BasicValue* obj = find(key);
+    if (!obj) {
+        failwith("key ", key, " was not found.");
+        return internal::emptyValue<T>();
+    }
+
+    return obj->as<T>();
+}
+
+template<typename ObjectPolicy>
+template<typename T>
+inline bool BasicValue<ObjectPolicy>::tryGet(const std::string& key, T& out) const
+{
+    const BasicValue* v = find(key);
+    return v && v->tryAs(out);
+}
+
+template<typename ObjectPolicy>
+inline const BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::find(const std::string& key) const
+{
+    if (!is<Object>())
+        return nullptr;
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    const BasicValue* current = this;
+    while (true) {
+        internal::Token t = lexer.nextToken();
+        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
+            return nullptr;
+
+        std::string part = t.strValue();
+        t = lexer.nextToken();
+        //if (t.type() == internal::TokenType::PERIOD) {
+        //    current = current->findChild(part);
+        //    if (!current || !current->is<Object>())
+        //        return nullptr;
+        //} else
+        if (t.type() == internal::TokenType::END_OF_FILE) {
+            return current->findChild(part);
+        } else {
+            return nullptr;
+        }
+    }
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::find(const std::string& key)
+{
+    return const_cast<BasicValue*>(const_cast<const BasicValue*>(this)->find(key));
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::sharesKeyWith(const BasicValue& v) const
+{
+    if (this == &v)
+        return true;
+    if (!is<Object>() || !v.is<Object>())
+        return false;
+
+    for (const auto& kv : *v.object_) {
+        if (object_->find(kv.first) != object_->end()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::merge(const BasicValue& v)
+{
+    if (this == &v)
+        return true;
+    if (!is<Object>() || !v.is<Object>())
+        return false;
+
+    // Works on the maps directly, so InternedValue keeps its Keys.
+    for (const auto& kv : *v.object_) {
+        auto it = object_->find(kv.first);
+        if (it == object_->end()) {
+            object_->emplace(kv.first, kv.second);
+        } else if (it->second.template is<Object>() && kv.second.template is<Object>()) {
+            // If both are object, we merge them.
+            if (!it->second.merge(kv.second))
+                return false;
+        } else {
+            it->second = kv.second;
+        }
+    }
+
+    return true;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::mergeObjects(const std::vector<std::string>& keys, BasicValue& added)
+{
+    if(keys.size() == 0) {
+        return false;
+    }
+
+    // Keys are looked up as they are, not as paths: they come straight
+    // from the parser and may contain anything a quoted key can.
+    if (keys.size() > 1) {
+        BasicValue parent((Object()));
+        BasicValue* ptr = &parent;
+        for (auto key = keys.begin() + 1; key < keys.end(); key++) {
+            if (key + 1 == keys.end()) {
+                ptr->setChild(*key, std::move(added));
+            } else {
+                ptr = ptr->setChild(*key, Object());
+            }
+        }
+        added = std::move(parent);
+    }
+    BasicValue* existing = findChild(keys.front());
+    bool expand = false;
+    if(existing)  {
+        if (existing->is<List>()) {
+            // This is an object list. Add the object.
+            existing->push(std::move(added));
+        } else {
+            // We tried assigning to a value that exists already.
+            // First, attempt to see if this is an object.
+            if (existing->is<Object>()) {
+                if (!added.is<Object>()) {
+                    // We tried assigning a non-object to an existing object.
+                    // Expand it into a list.
+                    expand = true;
+                } else {
+                    // If the objects share any keys (not nested),
+                    // expand into a list. Else, merge the two
+                    // objects.
+                    if (existing->sharesKeyWith(added)) {
+                        expand = true;
+                    } else {
+                        // No shared keys, so merging is moving the children over.
+                        for (auto& kv : *added.object_)
+                            existing->object_->emplace(kv.first, std::move(kv.second));
+                    }
+                }
+            } else {
+                // We tried assigning something to a non-object.
+                // Expand it into a list.
+                expand = true;
+            }
+            // Upgrade it to a list.
+            if(expand)
+            {
+                BasicValue l((List()));
+                l.push(std::move(*existing));
+                l.push(std::move(added));
+                *existing = std::move(l);
+            }
+        }
+    } else {
+        setChild(keys.front(), std::move(added));
+    }
+
+    return true;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::set(const std::string& key, const BasicValue& v)
+{
+    BasicValue* result = ensureValue(key);
+    *result = v;
+    return result;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::setChild(size_t index, const BasicValue& v)
+{
+    if (!valid())
+        *this = BasicValue((List()));
+
+    if (!is<List>()) {
+        failwith("type must be list to do set(key, v).");
+        return nullptr;
+    }
+
+    (*list_)[index] = v;
+    return &(*list_)[index];
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::setChild(size_t index, BasicValue&& v)
+{
+    if (!valid())
+        *this = BasicValue((List()));
+
+    if (!is<List>()) {
+        failwith("type must be object to do set(key, v).");
+        return nullptr;
+    }
+
+    (*list_)[index] = std::move(v);
+    return &(*list_)[index];
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::setChild(const std::string& key, const BasicValue& v)
+{
+    if (!valid())
+        *this = BasicValue((Object()));
+
+    if (!is<Object>()) {
+        failwith("type must be object to do set(key, v).");
+        return nullptr;
+    }
+
+    (*object_)[key] = v;
+    return &(*object_)[key];
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::setChild(const std::string& key, BasicValue&& v)
+{
+    if (!valid())
+        *this = BasicValue((Object()));
+
+    if (!is<Object>()) {
+        failwith("type must be object to do set(key, v).");
+        return nullptr;
+    }
+
+    BasicValue& child = (*object_)[key];
+    child = std::move(v);
+    return &child;
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::erase(const std::string& key)
+{
+    if (!is<Object>())
+        return false;
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    BasicValue* current = this;
+    while (true) {
+        internal::Token t = lexer.nextToken();
+        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
+            return false;
+
+        std::string part = t.strValue();
+        t = lexer.nextToken();
+        if (t.type() == internal::TokenType::PERIOD) {
+            current = current->findChild(part);
+            if (!current || !current->is<Object>())
+                return false;
+        } else if (t.type() == internal::TokenType::END_OF_FILE) {
+            return current->eraseChild(part);
+        } else {
+            return false;
+        }
+    }
+}
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::eraseChild(const std::string& key)
+{
+    if (!is<Object>()) {
+        failwith("type must be object to do erase(key).");
+        return false;
+    }
+
+    return object_->erase(key) > 0;
+}
+
+namespace internal {
+template<typename Map>
+inline void renameChild(Map& object, typename Map::iterator it, const std::string& to)
+{
+    typename Map::mapped_type v = std::move(it->second);
+    object.erase(it);
+    object.emplace(to, std::move(v));
+}
+
+template<typename V, typename K>
+inline void renameChild(FlatMap<V, K>& object, typename FlatMap<V, K>::iterator it, const std::string& to)
+{
+    object.rename(it, to);
+}
+} // namespace internal
+
+template<typename ObjectPolicy>
+inline bool BasicValue<ObjectPolicy>::renameChild(const std::string& from, const std::string& to)
+{
+    if (!is<Object>()) {
+        failwith("type must be object to do renameChild(from, to).");
+        return false;
+    }
+
+    auto it = object_->find(from);
+    if (it == object_->end())
+        return false;
+    if (from == to)
+        return true;
+    if (object_->count(to))
+        return false;
+    internal::renameChild(*object_, it, to);
+    return true;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>& BasicValue<ObjectPolicy>::operator[](size_t index)
+{
+    if (!valid())
+        *this = BasicValue((List()));
+
+    if (!is<List>()) {
+        failwith("type must be list to index by int");
+        return internal::detachedValue<BasicValue>();
+    }
+
+    if (list_->size() <= index) {
+        failwith("index out of bound");
+        return internal::detachedValue<BasicValue>();
+    }
+
+    if (BasicValue* v = find(index))
+        return *v;
+
+    return *setChild(index, BasicValue());
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>& BasicValue<ObjectPolicy>::operator[](const std::string& key)
+{
+    if (!valid())
+        *this = BasicValue((Object()));
+
+    if (BasicValue* v = findChild(key))
+        return *v;
+
+    if (BasicValue* v = setChild(key, BasicValue()))
+        return *v;
+    return internal::detachedValue<BasicValue>();
+}
+
+template<typename ObjectPolicy>
+template<typename T>
+inline typename call_traits<T>::return_type BasicValue<ObjectPolicy>::get(size_t index) const
+{
+    if (!is<List>()) {
+        failwith("type must be list to do get(index).");
+        return internal::emptyValue<T>();
+    }
+
+    if (list_->size() <= index) {
+        failwith("index out of bound");
+        return internal::emptyValue<T>();
+    }
+
+    return (*list_)[index].template as<T>();
+}
+
+template<typename ObjectPolicy>
+inline const BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::find(size_t index) const
+{
+    if (!is<List>())
+        return nullptr;
+    if (index < list_->size())
+        return &(*list_)[index];
+    return nullptr;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::find(size_t index)
+{
+    return const_cast<BasicValue*>(const_cast<const BasicValue*>(this)->find(index));
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::push(const BasicValue& v)
+{
+    if (!valid())
+        *this = BasicValue((List()));
+    else if (!is<List>()) {
+        failwith("type must be list to do push(BasicValue).");
+        return nullptr;
+    }
+
+    list_->push_back(v);
+    return &list_->back();
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::push(BasicValue&& v)
+{
+    if (!valid())
+        *this = BasicValue((List()));
+    else if (!is<List>()) {
+        failwith("type must be list to do push(BasicValue).");
+        return nullptr;
+    }
+
+    list_->push_back(std::move(v));
+    return &list_->back();
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::ensureValue(const std::string& key)
+{
+    if (!valid())
+        *this = BasicValue((Object()));
+    if (!is<Object>()) {
+        failwith("encountered non object value");
+        return nullptr;
+    }
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    BasicValue* current = this;
+    while (true) {
+        internal::Token t = lexer.nextToken();
+        if (key.size() > 0 && !(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING)) {
+            failwith("invalid key first: " + t.strValue() + " ");
+            return nullptr;
+        }
+
+        std::string part = t.strValue();
+
+        if (key.size() == 0)
+            part = "";
+
+        t = lexer.nextToken();
+        if (t.type() == internal::TokenType::PERIOD) {
+            if (BasicValue* candidate = current->findChild(part)) {
+                if (!candidate->is<Object>()) {
+                    failwith("encountered non object value");
+                    return nullptr;
+                }
+
+                current = candidate;
+            } else {
+                current = current->setChild(part, Object());
+            }
+        } else if (t.type() == internal::TokenType::END_OF_FILE) {
+            if (BasicValue* v = current->findChild(part))
+                return v;
+            return current->setChild(part, BasicValue());
+        } else {
+            failwith("invalid key second: " + t.strValue() + " ");
+            return nullptr;
+        }
+    }
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::findChild(const std::string& key)
+{
+    if (!is<Object>()) {
+        failwith("cannot use findChild on non-object");
+        return nullptr;
+    }
+
+    auto it = object_->find(key);
+    if (it == object_->end())
+        return nullptr;
+
+    return &it->second;
+}
+
+template<typename ObjectPolicy>
+inline const BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::findChild(const std::string& key) const
+{
+    if (!is<Object>()) {
+        failwith("cannot use findChild on non-object");
+        return nullptr;
+    }
+
+    auto it = object_->find(key);
+    if (it == object_->end())
+        return nullptr;
+
+    return &it->second;
+}
+
+template<typename ObjectPolicy>
+inline BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::findChild(const Key& key)
+{
+    return const_cast<BasicValue*>(static_cast<const BasicValue*>(this)->findChild(key));
+}
+
+template<typename ObjectPolicy>
+inline const BasicValue<ObjectPolicy>* BasicValue<ObjectPolicy>::findChild(const Key& key) const
+{
+    if (!is<Object>()) {
+        failwith("cannot use findChild on non-object");
+        return nullptr;
+    }
+
+    auto it = object_->find(key);
+    if (it == object_->end())
+        return nullptr;
+
+    return &it->second;
+}
+
+// ----------------------------------------------------------------------
+// Parser
+
+namespace internal {
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::start()
+{
+#ifdef MICROHCL_STATS
+    if (stats_)
+        stats_->clear();
+#endif
+
+    if (!lexer_.skipUTF8BOM()) {
+        token_ = Token(TokenType::ILLEGAL, std::string("Invalid UTF8 BOM"));
+    } else {
+        nextToken();
+    }
+}
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::reset()
+{
+    lexer_.reset();
+    keys_.clear();
+    depth_ = 0;
+    nodeCount_ = 0;
+    objectSchema_ = options_.schema ? options_.schema->node() : nullptr;
+    valueSchema_ = nullptr;
+    schemaKey_ = nullptr;
+    errorCode_ = ErrorCode::NONE;
+    errorReason_.clear();
+    path_ = ShapeProfile::root();
+    streamPath_.clear();
+    listDepth_ = 0;
+    start();
+}
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::reserveFromShape(Value& v) const
+{
+    if (size_t n = options_.shape->size(path_))
+        v.reserve(n);
+}
+
+// Objects created by mergeObjects() for block labels start with one
+// child. Presize them for the children that later items will add.
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::reserveMerged(Value& node, const std::vector<std::string>& keys)
+{
+    const ShapeProfile::Path parent = path_;
+    Value* current = &node;
+    for (size_t i = 0; i + 1 < keys.size(); ++i) {
+        current = current->findChild(keys[i]);
+        if (!current || !current->template is<Object>())
+            break;
+        path_ = ShapeProfile::child(path_, keys[i]);
+        if (current->size() == 1)
+            reserveFromShape(*current);
+    }
+    path_ = parent;
+}
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::addError(const std::string& reason)
+{
+    std::stringstream ss;
+    ss << "Error:" << lexer_.lineNo() << ":" << lexer_.columnNo() << ": " << reason << "\n";
+    errorReason_ += ss.str();
+}
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::addError(ErrorCode code, const std::string& reason)
+{
+    if (errorCode_ == ErrorCode::NONE)
+        errorCode_ = code;
+    addError(reason);
+}
+
+template<typename Tracer, typename V>
+inline const std::string& BasicParser<Tracer, V>::errorReason()
+{
+    return errorReason_;
+}
+
+template<typename Tracer, typename V>
+inline ErrorCode BasicParser<Tracer, V>::errorCode() const
+{
+    if (errorCode_ != ErrorCode::NONE)
+        return errorCode_;
+    if (lexer_.errorCode() != ErrorCode::NONE)
+        return lexer_.errorCode();
+    if (!errorReason_.empty())
+        return ErrorCode::SYNTAX_ERROR;
+    return ErrorCode::NONE;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::enterNesting()
+{
+    if (options_.maxDepth != 0 && depth_ >= options_.maxDepth) {
+        addError(ErrorCode::MAX_DEPTH_EXCEEDED, "nesting exceeds maximum depth");
+        return false;
+    }
+    ++depth_;
+#ifdef MICROHCL_STATS
+    if (stats_)
+        stats_->maxDepth = std::max(stats_->maxDepth, depth_);
+#endif
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::checkSchemaKeys(const std::vector<std::string>& keys)
+{
+    valueSchema_ = objectSchema_;
+    schemaKey_ = &keys.back();
+
+    for (const auto& key : keys) {
+        const SchemaNode* schema = valueSchema_;
+        if (!schema)
+            return true;
+
+        switch (schema->kind) {
+        case Schema::OBJECT: {
+            auto it = schema->fields.find(key);
+            if (it != schema->fields.end()) {
+                valueSchema_ = it->second.get();
+            } else if (schema->allowUnknownKeys) {
+                valueSchema_ = nullptr;
+            } else {
+                addError(ErrorCode::SCHEMA_VIOLATION, "schema: unknown key \"" + key + "\"");
+                return false;
+            }
+            break;
+        }
+        case Schema::BLOCK:
+            if (!schema->labels.empty() &&
+                std::find(schema->labels.begin(), schema->labels.end(), key) == schema->labels.end()) {
+                addError(ErrorCode::SCHEMA_VIOLATION, "schema: label \"" + key + "\" is not allowed");
+                return false;
+            }
+            valueSchema_ = schema->element.get();
+            break;
+        case Schema::ANY:
+            valueSchema_ = nullptr;
+            break;
+        default:
+            addError(ErrorCode::SCHEMA_VIOLATION, "schema: \"" + key + "\" is not an object");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::checkSchemaValue(bool element)
+{
+    if (!valueSchema_)
+        return true;
+
+    Schema::Kind kind = valueSchema_->kind;
+    bool ok;
+    switch (token().type()) {
+    case TokenType::BOOL:
+        ok = kind == Schema::BOOL;
+        break;
+    case TokenType::NUMBER:
+        ok = kind == Schema::INT || kind == Schema::NUMBER;
+        break;
+    case TokenType::FLOAT:
+        ok = kind == Schema::DOUBLE || kind == Schema::NUMBER;
+        break;
+    case TokenType::STRING:
+    case TokenType::HEREDOC:
+    case TokenType::IDENT:
+    case TokenType::HIL:
+        ok = kind == Schema::STRING;
+        break;
+    case TokenType::LBRACK:
+        ok = kind == Schema::LIST;
+        break;
+    case TokenType::LBRACE:
+        ok = kind == Schema::OBJECT || kind == Schema::BLOCK;
+        break;
+    default:
+        // Not the start of a value. Left to the grammar to report.
+        return true;
+    }
+
+    if (ok || kind == Schema::ANY)
+        return true;
+
+    std::string reason = "schema: ";
+    if (element)
+        reason += "element of ";
+    if (schemaKey_)
+        reason += "\"" + *schemaKey_ + "\" ";
+    reason += "must be ";
+    reason += Schema::kindToString(kind);
+    addError(ErrorCode::SCHEMA_VIOLATION, reason);
+    return false;
+}
+
+// Merging |v| under |keys| into |node| turns a repeated key into a list
+// when it cannot merge the two objects, as Value::mergeObjects() does.
+// Each item was checked on its own, so that list is only allowed where
+// the schema takes a list of anything.
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::checkSchemaMerge(const Value& node, const std::vector<std::string>& keys,
+                                                     const Value& v)
+{
+    if (!objectSchema_)
+        return true;
+
+    const std::string& key = keys.front();
+    const Value* existing = node.findChild(key);
+    if (!existing)
+        return true;
+    if (existing->template is<Object>()) {
+        const bool merged = keys.size() > 1 ? !existing->findChild(keys[1])
+                                            : v.template is<Object>() && !existing->sharesKeyWith(v);
+        if (merged)
+            return true;
+    }
+
+    const SchemaNode* schema = nullptr;
+    if (objectSchema_->kind == Schema::OBJECT) {
+        auto it = objectSchema_->fields.find(key);
+        if (it != objectSchema_->fields.end())
+            schema = it->second.get();
+    } else if (objectSchema_->kind == Schema::BLOCK) {
+        schema = objectSchema_->element.get();
+    }
+    if (!schema || schema->kind == Schema::ANY)
+        return true;
+    if (schema->kind == Schema::LIST && (!schema->element || schema->element->kind == Schema::ANY))
+        return true;
+
+    addError(ErrorCode::SCHEMA_VIOLATION, std::string("schema: repeated \"") + key +
+             "\" makes a list, but it must be " + Schema::kindToString(schema->kind));
+    return false;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::checkSchemaRequired(const Value& node)
+{
+    if (!objectSchema_ || objectSchema_->kind != Schema::OBJECT)
+        return true;
+
+    for (const auto& key : objectSchema_->required) {
+        if (!node.findChild(key)) {
+            addError(ErrorCode::SCHEMA_VIOLATION, "schema: missing required key \"" + key + "\"");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::addNode()
+{
+    ++nodeCount_;
+    if (options_.maxNodes != 0 && nodeCount_ > options_.maxNodes) {
+        addError(ErrorCode::MAX_NODES_EXCEEDED, "document exceeds maximum number of values");
+        return false;
+    }
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::nextToken()
+{
+#ifdef MICROHCL_STATS
+    if (stats_) {
+        const auto start = std::chrono::steady_clock::now();
+        token_ = lexer_.nextToken();
+        stats_->lexerNanos += nanosSince(start);
+        ++stats_->tokens[static_cast<size_t>(token_.type())];
+        return;
+    }
+#endif
+    token_ = lexer_.nextToken();
+}
+
+#ifdef MICROHCL_STATS
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::mergeObjects(Value& node, const std::vector<std::string>& keys, Value& v)
+{
+    if (!stats_) {
+        node.mergeObjects(keys, v);
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    node.mergeObjects(keys, v);
+    stats_->mergeNanos += nanosSince(start);
+}
+
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::countValues(const Value& v)
+{
+    ++stats_->values[v.type()];
+    switch (v.type()) {
+    case Value::INT_TYPE:
+    case Value::DOUBLE_TYPE:
+        if (v.isRawNumber() && v.rawSize() > 8)
+            ++stats_->allocations;
+        break;
+    case Value::STRING_TYPE:
+    case Value::IDENT_TYPE:
+    case Value::HIL_TYPE:
+        if (!v.isInlineString())
+            ++stats_->allocations;
+        break;
+    case Value::LIST_TYPE:
+        ++stats_->allocations;
+        for (const Value& element : v.template as<List>())
+            countValues(element);
+        break;
+    case Value::OBJECT_TYPE:
+        ++stats_->allocations;
+        for (const auto& kv : v.template as<Object>())
+            countValues(kv.second);
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+template<typename Tracer, typename V>
+inline V BasicParser<Tracer, V>::parse()
+{
+    KeyScope<Object> keyScope(options_.keyPool ? *options_.keyPool : keys_);
+    tracer_.begin("parse", nullptr, 0);
+#ifdef MICROHCL_STATS
+    if (stats_) {
+        // The first token was lexed by start(), before this.
+        const std::uint64_t lexed = stats_->lexerNanos;
+        const auto start = std::chrono::steady_clock::now();
+        Value v = parseObjectList(false);
+        stats_->parserNanos = nanosSince(start) - (stats_->lexerNanos - lexed) - stats_->mergeNanos;
+        stats_->bytesRead = lexer_.offset();
+        if (v.valid())
+            countValues(v);
+        tracer_.end("parse");
+        return v;
+    }
+#endif
+    Value v = parseObjectList(false);
+    tracer_.end("parse");
+    return v;
+}
+
+template<typename Tracer, typename V>
+inline V BasicParser<Tracer, V>::parseObjectList(bool isNested)
+{
+    if (!addNode())
+        return Value();
+
+    Value node((Object()));
+    if (options_.shape)
+        reserveFromShape(node);
+
+    while (true) {
+        if (token().type() == TokenType::END_OF_FILE) {
+            break;
+        }
+        if (isNested) {
+            // We're inside a nested object list, so end at an RBRACE.
+            if (token().type() == TokenType::RBRACE) {
+                break;
+            }
+        }
+
+        if (!parseObjectListItem(node)) {
+            // Make the node invalid
+            node = Value();
+            break;
+        }
+    }
+
+    if (node.valid() && !checkSchemaRequired(node))
+        return Value();
+
+    return node;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseObjectListItem(Value& node)
+{
+    // A deque, so that growing it for nested items keeps |keys| valid.
+    if (keyBuffers_.size() <= depth_)
+        keyBuffers_.resize(depth_ + 1);
+    std::vector<std::string>& keys = keyBuffers_[depth_];
+    const size_t begin = lexer_.tokenOffset();
+    if (!parseKeys(keys))
+        return false;
+    if (!checkSchemaKeys(keys))
+        return false;
+
+    const ShapeProfile::Path parent = path_;
+    if (options_.shape) {
+        for (const auto& key : keys)
+            path_ = ShapeProfile::child(path_, key);
+    }
+    const size_t streamDepth = streamPath_.size();
+    if (!options_.streamedLists.empty())
+        streamPath_.insert(streamPath_.end(), keys.begin(), keys.end());
+
+    const bool topLevel = depth_ == 0;
+    if (topLevel)
+        tracer_.begin("item", keys.data(), keys.size());
+
+    // Each block label makes an object around the value, as a nested
+    // block would, and counts toward the limits the same way.
+    size_t labels = 0;
+    bool parsed = true;
+    while (labels + 1 < keys.size()) {
+        if (!enterNesting() || !addNode()) {
+            parsed = false;
+            break;
+        }
+        ++labels;
+    }
+
+    Value v;
+    if (parsed)
+        parsed = parseObjectItem(v);
+    depth_ -= labels;
+    if (topLevel)
+        tracer_.end("item");
+    streamPath_.resize(streamDepth);
+    if (!parsed)
+        return false;
+
+    path_ = parent;
+    if (topLevel) {
+        itemBegin_ = begin;
+        itemEnd_ = lexer_.offset();
+    }
+    nextToken();
+
+    // object lists can be optionally comma-delimited e.g. when a list of maps
+    // is being expressed, so a comma is allowed here - it's simply consumed
+    if(token().type() == TokenType::COMMA)
+        nextToken();
+
+    if (!checkSchemaMerge(node, keys, v))
+        return false;
+    if (topLevel)
+        tracer_.begin("merge", keys.data(), keys.size());
+    mergeObjects(node, keys, v);
+    if (topLevel)
+        tracer_.end("merge");
+    if (options_.shape && keys.size() > 1)
+        reserveMerged(node, keys);
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseNextItem(Value& root)
+{
+    KeyScope<Object> keyScope(options_.keyPool ? *options_.keyPool : keys_);
+    if (!root.valid()) {
+        if (!addNode())
+            return false;
+        root = Value((Object()));
+    }
+
+    if (token().type() == TokenType::END_OF_FILE) {
+        checkSchemaRequired(root);
+        return false;
+    }
+
+    return parseObjectListItem(root);
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseKeys(std::vector<std::string>& keys)
+{
+    int keyCount = 0;
+    keys.clear();
+
+    while (true) {
+        switch (token().type()) {
+        case TokenType::END_OF_FILE:
+            addError("end of file reached");
+            return false;
+        case TokenType::ASSIGN:
+            if (keyCount > 1) {
+                addError("nested object expected: LBRACE got: " + token().strValue());
+                return false;
+            }
+            if (keyCount == 0) {
+                addError("expected to find at least one object key");
+                return false;
+            }
+
+            return true;
+        case TokenType::LBRACE:
+            if (keys.size() == 0) {
+                addError("expected IDENT | STRING got: LBRACE");
+                return false;
+            }
+
+            return true;
+        case TokenType::IDENT:
+        case TokenType::STRING:
+            keyCount++;
+            if (token().escaped()) {
+                keys.emplace_back();
+                unescapeString(token().strValue().data(), token().strValue().size(), keys.back());
+            } else {
+                keys.push_back(token().strValue());
+            }
+            nextToken();
+            break;
+        case TokenType::ILLEGAL:
+            addError("illegal character");
+            return false;
+        default:
+            addError("expected IDENT | STRING | ASSIGN | LBRACE got: " + token().strValue());
+            return false;
+        }
+    }
+
+    return false;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseObjectItem(Value& currentValue)
+{
+    switch (token().type()) {
+    case TokenType::ASSIGN:
+        if (!parseObject(currentValue))
+            return false;
+        break;
+    case TokenType::LBRACE:
+        if (!checkSchemaValue())
+            return false;
+        if (!parseObjectType(currentValue))
+            return false;
+        break;
+    default:
+        addError("Expected start of object ('{') or assignment ('=')");
+        return false;
+    }
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseObject(Value& currentValue)
+{
+    nextToken();
+
+    if (!checkSchemaValue())
+        return false;
+
+    switch (token().type()) {
+    case TokenType::NUMBER:
+    case TokenType::FLOAT:
+    case TokenType::BOOL:
+    case TokenType::STRING:
+    case TokenType::HEREDOC:
+    case TokenType::IDENT:
+    case TokenType::HIL:
+        return parseLiteralType(currentValue);
+    case TokenType::LBRACE:
+        return parseObjectType(currentValue);
+    case TokenType::LBRACK:
+        return parseListType(currentValue);
+    case TokenType::COMMENT:
+        break;
+    case TokenType::END_OF_FILE:
+        addError("Reached end of file");
+        return false;
+    default:
+        addError("Unknown token: " + token().strValue());
+        return false;
+    }
+    addError("Unknown token: " + token().strValue());
+    return false;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseObjectType(Value& currentValue)
+{
+    if(token().type() != TokenType::LBRACE) {
+        addError("object list did not start with LBRACE");
+        return false;
+    }
+    if (!enterNesting())
+        return false;
+    nextToken();
+    const SchemaNode* parentSchema = objectSchema_;
+    objectSchema_ = valueSchema_;
+    Value result = parseObjectList(true);
+    objectSchema_ = parentSchema;
+    leaveNesting();
+
+    if(!errorReason().empty()) {
+        addError("failed parsing object list");
+        return false;
+    }
+
+    if(token().type() != TokenType::RBRACE) {
+        addError("object expected closing RBRACE got: " + token().strValue());
+        return false;
+    }
+
+    currentValue = result;
+    return true;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseListType(Value& currentValue)
+{
+    if (!enterNesting())
+        return false;
+    ++listDepth_;
+    bool ok = addNode() && parseListElements(currentValue);
+    --listDepth_;
+    leaveNesting();
+    return ok;
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::isStreamedList() const
+{
+    if (options_.streamedLists.empty() || !options_.onListElement || listDepth_ != 1)
+        return false;
+    return std::find(options_.streamedLists.begin(), options_.streamedLists.end(), streamPath_) !=
+           options_.streamedLists.end();
 }
 
-inline void Lexer::skipUntilNewLine()
-{
-    char c;
-    while (current(&c)) {
-        if (c == '\n')
-            return;
-        next();
+template<typename Tracer, typename V>
+inline void BasicParser<Tracer, V>::pushElement(List& list, Value&& element, bool streamed)
+{
+    if (streamed)
+        options_.onListElement(streamPath_, hcl::Value(std::move(element)));
+    else
+        list.push_back(std::move(element));
+}
+
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseListElements(Value& currentValue)
+{
+    List a;
+    bool needComma = false;
+    const SchemaNode* elementSchema = valueSchema_ ? valueSchema_->element.get() : nullptr;
+    const std::string* listKey = schemaKey_;
+    const bool streamed = isStreamedList();
+
+    const ShapeProfile::Path parent = path_;
+    if (options_.shape) {
+        a.reserve(options_.shape->size(path_));
+        path_ = ShapeProfile::element(path_);
+    }
+
+    while (true) {
+        nextToken();
+
+        if (needComma) {
+            switch (token().type()) {
+            case TokenType::COMMA:
+            case TokenType::RBRACK:
+                break;
+            default:
+                addError("error parsing list, expected comma or list end, got: " + token().strValue());
+                return false;
+            }
+        }
+
+        valueSchema_ = elementSchema;
+        schemaKey_ = listKey;
+        if (!checkSchemaValue(true))
+            return false;
+
+        switch (token().type()) {
+        case TokenType::BOOL:
+        case TokenType::NUMBER:
+        case TokenType::FLOAT:
+        case TokenType::STRING:
+        case TokenType::HEREDOC:
+        case TokenType::IDENT:
+        case TokenType::HIL:
+        {
+            Value literal;
+            if (!parseLiteralType(literal)) {
+                addError("error parsing literal type");
+                return false;
+            }
+
+            pushElement(a, std::move(literal), streamed);
+            needComma = true;
+            break;
+        }
+        case TokenType::COMMA:
+            needComma = false;
+            continue;
+        case TokenType::LBRACE:
+        {
+            Value object;
+            if (!parseObjectType(object)) {
+                addError("error parsing object within list");
+                return false;
+            }
+            pushElement(a, std::move(object), streamed);
+            needComma = true;
+            break;
+        }
+        case TokenType::LBRACK:
+        {
+            Value list;
+            if (!parseListType(list)) {
+                addError("error parsing list within list");
+                return false;
+            }
+            pushElement(a, std::move(list), streamed);
+            break;
+        }
+        case TokenType::RBRACK:
+        {
+            path_ = parent;
+            currentValue = std::move(a);
+            return true;
+        }
+        default:
+            addError("unexpected token while parsing list: " + token().strValue());
+            return false;
+        }
     }
+    return false;
 }
 
-inline Token Lexer::nextStringDoubleQuote()
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::parseLiteralType(Value& currentValue)
 {
-    if (!consume('"'))
-        return Token(TokenType::ILLEGAL, std::string("string didn't start with '\"'"));
-
-    std::string s;
-    char c;
-    int braces = 0;
-    bool dollar = false;
-    bool hil = false;
+    if (token().type() != TokenType::ILLEGAL && !addNode())
+        return false;
 
-    while (current(&c)) {
-        next();
-        if (braces == 0 && dollar && c == '{') {
-            braces++;
-            hil = true;
-        } else if (braces > 0 && c == '{') {
-            braces++;
-        }
-        if (braces > 0 && c == '}') {
-            braces--;
-        }
-        dollar = false;
-        if (braces == 0 && c == '$') {
-            dollar = true;
+    switch (token().type()) {
+    case TokenType::HEREDOC: {
+#ifdef MICROHCL_STATS
+        if (stats_)
+            stats_->heredocBytes += token().strValue().size();
+#endif
+        std::string unindented;
+        if (!unindentHeredoc(token().strValue(), unindented)) {
+            addError("Failed unindenting heredoc: " + token().strValue());
+            return false;
         }
-        if (c == '\\') {
-            if (!current(&c))
-                return Token(TokenType::ILLEGAL, std::string("string has unknown escape sequence"));
-            next();
-            switch (c) {
-            case 't': c = '\t'; break;
-            case 'n': c = '\n'; break;
-            case 'r': c = '\r'; break;
-            case 'x':
-            case 'u':
-            case 'U': {
-                int size = 0;
-                if (c == 'x') {
-                    size = 2;
-                } else if (c == 'u') {
-                    size = 4;
-                } else if (c == 'U') {
-                    size = 8;
-                }
-                std::string codepoint;
-                for (int i = 0; i < size; ++i) {
-                  if (current(&c) && (('0' <= c && c <= '9') || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f'))) {
-                    codepoint += c;
-                    next();
-                  } else {
-                    return Token(TokenType::ILLEGAL, std::string("string has unknown escape sequence"));
-                  }
-                }
-                s += unescape(codepoint);
-                continue;
-            }
-            case '"': c = '"'; break;
-            case '\'': c = '\''; break;
-            case '\\': c = '\\'; break;
-            case '\n':
-                if (braces == 0) {
-                    return Token(TokenType::ILLEGAL, std::string("literal not terminated"));
-                } else {
-                    while (current(&c) && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
-                        next();
-                    }
-                }
-                continue;
-            default:
-                return Token(TokenType::ILLEGAL, std::string("string has unknown escape sequence"));
-            }
-        } else if (c == '\n' && braces == 0) {
-            return Token(TokenType::ILLEGAL, std::string("found newline while parsing non-HIL string literal"));
-        } else if (c == '"' && braces == 0) {
-            if (hil)
-                return Token(TokenType::HIL, s);
+        currentValue = unindented;
+        return true;
+    }
+    case TokenType::STRING:
+    case TokenType::IDENT:
+    case TokenType::HIL:
+        if (token().escaped() || options_.inlineStrings) {
+            const typename Value::Type type = token().type() == TokenType::HIL ? Value::HIL_TYPE :
+                                     token().type() == TokenType::IDENT ? Value::IDENT_TYPE : Value::STRING_TYPE;
+            if (token().escaped())
+                currentValue = Value::makeEscapedString(type, token().strValue());
             else
-                return Token(TokenType::STRING, s);
+                currentValue = Value::makeInlineString(type, token().strValue());
+            return true;
         }
 
-        s += c;
+        currentValue = token().strValue();
+
+        if (token().type() == TokenType::HIL)
+            currentValue.setStringType(Value::StringType::Hil);
+        else if (token().type() == TokenType::IDENT)
+            currentValue.setStringType(Value::StringType::Ident);
+
+        return true;
+    case TokenType::BOOL:
+        currentValue = token().boolValue();
+        return true;
+    case TokenType::NUMBER:
+        if (options_.lazyNumbers)
+            currentValue = Value::makeRawNumber(Value::INT_TYPE, token().strValue());
+        else
+            currentValue = token().intValue();
+        return true;
+    case TokenType::FLOAT:
+        if (options_.lazyNumbers)
+            currentValue = Value::makeRawNumber(Value::DOUBLE_TYPE, token().strValue());
+        else
+            currentValue = token().doubleValue();
+        return true;
+    case TokenType::ILLEGAL:
+        addError(token().strValue());
+        return false;
+    default:
+        addError("unexpected token");
+        return false;
     }
+}
 
-    return Token(TokenType::ILLEGAL, std::string("string didn't end"));
+static inline int isSpace(int c)
+{
+    return (c == ' ' || c == '\t') ? 1 : 0;
 }
 
-inline Token Lexer::nextStringSingleQuote()
+static inline std::string trimRight(const std::string& s) {
+  std::string r(s);
+  r.erase(std::find_if(r.rbegin(), r.rend(),
+                       std::not1(std::function<int(int)>(isSpace))
+              ).base(), r.end());
+  return r;
+}
+
+static inline std::string join(const std::vector<std::string>& elements, const char* const separator)
 {
-    if (!consume('\''))
-        return Token(TokenType::ILLEGAL, std::string("string didn't start with '\''?"));
+    switch (elements.size())
+    {
+        case 0:
+            return "";
+        case 1:
+            return elements[0];
+        default:
+            std::ostringstream os;
+            std::copy(elements.begin(), elements.end()-1, std::ostream_iterator<std::string>(os, separator));
+            os << *elements.rbegin();
+            return os.str();
+    }
+}
+static inline bool hasPrefix(const std::string & s, const std::string & prefix) {
+	return std::mismatch(prefix.begin(), prefix.end(), s.begin()).first == prefix.end();
+}
 
-    std::string s;
-    char c;
+inline std::string & trimPrefix(std::string & s, const std::string & prefix) {
+	if (!hasPrefix(s,prefix)) {
+		return s;
+	}
+	s.erase(0,prefix.size());
+	return s;
+}
 
-    if (current(&c) && c == '\'') {
-        // OK. It's empty string.
-        next();
-        return Token(TokenType::STRING, std::string());
+// Turns the text of a HEREDOC token into the string value.
+inline bool unindentHeredoc(const std::string& heredoc, std::string& out)
+{
+    auto index = heredoc.find("\n");
+    size_t contentBegin = index + 1;
+    size_t contentEnd = heredoc.size() - contentBegin - (index - 2);
+    std::string content = heredoc.substr(contentBegin, contentEnd);
+
+    if (index == std::string::npos)
+        return false;
+
+    bool unindent = heredoc[2] == '-';
+
+    if (!unindent) {
+        out = heredoc.substr(contentBegin, contentEnd - 1);
+        return true;
     }
 
-    while (current(&c)) {
-        next();
-        if (c == '\'') {
-            return Token(TokenType::STRING, s);
-        } else if (c == '\n') {
-            return Token(TokenType::ILLEGAL, std::string("found newline while parsing string literal"));
+    std::vector<std::string> lines;
+    std::istringstream ss(content);
+    std::string line;
+    while (std::getline(ss, line)) {
+        lines.push_back(line);
+    }
+
+    std::string whitespacePrefix = lines[lines.size() - 1];
+
+    bool isIndented = true;
+    for (const auto& line : lines) {
+        if(whitespacePrefix.size() > line.size()) {
+            isIndented = false;
+            break;
+        }
+
+        auto res = std::mismatch(whitespacePrefix.begin(), whitespacePrefix.end(), line.begin());
+
+        if (res.first == whitespacePrefix.end()) {
+            continue;
+        }
+
+        isIndented = false;
+        break;
+    }
+
+    if (!isIndented) {
+        out = trimRight(heredoc.substr(contentBegin, contentEnd));
+        return true;
+    }
+
+    std::vector<std::string> unindentedLines;
+    for (auto line = lines.begin(); line < lines.end(); line++) {
+        if (line + 1 == lines.end()) {
+            unindentedLines.push_back(std::string());
+            break;
         }
-
-        s += c;
+        trimPrefix(*line, whitespacePrefix);
+        unindentedLines.push_back(std::move(*line));
     }
 
-    return Token(TokenType::ILLEGAL, std::string("string didn't end with '\''?"));
+    out = join(unindentedLines, "\n");
+    return true;
 }
 
-inline bool hasSuffix(const std::string & s, const std::string & suffix) {
-    if(suffix.size() > s.size()) {
+template<typename Tracer, typename V>
+inline bool BasicParser<Tracer, V>::unindentHeredoc(const std::string& heredoc, std::string& out)
+{
+    if (heredoc.find("\n") == std::string::npos) {
+        addError("heredoc doesn't contain newline");
         return false;
     }
-    return std::mismatch(suffix.rbegin(),suffix.rend(),s.rbegin()).first == suffix.rend();
-}
-
-inline Token Lexer::nextHereDoc()
-{
-    if (!consume('<'))
-        return Token(TokenType::ILLEGAL, std::string("heredoc didn't start with '<<'?"));
-    if (!consume('<'))
-        return Token(TokenType::ILLEGAL, std::string("heredoc didn't start with '<<'?"));
-
-    std::string s("<<");
-    std::string anchor;
-    char c;
 
-    current(&c);
-
-    // Indented heredoc syntax
-    if(c == '-') {
-        s += c;
-        next();
-    }
+    return internal::unindentHeredoc(heredoc, out);
+}
 
-    while (current(&c) && (isalpha(static_cast<unsigned char>(c)) || isdigit(static_cast<unsigned char>(c)))) {
-        anchor += c;
-        next();
-    }
+} // namespace internal
 
-    if (anchor.size() == 0) {
-        return Token(TokenType::ILLEGAL, std::string("heredoc anchor was empty"));
-    }
+// ----------------------------------------------------------------------
+// Validator
 
-    s += anchor;
+namespace internal {
 
-    if(!current(&c)) {
-        return Token(TokenType::ILLEGAL, std::string("end of file reached"));
-    }
+// Runs the Parser grammar over Scanner tokens with an explicit,
+// fixed-size stack instead of recursion, and without building Values.
+class Validator {
+public:
+    static const int kMaxDepth = 256;
 
-    if(current(&c) && c == '\r') {
-        skipUntilNewLine();
-    }
+    Validator(const char* data, size_t size) : scanner_(data, size), depth_(0) {}
 
-    if(!current(&c) || (current(&c) && c != '\n')) {
-        return Token(TokenType::ILLEGAL, std::string("invalid characters in heredoc anchor"));
-    }
+    ValidationResult validate();
 
-    s += '\n';
+private:
+    enum Frame : unsigned char {
+        ROOT_FRAME,
+        OBJECT_FRAME,
+        LIST_FRAME,
+        LIST_NEEDS_COMMA_FRAME,
+    };
 
-    if(s.size() == 0) {
-        return Token(TokenType::ILLEGAL, std::string("zero-length heredoc anchor"));
-    }
+    void nextToken() { token_ = scanner_.nextToken(); }
+    bool fail(const char* reason);
+    bool push(Frame frame);
 
-    std::string buffer;
-    std::string line;
-    std::string indentLine;
+    bool parseKeys();
+    bool parseObjectValue();
+    bool endValue(Frame popped);
 
-    while(current(&c)) {
-        next();
-        if (current(&c) && c == '\n') {
-            if (buffer.size() != 0) {
-                buffer += '\n';
-            }
-            buffer += indentLine;
-            buffer += line;
-            indentLine.clear();
-            line.clear();
-        }
-        else if (current(&c) && line.size() == 0 && (c == ' ' || c == '\t')) {
-            indentLine += c;
-        } else if(current(&c)) {
-            line += c;
-        }
-        if (line.compare(anchor) == 0) {
-            buffer += '\n';
-            buffer += indentLine;
-            buffer += line;
-            buffer += '\n';
-            break;
-        }
-    }
+    static bool isLiteral(TokenType type);
 
-    s += buffer;
+    Scanner scanner_;
+    SpanToken token_;
+    Frame stack_[kMaxDepth];
+    int depth_;
+    ValidationResult result_;
+};
 
-    if(current(&c)) {
-        next();
-    }
-    return Token(TokenType::HEREDOC, s);
+inline bool Validator::fail(const char* reason)
+{
+    result_.errorReason = token_.type == TokenType::ILLEGAL ? token_.error : reason;
+    result_.lineNo = token_.lineNo;
+    result_.columnNo = token_.columnNo;
+    return false;
 }
 
-inline bool isValidIdentChar(char c) {
-    return isalpha(static_cast<unsigned char>(c)) || isdigit(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.' || c == ':' || c == '/';
+inline bool Validator::push(Frame frame)
+{
+    if (depth_ == kMaxDepth)
+        return fail("nesting exceeds maximum depth");
+    stack_[depth_++] = frame;
+    return true;
 }
 
-inline Token Lexer::nextValueToken()
+inline bool Validator::isLiteral(TokenType type)
 {
-    std::string s;
-    char c;
-
-    if (current(&c) && (isalpha(static_cast<unsigned char>(c)) || c == '_')) {
-        s += c;
-        next();
+    switch (type) {
+    case TokenType::NUMBER:
+    case TokenType::FLOAT:
+    case TokenType::BOOL:
+    case TokenType::STRING:
+    case TokenType::HEREDOC:
+    case TokenType::IDENT:
+    case TokenType::HIL:
+        return true;
+    default:
+        return false;
+    }
+}
 
-        while (current(&c) && isValidIdentChar(c)) {
-            s += c;
-            next();
-        }
+// Same as Parser::parseKeys().
+inline bool Validator::parseKeys()
+{
+    int keyCount = 0;
 
-        if (s == "true") {
-            return Token(TokenType::BOOL, true);
-        }
-        if (s == "false") {
-            return Token(TokenType::BOOL, false);
+    while (true) {
+        switch (token_.type) {
+        case TokenType::END_OF_FILE:
+            return fail("end of file reached");
+        case TokenType::ASSIGN:
+            if (keyCount > 1)
+                return fail("nested object expected: LBRACE");
+            if (keyCount == 0)
+                return fail("expected to find at least one object key");
+            return true;
+        case TokenType::LBRACE:
+            if (keyCount == 0)
+                return fail("expected IDENT | STRING got: LBRACE");
+            return true;
+        case TokenType::IDENT:
+        case TokenType::STRING:
+            keyCount++;
+            nextToken();
+            break;
+        case TokenType::ILLEGAL:
+            return fail("illegal character");
+        default:
+            return fail("expected IDENT | STRING | ASSIGN | LBRACE");
         }
-        return Token(TokenType::IDENT, s);
     }
-
-    return nextNumber(false, false);
 }
 
-inline Token Lexer::nextNumber(bool leadingDot, bool leadingSub)
+// Same as Parser::parseObject(), without descending: objects and lists
+// push a frame which the main loop continues with.
+inline bool Validator::parseObjectValue()
 {
-    std::string s;
-    char c;
+    nextToken();
 
-    if (leadingDot) {
-        s += '.';
-    }
+    if (isLiteral(token_.type))
+        return endValue(ROOT_FRAME);
 
-    if (leadingSub) {
-        s += '-';
+    switch (token_.type) {
+    case TokenType::LBRACE:
+        if (!push(OBJECT_FRAME))
+            return false;
+        nextToken();
+        return true;
+    case TokenType::LBRACK:
+        return push(LIST_FRAME);
+    case TokenType::END_OF_FILE:
+        return fail("Reached end of file");
+    default:
+        return fail("Unknown token");
     }
+}
 
-    while (current(&c) && (('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
-                           c == 'T' || c == 'Z' || c == '_' || c == ':' || c == '-' || c == '+')) {
-        next();
-        s += c;
+// Called when a value has been completed. |popped| is the frame of the
+// value if it was an object or a list.
+inline bool Validator::endValue(Frame popped)
+{
+    Frame& parent = stack_[depth_ - 1];
+    switch (parent) {
+    case ROOT_FRAME:
+    case OBJECT_FRAME:
+        // Same as the end of Parser::parseObjectListItem().
+        nextToken();
+        if (token_.type == TokenType::COMMA)
+            nextToken();
+        return true;
+    default:
+        // Parser::parseListType() expects a comma after an object,
+        // but not after a nested list.
+        if (popped == OBJECT_FRAME)
+            parent = LIST_NEEDS_COMMA_FRAME;
+        return true;
     }
+}
 
-    if (isInteger(s)) {
-        std::stringstream ss(removeDelimiter(s));
-        std::int64_t x;
-        ss >> x;
-        return Token(TokenType::NUMBER, x);
+inline ValidationResult Validator::validate()
+{
+    if (!scanner_.skipUTF8BOM()) {
+        result_.errorReason = "Invalid UTF8 BOM";
+        result_.lineNo = 1;
+        return result_;
     }
 
-    if (isDouble(s)) {
-        std::stringstream ss(removeDelimiter(s));
-        double d;
-        ss >> d;
-        return Token(TokenType::FLOAT, d);
-    }
+    nextToken();
+    push(ROOT_FRAME);
 
-    return Token(TokenType::ILLEGAL, std::string("Invalid token"));
-}
+    while (true) {
+        Frame& frame = stack_[depth_ - 1];
 
+        if (frame == ROOT_FRAME || frame == OBJECT_FRAME) {
+            if (token_.type == TokenType::END_OF_FILE) {
+                if (frame == OBJECT_FRAME)
+                    fail("object expected closing RBRACE");
+                return result_;
+            }
+            if (frame == OBJECT_FRAME && token_.type == TokenType::RBRACE) {
+                --depth_;
+                if (!endValue(OBJECT_FRAME))
+                    return result_;
+                continue;
+            }
 
-inline bool isWhitespace(char c)
-{
-    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
-}
+            if (!parseKeys())
+                return result_;
 
-inline Token Lexer::nextToken()
-{
-    char c;
-    while (current(&c)) {
-        if (isWhitespace(c)) {
-            next();
+            if (token_.type == TokenType::ASSIGN) {
+                if (!parseObjectValue())
+                    return result_;
+            } else {
+                if (!push(OBJECT_FRAME))
+                    return result_;
+                nextToken();
+            }
             continue;
         }
 
-        if (c == '#') {
-            skipUntilNewLine();
-            continue;
+        // Same as the loop in Parser::parseListElements().
+        nextToken();
+
+        if (frame == LIST_NEEDS_COMMA_FRAME &&
+            token_.type != TokenType::COMMA && token_.type != TokenType::RBRACK) {
+            fail("error parsing list, expected comma or list end");
+            return result_;
         }
 
-        switch (c) {
-        case '=':
-            next();
-            return Token(TokenType::ASSIGN, "=");
-        case '+':
-            next();
-            return Token(TokenType::ADD, "+");
-        case '-':
-            next();
-            if (current(&c) && isdigit(static_cast<unsigned char>(c))) {
-                return nextNumber(false, true);
-            }
-            else {
-                return Token(TokenType::SUB, "-");
-            }
-        case '{':
-            next();
-            return Token(TokenType::LBRACE, "{");
-        case '}':
-            next();
-            return Token(TokenType::RBRACE, "}");
-        case '[':
-            next();
-            return Token(TokenType::LBRACK, "[");
-        case ']':
-            next();
-            return Token(TokenType::RBRACK, "]");
-        case ',':
-            next();
-            return Token(TokenType::COMMA, ",");
-        case '.':
-            next();
-            if(current(&c) && isdigit(static_cast<unsigned char>(c))) {
-                return nextNumber(true, false);
-            }
-            else {
-                return Token(TokenType::PERIOD, ".");
-            }
-        case '\"':
-            return nextStringDoubleQuote();
-        case '\'':
-            return nextStringSingleQuote();
-        case '<':
-            return nextHereDoc();
-        case '/':
-            next();
-            if(current(&c) && c == '/') {
-                skipUntilNewLine();
-                continue;
-            }
-            return Token(TokenType::ILLEGAL, "unterminated comment");
+        if (isLiteral(token_.type)) {
+            frame = LIST_NEEDS_COMMA_FRAME;
+            continue;
+        }
+
+        switch (token_.type) {
+        case TokenType::COMMA:
+            frame = LIST_FRAME;
+            break;
+        case TokenType::LBRACE:
+            if (!push(OBJECT_FRAME))
+                return result_;
+            nextToken();
+            break;
+        case TokenType::LBRACK:
+            if (!push(LIST_FRAME))
+                return result_;
+            break;
+        case TokenType::RBRACK:
+            --depth_;
+            if (!endValue(LIST_FRAME))
+                return result_;
+            break;
         default:
-            return nextValueToken();
+            fail("unexpected token while parsing list");
+            return result_;
         }
     }
-
-    return Token(TokenType::END_OF_FILE);
 }
 
 } // namespace internal
 
-// static
-inline const char* Value::typeToString(Value::Type type)
+inline ValidationResult validate(const char* data, size_t size)
 {
-    switch (type) {
-    case NULL_TYPE:   return "null";
-    case BOOL_TYPE:   return "bool";
-    case INT_TYPE:    return "int";
-    case DOUBLE_TYPE: return "double";
-    case STRING_TYPE:
-    case IDENT_TYPE:
-    case HIL_TYPE:
-        return "string";
-    case LIST_TYPE:  return "list";
-    case OBJECT_TYPE:  return "object";
-    default:          return "unknown";
-    }
+    internal::Validator validator(data, size);
+    return validator.validate();
 }
 
-inline Value::Value(const Value& v) :
-    type_(v.type_)
+inline ValidationResult validate(const std::string& buffer)
 {
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE:
-    case IDENT_TYPE:
-    case HIL_TYPE:
-        string_ = new std::string(*v.string_);
-        break;
-    case LIST_TYPE: list_ = new List(*v.list_); break;
-    case OBJECT_TYPE: object_ = new Object(*v.object_); break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
-    }
+    return validate(buffer.data(), buffer.size());
 }
 
-inline Value::Value(Value&& v) noexcept :
-    type_(v.type_)
-{
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE:
-    case IDENT_TYPE:
-    case HIL_TYPE:
-        string_ = v.string_;
-        break;
-    case LIST_TYPE: list_ = v.list_; break;
-    case OBJECT_TYPE: object_ = v.object_; break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
-    }
+// ----------------------------------------------------------------------
+// JSON
 
-    v.type_ = NULL_TYPE;
-    v.null_ = nullptr;
-}
+namespace internal {
 
-inline Value& Value::operator=(const Value& v)
-{
-    if (this == &v)
-        return *this;
+// Parses the JSON syntax of HCL straight into Values. Objects whose
+// members are all objects, and lists whose elements are all objects,
+// are flattened into block keys the way HCL does it, so
+//   {"resource": {"aws_instance": {"web": {...}}}}
+// gives the same items as
+//   resource "aws_instance" "web" {...}
+// and items sharing keys go through Value::mergeObjects().
+class JsonParser {
+public:
+    JsonParser(const char* data, size_t size, const ParseOptions& options) :
+        begin_(data),
+        p_(data),
+        end_(data + size),
+        options_(options),
+        depth_(0),
+        nodeCount_(0),
+        errorCode_(ErrorCode::NONE) {}
 
-    this->~Value();
+    // Parses. If failed, value should be invalid value.
+    Value parse();
+    const std::string& errorReason() const { return errorReason_; }
+    ErrorCode errorCode() const { return errorCode_; }
 
-    type_ = v.type_;
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE:
-    case IDENT_TYPE:
-    case HIL_TYPE:
-        string_ = new std::string(*v.string_);
-        break;
-    case LIST_TYPE: list_ = new List(*v.list_); break;
-    case OBJECT_TYPE: object_ = new Object(*v.object_); break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
-    }
+private:
+    enum class ItemKind {
+        VALUE,
+        // Members to flatten, flattened_[first, first + count).
+        OBJECT_ITEMS,
+        // Elements to flatten, flattened_[first, first + count).
+        LIST_ITEMS,
+    };
 
-    return *this;
-}
+    // A member or element. Held back until the enclosing object knows
+    // whether to flatten it.
+    struct Item {
+        Item() : kind(ItemKind::VALUE), object(false), first(0), count(0) {}
+
+        std::string key;
+        Value value;
+        ItemKind kind;
+        // A JSON object, flattened or not.
+        bool object;
+        size_t first;
+        size_t count;
+    };
 
-inline Value& Value::operator=(Value&& v) noexcept
-{
-    if (this == &v)
-        return *this;
+    bool fail(const std::string& reason);
+    bool fail(ErrorCode code, const std::string& reason);
+    bool addNode();
+    bool enterNesting();
+    void leaveNesting() { --depth_; }
+
+    void skipWhitespace();
+    bool parseValue(Item& item);
+    bool parseObject(Item& item);
+    bool parseList(Item& item);
+    bool parseString(std::string& out);
+    bool parseNumber(Value& out);
+    bool parseWord(const char* word, size_t size);
+
+    // Items parsed at each nesting level. A deque, so that growing it
+    // for nested values keeps references into it valid.
+    std::vector<Item>& items();
+    // Merges |item| into |node| under keys_.
+    void emit(Value& node, Item& item);
+    Value toValue(Item& item);
+
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    const ParseOptions& options_;
+    size_t depth_;
+    size_t nodeCount_;
+
+    std::deque<std::vector<Item>> items_;
+    std::vector<Item> flattened_;
+    std::vector<std::string> keys_;
 
-    this->~Value();
+    std::string errorReason_;
+    ErrorCode errorCode_;
+};
 
-    type_ = v.type_;
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE:
-    case IDENT_TYPE:
-    case HIL_TYPE:
-        string_ = v.string_;
-        break;
-    case LIST_TYPE: list_ = v.list_; break;
-    case OBJECT_TYPE: object_ = v.object_; break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
+inline bool JsonParser::fail(const std::string& reason)
+{
+    // Positions are only needed for errors, so they are counted here
+    // instead of while scanning.
+    int lineNo = 1;
+    const char* lineStart = begin_;
+    for (const char* p = begin_; p < p_; ++p) {
+        if (*p == '\n') {
+            ++lineNo;
+            lineStart = p + 1;
+        }
     }
 
-    v.type_ = NULL_TYPE;
-    v.null_ = nullptr;
-    return *this;
+    std::stringstream ss;
+    ss << "Error:" << lineNo << ":" << (p_ - lineStart) << ": " << reason << "\n";
+    errorReason_ += ss.str();
+    if (errorCode_ == ErrorCode::NONE)
+        errorCode_ = ErrorCode::SYNTAX_ERROR;
+    return false;
 }
 
-inline Value::~Value()
+inline bool JsonParser::fail(ErrorCode code, const std::string& reason)
 {
-    switch (type_) {
-    case STRING_TYPE:
-    case IDENT_TYPE:
-    case HIL_TYPE:
-        delete string_;
-        break;
-    case LIST_TYPE:
-        delete list_;
-        break;
-    case OBJECT_TYPE:
-        delete object_;
-        break;
-    default:
-        break;
-    }
+    if (errorCode_ == ErrorCode::NONE)
+        errorCode_ = code;
+    return fail(reason);
 }
 
-inline size_t Value::size() const
+inline bool JsonParser::addNode()
 {
-    switch (type_) {
-    case NULL_TYPE:
-        return 0;
-    case LIST_TYPE:
-        return list_->size();
-    case OBJECT_TYPE:
-        return object_->size();
-    default:
-        return 1;
-    }
+    ++nodeCount_;
+    if (options_.maxNodes != 0 && nodeCount_ > options_.maxNodes)
+        return fail(ErrorCode::MAX_NODES_EXCEEDED, "document exceeds maximum number of values");
+    return true;
 }
 
-inline bool Value::empty() const
+inline bool JsonParser::enterNesting()
 {
-    return size() == 0;
+    if (options_.maxDepth != 0 && depth_ >= options_.maxDepth)
+        return fail(ErrorCode::MAX_DEPTH_EXCEEDED, "nesting exceeds maximum depth");
+    ++depth_;
+    return true;
 }
 
-template<> struct Value::ValueConverter<bool>
+inline std::vector<JsonParser::Item>& JsonParser::items()
 {
-    bool is(const Value& v) { return v.type() == Value::BOOL_TYPE; }
-    bool to(const Value& v) { v.assureType<bool>(); return v.bool_; }
+    if (items_.size() <= depth_)
+        items_.resize(depth_ + 1);
+    return items_[depth_];
+}
 
-};
-template<> struct Value::ValueConverter<int64_t>
-{
-    bool is(const Value& v) { return v.type() == Value::INT_TYPE; }
-    int64_t to(const Value& v) { v.assureType<int64_t>(); return v.int_; }
-};
-template<> struct Value::ValueConverter<int>
-{
-    bool is(const Value& v) { return v.type() == Value::INT_TYPE; }
-    int to(const Value& v) { v.assureType<int>(); return static_cast<int>(v.int_); }
-};
-template<> struct Value::ValueConverter<double>
-{
-    bool is(const Value& v) { return v.type() == Value::DOUBLE_TYPE; }
-    double to(const Value& v) { v.assureType<double>(); return v.double_; }
-};
-template<> struct Value::ValueConverter<std::string>
-{
-    bool is(const Value& v) { return v.isString(); }
-    const std::string& to(const Value& v) { v.assureType<std::string>(); return *v.string_; }
-};
-template<> struct Value::ValueConverter<List>
-{
-    bool is(const Value& v) { return v.type() == Value::LIST_TYPE; }
-    const List& to(const Value& v) { v.assureType<List>(); return *v.list_; }
-};
-template<> struct Value::ValueConverter<Object>
+inline void JsonParser::skipWhitespace()
 {
-    bool is(const Value& v) { return v.type() == Value::OBJECT_TYPE; }
-    const Object& to(const Value& v) { v.assureType<Object>(); return *v.object_; }
-};
+    while (p_ < end_ && isWhitespace(*p_))
+        ++p_;
+}
 
-template<typename T>
-struct Value::ValueConverter<std::vector<T>>
+inline Value JsonParser::parse()
 {
-    bool is(const Value& v)
-    {
-        if (v.type() != Value::LIST_TYPE)
-            return false;
-        const List& list = v.as<List>();
-        if (list.empty())
-            return true;
-        return list.front().is<T>();
+    if (options_.maxBytes != 0 && static_cast<size_t>(end_ - begin_) > options_.maxBytes) {
+        fail(ErrorCode::MAX_BYTES_EXCEEDED, "input exceeds maximum size");
+        return Value();
     }
 
-    std::vector<T> to(const Value& v)
-    {
-        const List& list = v.as<List>();
-        if (list.empty())
-            return std::vector<T>();
-        list.front().assureType<T>();
-
-        std::vector<T> result;
-        for (const auto& element : list) {
-            result.push_back(element.as<T>());
-        }
+    skipWhitespace();
+    // An empty document is an empty object, as with parse().
+    if (p_ == end_)
+        return addNode() ? Value(Object()) : Value();
 
-        return result;
+    if (*p_ != '{') {
+        fail("expected object at top level");
+        return Value();
     }
-};
 
-namespace internal {
-template<typename T> inline const char* type_name();
-template<> inline const char* type_name<bool>() { return "bool"; }
-template<> inline const char* type_name<int>() { return "int"; }
-template<> inline const char* type_name<int64_t>() { return "int64_t"; }
-template<> inline const char* type_name<double>() { return "double"; }
-template<> inline const char* type_name<std::string>() { return "string"; }
-template<> inline const char* type_name<hcl::List>() { return "list"; }
-template<> inline const char* type_name<hcl::Object>() { return "object"; }
-} // namespace internal
+    Item root;
+    if (!parseObject(root))
+        return Value();
 
-template<typename T>
-inline void Value::assureType() const
-{
-    if (!is<T>())
-        failwith("type error: this value is ", typeToString(type_), " but ", internal::type_name<T>(), " was requested");
-}
+    skipWhitespace();
+    if (p_ != end_) {
+        fail("unexpected data after document");
+        return Value();
+    }
 
-template<typename T>
-inline bool Value::is() const
-{
-    return ValueConverter<T>().is(*this);
+    return toValue(root);
 }
 
-template<typename T>
-inline typename call_traits<T>::return_type Value::as() const
+inline bool JsonParser::parseValue(Item& item)
 {
-    return ValueConverter<T>().to(*this);
+    if (p_ == end_)
+        return fail("Reached end of file");
+
+    switch (*p_) {
+    case '{':
+        return parseObject(item);
+    case '[':
+        return parseList(item);
+    case '"': {
+        if (!addNode())
+            return false;
+        std::string s;
+        if (!parseString(s))
+            return false;
+        const bool hil = s.find("${") != std::string::npos;
+        item.value = Value(std::move(s));
+        if (hil)
+            item.value.setStringType(Value::StringType::Hil);
+        return true;
+    }
+    case 't':
+        if (!addNode() || !parseWord("true", 4))
+            return false;
+        item.value = Value(true);
+        return true;
+    case 'f':
+        if (!addNode() || !parseWord("false", 5))
+            return false;
+        item.value = Value(false);
+        return true;
+    case 'n':
+        // HCL reads null as an empty string.
+        if (!addNode() || !parseWord("null", 4))
+            return false;
+        item.value = Value(std::string());
+        return true;
+    default:
+        if (*p_ == '-' || ('0' <= *p_ && *p_ <= '9'))
+            return addNode() && parseNumber(item.value);
+        return fail(std::string("unexpected character: ") + *p_);
+    }
 }
 
-inline bool Value::isNumber() const
+inline bool JsonParser::parseObject(Item& item)
 {
-    return is<int>() || is<double>();
-}
+    if (!enterNesting() || !addNode())
+        return false;
+    ++p_;
 
-inline double Value::asNumber() const
-{
-    if (is<int>())
-        return as<int>();
-    if (is<double>())
-        return as<double>();
+    std::vector<Item>& members = items();
+    const size_t mark = flattened_.size();
+    members.clear();
 
-    failwith("type error: this value is ", typeToString(type_), " but number is requested");
-}
+    skipWhitespace();
+    if (p_ < end_ && *p_ == '}') {
+        ++p_;
+    } else {
+        while (true) {
+            skipWhitespace();
+            if (p_ == end_ || *p_ != '"')
+                return fail("expected object key");
+
+            members.emplace_back();
+            Item& member = members.back();
+            if (!parseString(member.key))
+                return false;
 
-inline Value::StringType Value::getStringType() const
-{
-    if (!is<std::string>())
-        failwith("type must be string to use setStringType(type).");
+            skipWhitespace();
+            if (p_ == end_ || *p_ != ':')
+                return fail("expected ':' after object key");
+            ++p_;
+            skipWhitespace();
 
-    switch (type_) {
-    case STRING_TYPE:
-        return StringType::Normal;
-    case IDENT_TYPE:
-        return StringType::Ident;
-    case HIL_TYPE:
-        return StringType::Hil;
-    default:
-        assert(0);
-        return StringType::Normal;
+            if (!parseValue(member))
+                return false;
+
+            skipWhitespace();
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+                continue;
+            }
+            if (p_ < end_ && *p_ == '}') {
+                ++p_;
+                break;
+            }
+            return fail("expected ',' or '}' in object");
+        }
     }
+    leaveNesting();
+
+    item.object = true;
+    bool flatten = !members.empty();
+    for (const auto& member : members)
+        flatten = flatten && member.object;
+
+    if (flatten) {
+        item.kind = ItemKind::OBJECT_ITEMS;
+        item.first = flattened_.size();
+        item.count = members.size();
+        std::move(members.begin(), members.end(), std::back_inserter(flattened_));
+    } else {
+        item.value = Value(Object());
+        for (auto& member : members) {
+            keys_.assign(1, member.key);
+            emit(item.value, member);
+        }
+        // Everything flattened below this object has been merged into it.
+        flattened_.erase(flattened_.begin() + mark, flattened_.end());
+    }
+    members.clear();
+    return true;
 }
 
-inline void Value::setStringType(StringType type)
+inline bool JsonParser::parseList(Item& item)
 {
-    if (!is<std::string>())
-        failwith("type must be string to use setStringType(type).");
+    if (!enterNesting() || !addNode())
+        return false;
+    ++p_;
 
-    switch (type) {
-    case StringType::Normal:
-        type_ = STRING_TYPE;
+    std::vector<Item>& elements = items();
+    const size_t mark = flattened_.size();
+    elements.clear();
+
+    skipWhitespace();
+    if (p_ < end_ && *p_ == ']') {
+        ++p_;
+    } else {
+        while (true) {
+            skipWhitespace();
+            elements.emplace_back();
+            if (!parseValue(elements.back()))
+                return false;
+
+            skipWhitespace();
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+                continue;
+            }
+            if (p_ < end_ && *p_ == ']') {
+                ++p_;
+                break;
+            }
+            return fail("expected ',' or ']' in list");
+        }
+    }
+    leaveNesting();
+
+    bool flatten = !elements.empty();
+    for (const auto& element : elements)
+        flatten = flatten && element.object;
+
+    if (flatten) {
+        item.kind = ItemKind::LIST_ITEMS;
+        item.first = flattened_.size();
+        item.count = elements.size();
+        std::move(elements.begin(), elements.end(), std::back_inserter(flattened_));
+    } else {
+        List list;
+        list.reserve(elements.size());
+        for (auto& element : elements)
+            list.push_back(toValue(element));
+        item.value = Value(std::move(list));
+        flattened_.erase(flattened_.begin() + mark, flattened_.end());
+    }
+    elements.clear();
+    return true;
+}
+
+inline void JsonParser::emit(Value& node, Item& item)
+{
+    switch (item.kind) {
+    case ItemKind::VALUE:
+        node.mergeObjects(keys_, item.value);
         break;
-    case StringType::Ident:
-        type_ = IDENT_TYPE;
+    case ItemKind::OBJECT_ITEMS:
+        for (size_t i = item.first; i < item.first + item.count; ++i) {
+            keys_.push_back(flattened_[i].key);
+            emit(node, flattened_[i]);
+            keys_.pop_back();
+        }
         break;
-    case StringType::Hil:
-        type_ = HIL_TYPE;
+    case ItemKind::LIST_ITEMS:
+        for (size_t i = item.first; i < item.first + item.count; ++i)
+            emit(node, flattened_[i]);
         break;
-    default:
-        assert(0);
     }
 }
 
-inline bool Value::isString() const
+inline Value JsonParser::toValue(Item& item)
 {
-    return type_ == STRING_TYPE || type_ == IDENT_TYPE || type_ == HIL_TYPE;
+    switch (item.kind) {
+    case ItemKind::OBJECT_ITEMS: {
+        Value node((Object()));
+        for (size_t i = item.first; i < item.first + item.count; ++i) {
+            keys_.assign(1, flattened_[i].key);
+            emit(node, flattened_[i]);
+        }
+        return node;
+    }
+    case ItemKind::LIST_ITEMS: {
+        List list;
+        list.reserve(item.count);
+        for (size_t i = item.first; i < item.first + item.count; ++i)
+            list.push_back(toValue(flattened_[i]));
+        return Value(std::move(list));
+    }
+    default:
+        return std::move(item.value);
+    }
 }
 
-inline bool Value::isIdent() const
+inline bool JsonParser::parseString(std::string& out)
 {
-    return getStringType() == StringType::Ident;
-}
+    ++p_;
 
-inline bool Value::isHil() const
-{
-    return getStringType() == StringType::Hil;
+    // Most strings have no escapes; copy those in one go.
+    const char* start = p_;
+    while (p_ < end_ && *p_ != '"' && *p_ != '\\' && static_cast<unsigned char>(*p_) >= 0x20)
+        ++p_;
+    out.assign(start, p_);
+
+    while (true) {
+        if (p_ == end_)
+            return fail("string didn't end");
+
+        char c = *p_++;
+        if (c == '"')
+            break;
+        if (static_cast<unsigned char>(c) < 0x20)
+            return fail("control character in string");
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+
+        if (p_ == end_)
+            return fail("string didn't end");
+        c = *p_++;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            out += c;
+            break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            if (end_ - p_ < 4 || !isHexDigit(p_[0]) || !isHexDigit(p_[1]) ||
+                !isHexDigit(p_[2]) || !isHexDigit(p_[3]))
+                return fail("string has unknown escape sequence");
+            std::uint32_t x = parseHex(p_, 4);
+            p_ += 4;
+
+            // A surrogate pair.
+            if (0xD800 <= x && x <= 0xDBFF && end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u' &&
+                isHexDigit(p_[2]) && isHexDigit(p_[3]) && isHexDigit(p_[4]) && isHexDigit(p_[5])) {
+                std::uint32_t low = parseHex(p_ + 2, 4);
+                if (0xDC00 <= low && low <= 0xDFFF) {
+                    x = 0x10000 + ((x - 0xD800) << 10) + (low - 0xDC00);
+                    p_ += 6;
+                }
+            }
+            appendCodepoint(x, out);
+            break;
+        }
+        default:
+            return fail("string has unknown escape sequence");
+        }
+    }
+
+    if (options_.maxStringLength != 0 && out.size() > options_.maxStringLength)
+        return fail(ErrorCode::MAX_STRING_LENGTH_EXCEEDED, "string exceeds maximum length");
+    return true;
 }
 
-// static
-inline bool operator==(const Value& lhs, const Value& rhs)
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+inline bool JsonParser::parseNumber(Value& out)
 {
-    if (lhs.type() != rhs.type()) {
-        if (!lhs.isString() && !rhs.isString()) {
-            return false;
-        }
+    const char* start = p_;
+    bool integer = true;
+
+    if (*p_ == '-')
+        ++p_;
+    if (p_ < end_ && *p_ == '0') {
+        ++p_;
+    } else if (p_ < end_ && '1' <= *p_ && *p_ <= '9') {
+        while (p_ < end_ && '0' <= *p_ && *p_ <= '9')
+            ++p_;
+    } else {
+        return fail("invalid number");
     }
 
-    switch (lhs.type()) {
-    case Value::Type::NULL_TYPE:
+    if (p_ < end_ && *p_ == '.') {
+        integer = false;
+        ++p_;
+        if (p_ == end_ || !('0' <= *p_ && *p_ <= '9'))
+            return fail("invalid number");
+        while (p_ < end_ && '0' <= *p_ && *p_ <= '9')
+            ++p_;
+    }
+
+    if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+        integer = false;
+        ++p_;
+        if (p_ < end_ && (*p_ == '+' || *p_ == '-'))
+            ++p_;
+        if (p_ == end_ || !('0' <= *p_ && *p_ <= '9'))
+            return fail("invalid number");
+        while (p_ < end_ && '0' <= *p_ && *p_ <= '9')
+            ++p_;
+    }
+
+    const size_t size = static_cast<size_t>(p_ - start);
+    if (!integer) {
+        out = Value(parseDouble(start, size));
         return true;
-    case Value::Type::BOOL_TYPE:
-        return lhs.bool_ == rhs.bool_;
-    case Value::Type::INT_TYPE:
-        return lhs.int_ == rhs.int_;
-    case Value::Type::DOUBLE_TYPE:
-        return lhs.double_ == rhs.double_;
-    case Value::Type::STRING_TYPE:
-    case Value::Type::IDENT_TYPE:
-    case Value::Type::HIL_TYPE:
-        return *lhs.string_ == *rhs.string_;
-    case Value::Type::LIST_TYPE:
-        return *lhs.list_ == *rhs.list_;
-    case Value::Type::OBJECT_TYPE:
-        return *lhs.object_ == *rhs.object_;
-    default:
-        failwith("unknown type");
     }
+
+    std::int64_t x;
+    if (!parseInteger(start, size, &x)) {
+        // Out of range. Saturates, as parse() does.
+        x = *start == '-' ? std::numeric_limits<std::int64_t>::min()
+                          : std::numeric_limits<std::int64_t>::max();
+    }
+    out = Value(x);
+    return true;
 }
 
-// static
-inline std::ostream& operator<<(std::ostream& os, const hcl::Value& v)
+inline bool JsonParser::parseWord(const char* word, size_t size)
 {
-    v.write(&os);
-    return os;
+    if (static_cast<size_t>(end_ - p_) < size || std::memcmp(p_, word, size) != 0)
+        return fail(std::string("unexpected character: ") + *p_);
+    p_ += size;
+    return true;
 }
 
-inline std::string Value::spaces(int num)
+} // namespace internal
+
+inline ParseResult parseJSON(const char* data, size_t size, const ParseOptions& options)
 {
-    if (num <= 0)
-        return std::string();
+    internal::JsonParser parser(data, size, options);
+    hcl::Value v = parser.parse();
 
-    return std::string(num, ' ');
+    if (v.valid())
+        return ParseResult(std::move(v), std::string());
+
+    return ParseResult(std::move(v), parser.errorReason(), parser.errorCode());
 }
 
-inline std::string Value::escapeKey(const std::string& key)
+inline ParseResult parseJSON(const std::string& buffer, const ParseOptions& options)
 {
-    auto position = std::find_if(key.begin(), key.end(), [](char c) -> bool {
-        if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')
-            return false;
-        return true;
-    });
-
-    if (position != key.end()) {
-        std::string escaped = "\"";
-        for (const char& c : key) {
-            if (c == '\\' || c  == '"')
-                escaped += '\\';
-            escaped += c;
-        }
-        escaped += "\"";
+    return parseJSON(buffer.data(), buffer.size(), options);
+}
 
-        return escaped;
+inline ParseResult parseJSONFile(const std::string& filename, const ParseOptions& options)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        return ParseResult(hcl::Value(),
+                           std::string("could not open file: ") + filename,
+                           ErrorCode::IO_ERROR);
     }
 
-    return key;
+    std::string buffer((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    return parseJSON(buffer, options);
 }
 
-inline void Value::write(std::ostream* os, const std::string& keyPrefix, int indent) const
+// ----------------------------------------------------------------------
+// Document
+
+inline Document::Document(std::string text, const ParseOptions& options) :
+    text_(std::move(text)),
+    options_(options),
+    errorCode_(ErrorCode::NONE),
+    incremental_(false)
 {
-    switch (type_) {
-    case NULL_TYPE:
-        failwith("null type value is not a valid value");
-        break;
-    case BOOL_TYPE:
-        (*os) << (bool_ ? "true" : "false");
-        break;
-    case INT_TYPE:
-        (*os) << int_;
-        break;
-    case DOUBLE_TYPE: {
-        (*os) << std::fixed << std::showpoint << double_;
-        break;
+    parseAll();
+}
+
+inline bool Document::edit(size_t offset, size_t length, const std::string& replacement)
+{
+    if (offset > text_.size() || length > text_.size() - offset) {
+        failwith("edit is out of range");
+        return false;
     }
-    case STRING_TYPE:
-    case HIL_TYPE:
-        (*os) << '"' << internal::escapeString(*string_) << '"';
-        break;
-    case IDENT_TYPE:
-        (*os) << internal::escapeString(*string_);
-        break;
-    case LIST_TYPE:
-        (*os) << '[';
-        for (size_t i = 0; i < list_->size(); ++i) {
-            if (i)
-                (*os) << ", ";
-            (*list_)[i].write(os, keyPrefix, -1);
-        }
-        (*os) << ']';
-        break;
-    case OBJECT_TYPE:
-        for (const auto& kv : *object_) {
-            if (kv.second.is<Object>())
-                continue;
-            if (kv.second.is<List>() && kv.second.size() > 0 && kv.second.find(0)->is<Object>())
-                continue;
-            (*os) << spaces(indent) << escapeKey(kv.first) << " = ";
-            kv.second.write(os, keyPrefix, indent + 4);
-            (*os) << '\n';
-        }
-        for (const auto& kv : *object_) {
-            if (kv.second.is<Object>()) {
-                std::string key;
-
-                key += escapeKey(kv.first);
-                (*os) << spaces(indent) << key << " {\n";
-                kv.second.write(os, key, indent + 4);
-                (*os) << spaces(indent) << "}\n";
-            }
-            if (kv.second.is<List>() && kv.second.size() > 0 && kv.second.find(0)->is<Object>()) {
-                std::string key;
-
-                key += escapeKey(kv.first);
-                (*os) << spaces(indent) << key << " = [";
-                for (const auto& v : kv.second.as<List>()) {
-                    if(v.is<Object>())
-                        (*os) << "\n" << spaces(indent + 4) << "{";
-                    else
-                        (*os) << spaces(indent);
-                    v.write(os, key, indent + 4);
-                    if(v.is<Object>())
-                        (*os) << "},\n";
-                }
-                (*os) << spaces(indent) << "]\n";
-            }
-        }
-        break;
-    default:
-        failwith("writing unknown type");
-        break;
+
+    // The item the edit falls in, if any.
+    size_t index = items_.size();
+    const size_t size = text_.size() - length + replacement.size();
+    if (!options_.schema && options_.maxNodes == 0 &&
+        (options_.maxBytes == 0 || size <= options_.maxBytes)) {
+        auto it = std::upper_bound(items_.begin(), items_.end(), offset,
+                                   [](size_t x, const Item& item) { return x < item.begin; });
+        if (it != items_.begin() && offset + length <= (it - 1)->end)
+            index = static_cast<size_t>(it - items_.begin()) - 1;
     }
+    // Where a heredoc ends depends on the text after it, which a parse
+    // of the item alone does not see.
+    if (index < items_.size() && hasHeredoc(items_[index].begin, items_[index].end))
+        index = items_.size();
+
+    text_.replace(offset, length, replacement);
+
+    incremental_ = index < items_.size() &&
+        reparseItem(index, items_[index].end - length + replacement.size());
+    if (!incremental_)
+        parseAll();
+    return valid();
 }
 
-template<typename T>
-inline typename call_traits<T>::return_type Value::get(const std::string& key) const
+inline void Document::parseAll()
 {
-    if (!is<Object>())
-        failwith("type must be object to do get(key).");
-
-    const Value* obj = find(key);
-    if (!obj)
-        failwith("key ", key, " was not found.");
+    items_.clear();
+    groups_.clear();
+
+    internal::MemoryStreambuf buffer;
+    buffer.reset(text_.data(), text_.size());
+    std::istream is(&buffer);
+    internal::Parser parser(is, options_);
+
+    // Parser offsets start after the BOM.
+    const size_t base = text_.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+
+    Value root;
+    while (parser.parseNextItem(root)) {
+        Item item;
+        item.begin = base + parser.itemBegin();
+        item.end = base + parser.itemEnd();
+        item.keys = parser.itemKeys();
+        ++groups_[item.keys.front()];
+        items_.push_back(std::move(item));
+    }
 
-    return obj->as<T>();
+    if (root.valid() && parser.errorReason().empty()) {
+        value_ = std::move(root);
+        errorReason_.clear();
+        errorCode_ = ErrorCode::NONE;
+    } else {
+        value_ = Value();
+        errorReason_ = parser.errorReason();
+        errorCode_ = parser.errorCode();
+        items_.clear();
+        groups_.clear();
+    }
 }
 
-inline const Value* Value::find(const std::string& key) const
+// Reparses items_[index], which now ends at |end| in text_, on its own.
+// Returns false, leaving the document as it was, when the new text is
+// not exactly one item or would not merge into value_ the same way.
+inline bool Document::reparseItem(size_t index, size_t end)
 {
-    if (!is<Object>())
-        return nullptr;
+    Item& item = items_[index];
 
-    std::istringstream ss(key);
-    internal::Lexer lexer(ss);
+    // Text after the item must not continue its last token.
+    if (end < text_.size() && !internal::isWhitespace(text_[end]) &&
+        text_[end] != ',' && text_[end] != '#' && text_[end] != '/')
+        return false;
+    // Nor may text before it run into its first token. Comments end
+    // with a newline, so whitespace covers them.
+    const size_t base = text_.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+    if (item.begin > base && !internal::isWhitespace(text_[item.begin - 1]) &&
+        text_[item.begin - 1] != ',' && text_[item.begin - 1] != '}')
+        return false;
+    if (hasHeredoc(item.begin, end))
+        return false;
 
-    const Value* current = this;
-    while (true) {
-        internal::Token t = lexer.nextToken();
-        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
-            return nullptr;
+    internal::MemoryStreambuf buffer;
+    buffer.reset(text_.data() + item.begin, end - item.begin);
+    std::istream is(&buffer);
+    internal::Parser parser(is, options_);
 
-        std::string part = t.strValue();
-        t = lexer.nextToken();
-        //if (t.type() == internal::TokenType::PERIOD) {
-        //    current = current->findChild(part);
-        //    if (!current || !current->is<Object>())
-        //        return nullptr;
-        //} else
-        if (t.type() == internal::TokenType::END_OF_FILE) {
-            return current->findChild(part);
-        } else {
-            return nullptr;
+    Value root;
+    if (!parser.parseNextItem(root) || parser.itemEnd() != end - item.begin)
+        return false;
+    if (parser.parseNextItem(root) || !parser.errorReason().empty())
+        return false;
+
+    const std::vector<std::string>& keys = parser.itemKeys();
+    const std::string& oldFront = item.keys.front();
+    const std::string& newFront = keys.front();
+    if (groups_[oldFront] == 1 && (newFront == oldFront || groups_.count(newFront) == 0)) {
+        // The only item with its first key: replace the whole child,
+        // keeping its place in objects that keep one.
+        if (newFront != oldFront) {
+            value_.renameChild(oldFront, newFront);
+            groups_.erase(oldFront);
+            groups_[newFront] = 1;
         }
+        *value_.findChild(newFront) = std::move(*root.findChild(newFront));
+    } else if (keys == item.keys && keys.size() > 1) {
+        // A block among others with the same first key. Merging only
+        // looked at its keys, so its body can be swapped in place.
+        Value* block = findBlock(index);
+        if (!block)
+            return false;
+        Value* body = &root;
+        for (const auto& key : keys)
+            body = body->findChild(key);
+        *block = std::move(*body);
+    } else {
+        return false;
+    }
+
+    item.keys = keys;
+    const size_t oldEnd = item.end;
+    item.end = end;
+    for (size_t i = index + 1; i < items_.size(); ++i) {
+        items_[i].begin = items_[i].begin - oldEnd + end;
+        items_[i].end = items_[i].end - oldEnd + end;
     }
+    return true;
 }
 
-inline Value* Value::find(const std::string& key)
+// True if text_[begin, end) may hold a heredoc. "<<" inside a string
+// gives a false positive, which only costs a full parse.
+inline bool Document::hasHeredoc(size_t begin, size_t end) const
 {
-    return const_cast<Value*>(const_cast<const Value*>(this)->find(key));
+    const char marker[] = "<<";
+    return std::search(text_.begin() + begin, text_.begin() + end, marker, marker + 2) != text_.begin() + end;
 }
 
-inline bool Value::sharesKeyWith(const hcl::Value& v) const
+// Finds the body of the block items_[index] in value_.
+inline Value* Document::findBlock(size_t index)
 {
-    if (this == &v)
-        return true;
-    if (!is<Object>() || !v.is<Object>())
-        return false;
+    const std::vector<std::string>& keys = items_[index].keys;
+    Value* node = value_.findChild(keys.front());
+    if (!node)
+        return nullptr;
 
-    for (const auto& kv : *v.object_) {
-        if (find(kv.first)) {
-            return true;
+    auto walk = [&keys](Value* v) {
+        for (size_t i = 1; v && i < keys.size(); ++i)
+            v = v->is<Object>() ? v->findChild(keys[i]) : nullptr;
+        return v;
+    };
+    if (!node->is<List>())
+        return walk(node);
+
+    // Blocks sharing their first keys were expanded into a list, one
+    // block per element in text order. Give up if anything else in the
+    // list has the same keys.
+    size_t ordinal = 0;
+    size_t matchingItems = 0;
+    for (size_t i = 0; i < items_.size(); ++i) {
+        if (items_[i].keys == keys) {
+            if (i < index)
+                ++ordinal;
+            ++matchingItems;
         }
     }
 
-    return false;
+    Value* block = nullptr;
+    size_t matchingElements = 0;
+    for (size_t i = 0; i < node->size(); ++i) {
+        if (Value* v = walk(node->find(i))) {
+            if (matchingElements++ == ordinal)
+                block = v;
+        }
+    }
+    return matchingElements == matchingItems ? block : nullptr;
 }
 
-inline bool Value::merge(const hcl::Value& v)
-{
-    if (this == &v)
-        return true;
-    if (!is<Object>() || !v.is<Object>())
-        return false;
+// ----------------------------------------------------------------------
+// Decoder
 
-    for (const auto& kv : *v.object_) {
-        if (Value* tmp = find(kv.first)) {
-            // If both are object, we merge them.
-            if (tmp->is<Object>() && kv.second.is<Object>()) {
-                if (!tmp->merge(kv.second))
-                    return false;
-            } else {
-                setChild(kv.first, kv.second);
-            }
-        } else {
-            setChild(kv.first, kv.second);
+namespace internal {
+
+// A key or block label. Points into the decoded buffer, or into
+// decoder-owned storage when the key had escape sequences.
+struct KeySpan {
+    const char* data;
+    size_t size;
+
+    bool equals(const char* s) const
+    {
+        for (size_t i = 0; i < size; ++i) {
+            if (s[i] == '\0' || s[i] != data[i])
+                return false;
         }
+        return s[size] == '\0';
     }
 
-    return true;
-}
+    std::string str() const { return std::string(data, size); }
+};
 
-inline bool Value::mergeObjects(const std::vector<std::string>& keys, Value& added)
-{
-    if(keys.size() == 0) {
-        return false;
-    }
+// Runs the Parser grammar over Scanner tokens, handing values to
+// Decoder<T> instead of building Values.
+//
+// The decode functions start at the first token of a value and stop at
+// its last token, as in Parser.
+class StructDecoder {
+public:
+    // Maximum number of keys of a single item, e.g. 'a "b" "c" {}' has 3.
+    static const size_t kMaxKeys = 16;
+    static const size_t kMaxDepth = 256;
 
-    Value& nestedValue = added;
-    if (keys.size() > 1) {
-        Value parent((Object()));
-        Value* ptr = &parent;
-        std::vector<std::string> allButFirst(keys.begin() + 1, keys.end());
-        for (auto key = allButFirst.begin(); key < allButFirst.end(); key++) {
-            if ((key != allButFirst.end()) && (key + 1 == allButFirst.end())) {
-                ptr->set(*key, nestedValue);
-            } else {
-                ptr = ptr->set(*key, Object());
-            }
-        }
-        nestedValue = parent;
-    }
-    Value* existing = find(keys.front());
-    bool expand = false;
-    if(existing)  {
-        if (existing->is<List>()) {
-            // This is an object list. Add the object.
-            existing->push(std::move(added));
-        } else {
-            // We tried assigning to a value that exists already.
-            // First, attempt to see if this is an object.
-            if (existing->is<Object>()) {
-                if (!added.is<Object>()) {
-                    // We tried assigning a non-object to an existing object.
-                    // Expand it into a list.
-                    expand = true;
-                } else {
-                    // If the objects share any keys (not nested),
-                    // expand into a list. Else, merge the two
-                    // objects.
-                    if (existing->sharesKeyWith(added)) {
-                        expand = true;
-                    } else {
-                        existing->merge(added);
-                    }
-                }
-            } else {
-                // We tried assigning something to a non-object.
-                // Expand it into a list.
-                expand = true;
-            }
-            // Upgrade it to a list.
-            if(expand)
-            {
-                Value l((List()));
-                l.push(*existing);
-                l.push(std::move(added));
-                set(keys.front(), l);
-            }
-        }
-    } else {
-        set(keys.front(), added);
+    StructDecoder(const char* data, size_t size) :
+        scanner_(data, size),
+        depth_(0)
+    {
+        token_.type = TokenType::ILLEGAL;
     }
 
+    // Reads the first token.
+    bool start();
+
+    const SpanToken& token() const { return token_; }
+    std::string tokenText() const { return std::string(token_.data, token_.size); }
+
+    // Records an error at the current token. Always returns false.
+    bool fail(const std::string& reason);
+    const std::string& errorReason() const { return errorReason_; }
+
+    // Calls |item(keys, count)| for each item, positioned at the value.
+    template<typename F> bool decodeObjectList(bool nested, F&& item);
+    // Same as decodeObjectList(true, item) on a '{ ... }' value.
+    template<typename F> bool decodeObject(F&& item);
+    // Calls |element()| for each element, positioned at the element.
+    template<typename F> bool decodeList(F&& element);
+    bool skipValue();
+
+    bool decodeBool(bool& out);
+    bool decodeInteger(std::int64_t& out);
+    bool decodeDouble(double& out);
+    bool decodeString(std::string& out);
+
+private:
+    void nextToken() { token_ = scanner_.nextToken(); }
+    bool mismatch(const char* expected);
+    bool checkValueStart();
+    bool decodeKeys(KeySpan* keys, std::string* unescaped, size_t& count);
+    bool enterNesting();
+
+    Scanner scanner_;
+    SpanToken token_;
+    size_t depth_;
+    std::string errorReason_;
+};
+
+inline bool StructDecoder::start()
+{
+    if (!scanner_.skipUTF8BOM())
+        return fail("Invalid UTF8 BOM");
+    nextToken();
     return true;
 }
 
-inline Value* Value::set(const std::string& key, const Value& v)
+inline bool StructDecoder::fail(const std::string& reason)
 {
-    Value* result = ensureValue(key);
-    *result = v;
-    return result;
+    std::stringstream ss;
+    ss << "Error:" << token_.lineNo << ":" << token_.columnNo << ": " << reason << "\n";
+    errorReason_ += ss.str();
+    return false;
 }
 
-inline Value* Value::setChild(size_t index, const Value& v)
+inline bool StructDecoder::mismatch(const char* expected)
 {
-    if (!valid())
-        *this = Value((List()));
-
-    if (!is<List>())
-        failwith("type must be list to do set(key, v).");
-
-    (*list_)[index] = v;
-    return &(*list_)[index];
+    return fail(std::string("expected ") + expected + " got: " + tokenText());
 }
 
-inline Value* Value::setChild(size_t index, Value&& v)
+inline bool StructDecoder::enterNesting()
 {
-    if (!valid())
-        *this = Value((List()));
-
-    if (!is<List>())
-        failwith("type must be object to do set(key, v).");
-
-    (*list_)[index] = std::move(v);
-    return &(*list_)[index];
+    if (depth_ >= kMaxDepth)
+        return fail("nesting exceeds maximum depth");
+    ++depth_;
+    return true;
 }
 
-inline Value* Value::setChild(const std::string& key, const Value& v)
+// Same as the checks in Parser::parseObject().
+inline bool StructDecoder::checkValueStart()
 {
-    if (!valid())
-        *this = Value((Object()));
+    switch (token_.type) {
+    case TokenType::NUMBER:
+    case TokenType::FLOAT:
+    case TokenType::BOOL:
+    case TokenType::STRING:
+    case TokenType::HEREDOC:
+    case TokenType::IDENT:
+    case TokenType::HIL:
+    case TokenType::LBRACE:
+    case TokenType::LBRACK:
+        return true;
+    case TokenType::ILLEGAL:
+        return fail(token_.error);
+    case TokenType::END_OF_FILE:
+        return fail("Reached end of file");
+    default:
+        return fail("Unknown token: " + tokenText());
+    }
+}
 
-    if (!is<Object>())
-        failwith("type must be object to do set(key, v).");
+// Same as Parser::parseKeys().
+inline bool StructDecoder::decodeKeys(KeySpan* keys, std::string* unescaped, size_t& count)
+{
+    count = 0;
 
-    (*object_)[key] = v;
-    return &(*object_)[key];
+    while (true) {
+        switch (token_.type) {
+        case TokenType::END_OF_FILE:
+            return fail("end of file reached");
+        case TokenType::ASSIGN:
+            if (count > 1)
+                return fail("nested object expected: LBRACE got: =");
+            if (count == 0)
+                return fail("expected to find at least one object key");
+            return true;
+        case TokenType::LBRACE:
+            if (count == 0)
+                return fail("expected IDENT | STRING got: LBRACE");
+            return true;
+        case TokenType::IDENT:
+        case TokenType::STRING:
+            if (count == kMaxKeys)
+                return fail("too many keys");
+            if (token_.escaped) {
+                unescapeString(token_.data, token_.size, unescaped[count]);
+                keys[count] = KeySpan{unescaped[count].data(), unescaped[count].size()};
+            } else {
+                keys[count] = KeySpan{token_.data, token_.size};
+            }
+            ++count;
+            nextToken();
+            break;
+        case TokenType::ILLEGAL:
+            return fail(token_.error);
+        default:
+            return fail("expected IDENT | STRING | ASSIGN | LBRACE got: " + tokenText());
+        }
+    }
 }
 
-inline Value* Value::setChild(const std::string& key, Value&& v)
+template<typename F>
+inline bool StructDecoder::decodeObjectList(bool nested, F&& item)
 {
-    if (!valid())
-        *this = Value((Object()));
+    KeySpan keys[kMaxKeys];
+    std::string unescaped[kMaxKeys];
 
-    if (!is<Object>())
-        failwith("type must be object to do set(key, v).");
+    while (token_.type != TokenType::END_OF_FILE) {
+        if (nested && token_.type == TokenType::RBRACE)
+            break;
 
-    (*object_)[key] = std::move(v);
-    return &(*object_)[key];
+        size_t count;
+        if (!decodeKeys(keys, unescaped, count))
+            return false;
+        if (token_.type == TokenType::ASSIGN) {
+            nextToken();
+            if (!checkValueStart())
+                return false;
+        }
+        if (!item(static_cast<const KeySpan*>(keys), count))
+            return false;
+
+        nextToken();
+        if (token_.type == TokenType::COMMA)
+            nextToken();
+    }
+
+    if (nested && token_.type != TokenType::RBRACE)
+        return fail("object expected closing RBRACE got: " + tokenText());
+    return true;
 }
 
-inline bool Value::erase(const std::string& key)
+template<typename F>
+inline bool StructDecoder::decodeObject(F&& item)
 {
-    if (!is<Object>())
+    if (token_.type != TokenType::LBRACE)
+        return mismatch("object");
+    if (!enterNesting())
+        return false;
+    nextToken();
+    if (!decodeObjectList(true, std::forward<F>(item)))
         return false;
+    --depth_;
+    return true;
+}
 
-    std::istringstream ss(key);
-    internal::Lexer lexer(ss);
+// Same as Parser::parseListElements().
+template<typename F>
+inline bool StructDecoder::decodeList(F&& element)
+{
+    if (token_.type != TokenType::LBRACK)
+        return mismatch("list");
+    if (!enterNesting())
+        return false;
 
-    Value* current = this;
+    bool needComma = false;
     while (true) {
-        internal::Token t = lexer.nextToken();
-        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
-            return false;
+        nextToken();
 
-        std::string part = t.strValue();
-        t = lexer.nextToken();
-        if (t.type() == internal::TokenType::PERIOD) {
-            current = current->findChild(part);
-            if (!current || !current->is<Object>())
+        if (needComma && token_.type != TokenType::COMMA && token_.type != TokenType::RBRACK)
+            return fail("error parsing list, expected comma or list end, got: " + tokenText());
+
+        switch (token_.type) {
+        case TokenType::BOOL:
+        case TokenType::NUMBER:
+        case TokenType::FLOAT:
+        case TokenType::STRING:
+        case TokenType::HEREDOC:
+        case TokenType::IDENT:
+        case TokenType::HIL:
+        case TokenType::LBRACE:
+            if (!element())
                 return false;
-        } else if (t.type() == internal::TokenType::END_OF_FILE) {
-            return current->eraseChild(part);
-        } else {
-            return false;
+            needComma = true;
+            break;
+        case TokenType::LBRACK:
+            if (!element())
+                return false;
+            break;
+        case TokenType::COMMA:
+            needComma = false;
+            break;
+        case TokenType::RBRACK:
+            --depth_;
+            return true;
+        case TokenType::ILLEGAL:
+            return fail(token_.error);
+        default:
+            return fail("unexpected token while parsing list: " + tokenText());
         }
     }
 }
 
-inline bool Value::eraseChild(const std::string& key)
+inline bool StructDecoder::skipValue()
 {
-    if (!is<Object>())
-        failwith("type must be object to do erase(key).");
+    switch (token_.type) {
+    case TokenType::LBRACE:
+        return decodeObject([this](const KeySpan*, size_t) { return skipValue(); });
+    case TokenType::LBRACK:
+        return decodeList([this]() { return skipValue(); });
+    default:
+        return true;
+    }
+}
 
-    return object_->erase(key) > 0;
+inline bool StructDecoder::decodeBool(bool& out)
+{
+    if (token_.type != TokenType::BOOL)
+        return mismatch("bool");
+    out = token_.data[0] == 't';
+    return true;
 }
 
-inline Value& Value::operator[](size_t index)
+inline bool StructDecoder::decodeInteger(std::int64_t& out)
 {
-    if (!valid())
-        *this = Value((List()));
+    if (token_.type != TokenType::NUMBER)
+        return mismatch("int");
+    if (!parseInteger(token_.data, token_.size, &out))
+        return fail("integer out of range: " + tokenText());
+    return true;
+}
 
-    if (!is<List>())
-        failwith("type must be list to index by int");
+inline bool StructDecoder::decodeDouble(double& out)
+{
+    if (token_.type != TokenType::FLOAT)
+        return mismatch("double");
+    out = parseDouble(token_.data, token_.size);
+    return true;
+}
 
-    if (list_->size() <= index)
-        failwith("index out of bound");
+inline bool StructDecoder::decodeString(std::string& out)
+{
+    switch (token_.type) {
+    case TokenType::STRING:
+    case TokenType::IDENT:
+    case TokenType::HIL:
+        if (token_.escaped)
+            unescapeString(token_.data, token_.size, out);
+        else
+            out.assign(token_.data, token_.size);
+        return true;
+    case TokenType::HEREDOC: {
+        // Rare enough to go through the Lexer, which knows how heredoc
+        // lines are joined.
+        std::istringstream is(tokenText());
+        Lexer lexer(is);
+        Token t = lexer.nextToken();
+        if (t.type() != TokenType::HEREDOC || !unindentHeredoc(t.strValue(), out))
+            return fail("Failed unindenting heredoc");
+        return true;
+    }
+    default:
+        return mismatch("string");
+    }
+}
 
-    if (Value* v = find(index))
-        return *v;
+// Base of Decoders for values that can't have block labels.
+template<typename T>
+struct LeafDecoder {
+    static bool decodeItem(StructDecoder& dec, T& out, const KeySpan*, size_t labels)
+    {
+        if (labels != 0)
+            return dec.fail("unexpected block label");
+        return Decoder<T>::decode(dec, out);
+    }
+};
 
-    return *setChild(index, Value());
+// Decodes the struct member selected by |keys[0]|. The rest of the keys
+// are passed on as block labels.
+template<typename M>
+inline bool decodeMember(StructDecoder& dec, M& member, const KeySpan* keys, size_t count, const char* name)
+{
+    if (Decoder<M>::decodeItem(dec, member, keys + 1, count - 1))
+        return true;
+    return dec.fail(std::string("failed decoding \"") + name + "\"");
 }
 
-inline Value& Value::operator[](const std::string& key)
-{
-    if (!valid())
-        *this = Value((Object()));
+// Visitor for Binding<T>::fields() that decodes the field named
+// |keys[0]|.
+template<typename T>
+class FieldDecoder {
+public:
+    FieldDecoder(StructDecoder& dec, T& out, const KeySpan* keys, size_t count) :
+        dec_(dec),
+        out_(out),
+        keys_(keys),
+        count_(count),
+        index_(0),
+        matchedIndex_(0),
+        matched_(false),
+        ok_(true) {}
+
+    template<typename M, typename C>
+    void operator()(const char* name, M C::*member) { visit(name, member); }
+    template<typename M, typename C>
+    void required(const char* name, M C::*member) { visit(name, member); }
+
+    bool matched() const { return matched_; }
+    bool ok() const { return ok_; }
+    size_t matchedIndex() const { return matchedIndex_; }
 
-    if (Value* v = findChild(key))
-        return *v;
+private:
+    template<typename M, typename C>
+    void visit(const char* name, M C::*member)
+    {
+        if (!matched_ && keys_[0].equals(name)) {
+            matched_ = true;
+            matchedIndex_ = index_;
+            ok_ = decodeMember(dec_, out_.*member, keys_, count_, name);
+        }
+        ++index_;
+    }
 
-    return *setChild(key, Value());
-}
+    StructDecoder& dec_;
+    T& out_;
+    const KeySpan* keys_;
+    size_t count_;
+    size_t index_;
+    size_t matchedIndex_;
+    bool matched_;
+    bool ok_;
+};
+
+// Visitor for Binding<T>::fields() that finds a required field missing
+// from |seen|.
+class RequiredFieldChecker {
+public:
+    explicit RequiredFieldChecker(std::uint64_t seen) :
+        seen_(seen),
+        index_(0),
+        missing_(nullptr) {}
+
+    template<typename M, typename C>
+    void operator()(const char*, M C::*) { ++index_; }
+
+    template<typename M, typename C>
+    void required(const char* name, M C::*)
+    {
+        if (!missing_ && (index_ >= 64 || !(seen_ & (std::uint64_t(1) << index_))))
+            missing_ = name;
+        ++index_;
+    }
+
+    const char* missing() const { return missing_; }
+
+private:
+    std::uint64_t seen_;
+    size_t index_;
+    const char* missing_;
+};
 
+// Field lookup through Binding<T>.
 template<typename T>
-inline typename call_traits<T>::return_type Value::get(size_t index) const
-{
-    if (!is<List>())
-        failwith("type must be list to do get(index).");
+struct BindingFields {
+    static bool decodeField(StructDecoder& dec, T& out, const KeySpan* keys, size_t count, std::uint64_t& seen)
+    {
+        FieldDecoder<T> fields(dec, out, keys, count);
+        Binding<T>::fields(fields);
+        if (!fields.matched())
+            return dec.skipValue();
+        if (!fields.ok())
+            return false;
+        if (fields.matchedIndex() < 64)
+            seen |= std::uint64_t(1) << fields.matchedIndex();
+        return true;
+    }
 
-    if (list_->size() <= index)
-        failwith("index out of bound");
+    static bool checkRequired(StructDecoder& dec, std::uint64_t seen)
+    {
+        RequiredFieldChecker checker(seen);
+        Binding<T>::fields(checker);
+        if (checker.missing())
+            return dec.fail(std::string("missing required field \"") + checker.missing() + "\"");
+        return true;
+    }
+};
 
-    return (*list_)[index].as<T>();
-}
+// Decoder for structs. |Fields| provides
+//   static bool decodeField(StructDecoder&, T&, const KeySpan* keys, size_t count, std::uint64_t& seen);
+//   static bool checkRequired(StructDecoder&, std::uint64_t seen);
+// where decodeField() decodes or skips the field named |keys[0]| and
+// records it in |seen|.
+template<typename T, typename Fields>
+struct RecordDecoder {
+    static bool decode(StructDecoder& dec, T& out)
+    {
+        std::uint64_t seen = 0;
+        return dec.decodeObject([&](const KeySpan* keys, size_t count) {
+            return Fields::decodeField(dec, out, keys, count, seen);
+        }) && Fields::checkRequired(dec, seen);
+    }
 
-inline const Value* Value::find(size_t index) const
-{
-    if (!is<List>())
-        return nullptr;
-    if (index < list_->size())
-        return &(*list_)[index];
-    return nullptr;
-}
+    // The first label selects a field.
+    static bool decodeItem(StructDecoder& dec, T& out, const KeySpan* labels, size_t count)
+    {
+        if (count == 0)
+            return decode(dec, out);
+        std::uint64_t seen = 0;
+        return Fields::decodeField(dec, out, labels, count, seen);
+    }
+
+    // The top level object list.
+    static bool decodeBody(StructDecoder& dec, T& out)
+    {
+        std::uint64_t seen = 0;
+        return dec.decodeObjectList(false, [&](const KeySpan* keys, size_t count) {
+            return Fields::decodeField(dec, out, keys, count, seen);
+        }) && Fields::checkRequired(dec, seen);
+    }
+};
 
-inline Value* Value::find(size_t index)
+template<typename T>
+inline bool fitsIn(std::int64_t x)
 {
-    return const_cast<Value*>(const_cast<const Value*>(this)->find(index));
+    if (x < 0)
+        return std::is_signed<T>::value && x >= static_cast<std::int64_t>(std::numeric_limits<T>::min());
+    return static_cast<std::uint64_t>(x) <= static_cast<std::uint64_t>(std::numeric_limits<T>::max());
 }
 
-inline Value* Value::push(const Value& v)
-{
-    if (!valid())
-        *this = Value((List()));
-    else if (!is<List>())
-        failwith("type must be list to do push(Value).");
+template<typename M>
+struct MapDecoder {
+    typedef typename M::mapped_type Mapped;
 
-    list_->push_back(v);
-    return &list_->back();
-}
+    static bool decode(StructDecoder& dec, M& out)
+    {
+        return dec.decodeObject([&](const KeySpan* keys, size_t count) {
+            return decodeItem(dec, out, keys, count);
+        });
+    }
 
-inline Value* Value::push(Value&& v)
-{
-    if (!valid())
-        *this = Value((List()));
-    else if (!is<List>())
-        failwith("type must be list to do push(Value).");
+    static bool decodeItem(StructDecoder& dec, M& out, const KeySpan* labels, size_t count)
+    {
+        if (count == 0)
+            return decode(dec, out);
+        Mapped& mapped = out[labels[0].str()];
+        return Decoder<Mapped>::decodeItem(dec, mapped, labels + 1, count - 1);
+    }
 
-    list_->push_back(std::move(v));
-    return &list_->back();
-}
+    static bool decodeBody(StructDecoder& dec, M& out)
+    {
+        return dec.decodeObjectList(false, [&](const KeySpan* keys, size_t count) {
+            return decodeItem(dec, out, keys, count);
+        });
+    }
+};
 
-inline Value* Value::ensureValue(const std::string& key)
-{
-    if (!valid())
-        *this = Value((Object()));
-    if (!is<Object>()) {
-        failwith("encountered non object value");
+} // namespace internal
+
+// Structs, through Binding<T>.
+template<typename T, typename Enable>
+struct Decoder : internal::RecordDecoder<T, internal::BindingFields<T>> {};
+
+template<>
+struct Decoder<bool> : internal::LeafDecoder<bool> {
+    static bool decode(internal::StructDecoder& dec, bool& out) { return dec.decodeBool(out); }
+};
+
+template<typename T>
+struct Decoder<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> :
+    internal::LeafDecoder<T> {
+    static bool decode(internal::StructDecoder& dec, T& out)
+    {
+        std::int64_t x;
+        if (!dec.decodeInteger(x))
+            return false;
+        if (!internal::fitsIn<T>(x))
+            return dec.fail("integer out of range: " + dec.tokenText());
+        out = static_cast<T>(x);
+        return true;
     }
+};
 
-    std::istringstream ss(key);
-    internal::Lexer lexer(ss);
+template<typename T>
+struct Decoder<T, typename std::enable_if<std::is_floating_point<T>::value>::type> :
+    internal::LeafDecoder<T> {
+    static bool decode(internal::StructDecoder& dec, T& out)
+    {
+        double x;
+        if (!dec.decodeDouble(x))
+            return false;
+        out = static_cast<T>(x);
+        return true;
+    }
+};
 
-    Value* current = this;
-    while (true) {
-        internal::Token t = lexer.nextToken();
-        if (key.size() > 0 && !(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING)) {
-            failwith("invalid key first: " + t.strValue() + " ");
+template<>
+struct Decoder<std::string> : internal::LeafDecoder<std::string> {
+    static bool decode(internal::StructDecoder& dec, std::string& out) { return dec.decodeString(out); }
+};
+
+// A list value appends its elements. Any other value, such as a
+// repeated block, appends one element.
+template<typename T, typename Allocator>
+struct Decoder<std::vector<T, Allocator>> {
+    static bool decode(internal::StructDecoder& dec, std::vector<T, Allocator>& out)
+    {
+        if (dec.token().type == internal::TokenType::LBRACK) {
+            return dec.decodeList([&]() {
+                out.emplace_back();
+                return Decoder<T>::decode(dec, out.back());
+            });
         }
 
-        std::string part = t.strValue();
+        out.emplace_back();
+        return Decoder<T>::decode(dec, out.back());
+    }
 
-        if (key.size() == 0)
-            part = "";
+    static bool decodeItem(internal::StructDecoder& dec, std::vector<T, Allocator>& out,
+                           const internal::KeySpan* labels, size_t count)
+    {
+        if (count == 0)
+            return decode(dec, out);
+        out.emplace_back();
+        return Decoder<T>::decodeItem(dec, out.back(), labels, count);
+    }
+};
 
-        t = lexer.nextToken();
-        if (t.type() == internal::TokenType::PERIOD) {
-            if (Value* candidate = current->findChild(part)) {
-                if (!candidate->is<Object>())
-                    failwith("encountered non object value");
+template<typename T, typename Compare, typename Allocator>
+struct Decoder<std::map<std::string, T, Compare, Allocator>> :
+    internal::MapDecoder<std::map<std::string, T, Compare, Allocator>> {};
 
-                current = candidate;
-            } else {
-                current = current->setChild(part, Object());
-            }
-        } else if (t.type() == internal::TokenType::END_OF_FILE) {
-            if (Value* v = current->findChild(part))
-                return v;
-            return current->setChild(part, Value());
-        } else {
-            failwith("invalid key second: " + t.strValue() + " ");
-        }
+template<typename T, typename Hash, typename Equal, typename Allocator>
+struct Decoder<std::unordered_map<std::string, T, Hash, Equal, Allocator>> :
+    internal::MapDecoder<std::unordered_map<std::string, T, Hash, Equal, Allocator>> {};
+
+// Allocated when the key is present.
+template<typename T, typename Deleter>
+struct Decoder<std::unique_ptr<T, Deleter>> {
+    static bool decode(internal::StructDecoder& dec, std::unique_ptr<T, Deleter>& out)
+    {
+        if (!out)
+            out.reset(new T());
+        return Decoder<T>::decode(dec, *out);
     }
-}
 
-inline Value* Value::findChild(const std::string& key)
-{
-    if(!is<Object>())
-        failwith("cannot use findChild on non-object");
+    static bool decodeItem(internal::StructDecoder& dec, std::unique_ptr<T, Deleter>& out,
+                           const internal::KeySpan* labels, size_t count)
+    {
+        if (!out)
+            out.reset(new T());
+        return Decoder<T>::decodeItem(dec, *out, labels, count);
+    }
+};
 
-    auto it = object_->find(key);
-    if (it == object_->end())
-        return nullptr;
+#if __cplusplus >= 201703L
+template<typename T>
+struct Decoder<std::optional<T>> {
+    static bool decode(internal::StructDecoder& dec, std::optional<T>& out)
+    {
+        if (!out)
+            out.emplace();
+        return Decoder<T>::decode(dec, *out);
+    }
 
-    return &it->second;
+    static bool decodeItem(internal::StructDecoder& dec, std::optional<T>& out,
+                           const internal::KeySpan* labels, size_t count)
+    {
+        if (!out)
+            out.emplace();
+        return Decoder<T>::decodeItem(dec, *out, labels, count);
+    }
+};
+#endif
+
+template<typename T>
+inline DecodeResult decode(const char* data, size_t size, T& out)
+{
+    internal::StructDecoder decoder(data, size);
+    DecodeResult result;
+    if (!decoder.start() || !Decoder<T>::decodeBody(decoder, out)) {
+        result.errorReason = decoder.errorReason();
+        if (result.errorReason.empty())
+            result.errorReason = "decoding failed";
+    }
+    return result;
 }
 
-inline const Value* Value::findChild(const std::string& key) const
+template<typename T>
+inline DecodeResult decode(const std::string& buffer, T& out)
 {
-    if(!is<Object>())
-        failwith("cannot use findChild on non-object");
+    return decode(buffer.data(), buffer.size(), out);
+}
 
-    auto it = object_->find(key);
-    if (it == object_->end())
-        return nullptr;
+template<typename T>
+inline DecodeResult decodeFile(const std::string& filename, T& out)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        DecodeResult result;
+        result.errorReason = std::string("could not open file: ") + filename;
+        return result;
+    }
 
-    return &it->second;
+    std::string buffer((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    return decode(buffer, out);
 }
 
 // ----------------------------------------------------------------------
-// Parser
+// Tape
 
 namespace internal {
 
-inline void Parser::addError(const std::string& reason)
+inline std::uint32_t KeyTable::hash(const char* key, size_t size)
 {
-    std::stringstream ss;
-    ss << "Error:" << lexer_.lineNo() << ":" << lexer_.columnNo() << ": " << reason << "\n";
-    errorReason_ += ss.str();
+    std::uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+        h = (h ^ static_cast<unsigned char>(key[i])) * 16777619u;
+    return h;
 }
 
-inline const std::string& Parser::errorReason()
+// The slot holding |key|, or the empty slot where it would go.
+inline size_t KeyTable::slot(const char* key, size_t size, std::uint32_t h, const std::string& strings) const
 {
-    return errorReason_;
+    const size_t mask = slots_.size() - 1;
+    size_t i = h & mask;
+    for (; slots_[i] != kNone; i = (i + 1) & mask) {
+        const Key& k = keys_[slots_[i]];
+        if (k.hash == h && k.size == size && std::memcmp(strings.data() + k.offset, key, size) == 0)
+            break;
+    }
+    return i;
 }
 
-inline Value Parser::parse()
+inline void KeyTable::grow()
 {
-    return parseObjectList(false);
+    slots_.assign(std::max<size_t>(64, slots_.size() * 2), kNone);
+    const size_t mask = slots_.size() - 1;
+    for (std::uint32_t id = 0; id < keys_.size(); ++id) {
+        size_t i = keys_[id].hash & mask;
+        while (slots_[i] != kNone)
+            i = (i + 1) & mask;
+        slots_[i] = id;
+    }
 }
 
-inline Value Parser::parseObjectList(bool isNested)
+inline std::uint32_t KeyTable::intern(const char* key, size_t size, std::string& strings)
 {
-    Value node((Object()));
-
-    while (true) {
-        if (token().type() == TokenType::END_OF_FILE) {
-            break;
-        }
-        if (isNested) {
-            // We're inside a nested object list, so end at an RBRACE.
-            if (token().type() == TokenType::RBRACE) {
-                break;
-            }
-        }
-
-        std::vector<std::string> keys;
-        if (!parseKeys(keys)) {
-            // Make the node invalid
-            node = Value();
-            break;
-        }
+    if ((keys_.size() + 1) * 2 > slots_.size())
+        grow();
+
+    const std::uint32_t h = hash(key, size);
+    const size_t i = slot(key, size, h, strings);
+    if (slots_[i] == kNone) {
+        Key k;
+        k.offset = strings.size();
+        k.size = static_cast<std::uint32_t>(size);
+        k.hash = h;
+        strings.append(key, size);
+        slots_[i] = static_cast<std::uint32_t>(keys_.size());
+        keys_.push_back(k);
+    }
+    return slots_[i];
+}
 
-        Value v;
-        if (!parseObjectItem(v)) {
-            // Make the node invalid
-            node = Value();
-            break;
-        }
+inline const KeyTable::Key* KeyTable::find(const char* key, size_t size, const std::string& strings) const
+{
+    if (slots_.empty())
+        return nullptr;
+    const size_t i = slot(key, size, hash(key, size), strings);
+    return slots_[i] == kNone ? nullptr : &keys_[slots_[i]];
+}
 
-        nextToken();
+// Builds the tree in a scratch array of linked nodes, merging items the
+// way Value::mergeObjects() does, then lays it out as a Tape. Keys are
+// interned as they are read, so merging compares and hashes key ids, not
+// key text.
+class TapeBuilder {
+public:
+    TapeBuilder(const char* data, size_t size, Tape& tape) :
+        decoder_(data, size),
+        tape_(tape),
+        indexed_(0) {}
 
-        // object lists can be optionally comma-delimited e.g. when a list of maps
-        // is being expressed, so a comma is allowed here - it's simply consumed
-        if(token().type() == TokenType::COMMA)
-            nextToken();
+    bool build();
+    const std::string& errorReason() const { return decoder_.errorReason(); }
 
-        node.mergeObjects(keys, v);
-    }
+private:
+    enum : std::uint32_t { kNone = 0xFFFFFFFF };
+
+    struct Node {
+        std::uint8_t type;
+        std::uint32_t size;
+        // Key in the parent object, in the KeyTable of the Tape.
+        std::uint32_t key;
+        std::uint32_t parent;
+        // Children, linked through |next|.
+        std::uint32_t first;
+        std::uint32_t last;
+        std::uint32_t next;
+        union {
+            bool bool_;
+            std::int64_t int_;
+            double double_;
+            size_t offset;
+        };
+    };
 
-    return node;
-}
+    std::uint32_t newNode(Value::Type type);
+    std::uint32_t intern(const KeySpan& key) { return tape_.keys_.intern(key.data, key.size, tape_.strings_); }
 
-inline bool Parser::parseKeys(std::vector<std::string>& keys)
-{
-    int keyCount = 0;
-    keys.clear();
+    bool buildValue(std::uint32_t& out);
+    bool buildString(std::uint32_t node);
+    bool buildItem(std::uint32_t object, const KeySpan* keys, size_t count);
 
-    while (true) {
-        switch (token().type()) {
-        case TokenType::END_OF_FILE:
-            addError("end of file reached");
-            return false;
-        case TokenType::ASSIGN:
-            if (keyCount > 1) {
-                addError("nested object expected: LBRACE got: " + token().strValue());
-                return false;
-            }
-            if (keyCount == 0) {
-                addError("expected to find at least one object key");
-                return false;
-            }
+    void append(std::uint32_t parent, std::uint32_t child);
+    void merge(std::uint32_t object, const KeySpan* keys, size_t count, std::uint32_t added);
+    bool sharesKey(std::uint32_t existing, std::uint32_t added) const;
 
-            return true;
-        case TokenType::LBRACE:
-            if (keys.size() == 0) {
-                addError("expected IDENT | STRING got: LBRACE");
-                return false;
-            }
+    // Open addressing index of object children by (parent, key), so
+    // that merging many blocks into one object stays linear.
+    static size_t hash(std::uint32_t parent, std::uint32_t key);
+    std::uint32_t findChild(std::uint32_t object, std::uint32_t key) const;
+    void index(std::uint32_t child);
 
-            return true;
-        case TokenType::IDENT:
-        case TokenType::STRING:
-            keyCount++;
-            keys.push_back(token().strValue());
-            nextToken();
-            break;
-        case TokenType::ILLEGAL:
-            addError("illegal character");
-            return false;
-        default:
-            addError("expected IDENT | STRING | ASSIGN | LBRACE got: " + token().strValue());
-            return false;
-        }
-    }
+    void emit(std::uint32_t node);
 
-    return false;
-}
+    StructDecoder decoder_;
+    Tape& tape_;
+    std::vector<Node> nodes_;
+    std::vector<std::uint32_t> slots_;
+    size_t indexed_;
+    std::string scratch_;
+};
 
-inline bool Parser::parseObjectItem(Value& currentValue)
+inline std::uint32_t TapeBuilder::newNode(Value::Type type)
 {
-    switch (token().type()) {
-    case TokenType::ASSIGN:
-        if (!parseObject(currentValue))
-            return false;
-        break;
-    case TokenType::LBRACE:
-        if (!parseObjectType(currentValue))
-            return false;
-        break;
-    default:
-        addError("Expected start of object ('{') or assignment ('=')");
-        return false;
-    }
-    return true;
+    Node n;
+    n.type = static_cast<std::uint8_t>(type);
+    n.size = 0;
+    n.key = kNone;
+    n.parent = kNone;
+    n.first = kNone;
+    n.last = kNone;
+    n.next = kNone;
+    n.offset = 0;
+    nodes_.push_back(n);
+    return static_cast<std::uint32_t>(nodes_.size() - 1);
 }
 
-inline bool Parser::parseObject(Value& currentValue)
+inline size_t TapeBuilder::hash(std::uint32_t parent, std::uint32_t key)
 {
-    nextToken();
-
-    switch (token().type()) {
-    case TokenType::NUMBER:
-    case TokenType::FLOAT:
-    case TokenType::BOOL:
-    case TokenType::STRING:
-    case TokenType::HEREDOC:
-    case TokenType::IDENT:
-    case TokenType::HIL:
-        return parseLiteralType(currentValue);
-    case TokenType::LBRACE:
-        return parseObjectType(currentValue);
-    case TokenType::LBRACK:
-        return parseListType(currentValue);
-    case TokenType::COMMENT:
-        break;
-    case TokenType::END_OF_FILE:
-        addError("Reached end of file");
-        return false;
-    default:
-        addError("Unknown token: " + token().strValue());
-        return false;
-    }
-    addError("Unknown token: " + token().strValue());
-    return false;
+    const std::uint64_t h = ((static_cast<std::uint64_t>(parent) << 32) | key) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(h ^ (h >> 32));
 }
 
-inline bool Parser::parseObjectType(Value& currentValue)
+inline std::uint32_t TapeBuilder::findChild(std::uint32_t object, std::uint32_t key) const
 {
-    if(token().type() != TokenType::LBRACE) {
-        addError("object list did not start with LBRACE");
-        return false;
-    }
-    nextToken();
-    Value result = parseObjectList(true);
-
-    if(!errorReason().empty()) {
-        addError("failed parsing object list");
-        return false;
-    }
-
-    if(token().type() != TokenType::RBRACE) {
-        addError("object expected closing RBRACE got: " + token().strValue());
-        return false;
+    if (slots_.empty())
+        return kNone;
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hash(object, key) & mask; slots_[i] != kNone; i = (i + 1) & mask) {
+        // Children moved to another object leave their old entry behind;
+        // checking the parent skips those.
+        const std::uint32_t child = slots_[i];
+        if (nodes_[child].parent == object && nodes_[child].key == key)
+            return child;
     }
-
-    currentValue = result;
-    return true;
+    return kNone;
 }
-
-inline bool Parser::parseListType(Value& currentValue)
-{
-    List a;
-    bool needComma = false;
-
-    while (true) {
-        nextToken();
-
-        if (needComma) {
-            switch (token().type()) {
-            case TokenType::COMMA:
-            case TokenType::RBRACK:
-                break;
-            default:
-                addError("error parsing list, expected comma or list end, got: " + token().strValue());
-                return false;
-            }
-        }
-
-        switch (token().type()) {
-        case TokenType::BOOL:
-        case TokenType::NUMBER:
-        case TokenType::FLOAT:
-        case TokenType::STRING:
-        case TokenType::HEREDOC:
-        case TokenType::IDENT:
-        case TokenType::HIL:
-        {
-            Value literal;
-            if (!parseLiteralType(literal)) {
-                addError("error parsing literal type");
-                return false;
-            }
-
-            a.push_back(std::move(literal));
-            needComma = true;
-            break;
-        }
-        case TokenType::COMMA:
-            needComma = false;
-            continue;
-        case TokenType::LBRACE:
-        {
-            Value object;
-            if (!parseObjectType(object)) {
-                addError("error parsing object within list");
-                return false;
-            }
-            a.push_back(std::move(object));
-            needComma = true;
-            break;
-        }
-        case TokenType::LBRACK:
-        {
-            Value list;
-            if (!parseListType(list)) {
-                addError("error parsing list within list");
-                return false;
-            }
-            a.push_back(std::move(list));
-            break;
+
+inline void TapeBuilder::index(std::uint32_t child)
+{
+    if ((indexed_ + 1) * 2 > slots_.size()) {
+        std::vector<std::uint32_t> old(std::max<size_t>(64, slots_.size() * 2), kNone);
+        old.swap(slots_);
+        indexed_ = 0;
+        for (std::uint32_t c : old) {
+            if (c != kNone)
+                index(c);
         }
-        case TokenType::RBRACK:
-        {
-            currentValue = a;
+    }
+
+    const Node& n = nodes_[child];
+    const size_t mask = slots_.size() - 1;
+    size_t i = hash(n.parent, n.key) & mask;
+    while (slots_[i] != kNone)
+        i = (i + 1) & mask;
+    slots_[i] = child;
+    ++indexed_;
+}
+
+inline void TapeBuilder::append(std::uint32_t parent, std::uint32_t child)
+{
+    Node& p = nodes_[parent];
+    if (p.last == kNone)
+        p.first = child;
+    else
+        nodes_[p.last].next = child;
+    p.last = child;
+    ++p.size;
+
+    nodes_[child].next = kNone;
+    nodes_[child].parent = parent;
+    if (p.type == Value::OBJECT_TYPE)
+        index(child);
+}
+
+inline bool TapeBuilder::sharesKey(std::uint32_t existing, std::uint32_t added) const
+{
+    for (std::uint32_t c = nodes_[added].first; c != kNone; c = nodes_[c].next) {
+        if (findChild(existing, nodes_[c].key) != kNone)
             return true;
+    }
+    return false;
+}
+
+// Same as Value::mergeObjects().
+inline void TapeBuilder::merge(std::uint32_t object, const KeySpan* keys, size_t count, std::uint32_t added)
+{
+    if (count > 1) {
+        const std::uint32_t parent = newNode(Value::OBJECT_TYPE);
+        std::uint32_t ptr = parent;
+        for (size_t i = 1; i < count; ++i) {
+            std::uint32_t child = added;
+            if (i + 1 < count)
+                child = newNode(Value::OBJECT_TYPE);
+            nodes_[child].key = intern(keys[i]);
+            append(ptr, child);
+            ptr = child;
         }
-        default:
-            addError("unexpected token while parsing list: " + token().strValue());
-            return false;
+        added = parent;
+    }
+
+    const std::uint32_t key = intern(keys[0]);
+    const std::uint32_t existing = findChild(object, key);
+    if (existing == kNone) {
+        nodes_[added].key = key;
+        append(object, added);
+        return;
+    }
+
+    if (nodes_[existing].type == Value::LIST_TYPE) {
+        append(existing, added);
+        return;
+    }
+
+    if (nodes_[existing].type == Value::OBJECT_TYPE && nodes_[added].type == Value::OBJECT_TYPE &&
+        !sharesKey(existing, added)) {
+        for (std::uint32_t c = nodes_[added].first; c != kNone;) {
+            const std::uint32_t next = nodes_[c].next;
+            append(existing, c);
+            c = next;
         }
+        return;
     }
-    return false;
+
+    // Upgrade it to a list, keeping its place in the parent.
+    const std::uint32_t moved = newNode(Value::NULL_TYPE);
+    nodes_[moved] = nodes_[existing];
+    Node& list = nodes_[existing];
+    list.type = Value::LIST_TYPE;
+    list.size = 0;
+    list.first = kNone;
+    list.last = kNone;
+    append(existing, moved);
+    append(existing, added);
 }
 
-inline bool Parser::parseLiteralType(Value& currentValue)
+inline bool TapeBuilder::buildItem(std::uint32_t object, const KeySpan* keys, size_t count)
 {
-    switch (token().type()) {
-    case TokenType::HEREDOC: {
-        std::string unindented;
-        if (!unindentHeredoc(token().strValue(), unindented)) {
-            addError("Failed unindenting heredoc: " + token().strValue());
+    std::uint32_t value;
+    if (!buildValue(value))
+        return false;
+    merge(object, keys, count, value);
+    return true;
+}
+
+inline bool TapeBuilder::buildString(std::uint32_t node)
+{
+    const SpanToken& token = decoder_.token();
+    const char* data = token.data;
+    size_t size = token.size;
+    if (token.escaped || token.type == TokenType::HEREDOC) {
+        if (!decoder_.decodeString(scratch_))
             return false;
-        }
-        currentValue = unindented;
-        return true;
+        data = scratch_.data();
+        size = scratch_.size();
     }
-    case TokenType::STRING:
-    case TokenType::IDENT:
-    case TokenType::HIL:
-        currentValue = token().strValue();
 
-        if (token().type() == TokenType::HIL)
-            currentValue.setStringType(Value::StringType::Hil);
-        else if (token().type() == TokenType::IDENT)
-            currentValue.setStringType(Value::StringType::Ident);
+    nodes_[node].offset = tape_.strings_.size();
+    nodes_[node].size = static_cast<std::uint32_t>(size);
+    tape_.strings_.append(data, size);
+    return true;
+}
 
-        return true;
+inline bool TapeBuilder::buildValue(std::uint32_t& out)
+{
+    const SpanToken& token = decoder_.token();
+    switch (token.type) {
+    case TokenType::LBRACE: {
+        const std::uint32_t object = out = newNode(Value::OBJECT_TYPE);
+        return decoder_.decodeObject([this, object](const KeySpan* keys, size_t count) {
+            return buildItem(object, keys, count);
+        });
+    }
+    case TokenType::LBRACK: {
+        const std::uint32_t list = out = newNode(Value::LIST_TYPE);
+        return decoder_.decodeList([this, list]() {
+            std::uint32_t element;
+            if (!buildValue(element))
+                return false;
+            append(list, element);
+            return true;
+        });
+    }
     case TokenType::BOOL:
-        currentValue = token().boolValue();
+        out = newNode(Value::BOOL_TYPE);
+        nodes_[out].bool_ = token.data[0] == 't';
         return true;
-    case TokenType::NUMBER:
-        currentValue = token().intValue();
+    case TokenType::NUMBER: {
+        std::int64_t x;
+        if (!parseInteger(token.data, token.size, &x)) {
+            // Out of range. Saturates, as parse() does.
+            x = token.data[0] == '-' ? std::numeric_limits<std::int64_t>::min()
+                                     : std::numeric_limits<std::int64_t>::max();
+        }
+        out = newNode(Value::INT_TYPE);
+        nodes_[out].int_ = x;
         return true;
+    }
     case TokenType::FLOAT:
-        currentValue = token().doubleValue();
+        out = newNode(Value::DOUBLE_TYPE);
+        nodes_[out].double_ = parseDouble(token.data, token.size);
         return true;
-    case TokenType::ILLEGAL:
-        addError(token().strValue());
-        return false;
+    case TokenType::STRING:
+    case TokenType::HEREDOC:
+        out = newNode(Value::STRING_TYPE);
+        return buildString(out);
+    case TokenType::IDENT:
+        out = newNode(Value::IDENT_TYPE);
+        return buildString(out);
+    case TokenType::HIL:
+        out = newNode(Value::HIL_TYPE);
+        return buildString(out);
     default:
-        addError("unexpected token");
-        return false;
+        return decoder_.fail("Unknown token: " + decoder_.tokenText());
     }
 }
 
-static inline int isSpace(int c)
+inline void TapeBuilder::emit(std::uint32_t node)
 {
-    return (c == ' ' || c == '\t') ? 1 : 0;
+    const Node& n = nodes_[node];
+    const size_t at = tape_.nodes_.size();
+
+    TapeNode t;
+    t.type = n.type;
+    t.size = n.size;
+    t.offset = n.offset;
+    tape_.nodes_.push_back(t);
+    if (n.type != Value::LIST_TYPE && n.type != Value::OBJECT_TYPE)
+        return;
+
+    for (std::uint32_t c = n.first; c != kNone; c = nodes_[c].next) {
+        if (n.type == Value::OBJECT_TYPE) {
+            const KeyTable::Key& k = tape_.keys_.key(nodes_[c].key);
+            TapeNode key;
+            key.type = TapeNode::KEY;
+            key.size = k.size;
+            key.offset = k.offset;
+            tape_.nodes_.push_back(key);
+        }
+        emit(c);
+    }
+    tape_.nodes_[at].span = tape_.nodes_.size() - at;
 }
 
-static inline std::string trimRight(const std::string& s) {
-  std::string r(s);
-  r.erase(std::find_if(r.rbegin(), r.rend(),
-                       std::not1(std::function<int(int)>(isSpace))
-              ).base(), r.end());
-  return r;
+inline bool TapeBuilder::build()
+{
+    if (!decoder_.start())
+        return false;
+
+    const std::uint32_t root = newNode(Value::OBJECT_TYPE);
+    if (!decoder_.decodeObjectList(false, [this, root](const KeySpan* keys, size_t count) {
+            return buildItem(root, keys, count);
+        }))
+        return false;
+
+    // Every object child gets a KEY node in front of it.
+    tape_.nodes_.reserve(nodes_.size() * 2);
+    emit(root);
+    return true;
 }
 
-static inline std::string join(const std::vector<std::string>& elements, const char* const separator)
+} // namespace internal
+
+inline size_t ValueRef::size() const
 {
-    switch (elements.size())
-    {
-        case 0:
-            return "";
-        case 1:
-            return elements[0];
-        default:
-            std::ostringstream os;
-            std::copy(elements.begin(), elements.end()-1, std::ostream_iterator<std::string>(os, separator));
-            os << *elements.rbegin();
-            return os.str();
+    if (!valid())
+        return 0;
+    if (node_->type == Value::LIST_TYPE || node_->type == Value::OBJECT_TYPE)
+        return node_->size;
+    return 1;
+}
+
+template<typename T>
+inline void ValueRef::typeError() const
+{
+    failwith("type error: this value is ", Value::typeToString(type()), " but ", internal::ValueConverter<Value, T>::name(), " was requested");
+}
+
+template<> inline bool ValueRef::is<bool>() const { return type() == Value::BOOL_TYPE; }
+template<> inline bool ValueRef::is<int>() const { return type() == Value::INT_TYPE; }
+template<> inline bool ValueRef::is<int64_t>() const { return type() == Value::INT_TYPE; }
+template<> inline bool ValueRef::is<double>() const { return type() == Value::DOUBLE_TYPE; }
+template<> inline bool ValueRef::is<std::string>() const
+{
+    return type() == Value::STRING_TYPE || type() == Value::IDENT_TYPE || type() == Value::HIL_TYPE;
+}
+template<> inline bool ValueRef::is<List>() const { return type() == Value::LIST_TYPE; }
+template<> inline bool ValueRef::is<Object>() const { return type() == Value::OBJECT_TYPE; }
+
+template<> inline bool ValueRef::as<bool>() const
+{
+    if (!is<bool>()) {
+        typeError<bool>();
+        return false;
     }
+    return node_->bool_;
 }
-static inline bool hasPrefix(const std::string & s, const std::string & prefix) {
-	return std::mismatch(prefix.begin(), prefix.end(), s.begin()).first == prefix.end();
+
+template<> inline int ValueRef::as<int>() const
+{
+    if (!is<int>()) {
+        typeError<int>();
+        return 0;
+    }
+    return static_cast<int>(node_->int_);
 }
 
-inline std::string & trimPrefix(std::string & s, const std::string & prefix) {
-	if (!hasPrefix(s,prefix)) {
-		return s;
-	}
-	s.erase(0,prefix.size());
-	return s;
+template<> inline int64_t ValueRef::as<int64_t>() const
+{
+    if (!is<int64_t>()) {
+        typeError<int64_t>();
+        return 0;
+    }
+    return node_->int_;
 }
 
-inline bool Parser::unindentHeredoc(const std::string& heredoc, std::string& out)
+template<> inline double ValueRef::as<double>() const
 {
-    auto index = heredoc.find("\n");
-    size_t contentBegin = index + 1;
-    size_t contentEnd = heredoc.size() - contentBegin - (index - 2);
-    std::string content = heredoc.substr(contentBegin, contentEnd);
+    if (!is<double>()) {
+        typeError<double>();
+        return 0.0;
+    }
+    return node_->double_;
+}
 
-    if (index == std::string::npos) {
-        addError("heredoc doesn't contain newline");
-        return false;
+template<> inline std::string ValueRef::as<std::string>() const
+{
+    if (!is<std::string>()) {
+        typeError<std::string>();
+        return std::string();
     }
+    return str();
+}
 
-    bool unindent = heredoc[2] == '-';
+inline ValueRef ValueRef::find(const std::string& key) const
+{
+    if (!is<Object>())
+        return ValueRef();
+    for (iterator it = begin(); it != end(); ++it) {
+        const internal::TapeNode* k = it.node_;
+        if (k->size == key.size() && std::memcmp(strings_ + k->offset, key.data(), key.size()) == 0)
+            return *it;
+    }
+    return ValueRef();
+}
 
-    if (!unindent) {
-        out = heredoc.substr(contentBegin, contentEnd - 1);
-        return true;
+inline ValueRef ValueRef::find(const Symbol& key) const
+{
+    if (!is<Object>() || !key.valid())
+        return ValueRef();
+    for (iterator it = begin(); it != end(); ++it) {
+        // Keys with the same text share one offset. Only an empty key can
+        // share its offset with another key, and then not its size.
+        const internal::TapeNode* k = it.node_;
+        if (k->offset == key.offset_ && k->size == key.size_)
+            return *it;
     }
+    return ValueRef();
+}
 
-    std::vector<std::string> lines;
-    std::istringstream ss(content);
-    std::string line;
-    while (std::getline(ss, line)) {
-        lines.push_back(line);
+inline ValueRef ValueRef::operator[](size_t index) const
+{
+    if (!is<List>() || index >= node_->size)
+        return ValueRef();
+    iterator it = begin();
+    while (index-- > 0)
+        ++it;
+    return *it;
+}
+
+inline ValueRef::iterator ValueRef::begin() const
+{
+    if (!is<List>() && !is<Object>())
+        return end();
+    return iterator(node_ + 1, strings_, is<Object>());
+}
+
+inline ValueRef::iterator ValueRef::end() const
+{
+    if (!is<List>() && !is<Object>())
+        return iterator(node_, strings_, false);
+    return iterator(node_ + node_->span, strings_, is<Object>());
+}
+
+inline ValueRef::iterator& ValueRef::iterator::operator++()
+{
+    const internal::TapeNode* value = object_ ? node_ + 1 : node_;
+    const bool container = value->type == Value::LIST_TYPE || value->type == Value::OBJECT_TYPE;
+    node_ = value + (container ? value->span : 1);
+    return *this;
+}
+
+inline Value ValueRef::toValue() const
+{
+    switch (type()) {
+    case Value::NULL_TYPE:
+        return Value();
+    case Value::BOOL_TYPE:
+        return Value(node_->bool_);
+    case Value::INT_TYPE:
+        return Value(node_->int_);
+    case Value::DOUBLE_TYPE:
+        return Value(node_->double_);
+    case Value::STRING_TYPE:
+    case Value::IDENT_TYPE:
+    case Value::HIL_TYPE: {
+        Value v(str());
+        if (type() == Value::IDENT_TYPE)
+            v.setStringType(Value::StringType::Ident);
+        else if (type() == Value::HIL_TYPE)
+            v.setStringType(Value::StringType::Hil);
+        return v;
+    }
+    case Value::LIST_TYPE: {
+        List list;
+        list.reserve(size());
+        for (ValueRef element : *this)
+            list.push_back(element.toValue());
+        return Value(std::move(list));
+    }
+    case Value::OBJECT_TYPE: {
+        Value object((Object()));
+        for (iterator it = begin(); it != end(); ++it)
+            object.setChild(it.key(), (*it).toValue());
+        return object;
+    }
+    default:
+        failwith("unknown type");
+        return Value();
     }
+}
 
-    std::string whitespacePrefix = lines[lines.size() - 1];
+inline Symbol Tape::symbol(const std::string& key) const
+{
+    const internal::KeyTable::Key* k = keys_.find(key.data(), key.size(), strings_);
+    return k ? Symbol(k->offset, k->size) : Symbol();
+}
 
-    bool isIndented = true;
-    for (const auto& line : lines) {
-        if(whitespacePrefix.size() > line.size()) {
-            isIndented = false;
-            break;
-        }
+inline TapeResult parseTape(const char* data, size_t size)
+{
+    TapeResult result;
+    internal::TapeBuilder builder(data, size, result.tape);
+    if (!builder.build()) {
+        result.errorReason = builder.errorReason();
+        result.tape = Tape();
+    }
+    return result;
+}
 
-        auto res = std::mismatch(whitespacePrefix.begin(), whitespacePrefix.end(), line.begin());
+inline TapeResult parseTape(const std::string& buffer)
+{
+    return parseTape(buffer.data(), buffer.size());
+}
 
-        if (res.first == whitespacePrefix.end()) {
-            continue;
+// ----------------------------------------------------------------------
+// Encoder
+
+namespace internal {
+
+// Sets |name| in |object| unless |member| encodes to an invalid Value.
+template<typename M>
+inline void encodeMember(Value& object, const char* name, const M& member)
+{
+    Value v = Encoder<M>::encode(member);
+    if (v.valid())
+        object.setChild(name, std::move(v));
+}
+
+// Visitor for Binding<T>::fields() that encodes every field.
+template<typename T>
+class FieldEncoder {
+public:
+    FieldEncoder(const T& in, Value& out) : in_(in), out_(out) {}
+
+    template<typename M, typename C>
+    void operator()(const char* name, M C::*member) { encodeMember(out_, name, in_.*member); }
+    template<typename M, typename C>
+    void required(const char* name, M C::*member) { encodeMember(out_, name, in_.*member); }
+
+private:
+    const T& in_;
+    Value& out_;
+};
+
+template<typename M>
+struct MapEncoder {
+    static Value encode(const M& in)
+    {
+        Value v((Object()));
+        for (const auto& kv : in) {
+            Value mapped = Encoder<typename M::mapped_type>::encode(kv.second);
+            if (mapped.valid())
+                v.setChild(kv.first, std::move(mapped));
         }
+        return v;
+    }
+};
 
-        isIndented = false;
-        break;
+} // namespace internal
+
+// Structs, through Binding<T>.
+template<typename T, typename Enable>
+struct Encoder {
+    static Value encode(const T& in)
+    {
+        Value v((Object()));
+        internal::FieldEncoder<T> fields(in, v);
+        Binding<T>::fields(fields);
+        return v;
     }
+};
 
-    if (!isIndented) {
-        out = trimRight(heredoc.substr(contentBegin, contentEnd));
-        return true;
+template<>
+struct Encoder<bool> {
+    static Value encode(bool in) { return Value(in); }
+};
+
+template<typename T>
+struct Encoder<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static Value encode(T in) { return Value(static_cast<std::int64_t>(in)); }
+};
+
+template<typename T>
+struct Encoder<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static Value encode(T in) { return Value(static_cast<double>(in)); }
+};
+
+template<>
+struct Encoder<std::string> {
+    static Value encode(const std::string& in) { return Value(in); }
+};
+
+template<typename T, typename Allocator>
+struct Encoder<std::vector<T, Allocator>> {
+    static Value encode(const std::vector<T, Allocator>& in)
+    {
+        List list;
+        list.reserve(in.size());
+        for (const auto& element : in)
+            list.push_back(Encoder<T>::encode(element));
+        return Value(std::move(list));
     }
+};
 
-    std::vector<std::string> unindentedLines;
-    for (auto line = lines.begin(); line < lines.end(); line++) {
-        if (line + 1 == lines.end()) {
-            unindentedLines.push_back(std::string());
-            break;
-        }
-        trimPrefix(*line, whitespacePrefix);
-        unindentedLines.push_back(std::move(*line));
+template<typename T, typename Compare, typename Allocator>
+struct Encoder<std::map<std::string, T, Compare, Allocator>> :
+    internal::MapEncoder<std::map<std::string, T, Compare, Allocator>> {};
+
+template<typename T, typename Hash, typename Equal, typename Allocator>
+struct Encoder<std::unordered_map<std::string, T, Hash, Equal, Allocator>> :
+    internal::MapEncoder<std::unordered_map<std::string, T, Hash, Equal, Allocator>> {};
+
+template<typename T, typename Deleter>
+struct Encoder<std::unique_ptr<T, Deleter>> {
+    static Value encode(const std::unique_ptr<T, Deleter>& in)
+    {
+        return in ? Encoder<T>::encode(*in) : Value();
     }
+};
 
-    out = join(unindentedLines, "\n");
-    return true;
-}
+#if __cplusplus >= 201703L
+template<typename T>
+struct Encoder<std::optional<T>> {
+    static Value encode(const std::optional<T>& in)
+    {
+        return in ? Encoder<T>::encode(*in) : Value();
+    }
+};
+#endif
 
-} // namespace internal
+template<typename T>
+inline Value encode(const T& in)
+{
+    return Encoder<T>::encode(in);
+}
 
 } // namespace hcl
 
@@ -0,0 +1,65 @@
+#include "hcl/async.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <string>
+#include <vector>
+
+TEST_CASE("parse buffer asynchronously")
+{
+    hcl::ThreadPoolExecutor executor(2, 4);
+
+    std::future<hcl::ParseResult> future = hcl::parseAsync("foo = \"bar\"", executor);
+    hcl::ParseResult result = future.get();
+
+    REQUIRE(result.valid());
+    REQUIRE("bar" == result.value["foo"].as<std::string>());
+}
+
+TEST_CASE("parse file asynchronously")
+{
+    hcl::ThreadPoolExecutor executor(1, 1);
+
+    hcl::ParseResult result = hcl::parseFileAsync("tests/test-fixtures/decoding/flat.hcl", executor).get();
+    REQUIRE(result.valid());
+    REQUIRE(7 == result.value["Key"].as<int>());
+
+    result = hcl::parseFileAsync("tests/test-fixtures/decoding/does_not_exist.hcl", executor).get();
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::IO_ERROR);
+}
+
+TEST_CASE("parse many buffers through a bounded queue")
+{
+    hcl::ThreadPoolExecutor executor(2, 2);
+
+    std::vector<std::future<hcl::ParseResult>> futures;
+    for (int i = 0; i < 32; ++i)
+        futures.push_back(hcl::parseAsync("n = " + std::to_string(i), executor));
+
+    for (int i = 0; i < 32; ++i) {
+        hcl::ParseResult result = futures[i].get();
+        REQUIRE(result.valid());
+        REQUIRE(i == result.value["n"].as<int>());
+    }
+}
+
+TEST_CASE("parse asynchronously with callback")
+{
+    std::promise<std::string> reason;
+    hcl::parseAsync("foo = ", [&](hcl::ParseResult result) {
+        reason.set_value(result.errorReason);
+    });
+
+    REQUIRE(!reason.get_future().get().empty());
+}
+
+TEST_CASE("cancel asynchronous parse")
+{
+    hcl::ThreadPoolExecutor executor(1, 1);
+    hcl::CancellationToken token;
+    token.cancel();
+
+    hcl::ParseResult result = hcl::parseAsync("foo = 1", executor, hcl::ParseOptions(), token).get();
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::CANCELLED);
+}
@@ -0,0 +1,67 @@
+#ifndef MICROHCL_BENCH_UTIL_H_
+#define MICROHCL_BENCH_UTIL_H_
+
+#include <sstream>
+#include <string>
+
+namespace bench {
+
+// A Terraform-shaped document with |resources| resource blocks and as
+// many variables, roughly 400 bytes per resource.
+inline std::string terraformDocument(int resources)
+{
+    std::ostringstream ss;
+    for (int i = 0; i < resources; ++i) {
+        ss << "variable \"var_" << i << "\" {\n"
+           << "  type        = \"string\"\n"
+           << "  default     = \"value-" << i << "\"\n"
+           << "  description = \"Variable number " << i << "\"\n"
+           << "}\n\n";
+        ss << "resource \"aws_instance\" \"web_" << i << "\" {\n"
+           << "  ami           = \"ami-" << (100000 + i) << "\"\n"
+           << "  instance_type = \"t2.micro\"\n"
+           << "  count         = " << (i % 4 + 1) << "\n"
+           << "  ports         = [22, 80, 443, " << (8000 + i) << "]\n"
+           << "  enabled       = true\n"
+           << "  tags {\n"
+           << "    Name  = \"web-" << i << "\"\n"
+           << "    Owner = \"team\\tops\"\n"
+           << "  }\n"
+           << "}\n\n";
+    }
+    return ss.str();
+}
+
+// terraformDocument() in the JSON syntax.
+inline std::string terraformJSONDocument(int resources)
+{
+    std::ostringstream ss;
+    ss << "{\n  \"variable\": {\n";
+    for (int i = 0; i < resources; ++i) {
+        ss << "    \"var_" << i << "\": {\n"
+           << "      \"type\": \"string\",\n"
+           << "      \"default\": \"value-" << i << "\",\n"
+           << "      \"description\": \"Variable number " << i << "\"\n"
+           << "    }" << (i + 1 < resources ? "," : "") << "\n";
+    }
+    ss << "  },\n  \"resource\": [\n";
+    for (int i = 0; i < resources; ++i) {
+        ss << "    {\"aws_instance\": {\"web_" << i << "\": {\n"
+           << "      \"ami\": \"ami-" << (100000 + i) << "\",\n"
+           << "      \"instance_type\": \"t2.micro\",\n"
+           << "      \"count\": " << (i % 4 + 1) << ",\n"
+           << "      \"ports\": [22, 80, 443, " << (8000 + i) << "],\n"
+           << "      \"enabled\": true,\n"
+           << "      \"tags\": {\n"
+           << "        \"Name\": \"web-" << i << "\",\n"
+           << "        \"Owner\": \"team\\tops\"\n"
+           << "      }\n"
+           << "    }}}" << (i + 1 < resources ? "," : "") << "\n";
+    }
+    ss << "  ]\n}\n";
+    return ss.str();
+}
+
+} // namespace bench
+
+#endif // MICROHCL_BENCH_UTIL_H_
@@ -0,0 +1,75 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Same shape as test-fixtures/decoding/decode_policy.hcl.
+const char* const policyDocument =
+    "key \"\" {\n"
+    "\tpolicy = \"read\"\n"
+    "}\n"
+    "\n"
+    "key \"foo/\" {\n"
+    "\tpolicy = \"write\"\n"
+    "}\n"
+    "\n"
+    "key \"foo/bar/\" {\n"
+    "\tpolicy = \"read\"\n"
+    "}\n"
+    "\n"
+    "key \"foo/bar/baz\" {\n"
+    "\tpolicy = \"deny\"\n"
+    "}\n";
+
+const int documents = 10000;
+
+} // namespace
+
+TEST_CASE("parser context versus fresh parsers", "[context]")
+{
+    const std::string document(policyDocument);
+    const std::string empty;
+
+    BENCHMARK("parse 10000 policy documents")
+    {
+        for (int i = 0; i < documents; ++i) {
+            std::istringstream is(document);
+            hcl::ParseResult result = hcl::parse(is);
+            REQUIRE(result.valid());
+        }
+    }
+
+    BENCHMARK("parse 10000 policy documents with a context")
+    {
+        hcl::ParserContext context;
+        for (int i = 0; i < documents; ++i) {
+            context.reset(document);
+            hcl::ParseResult result = context.parse();
+            REQUIRE(result.valid());
+        }
+    }
+
+    // Fixed cost of a parse, without any content.
+    BENCHMARK("parse 10000 empty documents")
+    {
+        for (int i = 0; i < documents; ++i) {
+            std::istringstream is(empty);
+            hcl::ParseResult result = hcl::parse(is);
+            REQUIRE(result.valid());
+        }
+    }
+
+    BENCHMARK("parse 10000 empty documents with a context")
+    {
+        hcl::ParserContext context;
+        for (int i = 0; i < documents; ++i) {
+            context.reset(empty);
+            hcl::ParseResult result = context.parse();
+            REQUIRE(result.valid());
+        }
+    }
+}
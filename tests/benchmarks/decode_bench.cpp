@@ -0,0 +1,103 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Variable {
+    std::string type;
+    std::string defaultValue;
+    std::string description;
+};
+
+struct Instance {
+    Instance() : count(0), enabled(false) {}
+
+    std::string ami;
+    std::string instanceType;
+    int count;
+    std::vector<std::int64_t> ports;
+    bool enabled;
+    std::map<std::string, std::string> tags;
+};
+
+struct Terraform {
+    std::map<std::string, Variable> variables;
+    std::map<std::string, std::map<std::string, Instance>> resources;
+};
+
+// The hand-written path this replaces: parse, then get<T>() each field.
+Terraform fromValue(const hcl::Value& root)
+{
+    Terraform tf;
+    for (const auto& kv : root.get<hcl::Object>("variable")) {
+        Variable& v = tf.variables[kv.first];
+        v.type = kv.second.get<std::string>("type");
+        v.defaultValue = kv.second.get<std::string>("default");
+        v.description = kv.second.get<std::string>("description");
+    }
+    for (const auto& resource : root.get<hcl::List>("resource")) {
+        for (const auto& kv : resource.get<hcl::Object>("aws_instance")) {
+            Instance& instance = tf.resources["aws_instance"][kv.first];
+            instance.ami = kv.second.get<std::string>("ami");
+            instance.instanceType = kv.second.get<std::string>("instance_type");
+            instance.count = kv.second.get<int>("count");
+            instance.ports = kv.second.get<std::vector<std::int64_t>>("ports");
+            instance.enabled = kv.second.get<bool>("enabled");
+            for (const auto& tag : kv.second.get<hcl::Object>("tags"))
+                instance.tags[tag.first] = tag.second.as<std::string>();
+        }
+    }
+    return tf;
+}
+
+} // namespace
+
+MICROHCL_BEGIN_BINDING(Variable)
+    MICROHCL_FIELD(type)
+    MICROHCL_FIELD_AS("default", defaultValue)
+    MICROHCL_FIELD(description)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Instance)
+    MICROHCL_FIELD(ami)
+    MICROHCL_FIELD_AS("instance_type", instanceType)
+    MICROHCL_FIELD(count)
+    MICROHCL_FIELD(ports)
+    MICROHCL_FIELD(enabled)
+    MICROHCL_FIELD(tags)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Terraform)
+    MICROHCL_FIELD_AS("variable", variables)
+    MICROHCL_FIELD_AS("resource", resources)
+MICROHCL_END_BINDING()
+
+TEST_CASE("decode versus parse and get", "[decode]")
+{
+    const std::string document = bench::terraformDocument(2000);
+
+    BENCHMARK("parse and get 2000 resources")
+    {
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is);
+        REQUIRE(result.valid());
+        Terraform tf = fromValue(result.value);
+        REQUIRE(tf.variables.size() == 2000);
+    }
+
+    BENCHMARK("decode 2000 resources")
+    {
+        Terraform tf;
+        hcl::DecodeResult result = hcl::decode(document, tf);
+        REQUIRE(result.valid());
+        REQUIRE(tf.variables.size() == 2000);
+    }
+}
@@ -0,0 +1,39 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace {
+
+const int edits = 100;
+
+} // namespace
+
+TEST_CASE("edit a document versus parsing it again", "[document]")
+{
+    hcl::Document document(bench::terraformDocument(5000));
+    const size_t offset = document.text().find("ami-102500");
+    REQUIRE(offset != std::string::npos);
+
+    BENCHMARK("reparse a 2MB document after each of 100 edits")
+    {
+        std::string text = document.text();
+        for (int i = 0; i < edits; ++i) {
+            text[offset + 4] = static_cast<char>('0' + i % 10);
+            std::istringstream is(text);
+            hcl::ParseResult result = hcl::parse(is);
+            REQUIRE(result.valid());
+        }
+    }
+
+    BENCHMARK("100 edits inside one block of a 2MB document")
+    {
+        for (int i = 0; i < edits; ++i) {
+            document.edit(offset + 4, 1, std::string(1, static_cast<char>('0' + i % 10)));
+            REQUIRE(document.lastEditIncremental());
+        }
+    }
+}
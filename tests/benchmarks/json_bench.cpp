@@ -0,0 +1,26 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <sstream>
+#include <string>
+
+TEST_CASE("parse json versus the native syntax", "[json]")
+{
+    const std::string hcl = bench::terraformDocument(5000);
+    const std::string json = bench::terraformJSONDocument(5000);
+
+    BENCHMARK("parse a 2MB terraform document")
+    {
+        std::istringstream is(hcl);
+        hcl::ParseResult result = hcl::parse(is);
+        REQUIRE(result.valid());
+    }
+
+    BENCHMARK("parse the same document as json")
+    {
+        hcl::ParseResult result = hcl::parseJSON(json);
+        REQUIRE(result.valid());
+    }
+}
@@ -0,0 +1,40 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+
+#include <sstream>
+#include <string>
+
+// Port tables and weights, most of which a program never reads.
+static std::string numberDocument(int rows)
+{
+    std::ostringstream ss;
+    for (int i = 0; i < rows; ++i) {
+        ss << "route \"r" << i << "\" {\n"
+           << "  ports   = [" << (8000 + i) << ", " << (9000 + i) << ", " << (10000 + i) << "]\n"
+           << "  weights = [0." << (i % 97 + 1) << ", 1.25e-3, 2.718281828459045]\n"
+           << "}\n";
+    }
+    return ss.str();
+}
+
+TEST_CASE("parse numbers lazily versus eagerly", "[number]")
+{
+    const std::string document = numberDocument(20000);
+
+    BENCHMARK("parse a document of numbers")
+    {
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is);
+        REQUIRE(result.valid());
+    }
+
+    BENCHMARK("parse the same document with lazy numbers")
+    {
+        hcl::ParseOptions options;
+        options.lazyNumbers = true;
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is, options);
+        REQUIRE(result.valid());
+    }
+}
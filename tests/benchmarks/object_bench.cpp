@@ -0,0 +1,252 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The keys of a terraform "aws_instance" body.
+static const char* const kInstanceKeys[] = {
+    "ami", "instance_type", "count", "ports", "enabled", "tags",
+};
+
+template<typename Map> static std::vector<Map> smallObjects(size_t n)
+{
+    std::vector<Map> objects(n);
+    for (size_t i = 0; i < n; ++i) {
+        for (const char* key : kInstanceKeys)
+            objects[i].emplace(key, hcl::Value(static_cast<int>(i)));
+    }
+    return objects;
+}
+
+template<typename Map> static int64_t lookUpAll(const std::vector<Map>& objects)
+{
+    int64_t sum = 0;
+    for (const Map& object : objects) {
+        for (const char* key : {"count", "tags", "ami", "missing"}) {
+            auto it = object.find(key);
+            if (it != object.end())
+                sum += it->second.template as<int>();
+        }
+    }
+    return sum;
+}
+
+TEST_CASE("build and search small objects", "[object]")
+{
+    const size_t n = 100000;
+
+    BENCHMARK("build unordered_map objects")
+    {
+        REQUIRE(smallObjects<std::unordered_map<std::string, hcl::Value>>(n).size() == n);
+    }
+
+    BENCHMARK("build map objects")
+    {
+        REQUIRE(smallObjects<std::map<std::string, hcl::Value>>(n).size() == n);
+    }
+
+    BENCHMARK("build FlatMap objects")
+    {
+        REQUIRE(smallObjects<hcl::FlatMap<hcl::Value>>(n).size() == n);
+    }
+
+    BENCHMARK("build OpenHashMap objects")
+    {
+        REQUIRE(smallObjects<hcl::OpenHashMap<hcl::Value>>(n).size() == n);
+    }
+
+    const auto hashed = smallObjects<std::unordered_map<std::string, hcl::Value>>(n);
+    const auto ordered = smallObjects<std::map<std::string, hcl::Value>>(n);
+    const auto flat = smallObjects<hcl::FlatMap<hcl::Value>>(n);
+    const auto open = smallObjects<hcl::OpenHashMap<hcl::Value>>(n);
+
+    // Each object has count == tags == ami == its position.
+    const int64_t expected = 3 * static_cast<int64_t>(n) * (n - 1) / 2;
+
+    BENCHMARK("search unordered_map objects")
+    {
+        REQUIRE(lookUpAll(hashed) == expected);
+    }
+
+    BENCHMARK("search map objects")
+    {
+        REQUIRE(lookUpAll(ordered) == expected);
+    }
+
+    BENCHMARK("search FlatMap objects")
+    {
+        REQUIRE(lookUpAll(flat) == expected);
+    }
+
+    BENCHMARK("search OpenHashMap objects")
+    {
+        REQUIRE(lookUpAll(open) == expected);
+    }
+}
+
+template<typename Map> static Map largeObject(const std::vector<std::string>& keys)
+{
+    Map object;
+    for (size_t i = 0; i < keys.size(); ++i)
+        object.emplace(keys[i], hcl::Value(static_cast<int>(i)));
+    return object;
+}
+
+template<typename Map> static int64_t lookUpEach(const Map& object, const std::vector<std::string>& keys)
+{
+    int64_t sum = 0;
+    for (const std::string& key : keys)
+        sum += object.find(key)->second.template as<int>();
+    return sum;
+}
+
+TEST_CASE("search a large object", "[object]")
+{
+    // The size of the largest "variable" and "resource" objects we see.
+    const size_t n = 50000;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; ++i)
+        keys.push_back("aws_instance.web_" + std::to_string(i));
+    const int64_t expected = static_cast<int64_t>(n) * (n - 1) / 2;
+
+    // Looked up in another order than inserted.
+    std::vector<std::string> lookups = keys;
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(42));
+
+    const auto hashed = largeObject<std::unordered_map<std::string, hcl::Value>>(keys);
+    const auto ordered = largeObject<std::map<std::string, hcl::Value>>(keys);
+    const auto flat = largeObject<hcl::FlatMap<hcl::Value>>(keys);
+    const auto open = largeObject<hcl::OpenHashMap<hcl::Value>>(keys);
+
+    std::vector<size_t> hashes;
+    for (const std::string& key : lookups)
+        hashes.push_back(hcl::OpenHashMap<hcl::Value>::hash(key));
+
+    BENCHMARK("search a 50k key unordered_map")
+    {
+        REQUIRE(lookUpEach(hashed, lookups) == expected);
+    }
+
+    BENCHMARK("search a 50k key map")
+    {
+        REQUIRE(lookUpEach(ordered, lookups) == expected);
+    }
+
+    BENCHMARK("search a 50k key FlatMap")
+    {
+        REQUIRE(lookUpEach(flat, lookups) == expected);
+    }
+
+    BENCHMARK("search a 50k key OpenHashMap")
+    {
+        REQUIRE(lookUpEach(open, lookups) == expected);
+    }
+
+    BENCHMARK("search a 50k key OpenHashMap by precomputed hashes")
+    {
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += open.find(lookups[i], hashes[i])->second.as<int>();
+        REQUIRE(sum == expected);
+    }
+}
+
+template<typename V> static V parseAs(const std::string& document)
+{
+    std::istringstream is(document);
+    hcl::BasicParseResult<V> result = hcl::parse<V>(is);
+    REQUIRE(result.valid());
+    return std::move(result.value);
+}
+
+// Reads variables by name, the way a lookup service would.
+template<typename V> static size_t readDefaults(const V& root, const std::vector<std::string>& names)
+{
+    const V* variables = root.findChild("variable");
+    size_t size = 0;
+    for (const std::string& name : names)
+        size += variables->findChild(name)->findChild("default")->stringSize();
+    return size;
+}
+
+TEST_CASE("parse and search with each object policy", "[object]")
+{
+    const int n = 5000;
+    const std::string document = bench::terraformDocument(n);
+    std::vector<std::string> names;
+    size_t expected = 0;
+    for (int i = 0; i < n; ++i) {
+        names.push_back("var_" + std::to_string(i));
+        expected += std::string("value-").size() + std::to_string(i).size();
+    }
+    std::shuffle(names.begin(), names.end(), std::mt19937(42));
+
+    BENCHMARK("parse a 2MB terraform document into a HashValue")
+    {
+        REQUIRE(parseAs<hcl::HashValue>(document).valid());
+    }
+
+    BENCHMARK("parse a 2MB terraform document into a SortedValue")
+    {
+        REQUIRE(parseAs<hcl::SortedValue>(document).valid());
+    }
+
+    BENCHMARK("parse a 2MB terraform document into a FlatValue")
+    {
+        REQUIRE(parseAs<hcl::FlatValue>(document).valid());
+    }
+
+    BENCHMARK("parse a 2MB terraform document into an OpenHashValue")
+    {
+        REQUIRE(parseAs<hcl::OpenHashValue>(document).valid());
+    }
+
+    BENCHMARK("parse a 2MB terraform document into an InternedValue")
+    {
+        REQUIRE(parseAs<hcl::InternedValue>(document).valid());
+    }
+
+    const hcl::HashValue hashed = parseAs<hcl::HashValue>(document);
+    const hcl::SortedValue sorted = parseAs<hcl::SortedValue>(document);
+    const hcl::FlatValue flat = parseAs<hcl::FlatValue>(document);
+    const hcl::OpenHashValue open = parseAs<hcl::OpenHashValue>(document);
+    const hcl::InternedValue interned = parseAs<hcl::InternedValue>(document);
+
+    BENCHMARK("look up 5000 variables in a HashValue")
+    {
+        REQUIRE(readDefaults(hashed, names) == expected);
+    }
+
+    BENCHMARK("look up 5000 variables in a SortedValue")
+    {
+        REQUIRE(readDefaults(sorted, names) == expected);
+    }
+
+    BENCHMARK("look up 5000 variables in a FlatValue")
+    {
+        REQUIRE(readDefaults(flat, names) == expected);
+    }
+
+    BENCHMARK("look up 5000 variables in an OpenHashValue")
+    {
+        REQUIRE(readDefaults(open, names) == expected);
+    }
+
+    BENCHMARK("look up 5000 variables in an InternedValue")
+    {
+        REQUIRE(readDefaults(interned, names) == expected);
+    }
+
+    BENCHMARK("convert a HashValue to a SortedValue")
+    {
+        REQUIRE(hcl::SortedValue(hashed).size() == 2);
+    }
+}
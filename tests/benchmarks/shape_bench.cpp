@@ -0,0 +1,69 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Wide objects and long lists, where growing one child at a time hurts most.
+std::string wideDocument(int entries)
+{
+    std::ostringstream ss;
+    ss << "hosts = [";
+    for (int i = 0; i < entries; ++i)
+        ss << (i ? ", " : "") << "\"10.0.0." << i << "\"";
+    ss << "]\n\n";
+    for (int i = 0; i < entries; ++i)
+        ss << "limit \"client_" << i << "\" {\n  rate = " << i << "\n}\n";
+    return ss.str();
+}
+
+const int reloads = 20;
+
+void reload(const std::string& document, const hcl::ShapeProfile* profile)
+{
+    hcl::ParseOptions options;
+    options.shape = profile;
+    for (int i = 0; i < reloads; ++i) {
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is, options);
+        REQUIRE(result.valid());
+    }
+}
+
+} // namespace
+
+TEST_CASE("reloading a config with and without a shape profile", "[shape]")
+{
+    const std::string terraform = bench::terraformDocument(5000);
+    const std::string wide = wideDocument(20000);
+
+    std::istringstream is(terraform);
+    const hcl::ShapeProfile terraformProfile = hcl::parse(is).shape();
+    is.clear();
+    is.str(wide);
+    const hcl::ShapeProfile wideProfile = hcl::parse(is).shape();
+
+    BENCHMARK("reload a 2MB terraform document 20 times")
+    {
+        reload(terraform, nullptr);
+    }
+
+    BENCHMARK("reload a 2MB terraform document 20 times with its profile")
+    {
+        reload(terraform, &terraformProfile);
+    }
+
+    BENCHMARK("reload a wide document 20 times")
+    {
+        reload(wide, nullptr);
+    }
+
+    BENCHMARK("reload a wide document 20 times with its profile")
+    {
+        reload(wide, &wideProfile);
+    }
+}
@@ -0,0 +1,64 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <sstream>
+#include <string>
+
+// Embedded JSON policies, passed through without being read.
+static std::string policyDocument(int policies)
+{
+    std::ostringstream ss;
+    for (int i = 0; i < policies; ++i) {
+        ss << "policy \"p" << i << "\" {\n  document = \"{";
+        for (int j = 0; j < 20; ++j)
+            ss << (j ? "," : "") << "\\\"Sid" << j << "\\\":\\\"Allow\\tAll\\u00e9\\\"";
+        ss << "}\"\n}\n";
+    }
+    return ss.str();
+}
+
+TEST_CASE("parse escaped strings lazily versus eagerly", "[string]")
+{
+    const std::string document = policyDocument(5000);
+
+    BENCHMARK("parse and write a document of escaped strings")
+    {
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is);
+        REQUIRE(result.valid());
+        std::ostringstream os;
+        result.value.write(&os);
+    }
+
+    BENCHMARK("parse and write the same document with lazy strings")
+    {
+        hcl::ParseOptions options;
+        options.lazyStrings = true;
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is, options);
+        REQUIRE(result.valid());
+        std::ostringstream os;
+        result.value.write(&os);
+    }
+}
+
+TEST_CASE("parse short strings inline versus on the heap", "[string]")
+{
+    const std::string document = bench::terraformDocument(5000);
+
+    BENCHMARK("parse a terraform document")
+    {
+        std::istringstream is(document);
+        REQUIRE(hcl::parse(is).valid());
+    }
+
+    BENCHMARK("parse the same document with inline strings")
+    {
+        hcl::ParseOptions options;
+        options.inlineStrings = true;
+        std::istringstream is(document);
+        REQUIRE(hcl::parse(is, options).valid());
+    }
+}
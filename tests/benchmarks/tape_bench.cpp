@@ -0,0 +1,56 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <sstream>
+#include <string>
+
+TEST_CASE("parse into a tape versus values", "[tape]")
+{
+    const std::string document = bench::terraformDocument(5000);
+
+    BENCHMARK("parse a 2MB terraform document")
+    {
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is);
+        REQUIRE(result.valid());
+    }
+
+    BENCHMARK("parse the same document into a tape")
+    {
+        hcl::TapeResult result = hcl::parseTape(document);
+        REQUIRE(result.valid());
+    }
+
+    std::istringstream is(document);
+    const hcl::ParseResult parsed = hcl::parse(is);
+    const hcl::TapeResult tape = hcl::parseTape(document);
+    REQUIRE(parsed.valid());
+    REQUIRE(tape.valid());
+
+    BENCHMARK("read every variable default from values")
+    {
+        size_t total = 0;
+        for (const auto& kv : parsed.value.get<hcl::Object>("variable"))
+            total += kv.second.get<std::string>("default").size();
+        REQUIRE(total > 0);
+    }
+
+    BENCHMARK("read every variable default from the tape")
+    {
+        size_t total = 0;
+        for (hcl::ValueRef variable : tape.tape.root().find("variable"))
+            total += variable.find("default").as<std::string>().size();
+        REQUIRE(total > 0);
+    }
+
+    BENCHMARK("read every variable default from the tape by symbol")
+    {
+        const hcl::Symbol defaultKey = tape.tape.symbol("default");
+        size_t total = 0;
+        for (hcl::ValueRef variable : tape.tape.root().find("variable"))
+            total += variable.find(defaultKey).as<std::string>().size();
+        REQUIRE(total > 0);
+    }
+}
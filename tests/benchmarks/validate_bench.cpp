@@ -0,0 +1,25 @@
+#include "hcl/hcl.hpp"
+
+#include "../thirdparty/catch2/catch.hpp"
+#include "bench_util.hpp"
+
+#include <sstream>
+#include <string>
+
+TEST_CASE("validate versus parse", "[validate]")
+{
+    const std::string document = bench::terraformDocument(2000);
+
+    BENCHMARK("parse 2000 resources")
+    {
+        std::istringstream is(document);
+        hcl::ParseResult result = hcl::parse(is);
+        REQUIRE(result.valid());
+    }
+
+    BENCHMARK("validate 2000 resources")
+    {
+        hcl::ValidationResult result = hcl::validate(document);
+        REQUIRE(result.valid());
+    }
+}
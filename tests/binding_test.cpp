@@ -0,0 +1,309 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include "benchmarks/bench_util.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Listener {
+    Listener() : port(0), tls(false) {}
+
+    int port;
+    std::string host;
+    bool tls;
+};
+
+struct Limits {
+    Limits() : rate(0.0), burst(0), small(0) {}
+
+    double rate;
+    std::uint32_t burst;
+    std::int8_t small;
+};
+
+struct Server {
+    std::string name;
+    std::vector<std::string> aliases;
+    std::map<std::string, Listener> listeners;
+    std::vector<Listener> backends;
+    std::unique_ptr<Limits> limits;
+    std::vector<std::vector<int>> matrix;
+    std::unordered_map<std::string, std::string> tags;
+    std::string motd;
+};
+
+struct Variable {
+    std::string type;
+    std::string defaultValue;
+    std::string description;
+};
+
+struct Tags {
+    std::string name;
+    std::string owner;
+};
+
+struct Instance {
+    Instance() : count(0), enabled(false) {}
+
+    std::string ami;
+    std::string instanceType;
+    int count;
+    std::vector<std::int64_t> ports;
+    bool enabled;
+    Tags tags;
+};
+
+struct Terraform {
+    std::map<std::string, Variable> variables;
+    std::map<std::string, std::map<std::string, Instance>> resources;
+};
+
+} // namespace
+
+MICROHCL_BEGIN_BINDING(Listener)
+    MICROHCL_REQUIRED_FIELD(port)
+    MICROHCL_FIELD(host)
+    MICROHCL_FIELD(tls)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Limits)
+    MICROHCL_FIELD(rate)
+    MICROHCL_FIELD(burst)
+    MICROHCL_FIELD(small)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Variable)
+    MICROHCL_FIELD(type)
+    MICROHCL_FIELD_AS("default", defaultValue)
+    MICROHCL_FIELD(description)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Tags)
+    MICROHCL_FIELD_AS("Name", name)
+    MICROHCL_FIELD_AS("Owner", owner)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Instance)
+    MICROHCL_FIELD(ami)
+    MICROHCL_FIELD_AS("instance_type", instanceType)
+    MICROHCL_FIELD(count)
+    MICROHCL_FIELD(ports)
+    MICROHCL_FIELD(enabled)
+    MICROHCL_FIELD(tags)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(Terraform)
+    MICROHCL_FIELD_AS("variable", variables)
+    MICROHCL_FIELD_AS("resource", resources)
+MICROHCL_END_BINDING()
+
+// Written out by hand instead of through the macros.
+namespace hcl {
+template<> struct Binding<Server> {
+    template<typename Fields> static void fields(Fields& f)
+    {
+        f.required("name", &Server::name);
+        f("aliases", &Server::aliases);
+        f("listener", &Server::listeners);
+        f("backend", &Server::backends);
+        f("limits", &Server::limits);
+        f("matrix", &Server::matrix);
+        f("tags", &Server::tags);
+        f("motd", &Server::motd);
+    }
+};
+} // namespace hcl
+
+TEST_CASE("decode scalars and nested values", "[binding]")
+{
+    const std::string input = R"(
+name = "front\tend"
+aliases = ["www", 'web', ident]
+motd = <<EOF
+hello
+EOF
+
+listener "http" {
+  port = 80
+}
+listener "https" {
+  port = 443
+  host = "example.com"
+  tls = true
+}
+
+backend {
+  port = 8080
+}
+backend {
+  port = 8081
+}
+
+limits = {
+  rate = 1.5
+  burst = 100
+}
+
+matrix = [[1, 2], [3]]
+
+tags {
+  "team name" = "ops"
+  "escaped\"key" = x
+}
+
+unknown "block" {
+  nested = [1, { a = 2 }]
+}
+)";
+
+    Server server;
+    hcl::DecodeResult result = hcl::decode(input, server);
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+
+    CHECK(server.name == "front\tend");
+    CHECK(server.aliases == std::vector<std::string>({"www", "web", "ident"}));
+    CHECK(server.motd == "hello\n");
+
+    REQUIRE(server.listeners.size() == 2);
+    CHECK(server.listeners["http"].port == 80);
+    CHECK(server.listeners["http"].host.empty());
+    CHECK(!server.listeners["http"].tls);
+    CHECK(server.listeners["https"].port == 443);
+    CHECK(server.listeners["https"].host == "example.com");
+    CHECK(server.listeners["https"].tls);
+
+    REQUIRE(server.backends.size() == 2);
+    CHECK(server.backends[0].port == 8080);
+    CHECK(server.backends[1].port == 8081);
+
+    REQUIRE(server.limits);
+    CHECK(server.limits->rate == 1.5);
+    CHECK(server.limits->burst == 100);
+
+    CHECK(server.matrix == std::vector<std::vector<int>>({{1, 2}, {3}}));
+
+    CHECK(server.tags.size() == 2);
+    CHECK(server.tags["team name"] == "ops");
+    CHECK(server.tags["escaped\"key"] == "x");
+}
+
+TEST_CASE("decode leaves missing optional fields alone", "[binding]")
+{
+    Server server;
+    server.motd = "default";
+    hcl::DecodeResult result = hcl::decode(std::string("name = \"a\""), server);
+    REQUIRE(result.valid());
+    CHECK(server.name == "a");
+    CHECK(server.motd == "default");
+    CHECK(!server.limits);
+    CHECK(server.backends.empty());
+}
+
+TEST_CASE("decode reports missing required fields", "[binding]")
+{
+    Server server;
+    hcl::DecodeResult result = hcl::decode(std::string("motd = \"hi\""), server);
+    CHECK(!result.valid());
+    CHECK(result.errorReason.find("missing required field \"name\"") != std::string::npos);
+
+    result = hcl::decode(std::string("name = \"a\"\nlistener \"http\" {\n  host = \"x\"\n}\n"), server);
+    CHECK(!result.valid());
+    CHECK(result.errorReason.find("missing required field \"port\"") != std::string::npos);
+}
+
+TEST_CASE("decode reports type mismatches with their position", "[binding]")
+{
+    Server server;
+    hcl::DecodeResult result = hcl::decode(std::string("name = \"a\"\nlistener \"http\" {\n  port = \"80\"\n}\n"), server);
+    CHECK(!result.valid());
+    CHECK(result.errorReason.find("Error:3:9: expected int got: 80") != std::string::npos);
+    CHECK(result.errorReason.find("failed decoding \"port\"") != std::string::npos);
+
+    // No implicit conversions, same as Value::as<T>().
+    Limits limits;
+    CHECK(!hcl::decode(std::string("rate = 1"), limits).valid());
+    CHECK(!hcl::decode(std::string("burst = true"), limits).valid());
+    CHECK(!hcl::decode(std::string("burst \"label\" {}"), limits).valid());
+}
+
+TEST_CASE("decode rejects integers out of range", "[binding]")
+{
+    Limits limits;
+    CHECK(hcl::decode(std::string("small = -128"), limits).valid());
+    CHECK(limits.small == -128);
+    CHECK(!hcl::decode(std::string("small = 128"), limits).valid());
+    CHECK(!hcl::decode(std::string("burst = -1"), limits).valid());
+    CHECK(hcl::decode(std::string("burst = 4_294_967_295"), limits).valid());
+    CHECK(limits.burst == 4294967295u);
+    CHECK(!hcl::decode(std::string("burst = 99999999999999999999"), limits).valid());
+}
+
+TEST_CASE("decode rejects what parse rejects", "[binding]")
+{
+    const char* inputs[] = {
+        "name = ",
+        "name = \"a\" listener {",
+        "name = [1 2]",
+        "a b = 1",
+        "= 1",
+        "name = \"unterminated",
+        "}",
+    };
+
+    for (const char* input : inputs) {
+        INFO(input);
+        std::istringstream is(input);
+        CHECK(!hcl::parse(is).valid());
+
+        std::map<std::string, std::vector<std::string>> any;
+        CHECK(!hcl::decode(std::string(input), any).valid());
+    }
+}
+
+TEST_CASE("decode agrees with parse on a generated document", "[binding]")
+{
+    const std::string document = bench::terraformDocument(20);
+
+    Terraform tf;
+    hcl::DecodeResult result = hcl::decode(document, tf);
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+
+    std::istringstream is(document);
+    hcl::ParseResult parsed = hcl::parse(is);
+    REQUIRE(parsed.valid());
+
+    const hcl::Object& variables = parsed.value.get<hcl::Object>("variable");
+    REQUIRE(tf.variables.size() == variables.size());
+    for (const auto& kv : variables) {
+        const Variable& v = tf.variables[kv.first];
+        CHECK(v.type == kv.second.get<std::string>("type"));
+        CHECK(v.defaultValue == kv.second.get<std::string>("default"));
+        CHECK(v.description == kv.second.get<std::string>("description"));
+    }
+
+    // parse() expands the resource blocks into a list, as they share the
+    // "aws_instance" key. decode() collects them into the one map.
+    const hcl::List& resources = parsed.value.get<hcl::List>("resource");
+    REQUIRE(tf.resources["aws_instance"].size() == resources.size());
+    for (const auto& resource : resources) {
+        const auto& kv = *resource.get<hcl::Object>("aws_instance").begin();
+        const Instance& instance = tf.resources["aws_instance"][kv.first];
+        CHECK(instance.ami == kv.second.get<std::string>("ami"));
+        CHECK(instance.instanceType == kv.second.get<std::string>("instance_type"));
+        CHECK(instance.count == kv.second.get<int>("count"));
+        CHECK(instance.ports == kv.second.get<std::vector<std::int64_t>>("ports"));
+        CHECK(instance.enabled == kv.second.get<bool>("enabled"));
+        CHECK(instance.tags.name == kv.second.findChild("tags")->get<std::string>("Name"));
+        CHECK(instance.tags.owner == kv.second.findChild("tags")->get<std::string>("Owner"));
+    }
+}
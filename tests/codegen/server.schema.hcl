@@ -0,0 +1,54 @@
+namespace = "codegen::config"
+
+struct "Limits" {
+  field "rate" {
+    type    = "double"
+    default = 1.5
+  }
+  field "burst" {
+    type    = "int"
+    default = 10
+  }
+}
+
+struct "Listener" {
+  field "port" {
+    type     = "int"
+    required = true
+  }
+  field "host" {
+    type    = "string"
+    default = "localhost"
+  }
+  field "tls" {
+    type = "bool"
+  }
+  field "tls-cert" {
+    type   = "string"
+    member = "tlsCert"
+  }
+}
+
+struct "Server" {
+  field "name" {
+    type     = "string"
+    required = true
+  }
+  field "tags" {
+    type = "map(string)"
+  }
+  field "aliases" {
+    type = "list(string)"
+  }
+  field "listener" {
+    type   = "map(Listener)"
+    member = "listeners"
+  }
+  field "backend" {
+    type   = "list(Listener)"
+    member = "backends"
+  }
+  field "limits" {
+    type = "optional(Limits)"
+  }
+}
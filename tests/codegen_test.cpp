@@ -0,0 +1,117 @@
+#include "server_schema.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <sstream>
+#include <string>
+
+using codegen::config::Limits;
+using codegen::config::Listener;
+using codegen::config::Server;
+
+TEST_CASE("generated structs have their defaults", "[codegen]")
+{
+    Listener listener;
+    CHECK(listener.port == 0);
+    CHECK(listener.host == "localhost");
+    CHECK(!listener.tls);
+
+    Limits limits;
+    CHECK(limits.rate == 1.5);
+    CHECK(limits.burst == 10);
+}
+
+TEST_CASE("generated decoder fills the structs", "[codegen]")
+{
+    const std::string input = R"(
+name = "front"
+aliases = ["www", "web"]
+
+tags {
+  team = "ops"
+}
+
+listener "http" {
+  port = 80
+}
+listener "https" {
+  port = 443
+  host = "example.com"
+  tls = true
+  tls-cert = "/etc/cert.pem"
+}
+
+backend {
+  port = 8080
+}
+backend {
+  port = 8081
+}
+
+limits {
+  burst = 20
+}
+
+unknown = 1
+)";
+
+    Server server;
+    hcl::DecodeResult result = hcl::decode(input, server);
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+
+    CHECK(server.name == "front");
+    CHECK(server.aliases == std::vector<std::string>({"www", "web"}));
+    CHECK(server.tags["team"] == "ops");
+    REQUIRE(server.listeners.size() == 2);
+    CHECK(server.listeners["http"].port == 80);
+    CHECK(server.listeners["http"].host == "localhost");
+    CHECK(server.listeners["https"].host == "example.com");
+    CHECK(server.listeners["https"].tls);
+    CHECK(server.listeners["https"].tlsCert == "/etc/cert.pem");
+    REQUIRE(server.backends.size() == 2);
+    CHECK(server.backends[1].port == 8081);
+    REQUIRE(server.limits);
+    CHECK(server.limits->rate == 1.5);
+    CHECK(server.limits->burst == 20);
+}
+
+TEST_CASE("generated decoder checks required fields", "[codegen]")
+{
+    Server server;
+    hcl::DecodeResult result = hcl::decode(std::string("tags { a = \"b\" }"), server);
+    CHECK(!result.valid());
+    CHECK(result.errorReason.find("missing required field \"name\"") != std::string::npos);
+
+    result = hcl::decode(std::string("name = \"a\"\nlistener \"http\" {\n  host = \"x\"\n}\n"), server);
+    CHECK(!result.valid());
+    CHECK(result.errorReason.find("missing required field \"port\"") != std::string::npos);
+}
+
+TEST_CASE("generated encoder round trips through the writer", "[codegen]")
+{
+    Server server;
+    server.name = "front";
+    server.aliases = {"www"};
+    server.tags["team"] = "ops";
+    server.listeners["https"].port = 443;
+    server.listeners["https"].tlsCert = "/etc/cert.pem";
+    server.backends.resize(2);
+    server.backends[0].port = 8080;
+    server.backends[1].port = 8081;
+
+    hcl::Value v = hcl::encode(server);
+    CHECK(v.get<std::string>("name") == "front");
+    CHECK(v.findChild("listener")->findChild("https")->get<int>("port") == 443);
+    CHECK(v.findChild("listener")->findChild("https")->get<std::string>("tls-cert") == "/etc/cert.pem");
+    CHECK(!v.findChild("limits"));
+
+    std::stringstream ss;
+    ss << v;
+
+    Server decoded;
+    hcl::DecodeResult result = hcl::decode(ss.str(), decoded);
+    INFO(ss.str());
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+    CHECK(hcl::encode(decoded) == v);
+}
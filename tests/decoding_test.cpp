@@ -66,8 +66,8 @@ std::map<std::string, hcl::Value> cases = {
     {"escape.hcl",
      hcl::Value(hcl::Object{
              {"foo",          "bar\"baz\\n"},
-             {"qux",          "back\\slash"},
              {"bar",          "new\nline"},
+             {"qux",          "back\\slash"},
              {"qax",          R"(slash\:colon)"},
              {"nested",       R"(${HH\:mm\:ss})"},
              {"nestedquotes", R"(${""stringwrappedinquotes""})"}
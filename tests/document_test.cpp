@@ -0,0 +1,158 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include "benchmarks/bench_util.hpp"
+#include <sstream>
+#include <string>
+
+static hcl::ParseResult parseText(const std::string& text)
+{
+    std::istringstream is(text);
+    return hcl::parse(is);
+}
+
+// Applies the edit to |document| and checks it against a full parse.
+static void checkEdit(hcl::Document& document, size_t offset, size_t length,
+                      const std::string& replacement, bool incremental)
+{
+    std::string expectedText = document.text();
+    expectedText.replace(offset, length, replacement);
+    hcl::ParseResult expected = parseText(expectedText);
+
+    INFO(expectedText);
+    CHECK(document.edit(offset, length, replacement) == expected.valid());
+    CHECK(document.text() == expectedText);
+    CHECK(document.lastEditIncremental() == incremental);
+    CHECK(document.valid() == expected.valid());
+    CHECK(document.errorReason() == expected.errorReason);
+    if (expected.valid())
+        CHECK(document.value() == expected.value);
+}
+
+TEST_CASE("edit a document inside an item", "[document]")
+{
+    const std::string text =
+        "name = \"web\"\n"
+        "port = 80\n"
+        "\n"
+        "# listeners\n"
+        "listener \"http\" {\n"
+        "  port = 80\n"
+        "}\n"
+        "listener \"https\" {\n"
+        "  port = 443\n"
+        "}\n";
+    hcl::Document document(text);
+    REQUIRE(document.valid());
+
+    // Values of unique keys.
+    checkEdit(document, text.find("web"), 3, "frontend", true);
+    checkEdit(document, document.text().find("80"), 2, "8080", true);
+    // Renaming a unique key.
+    checkEdit(document, document.text().find("port ="), 4, "ports", true);
+    // Inside a block that shares its first key with another.
+    checkEdit(document, document.text().find("443"), 3, "8443", true);
+    checkEdit(document, document.text().find("  port = 80\n"), 0, "  tls = true\n", true);
+    // Appending to the last token of an item.
+    checkEdit(document, document.text().find("\"frontend\"") + 10, 0, " + 1", false);
+}
+
+TEST_CASE("edit a document across items", "[document]")
+{
+    const std::string text = "a = 1\nb = 2\nc {\n  d = 3\n}\n";
+    hcl::Document document(text);
+
+    // Between items, and across two of them.
+    checkEdit(document, text.find("\nb"), 1, "\n\n", false);
+    checkEdit(document, document.text().find("1"), document.text().find("2") - document.text().find("1"), "5\nb = ", false);
+    // Splitting an item into two.
+    checkEdit(document, document.text().find("d = 3"), 5, "d = 3\n}\ne {", false);
+    // Renaming a key to one that is used already.
+    checkEdit(document, document.text().find("a ="), 1, "b", false);
+}
+
+TEST_CASE("edit a document into and out of errors", "[document]")
+{
+    hcl::Document document("a = 1\nb = [1, 2]\n");
+
+    checkEdit(document, document.text().find("2]"), 2, "2", false);
+    CHECK(!document.valid());
+    checkEdit(document, document.text().find("2\n"), 1, "2]", false);
+    CHECK(document.valid());
+    checkEdit(document, document.text().find("1,"), 1, "1 1", false);
+}
+
+TEST_CASE("edit a document with heredocs", "[document]")
+{
+    const std::string text = "a = <<EOF\nx\nEOF\nb = 1\n";
+    hcl::Document document(text);
+    REQUIRE(document.valid());
+
+    // Breaking the terminator makes the heredoc run on over b.
+    checkEdit(document, 14, 1, "X", false);
+    checkEdit(document, 14, 1, "F", false);
+    // Adding a heredoc to another item.
+    checkEdit(document, document.text().find("1"), 1, "<<EOT\ny\nEOT", false);
+    // Items without one are still reparsed alone.
+    hcl::Document plain("a = 1\nb = <<EOF\nx\nEOF\n");
+    checkEdit(plain, 4, 1, "2", true);
+}
+
+TEST_CASE("edit a document where items touch", "[document]")
+{
+    // `"x"` starts the next item, as a block label of c.
+    hcl::Document labelled("a = 1\nb = _\"x\"\nc { d = 2 }");
+    REQUIRE(labelled.valid());
+    checkEdit(labelled, 11, 3, "_", false);
+
+    hcl::Document number("y = 1.5c = 3,");
+    REQUIRE(number.valid());
+    checkEdit(number, 7, 0, "_", false);
+
+    // Items after whitespace, a comma, a block or a comment are still
+    // reparsed alone.
+    hcl::Document spaced("a = 1, b = 2\nc { }d = 3 # x\ne = 4");
+    REQUIRE(spaced.valid());
+    checkEdit(spaced, spaced.text().find("2"), 1, "7", true);
+    checkEdit(spaced, spaced.text().find("3"), 1, "5", true);
+    checkEdit(spaced, spaced.text().find("4"), 1, "6", true);
+    checkEdit(spaced, spaced.text().find("e"), 1, "g", true);
+}
+
+TEST_CASE("edit every block of a generated document", "[document]")
+{
+    hcl::Document document(bench::terraformDocument(20));
+    REQUIRE(document.valid());
+
+    for (int i = 0; i < 20; i += 3) {
+        const std::string ami = "ami-" + std::to_string(100000 + i);
+        checkEdit(document, document.text().find(ami), ami.size(), "ami-x" + std::to_string(i), true);
+        const std::string name = "\"web-" + std::to_string(i) + "\"";
+        checkEdit(document, document.text().find(name), name.size(), "\"renamed\"", true);
+        const std::string variable = "\"value-" + std::to_string(i) + "\"";
+        checkEdit(document, document.text().find(variable), variable.size(), "42", true);
+    }
+
+    // A new block in the middle, and back.
+    const size_t offset = document.text().find("variable \"var_10\"");
+    const std::string block = "resource \"aws_instance\" \"new\" {\n  ami = \"x\"\n}\n\n";
+    checkEdit(document, offset, 0, block, false);
+    checkEdit(document, offset, block.size(), "", false);
+}
+
+TEST_CASE("edit a document with limits", "[document]")
+{
+    hcl::ParseOptions options;
+    options.maxStringLength = 5;
+    hcl::Document document("a = \"x\"\n", options);
+    REQUIRE(document.valid());
+
+    CHECK(!document.edit(5, 1, "0123456789"));
+    CHECK(document.errorCode() == hcl::ErrorCode::MAX_STRING_LENGTH_EXCEEDED);
+
+    options = hcl::ParseOptions();
+    options.maxBytes = 10;
+    hcl::Document small("a = \"x\"\n", options);
+    CHECK(!small.edit(5, 1, "0123456789"));
+    CHECK(small.errorCode() == hcl::ErrorCode::MAX_BYTES_EXCEEDED);
+}
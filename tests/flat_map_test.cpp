@@ -0,0 +1,215 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> keysOf(const hcl::FlatMap<int>& m)
+{
+    std::vector<std::string> keys;
+    for (const auto& kv : m)
+        keys.push_back(kv.first);
+    return keys;
+}
+
+} // namespace
+
+TEST_CASE("flat map keeps insertion order", "[flat_map]")
+{
+    hcl::FlatMap<int> m;
+    CHECK(m.empty());
+    CHECK(m.emplace("b", 1).second);
+    CHECK(m.emplace("a", 2).second);
+    CHECK(m.emplace("c", 3).second);
+
+    // A key already there keeps its value and place.
+    auto inserted = m.emplace("a", 4);
+    CHECK(!inserted.second);
+    CHECK(inserted.first->second == 2);
+
+    m["d"] = 5;
+    m["b"] = 6;
+    CHECK(m.size() == 4);
+    CHECK(keysOf(m) == std::vector<std::string>({"b", "a", "c", "d"}));
+    CHECK(m.find("b")->second == 6);
+    CHECK(m.count("c") == 1);
+    CHECK(m.count("e") == 0);
+    CHECK(m.find("e") == m.end());
+
+    CHECK(m.erase("a") == 1);
+    CHECK(m.erase("a") == 0);
+    CHECK(keysOf(m) == std::vector<std::string>({"b", "c", "d"}));
+}
+
+TEST_CASE("flat map lookups across the index threshold", "[flat_map]")
+{
+    const size_t n = 100;
+
+    hcl::FlatMap<int> m;
+    for (size_t i = 0; i < n; ++i) {
+        m.emplace("key" + std::to_string(i), static_cast<int>(i));
+        for (size_t j = 0; j <= i; ++j)
+            REQUIRE(m.find("key" + std::to_string(j))->second == static_cast<int>(j));
+        REQUIRE(m.count("key" + std::to_string(i + 1)) == 0);
+    }
+
+    // Erase every other key, then back down below the threshold.
+    for (size_t i = 0; i < n; i += 2)
+        REQUIRE(m.erase("key" + std::to_string(i)) == 1);
+    CHECK(m.size() == n / 2);
+    for (size_t i = 0; i < n; ++i)
+        REQUIRE(m.count("key" + std::to_string(i)) == i % 2);
+
+    while (m.size() > 3)
+        m.erase(m.begin());
+    CHECK(keysOf(m) == std::vector<std::string>({"key95", "key97", "key99"}));
+    CHECK(m.find("key97")->second == 97);
+    CHECK(m.count("key93") == 0);
+
+    m.clear();
+    CHECK(m.empty());
+    CHECK(m.find("key97") == m.end());
+}
+
+TEST_CASE("flat map renames in place", "[flat_map]")
+{
+    hcl::FlatMap<int> m{{"a", 1}, {"b", 2}, {"c", 3}};
+    m.rename(m.find("b"), "x");
+    CHECK(keysOf(m) == std::vector<std::string>({"a", "x", "c"}));
+    CHECK(m.find("x")->second == 2);
+    CHECK(m.count("b") == 0);
+
+    for (int i = 0; i < 10; ++i)
+        m.emplace("key" + std::to_string(i), i);
+    m.rename(m.find("key5"), "five");
+    CHECK(m.find("five")->second == 5);
+    CHECK(m.count("key5") == 0);
+    CHECK((m.begin() + 8)->first == "five");
+}
+
+TEST_CASE("flat map reserve and equality", "[flat_map]")
+{
+    hcl::FlatMap<int> a{{"x", 1}, {"y", 2}};
+    hcl::FlatMap<int> b;
+    b.reserve(20);
+    b.emplace("y", 2);
+    b.emplace("x", 1);
+
+    // Equal in any order.
+    CHECK(a == b);
+    b["x"] = 3;
+    CHECK(a != b);
+    b.erase("x");
+    CHECK(a != b);
+
+    CHECK(b.insert(std::make_pair(std::string("x"), 1)).second);
+    CHECK(a == b);
+    CHECK(b.find("y")->second == 2);
+}
+
+TEST_CASE("flat map of values", "[flat_map]")
+{
+    hcl::FlatMap<hcl::Value> m;
+    m.emplace("name", "web");
+    m.emplace("ports", hcl::List{80, 443});
+    m["enabled"] = true;
+
+    CHECK(m.find("name")->second.as<std::string>() == "web");
+    CHECK(m.find("ports")->second.size() == 2);
+    CHECK(m.find("enabled")->second.as<bool>());
+
+    hcl::FlatMap<hcl::Value> copy = m;
+    CHECK(copy == m);
+    copy["name"] = "db";
+    CHECK(copy != m);
+}
+
+TEST_CASE("flat map children after inserts", "[flat_map]")
+{
+    // Room reserved beforehand keeps pointers to children valid.
+    hcl::FlatValue v((hcl::FlatValue::Object()));
+    v.reserve(21);
+    hcl::FlatValue* a = v.setChild("a", hcl::FlatValue("first"));
+    for (int i = 0; i < 20; ++i)
+        v.setChild("k" + std::to_string(i), hcl::FlatValue(i));
+    CHECK(v.findChild("a") == a);
+    CHECK(a->as<std::string>() == "first");
+
+    // Beyond it, a child is found again after inserting.
+    for (int i = 20; i < 100; ++i)
+        v.setChild("k" + std::to_string(i), hcl::FlatValue(i));
+    a = v.findChild("a");
+    REQUIRE(a != nullptr);
+    CHECK(a->as<std::string>() == "first");
+    CHECK(v.size() == 101);
+}
+
+#ifdef MICROHCL_USE_FLAT_MAP
+TEST_CASE("write objects in source order", "[flat_map]")
+{
+    const std::string text =
+        "zone = \"b\"\n"
+        "name = \"web\"\n"
+        "listener \"https\" {\n"
+        "  port = 443\n"
+        "  host = \"example.com\"\n"
+        "}\n"
+        "listener \"http\" {\n"
+        "  port = 80\n"
+        "}\n"
+        "after = 1\n";
+
+    std::istringstream is(text);
+    hcl::ParseResult result = hcl::parse(is);
+    REQUIRE(result.valid());
+
+    std::vector<std::string> keys;
+    for (const auto& kv : result.value.as<hcl::Object>())
+        keys.push_back(kv.first);
+    CHECK(keys == std::vector<std::string>({"zone", "name", "listener", "after"}));
+
+    // Values come before blocks, each in source order.
+    std::ostringstream written;
+    written << result.value;
+    const std::string out = written.str();
+    CHECK(out ==
+          "zone = \"b\"\n"
+          "name = \"web\"\n"
+          "after = 1\n"
+          "listener {\n"
+          "   https {\n"
+          "       port = 443\n"
+          "       host = \"example.com\"\n"
+          "   }\n"
+          "   http {\n"
+          "       port = 80\n"
+          "   }\n"
+          "}\n");
+
+    // Writing what was written gives the same text back.
+    std::istringstream again(out);
+    hcl::ParseResult reparsed = hcl::parse(again);
+    REQUIRE(reparsed.valid());
+    std::ostringstream rewritten;
+    rewritten << reparsed.value;
+    CHECK(rewritten.str() == out);
+}
+
+TEST_CASE("edit a document in source order", "[flat_map]")
+{
+    const std::string text = "a = 1\nb = 2\nc = 3\n";
+    hcl::Document document(text);
+    REQUIRE(document.valid());
+
+    // Renaming the middle item keeps its place.
+    REQUIRE(document.edit(text.find("b ="), 1, "x"));
+    CHECK(document.lastEditIncremental());
+    std::vector<std::string> keys;
+    for (const auto& kv : document.value().as<hcl::Object>())
+        keys.push_back(kv.first);
+    CHECK(keys == std::vector<std::string>({"a", "x", "c"}));
+}
+#endif
@@ -0,0 +1,170 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include "benchmarks/bench_util.hpp"
+#include <sstream>
+#include <string>
+
+static hcl::Value parseHCL(const std::string& input)
+{
+    std::istringstream is(input);
+    hcl::ParseResult result = hcl::parse(is);
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+    return result.value;
+}
+
+static hcl::Value parseJSON(const std::string& input)
+{
+    hcl::ParseResult result = hcl::parseJSON(input);
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+    return result.value;
+}
+
+TEST_CASE("parse json scalars", "[json]")
+{
+    hcl::Value v = parseJSON(R"({
+  "int": 42,
+  "negative": -7,
+  "zero": 0,
+  "float": 1.5e3,
+  "small": -0.25,
+  "huge": 99999999999999999999,
+  "yes": true,
+  "no": false,
+  "nothing": null,
+  "escapes": "a\"b\\c\/d\b\f\n\r\t",
+  "unicode": "\u00e9\u4e2d\ud83d\ude00",
+  "hil": "${var.foo}"
+})");
+
+    CHECK(v.get<int>("int") == 42);
+    CHECK(v.get<int>("negative") == -7);
+    CHECK(v.get<int>("zero") == 0);
+    CHECK(v.get<double>("float") == 1500.0);
+    CHECK(v.get<double>("small") == -0.25);
+    CHECK(v.get<std::int64_t>("huge") == std::numeric_limits<std::int64_t>::max());
+    CHECK(v.get<bool>("yes"));
+    CHECK(!v.get<bool>("no"));
+    CHECK(v.get<std::string>("nothing") == "");
+    CHECK(v.get<std::string>("escapes") == "a\"b\\c/d\b\f\n\r\t");
+    CHECK(v.get<std::string>("unicode") == "\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80");
+    CHECK(v.findChild("hil")->isHil());
+}
+
+TEST_CASE("parse json lists", "[json]")
+{
+    hcl::Value v = parseJSON(R"({"a": [1, "two", [3, 4], {"b": 5}], "empty": []})");
+    REQUIRE(v.get<hcl::List>("a").size() == 4);
+    CHECK(v.get<hcl::List>("a")[2] == hcl::Value(hcl::List{3, 4}));
+    CHECK(v.get<hcl::List>("a")[3].get<int>("b") == 5);
+    CHECK(v.get<hcl::List>("empty").empty());
+}
+
+TEST_CASE("json objects of objects are read as blocks", "[json]")
+{
+    const char* const cases[][2] = {
+        {
+            R"({"service": {"web": {"port": 80}, "db": {"port": 5432}}})",
+            "service \"web\" { port = 80 }\nservice \"db\" { port = 5432 }\n",
+        },
+        {
+            R"({"resource": {"aws_instance": {"a": {"ami": "x"}, "b": {"ami": "y"}}}})",
+            "resource \"aws_instance\" \"a\" { ami = \"x\" }\nresource \"aws_instance\" \"b\" { ami = \"y\" }\n",
+        },
+        {
+            R"({"listener": [{"port": 80}, {"port": 443}]})",
+            "listener { port = 80 }\nlistener { port = 443 }\n",
+        },
+        {
+            R"({"listener": [{"http": {"port": 80}}, {"https": {"port": 443}}]})",
+            "listener \"http\" { port = 80 }\nlistener \"https\" { port = 443 }\n",
+        },
+        {
+            R"({"a": {"b": 1, "c": {"d": {"e": 2}}}})",
+            "a { b = 1\n c \"d\" { e = 2 } }\n",
+        },
+        {
+            R"({"a": {"b": [{"c": 1}]}, "empty": {}})",
+            "a { b { c = 1 } }\nempty {}\n",
+        },
+        {
+            R"({"a": [1, 2], "b": {"c": [{"d": 1}, 2]}})",
+            "a = [1, 2]\nb { c = [{ d = 1 }, 2] }\n",
+        },
+    };
+
+    for (const auto& c : cases) {
+        INFO(c[0]);
+        CHECK(parseJSON(c[0]) == parseHCL(c[1]));
+    }
+}
+
+TEST_CASE("parse json agrees with parse on a generated document", "[json]")
+{
+    CHECK(parseJSON(bench::terraformJSONDocument(20)) == parseHCL(bench::terraformDocument(20)));
+}
+
+TEST_CASE("parse empty json documents", "[json]")
+{
+    CHECK(parseJSON("") == hcl::Value(hcl::Object()));
+    CHECK(parseJSON(" {\n}\n") == hcl::Value(hcl::Object()));
+}
+
+TEST_CASE("fail parsing invalid json", "[json]")
+{
+    const char* inputs[] = {
+        "[1, 2]",
+        "{",
+        "{\"a\"}",
+        "{\"a\": }",
+        "{\"a\": 1,}",
+        "{\"a\": 1 \"b\": 2}",
+        "{\"a\": [1 2]}",
+        "{\"a\": [1,]}",
+        "{\"a\": 01}",
+        "{\"a\": 1.}",
+        "{\"a\": -}",
+        "{\"a\": tru}",
+        "{\"a\": \"b}",
+        "{\"a\": \"\\q\"}",
+        "{\"a\": \"\\u12\"}",
+        "{\"a\": \"new\nline\"}",
+        "{a: 1}",
+        "{} {}",
+    };
+
+    for (const char* input : inputs) {
+        INFO(input);
+        hcl::ParseResult result = hcl::parseJSON(input);
+        CHECK(!result.valid());
+        CHECK(result.errorCode == hcl::ErrorCode::SYNTAX_ERROR);
+        CHECK(!result.errorReason.empty());
+    }
+
+    hcl::ParseResult result = hcl::parseJSON("{\n  \"a\": 1,\n  \"b\": [1, x]\n}");
+    CHECK(result.errorReason == "Error:3:11: unexpected character: x\n");
+}
+
+TEST_CASE("parse json with limits", "[json]")
+{
+    const std::string input = R"({"a": {"b": [1, 2, 3]}, "c": "0123456789"})";
+    REQUIRE(hcl::parseJSON(input).valid());
+
+    hcl::ParseOptions options;
+    options.maxDepth = 2;
+    CHECK(hcl::parseJSON(input, options).errorCode == hcl::ErrorCode::MAX_DEPTH_EXCEEDED);
+
+    options = hcl::ParseOptions();
+    options.maxNodes = 5;
+    CHECK(hcl::parseJSON(input, options).errorCode == hcl::ErrorCode::MAX_NODES_EXCEEDED);
+
+    options = hcl::ParseOptions();
+    options.maxStringLength = 5;
+    CHECK(hcl::parseJSON(input, options).errorCode == hcl::ErrorCode::MAX_STRING_LENGTH_EXCEEDED);
+
+    options = hcl::ParseOptions();
+    options.maxBytes = 10;
+    CHECK(hcl::parseJSON(input, options).errorCode == hcl::ErrorCode::MAX_BYTES_EXCEEDED);
+}
@@ -0,0 +1,137 @@
+// Built with -fno-exceptions and MICROHCL_NO_EXCEPTIONS. Catch needs
+// exceptions, so this checks with a few macros of its own.
+#include "hcl/hcl.hpp"
+#include "hcl/async.hpp"
+
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(expr)                                                     \
+    do {                                                                \
+        if (!(expr)) {                                                  \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            ++failures;                                                 \
+        }                                                               \
+    } while (0)
+
+#define CHECK_FAILS(expr, message)                                      \
+    do {                                                                \
+        hcl::clearError();                                              \
+        (void)(expr);                                                   \
+        if (hcl::lastError() != (message)) {                            \
+            std::fprintf(stderr, "%s:%d: %s failed with \"%s\"\n", __FILE__, __LINE__, #expr, \
+                         hcl::lastError().c_str());                     \
+            ++failures;                                                 \
+        }                                                               \
+    } while (0)
+
+namespace {
+
+struct Listener {
+    Listener() : port(0) {}
+
+    int port;
+    std::string host;
+};
+
+} // namespace
+
+MICROHCL_BEGIN_BINDING(Listener)
+    MICROHCL_REQUIRED_FIELD(port)
+    MICROHCL_FIELD(host)
+MICROHCL_END_BINDING()
+
+static void testParse()
+{
+    std::istringstream is("a = 1\nb = \"x\"\nc = [1, 2]\nd { e = true }\n");
+    hcl::ParseResult result = hcl::parse(is);
+    CHECK(result.valid());
+    const hcl::Value& v = result.value;
+
+    CHECK(v.get<int>("a") == 1);
+    CHECK(v.get<std::string>("b") == "x");
+    CHECK(v.findChild("d")->get<bool>("e"));
+
+    int i = 0;
+    CHECK(v.tryGet("a", i) && i == 1);
+    CHECK(!v.tryGet("b", i));
+    CHECK(!v.tryGet("missing", i));
+    std::string s;
+    CHECK(v.findChild("b")->tryAs(s) && s == "x");
+
+    std::istringstream bad("a = [1 2]");
+    CHECK(!hcl::parse(bad).valid());
+}
+
+static void testFailures()
+{
+    hcl::Value v(1);
+    CHECK_FAILS(v.as<std::string>(), "type error: this value is int but string was requested");
+    CHECK(v.as<std::string>().empty());
+    CHECK(v.as<bool>() == false);
+    CHECK(v.as<hcl::List>().empty());
+
+    CHECK_FAILS(v.findChild("a"), "cannot use findChild on non-object");
+    CHECK(v.findChild("a") == nullptr);
+    CHECK(v.setChild("a", hcl::Value(2)) == nullptr);
+    CHECK(v.push(hcl::Value(2)) == nullptr);
+    CHECK(!v.eraseChild("a"));
+    CHECK(v.asNumber() == 1.0);
+
+    hcl::Value object((hcl::Object()));
+    CHECK_FAILS(object.get<int>("missing"), "key missing was not found.");
+    CHECK(object.get<int>("missing") == 0);
+    CHECK_FAILS(object[3], "type must be list to index by int");
+    CHECK(!object[3].valid());
+
+    hcl::Value list((hcl::List()));
+    CHECK_FAILS(list.get<int>(0), "index out of bound");
+    CHECK_FAILS(list.setChild("a", 1), "type must be object to do set(key, v).");
+
+    CHECK_FAILS(hcl::Value::rawNumber("x"), "not a number: x");
+    CHECK(!hcl::Value::rawNumber("x").valid());
+
+    hcl::clearError();
+    CHECK(hcl::lastError().empty());
+}
+
+static void testOtherFrontEnds()
+{
+    std::map<std::string, Listener> listeners;
+    hcl::DecodeResult decoded = hcl::decode(std::string("http { port = 80 }\nhttps { host = \"x\" }\n"), listeners);
+    CHECK(!decoded.valid());
+
+    CHECK(hcl::validate(std::string("a = 1")).valid());
+    CHECK(hcl::parseJSON(std::string("{\"a\": [1, 2]}")).valid());
+
+    hcl::TapeResult tape = hcl::parseTape(std::string("a = \"x\""));
+    CHECK(tape.valid());
+    CHECK_FAILS(tape.tape.root().find("a").as<int>(), "type error: this value is string but int was requested");
+
+    hcl::Document document("a = 1\n");
+    CHECK_FAILS(document.edit(10, 1, "x"), "edit is out of range");
+    CHECK(document.edit(4, 1, "2"));
+    CHECK(document.value().get<int>("a") == 2);
+
+    hcl::ThreadPoolExecutor executor(1);
+    CHECK(hcl::parseAsync("a = 1", executor).get().valid());
+}
+
+int main()
+{
+    testParse();
+    testFailures();
+    testOtherFrontEnds();
+
+    if (failures) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
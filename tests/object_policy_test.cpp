@@ -0,0 +1,222 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+// Sorted with the largest key first, to check that a policy of one's own
+// is used everywhere objects are built.
+struct ReverseSortedObjects {
+    template<typename V> using map = std::map<std::string, V, std::greater<std::string>>;
+};
+
+typedef hcl::BasicValue<ReverseSortedObjects> ReverseSortedValue;
+
+const char* const kText =
+    "name = \"web\"\n"
+    "zone = \"b\"\n"
+    "count = 2\n"
+    "ports = [80, 443]\n"
+    "listener \"https\" {\n"
+    "  port = 443\n"
+    "}\n"
+    "listener \"http\" {\n"
+    "  port = 80\n"
+    "}\n";
+
+template<typename V> hcl::BasicParseResult<V> parseText()
+{
+    std::istringstream is(kText);
+    return hcl::parse<V>(is);
+}
+
+template<typename V> std::vector<std::string> keysOf(const V& value)
+{
+    std::vector<std::string> keys;
+    for (const auto& kv : value.template as<typename V::Object>())
+        keys.push_back(kv.first);
+    return keys;
+}
+
+template<typename V> std::string written(const V& value)
+{
+    std::ostringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+template<typename V> void checkParsed()
+{
+    hcl::BasicParseResult<V> result = parseText<V>();
+    REQUIRE(result.valid());
+
+    const V& value = result.value;
+    CHECK(value.template get<std::string>("name") == "web");
+    CHECK(value.template get<int>("count") == 2);
+    CHECK(value.template get<std::vector<int>>("ports") == std::vector<int>({80, 443}));
+    CHECK(value.findChild("listener")->findChild("https")->template get<int>("port") == 443);
+    CHECK(value.findChild("listener")->size() == 2);
+
+    int port = 0;
+    CHECK(!value.tryGet("name", port));
+    CHECK(value.findChild("ports")->template is<typename V::List>());
+    CHECK(value.findChild("listener")->template is<typename V::Object>());
+    CHECK(result.shape().paths() > 0);
+
+    V copy = value;
+    CHECK(copy == value);
+    copy["name"] = "db";
+    CHECK(copy != value);
+}
+
+} // namespace
+
+TEST_CASE("parse with each object policy", "[object_policy]")
+{
+    checkParsed<hcl::HashValue>();
+    checkParsed<hcl::SortedValue>();
+    checkParsed<hcl::FlatValue>();
+    checkParsed<hcl::OpenHashValue>();
+    checkParsed<hcl::InternedValue>();
+    checkParsed<ReverseSortedValue>();
+
+    CHECK((std::is_same<hcl::SortedValue::Object, std::map<std::string, hcl::SortedValue>>::value));
+    CHECK((std::is_same<hcl::FlatValue::Object, hcl::FlatMap<hcl::FlatValue>>::value));
+    CHECK((std::is_same<hcl::Value, hcl::BasicValue<hcl::DefaultObjects>>::value));
+}
+
+TEST_CASE("objects are kept in the order of their policy", "[object_policy]")
+{
+    CHECK(keysOf(parseText<hcl::SortedValue>().value) ==
+          std::vector<std::string>({"count", "listener", "name", "ports", "zone"}));
+    CHECK(keysOf(parseText<hcl::FlatValue>().value) ==
+          std::vector<std::string>({"name", "zone", "count", "ports", "listener"}));
+    CHECK(keysOf(parseText<ReverseSortedValue>().value) ==
+          std::vector<std::string>({"zone", "ports", "name", "listener", "count"}));
+
+    CHECK(written(parseText<hcl::SortedValue>().value) ==
+          "count = 2\n"
+          "name = \"web\"\n"
+          "ports = [80, 443]\n"
+          "zone = \"b\"\n"
+          "listener {\n"
+          "   http {\n"
+          "       port = 80\n"
+          "   }\n"
+          "   https {\n"
+          "       port = 443\n"
+          "   }\n"
+          "}\n");
+}
+
+TEST_CASE("convert values between object policies", "[object_policy]")
+{
+    hcl::ParseOptions options;
+    options.lazyNumbers = true;
+    options.inlineStrings = true;
+    std::istringstream is(std::string(kText) + "ratio = 1.50\nnote = \"a\\tb\"\n");
+    hcl::BasicParseResult<hcl::OpenHashValue> lookup = hcl::parse<hcl::OpenHashValue>(is, options);
+    REQUIRE(lookup.valid());
+
+    // A lookup service's values, written out sorted by a config writer.
+    hcl::SortedValue sorted(lookup.value);
+    CHECK(keysOf(sorted) ==
+          std::vector<std::string>({"count", "listener", "name", "note", "ports", "ratio", "zone"}));
+    CHECK(sorted.findChild("ratio")->isRawNumber());
+    CHECK(sorted.findChild("zone")->isInlineString());
+    CHECK(sorted.get<std::string>("note") == "a\tb");
+    CHECK(sorted.findChild("listener")->findChild("http")->get<int>("port") == 80);
+    CHECK(written(sorted).find("ratio = 1.50\n") != std::string::npos);
+
+    // And back.
+    hcl::OpenHashValue again(sorted);
+    CHECK(again == lookup.value);
+    hcl::Value value(again);
+    CHECK(value.get<double>("ratio") == 1.5);
+    CHECK(hcl::FlatValue(hcl::SortedValue(42)).as<int>() == 42);
+}
+
+TEST_CASE("intern keys once per document", "[object_policy]")
+{
+    hcl::KeyPool pool;
+    hcl::ParseOptions options;
+    options.keyPool = &pool;
+    const hcl::Key port = pool.intern("port");
+
+    std::istringstream is(kText);
+    hcl::BasicParseResult<hcl::InternedValue> result = hcl::parse<hcl::InternedValue>(is, options);
+    REQUIRE(result.valid());
+    const hcl::InternedValue* listener = result.value.findChild("listener");
+    REQUIRE(listener);
+
+    // Both listeners hold the pool's "port", not copies of it.
+    const hcl::InternedValue::Object& https = listener->findChild("https")->as<hcl::InternedValue::Object>();
+    const hcl::InternedValue::Object& http = listener->findChild("http")->as<hcl::InternedValue::Object>();
+    CHECK(&https.begin()->first.str() == &port.str());
+    CHECK(&http.begin()->first.str() == &port.str());
+    CHECK(listener->findChild("http")->findChild(port)->as<int>() == 80);
+    CHECK(pool.size() == 8);
+
+    // Keys made without a pool still find children by their text.
+    CHECK(listener->findChild("https")->findChild(hcl::Key("port"))->as<int>() == 443);
+    CHECK(!listener->findChild(hcl::Key("ftp")));
+
+    hcl::InternedValue merged = result.value;
+    CHECK(merged.merge(result.value));
+    CHECK(merged == result.value);
+    CHECK(hcl::Value(result.value) == parseText<hcl::Value>().value);
+}
+
+TEST_CASE("intern keys when converting a value", "[object_policy]")
+{
+    std::istringstream is(kText);
+    hcl::ParseResult result = hcl::parse(is);
+    REQUIRE(result.valid());
+
+    hcl::KeyPool pool;
+    hcl::InternedValue interned;
+    {
+        hcl::KeyPool::Scope scope(pool);
+        interned = hcl::InternedValue(result.value);
+    }
+    CHECK(hcl::KeyPool::current() == nullptr);
+    CHECK(pool.size() == 8);
+    CHECK(hcl::Value(interned) == result.value);
+    CHECK(interned.findChild("listener")->findChild(pool.intern("http"))->get<int>("port") == 80);
+}
+
+TEST_CASE("stream list elements with another object policy", "[object_policy]")
+{
+    std::vector<std::string> names;
+    hcl::ParseOptions options;
+    options.streamedLists = {{"hosts"}};
+    options.onListElement = [&](const hcl::ParseOptions::Path&, hcl::Value&& element) {
+        names.push_back(element.get<std::string>("name"));
+    };
+
+    std::istringstream is("hosts = [{ name = \"a\" }, { name = \"b\" }]\nsize = 2\n");
+    hcl::BasicParseResult<hcl::SortedValue> result = hcl::parse<hcl::SortedValue>(is, options);
+    REQUIRE(result.valid());
+    CHECK(names == std::vector<std::string>({"a", "b"}));
+    CHECK(result.value.findChild("hosts")->empty());
+    CHECK(result.value.get<int>("size") == 2);
+}
+
+TEST_CASE("parse files with another object policy", "[object_policy]")
+{
+    hcl::BasicParseResult<hcl::FlatValue> result = hcl::parseFile<hcl::FlatValue>("tests/test-fixtures/missing.hcl");
+    CHECK(!result.valid());
+    CHECK(result.errorCode == hcl::ErrorCode::IO_ERROR);
+
+    std::istringstream is("a = [\n");
+    hcl::BasicParseResult<hcl::FlatValue> broken = hcl::parse<hcl::FlatValue>(is);
+    CHECK(!broken.valid());
+    CHECK(broken.errorCode == hcl::ErrorCode::SYNTAX_ERROR);
+    CHECK(!broken.errorReason.empty());
+}
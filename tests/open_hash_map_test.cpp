@@ -0,0 +1,152 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <map>
+#include <string>
+#include <utility>
+
+namespace {
+
+std::map<std::string, int> sorted(const hcl::OpenHashMap<int>& m)
+{
+    std::map<std::string, int> entries;
+    for (const auto& kv : m)
+        REQUIRE(entries.emplace(kv.first, kv.second).second);
+    return entries;
+}
+
+} // namespace
+
+TEST_CASE("open hash map basic operations", "[open_hash_map]")
+{
+    hcl::OpenHashMap<int> m;
+    CHECK(m.empty());
+    CHECK(m.begin() == m.end());
+    CHECK(m.find("a") == m.end());
+    CHECK(m.erase("a") == 0);
+
+    CHECK(m.emplace("a", 1).second);
+    CHECK(m.emplace(std::string("b"), 2).second);
+    auto inserted = m.emplace("a", 3);
+    CHECK(!inserted.second);
+    CHECK(inserted.first->second == 1);
+
+    m["c"] = 3;
+    m["a"] = 4;
+    CHECK(m.size() == 3);
+    CHECK(sorted(m) == std::map<std::string, int>({{"a", 4}, {"b", 2}, {"c", 3}}));
+    CHECK(m.count("b") == 1);
+    CHECK(m.count("d") == 0);
+
+    CHECK(m.erase("b") == 1);
+    CHECK(m.count("b") == 0);
+    CHECK(m.size() == 2);
+}
+
+TEST_CASE("open hash map grows and erases", "[open_hash_map]")
+{
+    const int n = 5000;
+
+    hcl::OpenHashMap<int> m;
+    for (int i = 0; i < n; ++i) {
+        m.emplace("key" + std::to_string(i), i);
+        REQUIRE(m.find("key" + std::to_string(i / 2))->second == i / 2);
+    }
+    CHECK(m.size() == static_cast<size_t>(n));
+    CHECK(sorted(m).size() == static_cast<size_t>(n));
+
+    // Erase and insert again over the deleted slots, without growing
+    // the table each time.
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < n; i += 3)
+            REQUIRE(m.erase("key" + std::to_string(i)) == 1);
+        for (int i = 0; i < n; ++i)
+            REQUIRE(m.count("key" + std::to_string(i)) == (i % 3 ? 1u : 0u));
+        for (int i = 0; i < n; i += 3)
+            REQUIRE(m.emplace("key" + std::to_string(i), i).second);
+    }
+    CHECK(m.size() == static_cast<size_t>(n));
+
+    // Erasing through iterators visits every entry once.
+    size_t erased = 0;
+    for (auto it = m.begin(); it != m.end();) {
+        if (it->second % 2)
+            it = m.erase(it);
+        else
+            ++it;
+        ++erased;
+    }
+    CHECK(erased == static_cast<size_t>(n));
+    CHECK(m.size() == static_cast<size_t>(n / 2));
+    CHECK(m.count("key1") == 0);
+    CHECK(m.find("key2")->second == 2);
+
+    m.clear();
+    CHECK(m.empty());
+    CHECK(m.begin() == m.end());
+    m["again"] = 1;
+    CHECK(m.size() == 1);
+}
+
+TEST_CASE("open hash map lookups by precomputed hash", "[open_hash_map]")
+{
+    hcl::OpenHashMap<int> m{{"type", 1}, {"default", 2}, {"description", 3}};
+
+    const size_t h = hcl::OpenHashMap<int>::hash("default");
+    CHECK(m.find("default", h)->second == 2);
+    CHECK(m.count("default", h) == 1);
+
+    const hcl::OpenHashMap<int>& cm = m;
+    CHECK(cm.find("type", hcl::OpenHashMap<int>::hash("type"))->second == 1);
+    CHECK(cm.find("source", hcl::OpenHashMap<int>::hash("source")) == cm.end());
+}
+
+TEST_CASE("open hash map copies, moves and equality", "[open_hash_map]")
+{
+    hcl::OpenHashMap<hcl::Value> m;
+    m.reserve(100);
+    for (int i = 0; i < 100; ++i)
+        m.emplace("key" + std::to_string(i), hcl::List{i, "x"});
+
+    hcl::OpenHashMap<hcl::Value> copy(m);
+    CHECK(copy == m);
+    CHECK(copy.find("key42")->second == hcl::Value(hcl::List{42, "x"}));
+    copy["key42"] = 0;
+    CHECK(copy != m);
+
+    copy = m;
+    CHECK(copy == m);
+
+    hcl::OpenHashMap<hcl::Value> moved(std::move(copy));
+    CHECK(moved == m);
+    CHECK(copy.empty());
+
+    copy = std::move(moved);
+    CHECK(copy == m);
+    CHECK(moved.empty());
+    CHECK(moved.find("key1") == moved.end());
+
+    hcl::OpenHashMap<hcl::Value> other;
+    other.emplace("key0", 1);
+    CHECK(other != m);
+}
+
+TEST_CASE("open hash map children after inserts", "[open_hash_map]")
+{
+    // Room reserved beforehand keeps pointers to children valid.
+    hcl::OpenHashValue v((hcl::OpenHashValue::Object()));
+    v.reserve(21);
+    hcl::OpenHashValue* a = v.setChild("a", hcl::OpenHashValue("first"));
+    for (int i = 0; i < 20; ++i)
+        v.setChild("k" + std::to_string(i), hcl::OpenHashValue(i));
+    CHECK(v.findChild("a") == a);
+    CHECK(a->as<std::string>() == "first");
+
+    // Growing the table moves the children; find them again.
+    for (int i = 20; i < 100; ++i)
+        v.setChild("k" + std::to_string(i), hcl::OpenHashValue(i));
+    a = v.findChild("a");
+    REQUIRE(a != nullptr);
+    CHECK(a->as<std::string>() == "first");
+    CHECK(v.size() == 101);
+}
@@ -1,10 +1,13 @@
 #include "hcl/hcl.hpp"
 
 #include "thirdparty/catch2/catch.hpp"
+#include <clocale>
 #include <map>
 #include <istream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 const std::string fixtureDir = "tests/test-fixtures/parser";
 
@@ -660,3 +663,702 @@ TEST_CASE("parse official HCL tests")
         }
     }
 }
+
+static hcl::ParseResult parseWithOptions(const std::string& s, const hcl::ParseOptions& options)
+{
+    std::stringstream ss(s);
+    return hcl::parse(ss, options);
+}
+
+TEST_CASE("parse within limits")
+{
+    hcl::ParseOptions options;
+    options.maxDepth = 2;
+    options.maxBytes = 64;
+    options.maxNodes = 8;
+    options.maxStringLength = 8;
+
+    hcl::ParseResult result = parseWithOptions("foo = { bar = [1, \"baz\"] }", options);
+    REQUIRE(result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::NONE);
+    REQUIRE("baz" == result.value["foo"]["bar"][1].as<std::string>());
+}
+
+TEST_CASE("fail parsing past max depth")
+{
+    hcl::ParseOptions options;
+    options.maxDepth = 2;
+
+    REQUIRE(parseWithOptions("a = [[1]]", options).valid());
+
+    hcl::ParseResult result = parseWithOptions("a = [[[1]]]", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_DEPTH_EXCEEDED);
+
+    result = parseWithOptions("a { b { c { d = 1 } } }", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_DEPTH_EXCEEDED);
+}
+
+TEST_CASE("count block labels toward max depth and max nodes")
+{
+    hcl::ParseOptions options;
+    options.maxDepth = 2;
+
+    // Each label nests the block one level deeper, as `a { b { } }` does.
+    REQUIRE(parseWithOptions("a \"b\" { c = 1 }", options).valid());
+    hcl::ParseResult result = parseWithOptions("a \"b\" \"c\" { d = 1 }", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_DEPTH_EXCEEDED);
+
+    options.maxDepth = 10;
+    options.maxNodes = 100;
+    std::string labels;
+    for (int i = 0; i < 5000; ++i)
+        labels += "a ";
+    result = parseWithOptions(labels + "{ }", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_DEPTH_EXCEEDED);
+
+    options.maxDepth = 0;
+    result = parseWithOptions(labels + "{ }", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_NODES_EXCEEDED);
+}
+
+TEST_CASE("fail parsing past max bytes")
+{
+    hcl::ParseOptions options;
+    options.maxBytes = 11;
+
+    REQUIRE(parseWithOptions("foo = \"bar\"", options).valid());
+
+    hcl::ParseResult result = parseWithOptions("foo = \"barbaz\"", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_BYTES_EXCEEDED);
+}
+
+TEST_CASE("fail parsing past max nodes")
+{
+    hcl::ParseOptions options;
+    options.maxNodes = 4;
+
+    REQUIRE(parseWithOptions("a = [1, 2]", options).valid());
+
+    hcl::ParseResult result = parseWithOptions("a = [1, 2, 3, 4]", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::MAX_NODES_EXCEEDED);
+}
+
+TEST_CASE("fail parsing past max string length")
+{
+    hcl::ParseOptions options;
+    options.maxStringLength = 3;
+
+    REQUIRE(parseWithOptions("foo = \"bar\"", options).valid());
+
+    const std::vector<std::string> inputs = {
+        "foo = \"barbaz\"",
+        "foo = 'barbaz'",
+        "foo = barbaz",
+        "foo = 123456",
+        "foo = <<EOF\nbarbaz\nEOF\n",
+    };
+    for (const auto& input : inputs) {
+        SECTION(input)
+        {
+            hcl::ParseResult result = parseWithOptions(input, options);
+            REQUIRE(!result.valid());
+            REQUIRE(result.errorCode == hcl::ErrorCode::MAX_STRING_LENGTH_EXCEEDED);
+        }
+    }
+}
+
+TEST_CASE("report syntax errors")
+{
+    hcl::ParseResult result = parseWithOptions("foo = ", hcl::ParseOptions());
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::SYNTAX_ERROR);
+}
+
+TEST_CASE("parse in steps")
+{
+    const std::string input =
+        "foo = \"bar\"\n"
+        "baz { qux = [1, 2, 3] }\n"
+        "baz { quux = true }\n";
+    std::stringstream ss(input);
+    hcl::ParseHandle handle(ss);
+
+    int steps = 0;
+    while (!handle.step(1))
+        ++steps;
+
+    REQUIRE(steps == 3);
+    REQUIRE(handle.done());
+
+    hcl::ParseResult result = handle.result();
+    REQUIRE(result.valid());
+    REQUIRE(result.value == parse(input));
+}
+
+TEST_CASE("parse empty input in steps")
+{
+    std::stringstream ss("");
+    hcl::ParseHandle handle(ss);
+
+    REQUIRE(handle.step(std::chrono::microseconds(1000)));
+    hcl::ParseResult result = handle.result();
+    REQUIRE(result.valid());
+    REQUIRE(result.value.is<hcl::Object>());
+    REQUIRE(result.value.empty());
+}
+
+TEST_CASE("fail parsing invalid input in steps")
+{
+    std::stringstream ss("foo = 1\nbar = \n");
+    hcl::ParseHandle handle(ss);
+
+    REQUIRE(!handle.step(1));
+    REQUIRE(handle.step(1));
+
+    hcl::ParseResult result = handle.result();
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::SYNTAX_ERROR);
+}
+
+static hcl::Schema listenerSchema()
+{
+    hcl::Schema listener = hcl::Schema::object()
+        .required("port", hcl::Schema::integer())
+        .field("host", hcl::Schema::string())
+        .field("timeout", hcl::Schema::number())
+        .field("tags", hcl::Schema::list(hcl::Schema::string()));
+
+    return hcl::Schema::object()
+        .field("name", hcl::Schema::string())
+        .field("listener", hcl::Schema::block(listener, {"http", "https"}))
+        .field("extra", hcl::Schema::object().allowUnknownKeys())
+        .field("anything", hcl::Schema::any());
+}
+
+TEST_CASE("parse with schema")
+{
+    const hcl::Schema schema = listenerSchema();
+    hcl::ParseOptions options;
+    options.schema = &schema;
+
+    hcl::ParseResult result = parseWithOptions(
+        "name = \"proxy\"\n"
+        "listener \"http\" { port = 80, tags = [\"a\", \"b\"] }\n"
+        "listener \"https\" {\n"
+        "  port = 443\n"
+        "  host = \"localhost\"\n"
+        "  timeout = 1.5\n"
+        "}\n"
+        "extra { whatever = [1, {a = 2}] }\n"
+        "anything = [1, \"two\"]\n",
+        options);
+
+    REQUIRE(result.valid());
+    REQUIRE(443 == result.value["listener"]["https"]["port"].as<int>());
+}
+
+TEST_CASE("fail parsing against schema")
+{
+    const hcl::Schema schema = listenerSchema();
+    hcl::ParseOptions options;
+    options.schema = &schema;
+
+    const std::vector<std::string> inputs = {
+        // Unknown key
+        "nmae = \"proxy\"",
+        "listener \"http\" { port = 80, prot = 1 }",
+        // Type mismatch
+        "name = 1",
+        "name { foo = 1 }",
+        "listener \"http\" { port = \"80\" }",
+        "listener \"http\" { port = 80, tags = [1] }",
+        "listener \"http\" { port = 80, tags = \"a\" }",
+        "listener = [1]",
+        // Label not allowed
+        "listener \"ftp\" { port = 21 }",
+        // Missing required key
+        "listener \"http\" { host = \"localhost\" }",
+    };
+
+    for (const auto& input : inputs) {
+        SECTION(input)
+        {
+            hcl::ParseResult result = parseWithOptions(input, options);
+            REQUIRE(!result.valid());
+            REQUIRE(result.errorCode == hcl::ErrorCode::SCHEMA_VIOLATION);
+        }
+    }
+}
+
+TEST_CASE("fail parsing repeated keys against schema")
+{
+    const hcl::Schema schema = listenerSchema();
+    hcl::ParseOptions options;
+    options.schema = &schema;
+
+    // Each item matches on its own, but merging them makes a list.
+    const std::vector<std::string> inputs = {
+        "listener \"http\" { port = 1 \n port = 2 }",
+        "listener \"http\" { port = 1 }\nlistener \"http\" { port = 2 }",
+        "listener \"http\" { port = 1, tags = [\"a\"], tags = [\"b\"] }",
+        "name = \"a\"\nname = \"b\"",
+    };
+    for (const auto& input : inputs) {
+        SECTION(input)
+        {
+            hcl::ParseResult result = parseWithOptions(input, options);
+            REQUIRE(!result.valid());
+            REQUIRE(result.errorCode == hcl::ErrorCode::SCHEMA_VIOLATION);
+            REQUIRE(result.errorReason.find("schema: repeated") != std::string::npos);
+        }
+    }
+
+    // Blocks with other labels merge into one object, and any() takes
+    // whatever the repeats make.
+    REQUIRE(parseWithOptions("listener \"http\" { port = 1 }\nlistener \"https\" { port = 2 }", options).valid());
+    REQUIRE(parseWithOptions("anything = 1\nanything = 2", options).valid());
+    const hcl::Schema lists = hcl::Schema::object().field("l", hcl::Schema::list(hcl::Schema::any()));
+    options.schema = &lists;
+    REQUIRE(parseWithOptions("l = [1]\nl = [2]", options).valid());
+}
+
+TEST_CASE("name the key in schema value errors")
+{
+    const hcl::Schema schema = listenerSchema();
+    hcl::ParseOptions options;
+    options.schema = &schema;
+
+    hcl::ParseResult result = parseWithOptions("listener \"http\" { port = { a = 1 } }", options);
+    REQUIRE(!result.valid());
+    CHECK(result.errorReason.find("schema: \"port\" must be int") != std::string::npos);
+
+    result = parseWithOptions("listener \"http\" { port = 1, tags = [1] }", options);
+    REQUIRE(!result.valid());
+    CHECK(result.errorReason.find("schema: element of \"tags\" must be string") != std::string::npos);
+}
+
+TEST_CASE("check required top level keys against schema")
+{
+    const hcl::Schema schema = hcl::Schema::object().required("name", hcl::Schema::string());
+    hcl::ParseOptions options;
+    options.schema = &schema;
+
+    REQUIRE(parseWithOptions("name = \"foo\"", options).valid());
+
+    hcl::ParseResult result = parseWithOptions("", options);
+    REQUIRE(!result.valid());
+    REQUIRE(result.errorCode == hcl::ErrorCode::SCHEMA_VIOLATION);
+
+    std::stringstream ss("");
+    hcl::ParseHandle handle(ss, options);
+    while (!handle.step(1)) {}
+    REQUIRE(handle.result().errorCode == hcl::ErrorCode::SCHEMA_VIOLATION);
+}
+
+TEST_CASE("parse quoted keys containing spaces")
+{
+    hcl::ParseResult result = parseWithOptions("\"foo bar\" = 1\nblock \"a b\" \"c.d\" {\n  x = 2\n}\n", hcl::ParseOptions());
+    REQUIRE(result.valid());
+    REQUIRE(result.value.findChild("foo bar")->as<int>() == 1);
+    REQUIRE(result.value.findChild("block")->findChild("a b")->findChild("c.d")->get<int>("x") == 2);
+}
+
+TEST_CASE("reuse a parser context")
+{
+    const std::vector<std::string> inputs = {
+        "key \"foo/\" {\n  policy = \"write\"\n}\n",
+        "a = [1, 2",
+        "",
+        "\xEF\xBB\xBF" "b = 1.5",
+        "a = { b = { c = 1 } }\nd = \"${e}\"\n",
+        "x = ",
+        "key \"\" { policy = \"read\" }\nkey \"foo/bar\" { policy = \"deny\" }\n",
+    };
+
+    hcl::ParserContext context;
+    for (int round = 0; round < 2; ++round) {
+        for (const auto& input : inputs) {
+            std::istringstream is(input);
+            hcl::ParseResult expected = hcl::parse(is);
+
+            context.reset(input);
+            hcl::ParseResult result = context.parse();
+            INFO(input);
+            REQUIRE(result.valid() == expected.valid());
+            REQUIRE(result.value == expected.value);
+            REQUIRE(result.errorReason == expected.errorReason);
+            REQUIRE(result.errorCode == expected.errorCode);
+        }
+    }
+}
+
+TEST_CASE("export a shape profile")
+{
+    hcl::ParseResult result = parseWithOptions(
+        "a = [1, 2, 3]\n"
+        "b = [[1, 2], [3, 4, 5, 6]]\n"
+        "service \"web\" {\n  port = 80\n  host = \"x\"\n}\n"
+        "service \"db\" {\n  port = 5432\n}\n",
+        hcl::ParseOptions());
+    REQUIRE(result.valid());
+
+    typedef hcl::ShapeProfile Shape;
+    Shape profile = result.shape();
+    REQUIRE(profile.size(Shape::root()) == 3);
+    REQUIRE(profile.size(Shape::child(Shape::root(), "a")) == 3);
+    REQUIRE(profile.size(Shape::child(Shape::root(), "b")) == 2);
+    REQUIRE(profile.size(Shape::element(Shape::child(Shape::root(), "b"))) == 4);
+
+    Shape::Path service = Shape::child(Shape::root(), "service");
+    REQUIRE(profile.size(service) == 2);
+    REQUIRE(profile.size(Shape::child(service, "web")) == 2);
+    REQUIRE(profile.size(Shape::child(service, "db")) == 0);
+    REQUIRE(profile.size(Shape::child(Shape::root(), "missing")) == 0);
+
+    REQUIRE(Shape::child(Shape::child(Shape::root(), "a"), "bc") != Shape::child(Shape::child(Shape::root(), "ab"), "c"));
+    REQUIRE(Shape().empty());
+}
+
+TEST_CASE("parse with a shape profile")
+{
+    const std::vector<std::string> inputs = {
+        "a = [1, 2, 3]\nb = { c = 1, d = [[1], [2, 3]] }\n",
+        "key \"\" { policy = \"read\" }\nkey \"foo/\" { policy = \"write\" }\nkey \"foo/bar\" { policy = \"deny\" }\n",
+        "resource \"aws\" \"a\" { x = 1 }\nresource \"aws\" \"b\" { x = 2 }\nresource \"gcp\" \"c\" { y = [1, 2] }\n",
+        "a = [1, 2",
+    };
+
+    // Profiles taken from every input, so most of them don't fit.
+    for (const auto& source : inputs) {
+        hcl::ShapeProfile profile = parseWithOptions(source, hcl::ParseOptions()).shape();
+        hcl::ParseOptions options;
+        options.shape = &profile;
+        for (const auto& input : inputs) {
+            INFO(source << " -> " << input);
+            hcl::ParseResult expected = parseWithOptions(input, hcl::ParseOptions());
+            hcl::ParseResult result = parseWithOptions(input, options);
+            REQUIRE(result.valid() == expected.valid());
+            REQUIRE(result.value == expected.value);
+            REQUIRE(result.errorReason == expected.errorReason);
+        }
+    }
+}
+
+TEST_CASE("presize lists from a shape profile")
+{
+    const std::string input = "a = [1, 2, 3, 4, 5, 6, 7, 8, 9]\n";
+    hcl::ShapeProfile profile = parseWithOptions(input, hcl::ParseOptions()).shape();
+
+    hcl::ParseOptions options;
+    options.shape = &profile;
+    hcl::ParseResult result = parseWithOptions(input, options);
+    REQUIRE(result.valid());
+    REQUIRE(result.value.get<hcl::List>("a").capacity() == 9);
+}
+
+TEST_CASE("parse numbers lazily")
+{
+    const std::string input = "a = 42\nb = [1_000, -2.50e1]\nc { d = 0.10 }\n";
+    hcl::ParseOptions options;
+    options.lazyNumbers = true;
+    hcl::ParseResult lazy = parseWithOptions(input, options);
+    REQUIRE(lazy.valid());
+    REQUIRE(lazy.value == parseWithOptions(input, hcl::ParseOptions()).value);
+
+    hcl::Value& b = lazy.value["b"];
+    REQUIRE(b[0].isRawNumber());
+    REQUIRE(b[0].as<int>() == 1000);
+    REQUIRE(b[1].as<double>() == -25.0);
+
+    std::ostringstream ss;
+    lazy.value["c"].write(&ss);
+    REQUIRE(ss.str() == "d = 0.10\n");
+}
+
+TEST_CASE("parse strings lazily")
+{
+    const std::string input = R"(a = "tab\there \u00e9 \"quoted\""
+"key\twith tab" = "plain"
+b = ["x\ny", "${HH\\:mm}"]
+c "label\u00e9" { d = "e\\f" }
+)";
+    hcl::ParseOptions options;
+    options.lazyStrings = true;
+    hcl::ParseResult lazy = parseWithOptions(input, options);
+    INFO(lazy.errorReason);
+    REQUIRE(lazy.valid());
+
+    // Keys are unescaped while parsing.
+    REQUIRE(lazy.value.findChild("key\twith tab"));
+    REQUIRE(lazy.value.findChild("c")->findChild("label\xC3\xA9"));
+
+    // Unread strings are written back as they were.
+    std::ostringstream ss;
+    lazy.value["a"].write(&ss);
+    REQUIRE(ss.str() == "\"tab\\there \\u00e9 \\\"quoted\\\"\"");
+
+    REQUIRE(lazy.value.get<std::string>("a") == "tab\there \xC3\xA9 \"quoted\"");
+    REQUIRE(lazy.value == parseWithOptions(input, hcl::ParseOptions()).value);
+
+    // Read strings too: reading leaves the value as it was.
+    ss.str("");
+    lazy.value["a"].write(&ss);
+    REQUIRE(ss.str() == "\"tab\\there \\u00e9 \\\"quoted\\\"\"");
+
+    const std::string fixture = "foo = \"bar\\\"baz\\\\n\"\nnested = \"${\"\\\"x\\\"\"}\"\n";
+    REQUIRE(parseWithOptions(fixture, options).value == parseWithOptions(fixture, hcl::ParseOptions()).value);
+    REQUIRE(!parseWithOptions("a = \"\\q\"", options).valid());
+}
+
+TEST_CASE("read lazy strings from several threads")
+{
+    hcl::ParseOptions options;
+    options.lazyStrings = true;
+    const hcl::ParseResult lazy = parseWithOptions("a = \"x\\ty\"\nb = \"x\\ty\"\n", options);
+    REQUIRE(lazy.valid());
+    const hcl::Value& a = *lazy.value.findChild("a");
+    const hcl::Value& b = *lazy.value.findChild("b");
+
+    // Comparing and reading unescape without writing to the values.
+    std::vector<int> ok(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ok.size(); ++t) {
+        threads.emplace_back([&, t] {
+            bool same = true;
+            for (int i = 0; i < 1000; ++i)
+                same = same && a == b && a.as<std::string>() == "x\ty" && std::string(b.stringData(), b.stringSize()) == "x\ty";
+            ok[t] = same;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    REQUIRE(ok == std::vector<int>(4, 1));
+
+    const char* p = a.stringData();
+    hcl::Value copy = a;
+    REQUIRE(copy == a);
+    REQUIRE(a.stringData() == p);
+    std::ostringstream ss;
+    copy.write(&ss);
+    REQUIRE(ss.str() == "\"x\\ty\"");
+}
+
+TEST_CASE("parse short strings inline")
+{
+    const std::string input = R"(a = "t2.micro"
+b = "a string longer than eight bytes"
+c = ident
+d = "${var.foo}"
+e = ""
+f = ["x", "tab\there", [eightbyt]]
+)";
+    hcl::ParseOptions options;
+    options.inlineStrings = true;
+    hcl::ParseResult result = parseWithOptions(input, options);
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+    hcl::Value& v = result.value;
+
+    CHECK(v.findChild("a")->isInlineString());
+    CHECK(!v.findChild("b")->isInlineString());
+    CHECK(v.findChild("c")->isInlineString());
+    CHECK(v.findChild("c")->isIdent());
+    CHECK(!v.findChild("d")->isInlineString());
+    CHECK(v.findChild("e")->isInlineString());
+    CHECK(v.findChild("f")->find(0)->isInlineString());
+    CHECK(v.findChild("f")->find(2)->find(0)->isInlineString());
+
+    // Read in place, compared and written without leaving inline storage.
+    CHECK(std::string(v.findChild("a")->stringData(), v.findChild("a")->stringSize()) == "t2.micro");
+    CHECK(std::string(v.findChild("b")->stringData(), v.findChild("b")->stringSize()) == "a string longer than eight bytes");
+    CHECK(v.findChild("e")->stringSize() == 0);
+    CHECK(v == parseWithOptions(input, hcl::ParseOptions()).value);
+    std::ostringstream ss;
+    v.findChild("f")->write(&ss);
+    CHECK(ss.str() == "[\"x\", \"tab\\there\", [eightbyt]]");
+    hcl::Value copy = v;
+    CHECK(copy.findChild("a")->isInlineString());
+    CHECK(v.findChild("a")->isInlineString());
+
+    // as<std::string>() copies the text out.
+    CHECK(v.get<std::string>("a") == "t2.micro");
+    CHECK(v.findChild("a")->isInlineString());
+    CHECK(v.get<std::string>("c") == "ident");
+    CHECK(copy == v);
+
+    CHECK(!parseWithOptions(input, hcl::ParseOptions()).value.findChild("a")->isInlineString());
+}
+
+TEST_CASE("read an inline string again after as<std::string>()")
+{
+    hcl::ParseOptions options;
+    options.inlineStrings = true;
+    hcl::ParseResult result = parseWithOptions("a = \"abc\"\n", options);
+    REQUIRE(result.valid());
+    const hcl::Value* a = result.value.findChild("a");
+    REQUIRE(a->isInlineString());
+    const char* p = a->stringData();
+    REQUIRE(p >= reinterpret_cast<const char*>(a));
+    REQUIRE(p < reinterpret_cast<const char*>(a + 1));
+
+    // as<std::string>() copies the text out and leaves it in place.
+    REQUIRE(a->as<std::string>() == "abc");
+    REQUIRE(a->isInlineString());
+    REQUIRE(a->stringData() == p);
+    REQUIRE(std::string(p, a->stringSize()) == "abc");
+
+    // So a shared value can be read from several threads.
+    std::vector<int> ok(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ok.size(); ++t) {
+        threads.emplace_back([&, t] {
+            bool same = true;
+            for (int i = 0; i < 1000; ++i)
+                same = same && a->as<std::string>() == "abc" && result.value.get<std::string>("a") == "abc";
+            ok[t] = same;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    REQUIRE(ok == std::vector<int>(4, 1));
+    REQUIRE(a->stringData() == p);
+}
+
+TEST_CASE("collect parse statistics")
+{
+    const std::string input = "a = 1\nb = [1.5, \"x\"]\nc \"d\" { e = <<EOF\nhi\nEOF\n}\nc \"f\" { g = true }\n";
+    hcl::ParseStats stats;
+    hcl::ParseOptions options;
+    options.stats = &stats;
+    hcl::ParseResult result = parseWithOptions(input, options);
+    REQUIRE(result.valid());
+
+    CHECK(stats.bytesRead == input.size());
+    CHECK(stats.tokenCount(hcl::internal::TokenType::NUMBER) == 1);
+    CHECK(stats.tokenCount(hcl::internal::TokenType::FLOAT) == 1);
+    CHECK(stats.tokenCount(hcl::internal::TokenType::HEREDOC) == 1);
+    CHECK(stats.tokenCount(hcl::internal::TokenType::LBRACE) == 2);
+    CHECK(stats.tokenCount(hcl::internal::TokenType::END_OF_FILE) == 1);
+    CHECK(stats.heredocBytes == std::string("<<EOF\nhi\nEOF\n").size());
+    // The label "d" nests its block one level below c.
+    CHECK(stats.maxDepth == 2);
+
+    // root, b, c and its blocks d and f.
+    CHECK(stats.valueCount(hcl::Value::OBJECT_TYPE) == 4);
+    CHECK(stats.valueCount(hcl::Value::LIST_TYPE) == 1);
+    CHECK(stats.valueCount(hcl::Value::INT_TYPE) == 1);
+    CHECK(stats.valueCount(hcl::Value::DOUBLE_TYPE) == 1);
+    CHECK(stats.valueCount(hcl::Value::STRING_TYPE) == 2);
+    CHECK(stats.valueCount(hcl::Value::BOOL_TYPE) == 1);
+    CHECK(stats.allocations == 7);
+    CHECK(stats.lexerNanos > 0);
+    CHECK(stats.parserNanos > 0);
+    CHECK(stats.mergeNanos > 0);
+
+    // Cleared by the next parse.
+    REQUIRE(parseWithOptions("a = 1", options).valid());
+    CHECK(stats.tokenCount(hcl::internal::TokenType::LBRACE) == 0);
+    CHECK(stats.valueCount(hcl::Value::OBJECT_TYPE) == 1);
+}
+
+TEST_CASE("stream designated lists to a callback")
+{
+    const std::string input = R"(
+allow = ["10.0.0.0/8", "192.168.0.0/16"]
+deny = ["0.0.0.0/0"]
+firewall "main" {
+  cidrs = [1, [2, 3], { a = [4] }]
+}
+nested = [["x"]]
+)";
+
+    std::vector<std::pair<std::string, hcl::Value>> elements;
+    hcl::ParseOptions options;
+    options.streamedLists = {{"allow"}, {"firewall", "main", "cidrs"}, {"firewall", "main", "cidrs", "a"}, {"nested"}};
+    options.onListElement = [&](const hcl::ParseOptions::Path& path, hcl::Value&& element) {
+        std::string joined;
+        for (const auto& key : path)
+            joined += (joined.empty() ? "" : ".") + key;
+        elements.emplace_back(joined, std::move(element));
+    };
+
+    hcl::ParseResult result = parseWithOptions(input, options);
+    REQUIRE(result.valid());
+
+    // Streamed lists are left empty; the rest is built as usual.
+    CHECK(result.value.get<hcl::List>("allow").empty());
+    CHECK(result.value.get<hcl::List>("deny") == hcl::List{"0.0.0.0/0"});
+    CHECK(result.value.findChild("firewall")->findChild("main")->get<hcl::List>("cidrs").empty());
+    CHECK(result.value.get<hcl::List>("nested").empty());
+
+    // Lists inside streamed lists arrive whole.
+    REQUIRE(elements.size() == 6);
+    CHECK(elements[0].first == "allow");
+    CHECK(elements[0].second == hcl::Value("10.0.0.0/8"));
+    CHECK(elements[1].second == hcl::Value("192.168.0.0/16"));
+    CHECK(elements[2].first == "firewall.main.cidrs");
+    CHECK(elements[2].second == hcl::Value(1));
+    CHECK(elements[3].second == hcl::Value(hcl::List{2, 3}));
+    CHECK(elements[4].first == "firewall.main.cidrs");
+    CHECK(elements[4].second.get<hcl::List>("a") == hcl::List{4});
+    CHECK(elements[5].first == "nested");
+    CHECK(elements[5].second == hcl::Value(hcl::List{"x"}));
+
+    // Same result otherwise.
+    elements.clear();
+    options.streamedLists.clear();
+    CHECK(parseWithOptions(input, options).value == parseWithOptions(input, hcl::ParseOptions()).value);
+    CHECK(elements.empty());
+
+    // Without a callback, nothing is streamed.
+    hcl::ParseOptions unset;
+    unset.streamedLists = {{"allow"}, {"firewall", "main", "cidrs"}};
+    hcl::ParseResult built = parseWithOptions(input, unset);
+    REQUIRE(built.valid());
+    CHECK(built.value == parseWithOptions(input, hcl::ParseOptions()).value);
+    CHECK(built.value.get<hcl::List>("allow").size() == 2);
+}
+
+TEST_CASE("parse floats with a decimal comma locale")
+{
+    struct RestoreLocale {
+        RestoreLocale() : name(std::setlocale(LC_NUMERIC, nullptr)) {}
+        ~RestoreLocale() { std::setlocale(LC_NUMERIC, name.c_str()); }
+        std::string name;
+    } restore;
+
+    // Locales that write 1,5 for 1.5, where the host has one.
+    const char* names[] = {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR"};
+    const char* comma = nullptr;
+    for (const char* name : names) {
+        if (std::setlocale(LC_NUMERIC, name) && std::localeconv()->decimal_point[0] == ',') {
+            comma = name;
+            break;
+        }
+    }
+    if (!comma) {
+        WARN("no decimal comma locale");
+        return;
+    }
+    INFO(comma);
+
+    hcl::ParseResult result = parseWithOptions("a = 1.5\nb = 2_000.25e-1\n", hcl::ParseOptions());
+    REQUIRE(result.valid());
+    CHECK(result.value.get<double>("a") == 1.5);
+    CHECK(result.value.get<double>("b") == 200.025);
+
+    hcl::ParseOptions lazy;
+    lazy.lazyNumbers = true;
+    CHECK(parseWithOptions("a = 1.5\n", lazy).value.get<double>("a") == 1.5);
+    CHECK(hcl::parseJSON("{\"a\": 1.5}").value.get<double>("a") == 1.5);
+    hcl::TapeResult tape = hcl::parseTape(std::string("a = 1.5\n"));
+    REQUIRE(tape.valid());
+    CHECK(tape.tape.root().find("a").as<double>() == 1.5);
+}
@@ -0,0 +1,226 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include "benchmarks/bench_util.hpp"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::string readFile(const std::string& filename)
+{
+    std::ifstream is(filename, std::ios::binary);
+    REQUIRE(is);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+}
+
+static void checkAgreesWithParse(const std::string& input)
+{
+    std::istringstream is(input);
+    hcl::ParseResult parsed = hcl::parse(is);
+    hcl::TapeResult result = hcl::parseTape(input);
+    REQUIRE(result.valid() == parsed.valid());
+    if (parsed.valid())
+        CHECK(result.tape.root().toValue() == parsed.value);
+}
+
+TEST_CASE("parse tape agrees with parse on fixtures", "[tape]")
+{
+    const std::vector<std::string> fixtures = {
+        "decoding/assign_deep.hcl",
+        "decoding/basic.hcl",
+        "decoding/decode_policy.hcl",
+        "decoding/decode_tf_variable.hcl",
+        "decoding/empty.hcl",
+        "decoding/escape.hcl",
+        "decoding/flat.hcl",
+        "decoding/float.hcl",
+        "decoding/list_of_lists.hcl",
+        "decoding/list_of_maps.hcl",
+        "decoding/list_of_nested_object_lists.hcl",
+        "decoding/multiline.hcl",
+        "decoding/multiline_indented.hcl",
+        "decoding/multiline_literal_with_hil.hcl",
+        "decoding/nested_block_comment.hcl",
+        "decoding/nested_provider_bad.hcl",
+        "decoding/scientific.hcl",
+        "decoding/slice_expand.hcl",
+        "decoding/structure.hcl",
+        "decoding/structure2.hcl",
+        "decoding/structure_flatmap.hcl",
+        "decoding/structure_list.hcl",
+        "decoding/structure_multi.hcl",
+        "decoding/terraform_heroku.hcl",
+        "decoding/tfvars.hcl",
+        "decoding/top_level_keys.hcl",
+        "decoding/unterminated_brace.hcl",
+        "parser/array_comment.hcl",
+        "parser/assign_deep.hcl",
+        "parser/comment.hcl",
+        "parser/complex.hcl",
+        "parser/complex_crlf.hcl",
+        "parser/complex_key.hcl",
+        "parser/list_comma.hcl",
+        "parser/missing_braces.hcl",
+        "parser/multiple.hcl",
+        "parser/object_list_comma.hcl",
+        "parser/old.hcl",
+        "parser/structure.hcl",
+        "parser/structure_empty.hcl",
+        "parser/types.hcl",
+    };
+
+    for (const auto& filename : fixtures) {
+        SECTION(filename)
+        {
+            checkAgreesWithParse(readFile("tests/test-fixtures/" + filename));
+        }
+    }
+}
+
+TEST_CASE("parse tape merges items like parse", "[tape]")
+{
+    const char* inputs[] = {
+        "a = 1\na = 2\n",
+        "a = [1]\na = 2\n",
+        "a { b = 1 }\na { c = 2 }\n",
+        "a { b = 1 }\na { b = 2 }\na { b = 3 }\n",
+        "a \"x\" { b = 1 }\na \"y\" { b = 2 }\na \"x\" { c = 3 }\n",
+        "a \"x\" \"y\" { b = 1 }\na \"x\" \"z\" { b = 2 }\n",
+        "a { b = 1 }\na = 2\na { c = 3 }\n",
+        "a = { b = 1 }\nc = [{ d = 2 }, [3, \"x${y}\"]]\n",
+        "big = 99999999999999999999\nsmall = -99999999999999999999\n",
+    };
+
+    for (const char* input : inputs) {
+        INFO(input);
+        checkAgreesWithParse(input);
+    }
+
+    checkAgreesWithParse(bench::terraformDocument(20));
+}
+
+TEST_CASE("read values from a tape", "[tape]")
+{
+    hcl::TapeResult result = hcl::parseTape(std::string(R"(
+name = "web"
+port = 8080
+ratio = 0.5
+enabled = true
+kind = ident
+tags = ["a", "b\tc"]
+
+listener "http" {
+  port = 80
+}
+listener "https" {
+  port = 443
+}
+)"));
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+
+    hcl::ValueRef root = result.tape.root();
+    REQUIRE(root.is<hcl::Object>());
+    CHECK(root.size() == 7);
+    CHECK(root.find("name").as<std::string>() == "web");
+    CHECK(root.find("port").as<int>() == 8080);
+    CHECK(root.find("port").as<std::int64_t>() == 8080);
+    CHECK(root.find("ratio").as<double>() == 0.5);
+    CHECK(root.find("enabled").as<bool>());
+    CHECK(root.find("kind").type() == hcl::Value::IDENT_TYPE);
+    CHECK(root.find("kind").as<std::string>() == "ident");
+    CHECK(!root.find("missing").valid());
+    CHECK(!root.find("name").find("x").valid());
+
+    hcl::ValueRef tags = root.find("tags");
+    REQUIRE(tags.is<hcl::List>());
+    CHECK(tags.size() == 2);
+    CHECK(tags[1].as<std::string>() == "b\tc");
+    CHECK(!tags[2].valid());
+
+    hcl::ValueRef listener = root.find("listener");
+    std::vector<std::string> keys;
+    for (auto it = listener.begin(); it != listener.end(); ++it) {
+        keys.push_back(it.key());
+        CHECK((*it).find("port").is<int>());
+    }
+    CHECK(keys == std::vector<std::string>({"http", "https"}));
+    CHECK(listener.find("https").find("port").as<int>() == 443);
+
+    std::vector<std::string> elements;
+    for (hcl::ValueRef element : tags)
+        elements.push_back(element.as<std::string>());
+    CHECK(elements == std::vector<std::string>({"a", "b\tc"}));
+
+    CHECK_THROWS_WITH(root.find("port").as<std::string>(),
+                      "type error: this value is int but string was requested");
+    CHECK_THROWS(root.find("name").as<int>());
+
+    // Refs stay valid when the tape is moved.
+    hcl::Tape tape = std::move(result.tape);
+    CHECK(root.find("name").as<std::string>() == "web");
+}
+
+TEST_CASE("look up interned keys in a tape", "[tape]")
+{
+    hcl::TapeResult result = hcl::parseTape(std::string(R"(
+variable "a" {
+  type = "string"
+  default = "x"
+}
+variable "b" {
+  type = "list"
+  default = "y"
+}
+"" = 1
+type = 2
+)"));
+    INFO(result.errorReason);
+    REQUIRE(result.valid());
+    const hcl::Tape& tape = result.tape;
+
+    // variable, a, b, type, default and the empty key, each stored once.
+    CHECK(tape.keyCount() == 6);
+
+    const hcl::Symbol type = tape.symbol("type");
+    const hcl::Symbol defaultKey = tape.symbol("default");
+    const hcl::Symbol empty = tape.symbol("");
+    REQUIRE(type.valid());
+    REQUIRE(defaultKey.valid());
+    REQUIRE(empty.valid());
+    CHECK(!tape.symbol("description").valid());
+    CHECK(!hcl::Symbol().valid());
+
+    hcl::ValueRef root = tape.root();
+    hcl::ValueRef variables = root.find("variable");
+    CHECK(variables.find(tape.symbol("a")).find(type).as<std::string>() == "string");
+    CHECK(variables.find(tape.symbol("b")).find(defaultKey).as<std::string>() == "y");
+    CHECK(root.find(type).as<int>() == 2);
+    CHECK(root.find(empty).as<int>() == 1);
+    CHECK(root.find("").as<int>() == 1);
+    CHECK(!root.find(defaultKey).valid());
+    CHECK(!root.find(tape.symbol("description")).valid());
+    CHECK(!root.find(type).find(type).valid());
+}
+
+TEST_CASE("fail parsing a tape", "[tape]")
+{
+    const char* inputs[] = {
+        "a = ",
+        "a = [1 2]",
+        "a { b = 1",
+        "}",
+        "a = \"unterminated",
+    };
+
+    for (const char* input : inputs) {
+        INFO(input);
+        hcl::TapeResult result = hcl::parseTape(std::string(input));
+        CHECK(!result.valid());
+        CHECK(!result.errorReason.empty());
+        CHECK(!result.tape.root().valid());
+    }
+}
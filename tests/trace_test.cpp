@@ -0,0 +1,119 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Records events as "+phase:keys" and "-phase".
+struct RecordingTracer {
+    void begin(const char* phase, const std::string* keys, size_t keyCount)
+    {
+        std::string event = std::string("+") + phase + ":";
+        for (size_t i = 0; i < keyCount; ++i) {
+            if (i)
+                event += '.';
+            event += keys[i];
+        }
+        events.push_back(event);
+    }
+
+    void end(const char* phase) { events.push_back(std::string("-") + phase); }
+
+    std::vector<std::string> events;
+};
+
+} // namespace
+
+TEST_CASE("trace parse phases and top level items", "[trace]")
+{
+    std::istringstream is(R"(
+a = 1
+service "web" {
+  port = 80
+}
+)");
+
+    RecordingTracer tracer;
+    hcl::ParseResult result = hcl::parse(is, hcl::ParseOptions(), tracer);
+    REQUIRE(result.valid());
+    CHECK(result.value.findChild("service")->findChild("web")->get<int>("port") == 80);
+
+    const std::vector<std::string> expected = {
+        "+parse:",
+        "+item:a", "-item",
+        "+merge:a", "-merge",
+        "+item:service.web", "-item",
+        "+merge:service.web", "-merge",
+        "-parse",
+    };
+    CHECK(tracer.events == expected);
+}
+
+TEST_CASE("trace a failed parse", "[trace]")
+{
+    std::istringstream is("a = 1\nb = [1 2]\n");
+
+    RecordingTracer tracer;
+    hcl::ParseResult result = hcl::parse(is, hcl::ParseOptions(), tracer);
+    CHECK(!result.valid());
+
+    const std::vector<std::string> expected = {
+        "+parse:",
+        "+item:a", "-item",
+        "+merge:a", "-merge",
+        "+item:b", "-item",
+        "-parse",
+    };
+    CHECK(tracer.events == expected);
+}
+
+TEST_CASE("trace write", "[trace]")
+{
+    std::istringstream is("a = 1\nb { c = 2 }\n");
+    hcl::ParseResult result = hcl::parse(is);
+    REQUIRE(result.valid());
+
+    RecordingTracer tracer;
+    std::ostringstream traced;
+    hcl::write(result.value, traced, tracer);
+
+    std::ostringstream plain;
+    plain << result.value;
+    CHECK(traced.str() == plain.str());
+
+    const std::vector<std::string> expected = {
+        "+write:",
+        "+item:a", "-item",
+        "+item:b", "-item",
+        "-write",
+    };
+    CHECK(tracer.events == expected);
+}
+
+TEST_CASE("write chrome trace_event json", "[trace]")
+{
+    std::istringstream is("a = 1\n\"quoted\\\"key\" = 2\n");
+
+    hcl::ChromeTracer tracer;
+    REQUIRE(hcl::parse(is, hcl::ParseOptions(), tracer).valid());
+    CHECK(tracer.size() == 10);
+
+    std::ostringstream os;
+    tracer.writeJSON(os);
+    const std::string json = os.str();
+    CHECK(json.find("{\"traceEvents\":[") == 0);
+    CHECK(json.find("{\"ph\":\"B\",\"cat\":\"parse\",\"name\":\"parse\",\"ts\":") != std::string::npos);
+    CHECK(json.find("{\"ph\":\"B\",\"cat\":\"item\",\"name\":\"a\",\"ts\":") != std::string::npos);
+    CHECK(json.find("\"name\":\"quoted\\\"key\"") != std::string::npos);
+    CHECK(json.find("{\"ph\":\"E\",\"cat\":\"parse\",\"ts\":") != std::string::npos);
+    CHECK(json.find(",\"pid\":1,\"tid\":1}\n]}\n") != std::string::npos);
+
+    // The result is valid HCL JSON, too.
+    CHECK(hcl::parseJSON(json).valid());
+
+    tracer.clear();
+    CHECK(tracer.size() == 0);
+}
@@ -0,0 +1,205 @@
+#include "hcl/hcl.hpp"
+
+#include "thirdparty/catch2/catch.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Counts heap allocations so that validate() can be checked to make none.
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+static std::string readFile(const std::string& filename)
+{
+    std::ifstream is(filename, std::ios::binary);
+    REQUIRE(is);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+}
+
+static bool parses(const std::string& s)
+{
+    std::stringstream ss(s);
+    hcl::internal::Parser p(ss);
+    return p.parse().valid();
+}
+
+const std::vector<std::string> fixtures = {
+    "decoding/assign_deep.hcl",
+    "decoding/basic.hcl",
+    "decoding/basic_int_string.hcl",
+    "decoding/basic_squish.hcl",
+    "decoding/block_assign.hcl",
+    "decoding/decode_policy.hcl",
+    "decoding/decode_tf_variable.hcl",
+    "decoding/empty.hcl",
+    "decoding/escape.hcl",
+    "decoding/escape_backslash.hcl",
+    "decoding/flat.hcl",
+    "decoding/float.hcl",
+    "decoding/git_crypt.hcl",
+    "decoding/list_of_lists.hcl",
+    "decoding/list_of_maps.hcl",
+    "decoding/list_of_nested_object_lists.hcl",
+    "decoding/multiline.hcl",
+    "decoding/multiline_bad.hcl",
+    "decoding/multiline_indented.hcl",
+    "decoding/multiline_literal.hcl",
+    "decoding/multiline_literal_single_quoted.hcl",
+    "decoding/multiline_literal_with_hil.hcl",
+    "decoding/multiline_no_eof.hcl",
+    "decoding/multiline_no_hanging_indent.hcl",
+    "decoding/multiline_no_marker.hcl",
+    "decoding/nested_block_comment.hcl",
+    "decoding/nested_provider_bad.hcl",
+    "decoding/object_with_bool.hcl",
+    "decoding/scientific.hcl",
+    "decoding/slice_expand.hcl",
+    "decoding/structure.hcl",
+    "decoding/structure2.hcl",
+    "decoding/structure_flatmap.hcl",
+    "decoding/structure_list.hcl",
+    "decoding/structure_multi.hcl",
+    "decoding/terraform_heroku.hcl",
+    "decoding/tfvars.hcl",
+    "decoding/top_level_keys.hcl",
+    "decoding/unterminated_block_comment.hcl",
+    "decoding/unterminated_brace.hcl",
+    "parser/array_comment.hcl",
+    "parser/array_comment_2.hcl",
+    "parser/assign_colon.hcl",
+    "parser/assign_deep.hcl",
+    "parser/comment.hcl",
+    "parser/comment_crlf.hcl",
+    "parser/comment_lastline.hcl",
+    "parser/comment_single.hcl",
+    "parser/complex.hcl",
+    "parser/complex_crlf.hcl",
+    "parser/complex_key.hcl",
+    "parser/empty.hcl",
+    "parser/git_crypt.hcl",
+    "parser/key_without_value.hcl",
+    "parser/list.hcl",
+    "parser/list_comma.hcl",
+    "parser/missing_braces.hcl",
+    "parser/multiple.hcl",
+    "parser/object_key_assign_without_value.hcl",
+    "parser/object_key_assign_without_value2.hcl",
+    "parser/object_key_assign_without_value3.hcl",
+    "parser/object_key_without_value.hcl",
+    "parser/object_list_comma.hcl",
+    "parser/old.hcl",
+    "parser/structure.hcl",
+    "parser/structure_basic.hcl",
+    "parser/structure_empty.hcl",
+    "parser/types.hcl",
+    "parser/unterminated_object.hcl",
+    "parser/unterminated_object_2.hcl",
+};
+
+TEST_CASE("validate agrees with parse on fixtures")
+{
+    for (const auto& filename : fixtures) {
+        SECTION(filename)
+        {
+            const std::string s = readFile("tests/test-fixtures/" + filename);
+            REQUIRE(hcl::validate(s).valid() == parses(s));
+        }
+    }
+}
+
+TEST_CASE("validate agrees with parse on snippets")
+{
+    const std::vector<std::string> inputs = {
+        "",
+        "foo = 1",
+        "foo = -1.5e3",
+        "foo = .5",
+        "foo = \"bar\\n\\u00e9\"",
+        "foo = \"${bar(\"baz\")}\"",
+        "foo = 'bar'",
+        "foo = <<EOF\nbar\nEOF\n",
+        "foo = <<-EOF\n  bar\n  EOF\n",
+        "foo = [1, [2, 3], {a = 1}]",
+        "foo = [[1] [2]]",
+        "foo = [{a = 1} {b = 2}]",
+        "foo \"bar\" { baz = true }",
+        "foo { bar = 1 }, baz { qux = 2 }",
+        "foo = { bar = 1 baz = [] }",
+        "// comment\nfoo = 1 # trailing",
+        "foo = ",
+        "foo bar = 1",
+        "= 1",
+        "foo = [1 2]",
+        "foo = [1,",
+        "foo { bar = 1",
+        "foo = \"bar",
+        "foo = \"\\q\"",
+        "foo = 1 }",
+        "foo = /",
+        "foo = 1.2.3",
+        "foo = @",
+        "\xEF\xBB\xBF" "foo = 1",
+        "\xEF\xBB" "foo = 1",
+    };
+
+    for (const auto& input : inputs) {
+        SECTION(input)
+        {
+            REQUIRE(hcl::validate(input).valid() == parses(input));
+        }
+    }
+}
+
+TEST_CASE("validate reports the first error position")
+{
+    hcl::ValidationResult result = hcl::validate("foo = 1\nbar = [1 2]\n");
+    REQUIRE(!result.valid());
+    REQUIRE(2 == result.lineNo);
+    REQUIRE(9 == result.columnNo);
+
+    result = hcl::validate("foo = \"bar\\q\"");
+    REQUIRE(!result.valid());
+    REQUIRE(std::string("string has unknown escape sequence") == result.errorReason);
+}
+
+TEST_CASE("validate rejects documents nested too deep")
+{
+    const int depth = hcl::internal::Validator::kMaxDepth;
+    const std::string input = "foo = " + std::string(depth, '[') + std::string(depth, ']');
+    REQUIRE(!hcl::validate(input).valid());
+}
+
+TEST_CASE("validate does not allocate")
+{
+    const std::string s = readFile("tests/test-fixtures/parser/complex.hcl");
+
+    const size_t before = allocationCount;
+    hcl::ValidationResult result = hcl::validate(s);
+    const size_t after = allocationCount;
+
+    REQUIRE(result.valid());
+    REQUIRE(before == after);
+}
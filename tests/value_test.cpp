@@ -6,6 +6,8 @@
 #include <istream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 bool map_compare(hcl::Object const &actual, hcl::Object const &expected) {
     bool result =  actual.size() == expected.size()
@@ -169,6 +171,42 @@ TEST_CASE("string")
 
 }
 
+TEST_CASE("read strings in place")
+{
+    const std::string text("a string with\0a nul", 20);
+    hcl::Value v(text);
+    REQUIRE(v.stringSize() == 20);
+    REQUIRE(std::string(v.stringData(), v.stringSize()) == text);
+
+    hcl::Value copy = v;
+    hcl::Value moved = std::move(copy);
+    REQUIRE(moved == v);
+    REQUIRE(v.as<std::string>() == text);
+    REQUIRE(moved == v);
+    REQUIRE(std::string(moved.stringData(), moved.stringSize()) == text);
+
+    hcl::Value ident("x");
+    ident.setStringType(hcl::Value::Ident);
+    REQUIRE(ident.stringSize() == 1);
+    REQUIRE(!ident.isInlineString());
+    REQUIRE_THROWS(hcl::Value(1).stringData());
+}
+
+TEST_CASE("as<std::string>() keeps stringData() valid")
+{
+    hcl::Value v(std::string("hello"));
+    const char* p = v.stringData();
+    const std::string s = v.as<std::string>();
+    REQUIRE(s == "hello");
+    REQUIRE(std::string(p, 5) == "hello");
+    REQUIRE(v.stringData() == p);
+    REQUIRE(v.as<std::string>() == s);
+
+    hcl::Value copy = v;
+    REQUIRE(copy.as<std::string>() == "hello");
+    REQUIRE(std::string(p, 5) == "hello");
+}
+
 TEST_CASE("bool_array")
 {
     hcl::Value v((hcl::List()));
@@ -336,6 +374,26 @@ TEST_CASE("tableErase")
     REQUIRE_FALSE(v.has("key1.key2"));
 }
 
+TEST_CASE("tableRename")
+{
+    hcl::Value v;
+    v.set("a", 1);
+    v.set("b", 2);
+
+    REQUIRE(v.renameChild("a", "c"));
+    REQUIRE(nullptr == v.findChild("a"));
+    REQUIRE(1 == v.get<int>("c"));
+    REQUIRE(v.renameChild("c", "c"));
+
+    REQUIRE_FALSE(v.renameChild("missing", "d"));
+    REQUIRE_FALSE(v.renameChild("c", "b"));
+    REQUIRE(1 == v.get<int>("c"));
+    REQUIRE(2 == v.get<int>("b"));
+
+    hcl::Value n = 1;
+    REQUIRE_THROWS(n.renameChild("a", "b"));
+}
+
 TEST_CASE("number")
 {
     hcl::Value v(1);
@@ -350,6 +408,87 @@ TEST_CASE("number")
     REQUIRE_FALSE(v.isNumber());
 }
 
+TEST_CASE("rawNumber")
+{
+    hcl::Value i = hcl::Value::rawNumber("1_000");
+    REQUIRE(i.isRawNumber());
+    REQUIRE(i.is<int>());
+    REQUIRE(1000 == i.as<int>());
+    REQUIRE(1000 == i.as<int64_t>());
+    REQUIRE(i == hcl::Value(1000));
+
+    hcl::Value d = hcl::Value::rawNumber("1.50");
+    REQUIRE(d.is<double>());
+    REQUIRE(1.5 == d.as<double>());
+    REQUIRE(d == hcl::Value(1.5));
+
+    // Written back as given, also after conversion.
+    std::ostringstream ss;
+    d.write(&ss);
+    REQUIRE("1.50" == ss.str());
+
+    hcl::Value copy = d;
+    REQUIRE(copy.isRawNumber());
+    copy = i;
+    REQUIRE(1000 == copy.as<int>());
+    hcl::Value moved = std::move(copy);
+    REQUIRE(1000 == moved.as<int>());
+    REQUIRE_FALSE(copy.isRawNumber());
+
+    // Longer text is kept on the heap.
+    hcl::Value pi = hcl::Value::rawNumber("3.14159265358979");
+    REQUIRE(pi.as<double>() == 3.14159265358979);
+    hcl::Value piCopy = pi;
+    REQUIRE(piCopy == pi);
+    std::ostringstream ss2;
+    piCopy.write(&ss2);
+    REQUIRE("3.14159265358979" == ss2.str());
+
+    REQUIRE(hcl::Value::rawNumber("99999999999999999999").as<int64_t>() == std::numeric_limits<int64_t>::max());
+    REQUIRE_THROWS(hcl::Value::rawNumber("1x"));
+    REQUIRE_THROWS(hcl::Value::rawNumber("1").as<double>());
+}
+
+TEST_CASE("read a long raw number from several threads")
+{
+    // Reads convert the text each time and never write to the value.
+    const hcl::Value big = hcl::Value::rawNumber("1_000_000_000");
+    const hcl::Value pi = hcl::Value::rawNumber("3.14159265358979");
+    std::vector<int> ok(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ok.size(); ++t) {
+        threads.emplace_back([&, t] {
+            bool same = true;
+            for (int i = 0; i < 1000; ++i)
+                same = same && big.as<int64_t>() == 1000000000 && pi.as<double>() == 3.14159265358979;
+            ok[t] = same;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    REQUIRE(ok == std::vector<int>(4, 1));
+    REQUIRE(big.isRawNumber());
+}
+
+TEST_CASE("tryGet")
+{
+    hcl::Value v((hcl::Object()));
+    v.set("a", 1);
+    v.set("b", "x");
+
+    int i = 0;
+    REQUIRE(v.tryGet("a", i));
+    REQUIRE(1 == i);
+    REQUIRE_FALSE(v.tryGet("b", i));
+    REQUIRE_FALSE(v.tryGet("c", i));
+    REQUIRE(1 == i);
+
+    std::string s;
+    REQUIRE(v.findChild("b")->tryAs(s));
+    REQUIRE("x" == s);
+    REQUIRE_FALSE(hcl::Value(1).tryGet("a", s));
+}
+
 TEST_CASE("tableFind")
 {
     hcl::Value v;
@@ -0,0 +1,670 @@
+// hclgen: generates C++ structs, and hcl::Decoder/hcl::Encoder
+// specializations for them, from an HCL schema file.
+//
+//   hclgen <schema.hcl> <output.hpp>
+//
+// Schema file:
+//
+//   namespace = "app::config"
+//
+//   struct "Listener" {
+//     field "port" {
+//       type     = "int"
+//       required = true
+//     }
+//     field "host" {
+//       type    = "string"
+//       default = "localhost"
+//     }
+//     field "tls-cert" {
+//       type   = "string"
+//       member = "tlsCert"
+//     }
+//   }
+//
+//   struct "Config" {
+//     field "listener" {
+//       type = "map(Listener)"
+//     }
+//   }
+//
+// Types are bool, int (std::int64_t), double, string, list(T)
+// (std::vector), map(T) (std::map with std::string keys), optional(T)
+// (std::unique_ptr) and the name of a struct defined earlier in the
+// file. |member| defaults to the key with '-' replaced by '_'.
+//
+// The generated decoders switch on the key length and characters
+// instead of comparing against every field name.
+
+#include "hcl/hcl.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Labeled blocks in the order they appear in the file.
+template<typename T>
+struct Ordered {
+    std::vector<std::pair<std::string, T>> items;
+};
+
+// A default value, kept as written.
+struct Literal {
+    Literal() : present(false), type(hcl::internal::TokenType::ILLEGAL) {}
+
+    bool present;
+    hcl::internal::TokenType type;
+    std::string text;
+};
+
+struct FieldSpec {
+    FieldSpec() : required(false) {}
+
+    std::string type;
+    bool required;
+    std::string member;
+    Literal defaultValue;
+};
+
+struct StructSpec {
+    Ordered<FieldSpec> fields;
+};
+
+struct SchemaFile {
+    std::string ns;
+    Ordered<StructSpec> structs;
+};
+
+} // namespace
+
+namespace hcl {
+
+template<typename T>
+struct Decoder<Ordered<T>> {
+    static bool decode(internal::StructDecoder& dec, Ordered<T>& out)
+    {
+        return dec.decodeObject([&](const internal::KeySpan* keys, size_t count) {
+            return decodeItem(dec, out, keys, count);
+        });
+    }
+
+    static bool decodeItem(internal::StructDecoder& dec, Ordered<T>& out,
+                           const internal::KeySpan* labels, size_t count)
+    {
+        if (count == 0)
+            return decode(dec, out);
+        out.items.emplace_back(labels[0].str(), T());
+        return Decoder<T>::decodeItem(dec, out.items.back().second, labels + 1, count - 1);
+    }
+};
+
+template<>
+struct Decoder<Literal> : internal::LeafDecoder<Literal> {
+    static bool decode(internal::StructDecoder& dec, Literal& out)
+    {
+        out.present = true;
+        out.type = dec.token().type;
+        switch (out.type) {
+        case internal::TokenType::BOOL:
+        case internal::TokenType::NUMBER:
+        case internal::TokenType::FLOAT:
+            out.text = dec.tokenText();
+            return true;
+        case internal::TokenType::STRING:
+        case internal::TokenType::HEREDOC:
+            out.type = internal::TokenType::STRING;
+            return dec.decodeString(out.text);
+        default:
+            return dec.fail("default must be a bool, number or string");
+        }
+    }
+};
+
+} // namespace hcl
+
+MICROHCL_BEGIN_BINDING(FieldSpec)
+    MICROHCL_REQUIRED_FIELD(type)
+    MICROHCL_FIELD(required)
+    MICROHCL_FIELD(member)
+    MICROHCL_FIELD_AS("default", defaultValue)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(StructSpec)
+    MICROHCL_FIELD_AS("field", fields)
+MICROHCL_END_BINDING()
+
+MICROHCL_BEGIN_BINDING(SchemaFile)
+    MICROHCL_FIELD_AS("namespace", ns)
+    MICROHCL_FIELD_AS("struct", structs)
+MICROHCL_END_BINDING()
+
+namespace {
+
+struct Type {
+    enum Kind {
+        BOOL,
+        INT,
+        DOUBLE,
+        STRING,
+        LIST,
+        MAP,
+        OPTIONAL,
+        STRUCT,
+    };
+
+    Kind kind;
+    // LIST, MAP and OPTIONAL element.
+    std::shared_ptr<Type> element;
+    // STRUCT name.
+    std::string name;
+};
+
+struct Field {
+    std::string key;
+    std::string member;
+    Type type;
+    bool required;
+    // Bit in the |seen| mask. Only required fields have one.
+    int bit;
+    Literal defaultValue;
+};
+
+struct Struct {
+    std::string name;
+    std::vector<Field> fields;
+};
+
+std::string cppString(const std::string& s)
+{
+    std::string r("\"");
+    for (char c : s) {
+        switch (c) {
+        case '"': r += "\\\""; break;
+        case '\\': r += "\\\\"; break;
+        case '\n': r += "\\n"; break;
+        case '\r': r += "\\r"; break;
+        case '\t': r += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\%03o", static_cast<unsigned char>(c));
+                r += buf;
+            } else {
+                r += c;
+            }
+        }
+    }
+    return r + "\"";
+}
+
+std::string cppChar(char c)
+{
+    if (c == '\'' || c == '\\')
+        return std::string("'\\") + c + "'";
+    if (static_cast<unsigned char>(c) < 0x20 || static_cast<unsigned char>(c) >= 0x7F) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "'\\%03o'", static_cast<unsigned char>(c));
+        return buf;
+    }
+    return std::string("'") + c + "'";
+}
+
+bool isIdentifier(const std::string& s)
+{
+    if (s.empty() || isdigit(static_cast<unsigned char>(s[0])))
+        return false;
+    for (char c : s) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_')
+            return false;
+    }
+    return true;
+}
+
+class Generator {
+public:
+    explicit Generator(const SchemaFile& schema) : schema_(schema) {}
+
+    bool generate(const std::string& source, const std::string& guard, std::string& out);
+    const std::string& error() const { return error_; }
+
+private:
+    bool fail(const std::string& reason)
+    {
+        error_ = reason;
+        return false;
+    }
+
+    bool parseType(const std::string& s, Type& type);
+    bool checkDefault(const Field& field);
+    std::string cppType(const Type& type) const;
+    std::string qualified(const std::string& name) const;
+    std::string defaultInitializer(const Field& field) const;
+
+    void writeStruct(std::ostream& os, const Struct& s) const;
+    void writeDecoder(std::ostream& os, const Struct& s) const;
+    void writeEncoder(std::ostream& os, const Struct& s) const;
+    void writeKeySwitch(std::ostream& os, const Struct& s) const;
+
+    const SchemaFile& schema_;
+    std::vector<std::string> namespaces_;
+    std::vector<Struct> structs_;
+    std::set<std::string> defined_;
+    std::string error_;
+};
+
+bool Generator::parseType(const std::string& s, Type& type)
+{
+    static const struct {
+        const char* prefix;
+        Type::Kind kind;
+    } wrappers[] = {
+        {"list(", Type::LIST},
+        {"map(", Type::MAP},
+        {"optional(", Type::OPTIONAL},
+    };
+
+    for (const auto& w : wrappers) {
+        const std::string prefix(w.prefix);
+        if (s.compare(0, prefix.size(), prefix) == 0 && s.size() > prefix.size() && s.back() == ')') {
+            type.kind = w.kind;
+            type.element = std::make_shared<Type>();
+            return parseType(s.substr(prefix.size(), s.size() - prefix.size() - 1), *type.element);
+        }
+    }
+
+    if (s == "bool") {
+        type.kind = Type::BOOL;
+    } else if (s == "int") {
+        type.kind = Type::INT;
+    } else if (s == "double") {
+        type.kind = Type::DOUBLE;
+    } else if (s == "string") {
+        type.kind = Type::STRING;
+    } else if (defined_.count(s)) {
+        type.kind = Type::STRUCT;
+        type.name = s;
+    } else {
+        return fail("unknown type \"" + s + "\"; structs must be defined before they are used");
+    }
+    return true;
+}
+
+bool Generator::checkDefault(const Field& field)
+{
+    if (!field.defaultValue.present)
+        return true;
+
+    using hcl::internal::TokenType;
+    const TokenType t = field.defaultValue.type;
+    bool ok;
+    switch (field.type.kind) {
+    case Type::BOOL: ok = t == TokenType::BOOL; break;
+    case Type::INT: ok = t == TokenType::NUMBER; break;
+    case Type::DOUBLE: ok = t == TokenType::FLOAT; break;
+    case Type::STRING: ok = t == TokenType::STRING; break;
+    default: ok = false; break;
+    }
+    if (!ok)
+        return fail("default of \"" + field.key + "\" does not match its type");
+    return true;
+}
+
+std::string Generator::cppType(const Type& type) const
+{
+    switch (type.kind) {
+    case Type::BOOL: return "bool";
+    case Type::INT: return "std::int64_t";
+    case Type::DOUBLE: return "double";
+    case Type::STRING: return "std::string";
+    case Type::LIST: return "std::vector<" + cppType(*type.element) + ">";
+    case Type::MAP: return "std::map<std::string, " + cppType(*type.element) + ">";
+    case Type::OPTIONAL: return "std::unique_ptr<" + cppType(*type.element) + ">";
+    case Type::STRUCT: return type.name;
+    }
+    return std::string();
+}
+
+std::string Generator::qualified(const std::string& name) const
+{
+    std::string r;
+    for (const auto& ns : namespaces_)
+        r += ns + "::";
+    return r + name;
+}
+
+std::string Generator::defaultInitializer(const Field& field) const
+{
+    const Literal& d = field.defaultValue;
+    switch (field.type.kind) {
+    case Type::BOOL:
+        return d.present ? d.text : "false";
+    case Type::INT: {
+        if (!d.present)
+            return "0";
+        std::int64_t x = 0;
+        hcl::internal::parseInteger(d.text.data(), d.text.size(), &x);
+        std::ostringstream ss;
+        if (x == std::numeric_limits<std::int64_t>::min())
+            ss << "std::numeric_limits<std::int64_t>::min()";
+        else
+            ss << x << "LL";
+        return ss.str();
+    }
+    case Type::DOUBLE: {
+        if (!d.present)
+            return "0.0";
+        std::string r;
+        for (char c : d.text) {
+            if (c != '_')
+                r += c;
+        }
+        return r;
+    }
+    case Type::STRING:
+        return d.present ? cppString(d.text) : std::string();
+    default:
+        return std::string();
+    }
+}
+
+bool Generator::generate(const std::string& source, const std::string& guard, std::string& out)
+{
+    std::string ns = schema_.ns;
+    size_t pos;
+    while ((pos = ns.find("::")) != std::string::npos) {
+        namespaces_.push_back(ns.substr(0, pos));
+        ns.erase(0, pos + 2);
+    }
+    if (!ns.empty())
+        namespaces_.push_back(ns);
+    for (const auto& n : namespaces_) {
+        if (!isIdentifier(n))
+            return fail("invalid namespace \"" + schema_.ns + "\"");
+    }
+
+    for (const auto& item : schema_.structs.items) {
+        if (!isIdentifier(item.first))
+            return fail("invalid struct name \"" + item.first + "\"");
+        if (defined_.count(item.first))
+            return fail("struct \"" + item.first + "\" is defined twice");
+
+        Struct s;
+        s.name = item.first;
+        std::set<std::string> keys;
+        std::set<std::string> members;
+        int bits = 0;
+        for (const auto& f : item.second.fields.items) {
+            Field field;
+            field.key = f.first;
+            field.member = f.second.member;
+            if (field.member.empty()) {
+                field.member = f.first;
+                std::replace(field.member.begin(), field.member.end(), '-', '_');
+            }
+            if (!isIdentifier(field.member))
+                return fail("field \"" + f.first + "\" of \"" + s.name + "\" needs a member name");
+            if (!keys.insert(field.key).second || !members.insert(field.member).second)
+                return fail("field \"" + f.first + "\" of \"" + s.name + "\" is defined twice");
+            if (!parseType(f.second.type, field.type))
+                return false;
+            field.required = f.second.required;
+            field.bit = field.required ? bits++ : -1;
+            if (bits > 64)
+                return fail("struct \"" + s.name + "\" has more than 64 required fields");
+            field.defaultValue = f.second.defaultValue;
+            if (!checkDefault(field))
+                return false;
+            s.fields.push_back(field);
+        }
+
+        defined_.insert(s.name);
+        structs_.push_back(s);
+    }
+
+    std::ostringstream os;
+    os << "// Generated by hclgen from " << source << ". Do not edit.\n"
+       << "\n"
+       << "#ifndef " << guard << "\n"
+       << "#define " << guard << "\n"
+       << "\n"
+       << "#include \"hcl/hcl.hpp\"\n"
+       << "\n"
+       << "#include <cstdint>\n"
+       << "#include <cstring>\n"
+       << "#include <limits>\n"
+       << "#include <map>\n"
+       << "#include <memory>\n"
+       << "#include <string>\n"
+       << "#include <vector>\n"
+       << "\n";
+
+    for (const auto& n : namespaces_)
+        os << "namespace " << n << " {\n";
+    if (!namespaces_.empty())
+        os << "\n";
+    for (const auto& s : structs_)
+        writeStruct(os, s);
+    for (auto n = namespaces_.rbegin(); n != namespaces_.rend(); ++n)
+        os << "} // namespace " << *n << "\n";
+    if (!namespaces_.empty())
+        os << "\n";
+
+    os << "namespace hcl {\n\n";
+    for (const auto& s : structs_) {
+        writeDecoder(os, s);
+        writeEncoder(os, s);
+    }
+    os << "} // namespace hcl\n"
+       << "\n"
+       << "#endif // " << guard << "\n";
+
+    out = os.str();
+    return true;
+}
+
+void Generator::writeStruct(std::ostream& os, const Struct& s) const
+{
+    os << "struct " << s.name << " {\n";
+
+    std::vector<std::string> initializers;
+    for (const auto& f : s.fields) {
+        std::string init = defaultInitializer(f);
+        if (!init.empty())
+            initializers.push_back(f.member + "(" + init + ")");
+    }
+    if (!initializers.empty()) {
+        os << "    " << s.name << "() :\n";
+        for (size_t i = 0; i < initializers.size(); ++i)
+            os << "        " << initializers[i] << (i + 1 < initializers.size() ? ",\n" : " {}\n");
+        os << "\n";
+    }
+
+    for (const auto& f : s.fields)
+        os << "    " << cppType(f.type) << " " << f.member << ";\n";
+    os << "};\n\n";
+}
+
+// Switches on the key length, then on the character that tells the most
+// keys of that length apart, before comparing whole keys.
+void Generator::writeKeySwitch(std::ostream& os, const Struct& s) const
+{
+    std::map<size_t, std::vector<const Field*>> byLength;
+    for (const auto& f : s.fields)
+        byLength[f.key.size()].push_back(&f);
+
+    auto writeMatch = [&](const Field& f, const char* indent) {
+        os << indent << "if (std::memcmp(key.data, " << cppString(f.key) << ", " << f.key.size() << ") == 0) {\n";
+        if (f.bit >= 0)
+            os << indent << "    seen |= std::uint64_t(1) << " << f.bit << ";\n";
+        os << indent << "    return internal::decodeMember(dec, out." << f.member << ", keys, count, "
+           << cppString(f.key) << ");\n"
+           << indent << "}\n";
+    };
+
+    os << "        const internal::KeySpan& key = keys[0];\n"
+       << "        switch (key.size) {\n";
+    for (const auto& group : byLength) {
+        const std::vector<const Field*>& fields = group.second;
+        os << "        case " << group.first << ":\n";
+
+        size_t column = 0;
+        size_t best = 0;
+        for (size_t i = 0; i < group.first; ++i) {
+            std::set<char> chars;
+            for (const Field* f : fields)
+                chars.insert(f->key[i]);
+            if (chars.size() > best) {
+                best = chars.size();
+                column = i;
+            }
+        }
+
+        if (fields.size() == 1 || best <= 1) {
+            for (const Field* f : fields)
+                writeMatch(*f, "            ");
+        } else {
+            std::map<char, std::vector<const Field*>> byChar;
+            for (const Field* f : fields)
+                byChar[f->key[column]].push_back(f);
+            os << "            switch (key.data[" << column << "]) {\n";
+            for (const auto& c : byChar) {
+                os << "            case " << cppChar(c.first) << ":\n";
+                for (const Field* f : c.second)
+                    writeMatch(*f, "                ");
+                os << "                break;\n";
+            }
+            os << "            }\n";
+        }
+        os << "            break;\n";
+    }
+    os << "        }\n";
+}
+
+void Generator::writeDecoder(std::ostream& os, const Struct& s) const
+{
+    const std::string type = qualified(s.name);
+
+    os << "template<>\n"
+       << "struct Decoder<" << type << "> : internal::RecordDecoder<" << type << ", Decoder<" << type << ">> {\n"
+       << "    static bool decodeField(internal::StructDecoder& dec, " << type << "& out,\n"
+       << "                            const internal::KeySpan* keys, size_t count, std::uint64_t& seen)\n"
+       << "    {\n";
+    if (s.fields.empty()) {
+        os << "        (void)out;\n"
+           << "        (void)keys;\n"
+           << "        (void)count;\n";
+    } else {
+        writeKeySwitch(os, s);
+    }
+    const bool hasRequired = std::any_of(s.fields.begin(), s.fields.end(),
+                                         [](const Field& f) { return f.bit >= 0; });
+    if (!hasRequired)
+        os << "        (void)seen;\n";
+    os << "        return dec.skipValue();\n"
+       << "    }\n"
+       << "\n"
+       << "    static bool checkRequired(internal::StructDecoder& dec, std::uint64_t seen)\n"
+       << "    {\n";
+    for (const auto& f : s.fields) {
+        if (f.bit < 0)
+            continue;
+        os << "        if (!(seen & (std::uint64_t(1) << " << f.bit << ")))\n"
+           << "            return dec.fail(" << cppString("missing required field \"" + f.key + "\"") << ");\n";
+    }
+    if (!hasRequired)
+        os << "        (void)dec;\n"
+           << "        (void)seen;\n";
+    os << "        return true;\n"
+       << "    }\n"
+       << "};\n\n";
+}
+
+void Generator::writeEncoder(std::ostream& os, const Struct& s) const
+{
+    const std::string type = qualified(s.name);
+
+    os << "template<>\n"
+       << "struct Encoder<" << type << "> {\n"
+       << "    static Value encode(const " << type << "& in)\n"
+       << "    {\n"
+       << "        Value v((Object()));\n";
+    for (const auto& f : s.fields)
+        os << "        internal::encodeMember(v, " << cppString(f.key) << ", in." << f.member << ");\n";
+    if (s.fields.empty())
+        os << "        (void)in;\n";
+    os << "        return v;\n"
+       << "    }\n"
+       << "};\n\n";
+}
+
+std::string baseName(const std::string& path)
+{
+    size_t pos = path.find_last_of("/\\");
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+std::string includeGuard(const std::string& path)
+{
+    std::string guard("MICROHCL_GENERATED_");
+    for (char c : baseName(path))
+        guard += isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(toupper(static_cast<unsigned char>(c))) : '_';
+    return guard + "_";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "usage: hclgen <schema.hcl> <output.hpp>" << std::endl;
+        return 2;
+    }
+
+    const std::string input(argv[1]);
+    const std::string output(argv[2]);
+
+    SchemaFile schema;
+    hcl::DecodeResult result = hcl::decodeFile(input, schema);
+    if (!result.valid()) {
+        std::cerr << input << ":\n" << result.errorReason;
+        return 1;
+    }
+
+    Generator generator(schema);
+    std::string header;
+    if (!generator.generate(baseName(input), includeGuard(output), header)) {
+        std::cerr << input << ": " << generator.error() << std::endl;
+        return 1;
+    }
+
+    // Leave the file alone when nothing changed, so dependents aren't rebuilt.
+    {
+        std::ifstream ifs(output, std::ios::binary);
+        if (ifs) {
+            std::string current((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            if (current == header)
+                return 0;
+        }
+    }
+
+    std::ofstream ofs(output, std::ios::binary);
+    ofs << header;
+    if (!ofs) {
+        std::cerr << "could not write " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}